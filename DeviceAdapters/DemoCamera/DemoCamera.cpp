@@ -27,11 +27,13 @@
 #include <string>
 #include <math.h>
 #include "ModuleInterface.h"
+#include "BandWorkers.h"
 #include <sstream>
 #include <algorithm>
 #include "WriteCompactTiffRGB.h"
 #include <iostream>
 #include <future>
+#include <thread>
 
 const double CDemoCamera::nominalPixelSizeUm_ = 1.0;
 double g_IntensityFactor_ = 1.0;
@@ -64,8 +66,9 @@ const char* g_PixelType_32bit = "32bit";  // floating point greyscale
 const char* g_Sine_Wave = "Artificial Waves";
 const char* g_Norm_Noise = "Noise";
 const char* g_Color_Test = "Color Test Pattern";
+const char* g_Fast_Waves_Noise = "Fast Waves + Noise";
 
-enum { MODE_ARTIFICIAL_WAVES, MODE_NOISE, MODE_COLOR_TEST };
+enum { MODE_ARTIFICIAL_WAVES, MODE_NOISE, MODE_COLOR_TEST, MODE_FAST_WAVES_NOISE };
 
 ///////////////////////////////////////////////////////////////////////////////
 // Exported MMDevice API
@@ -244,7 +247,10 @@ CDemoCamera::CDemoCamera() :
    imgManpl_(0),
    pcf_(1.0),
    photonFlux_(50.0),
-   readNoise_(2.5)
+   readNoise_(2.5),
+   fastTableWidth_(0),
+   fastTableStripeWidth_(0.0),
+   fastFrameCounter_(0)
 {
    memset(testProperty_,0,sizeof(testProperty_));
 
@@ -510,6 +516,7 @@ int CDemoCamera::Initialize()
    AddAllowedValue(propName.c_str(), g_Sine_Wave);
    AddAllowedValue(propName.c_str(), g_Norm_Noise);
    AddAllowedValue(propName.c_str(), g_Color_Test);
+   AddAllowedValue(propName.c_str(), g_Fast_Waves_Noise);
 
    // Photon Conversion Factor for Noise type camera
    pAct = new CPropertyAction(this, &CDemoCamera::OnPCF);
@@ -1091,17 +1098,26 @@ int CDemoCamera::InsertImage()
    this->GetLabel(label);
  
    // Important:  metadata about the image are generated here:
-   Metadata md;
-   md.put(MM::g_Keyword_Metadata_CameraLabel, label);
-   md.put(MM::g_Keyword_Elapsed_Time_ms, CDeviceUtils::ConvertToString((timeStamp - sequenceStartTime_).getMsec()));
-   md.put(MM::g_Keyword_Metadata_ROI_X, CDeviceUtils::ConvertToString( (long) roiX_)); 
-   md.put(MM::g_Keyword_Metadata_ROI_Y, CDeviceUtils::ConvertToString( (long) roiY_)); 
+   char elapsed[MM::MaxStrLength];
+   CDeviceUtils::CopyLimitedString(elapsed, CDeviceUtils::ConvertToString((timeStamp - sequenceStartTime_).getMsec()));
+   char roiX[MM::MaxStrLength];
+   CDeviceUtils::CopyLimitedString(roiX, CDeviceUtils::ConvertToString((long) roiX_));
+   char roiY[MM::MaxStrLength];
+   CDeviceUtils::CopyLimitedString(roiY, CDeviceUtils::ConvertToString((long) roiY_));
 
    imageCounter_++;
 
    char buf[MM::MaxStrLength];
    GetProperty(MM::g_Keyword_Binning, buf);
-   md.put(MM::g_Keyword_Binning, buf);
+
+   const MM::ImageMetadataTag md[] = {
+      { MM::g_Keyword_Metadata_CameraLabel, 0, label },
+      { MM::g_Keyword_Elapsed_Time_ms, 0, elapsed },
+      { MM::g_Keyword_Metadata_ROI_X, 0, roiX },
+      { MM::g_Keyword_Metadata_ROI_Y, 0, roiY },
+      { MM::g_Keyword_Binning, 0, buf },
+   };
+   const unsigned numTags = sizeof(md) / sizeof(md[0]);
 
    MMThreadGuard g(imgPixelsLock_);
 
@@ -1112,13 +1128,13 @@ int CDemoCamera::InsertImage()
    unsigned int h = GetImageHeight();
    unsigned int b = GetImageBytesPerPixel();
 
-   int ret = GetCoreCallback()->InsertImage(this, pI, w, h, b, nComponents_, md.Serialize().c_str());
+   int ret = GetCoreCallback()->InsertImage(this, pI, w, h, b, nComponents_, md, numTags);
    if (!stopOnOverflow_ && ret == DEVICE_BUFFER_OVERFLOW)
    {
       // do not stop on overflow - just reset the buffer
       GetCoreCallback()->ClearImageBuffer(this);
       // don't process this same image again...
-      return GetCoreCallback()->InsertImage(this, pI, w, h, b, nComponents_, md.Serialize().c_str(), false);
+      return GetCoreCallback()->InsertImage(this, pI, w, h, b, nComponents_, md, numTags, false);
    }
    else
    {
@@ -1898,6 +1914,9 @@ int CDemoCamera::OnMode(MM::PropertyBase* pProp, MM::ActionType eAct)
          case MODE_COLOR_TEST:
             val = g_Color_Test;
             break;
+         case MODE_FAST_WAVES_NOISE:
+            val = g_Fast_Waves_Noise;
+            break;
          default:
             val = g_Sine_Wave;
             break;
@@ -1915,6 +1934,10 @@ int CDemoCamera::OnMode(MM::PropertyBase* pProp, MM::ActionType eAct)
       {
          mode_ = MODE_COLOR_TEST;
       }
+      else if (val == g_Fast_Waves_Noise)
+      {
+         mode_ = MODE_FAST_WAVES_NOISE;
+      }
       else
       {
          mode_ = MODE_ARTIFICIAL_WAVES;
@@ -2083,11 +2106,13 @@ void CDemoCamera::GenerateSyntheticImage(ImgBuffer& img, double exp)
       if (GenerateColorTestPattern(img))
          return;
    }
+   else if (mode_ == MODE_FAST_WAVES_NOISE)
+   {
+      if (GenerateFastSyntheticImage(img, exp))
+         return;
+   }
 
-	//std::string pixelType;
-	char buf[MM::MaxStrLength];
-   GetProperty(MM::g_Keyword_PixelType, buf);
-   std::string pixelType(buf);
+   std::string pixelType(GetPixelTypeName(img));
 
 	if (img.Height() == 0 || img.Width() == 0 || img.Depth() == 0)
       return;
@@ -2530,6 +2555,182 @@ bool CDemoCamera::GenerateColorTestPattern(ImgBuffer& img)
 }
 
 
+namespace {
+
+// The "lowbias32" integer hash. Hashing a counter gives a random number
+// generator whose output for any pixel can be computed independently of
+// the others, so rows can be filled in any order and on any thread.
+inline uint32_t HashCounter(uint32_t x)
+{
+   x ^= x >> 16;
+   x *= 0x7feb352dU;
+   x ^= x >> 15;
+   x *= 0x846ca68bU;
+   x ^= x >> 16;
+   return x;
+}
+
+template <typename PixelType>
+inline void StoreWavesAndNoise(PixelType* pixels, unsigned count,
+      const float* sinTable, const float* cosTable, const float* noise,
+      float pedestal, float sinLine, float cosLine, float maxValue)
+{
+   for (unsigned i = 0; i < count; ++i)
+   {
+      float value = pedestal + sinLine * cosTable[i] + cosLine * sinTable[i] +
+         noise[i];
+      value = value < 0.0f ? 0.0f : (value > maxValue ? maxValue : value);
+      pixels[i] = static_cast<PixelType>(value);
+   }
+}
+
+template <typename PixelType>
+void FillWavesAndNoiseRows(PixelType* pixels, unsigned width,
+      unsigned rowBegin, unsigned rowEnd, const float* sinTable,
+      const float* cosTable, double phase, double linePhaseInc,
+      float pedestal, float amplitude, float noiseStdDev, float maxValue,
+      uint32_t seed)
+{
+   // The sum of the four bytes of a random value is close to normally
+   // distributed, with mean 2 * 255 and standard deviation 256 / sqrt(3)
+   const float noiseMean = 2.0f * 255.0f;
+   const float noiseScale = noiseStdDev * 1.7320508f / 256.0f;
+   // Noise is generated into a fixed-size block, so that both inner loops
+   // have simple bounds and no aliasing, and vectorize
+   const unsigned blockSize = 64;
+   float noise[blockSize];
+   for (unsigned j = rowBegin; j < rowEnd; ++j)
+   {
+      // sin(a + b) = sin(a) cos(b) + cos(a) sin(b), with b from the tables
+      const double linePhase = phase + linePhaseInc * j;
+      const float sinLine = amplitude * static_cast<float>(sin(linePhase));
+      const float cosLine = amplitude * static_cast<float>(cos(linePhase));
+      const uint32_t rowCounter = j * width;
+      PixelType* row = pixels + static_cast<size_t>(j) * width;
+      for (unsigned k0 = 0; k0 < width; k0 += blockSize)
+      {
+         for (unsigned i = 0; i < blockSize; ++i)
+         {
+            const uint32_t r = HashCounter((rowCounter + k0 + i) ^ seed);
+            const float sum = static_cast<float>((r & 0xff) +
+                  ((r >> 8) & 0xff) + ((r >> 16) & 0xff) + (r >> 24));
+            noise[i] = (sum - noiseMean) * noiseScale;
+         }
+         // A constant count lets the compiler vectorize without a remainder
+         // loop; only the last block of a row can be partial
+         if (width - k0 >= blockSize)
+            StoreWavesAndNoise(row + k0, blockSize, sinTable + k0,
+                  cosTable + k0, noise, pedestal, sinLine, cosLine, maxValue);
+         else
+            StoreWavesAndNoise(row + k0, width - k0, sinTable + k0,
+                  cosTable + k0, noise, pedestal, sinLine, cosLine, maxValue);
+      }
+   }
+}
+
+template <typename PixelType>
+void FillWavesAndNoise(PixelType* pixels, unsigned width, unsigned height,
+      const float* sinTable, const float* cosTable, double phase,
+      double linePhaseInc, float pedestal, float amplitude,
+      float noiseStdDev, float maxValue, uint32_t seed)
+{
+   // Below this, starting a thread costs more than it saves
+   const unsigned minRowsPerThread = 32;
+   MM::ForEachRowBand(height,
+         (std::max)(1u, std::thread::hardware_concurrency()), minRowsPerThread,
+         [=](unsigned rowBegin, unsigned rowEnd)
+         {
+            FillWavesAndNoiseRows(pixels, width, rowBegin, rowEnd, sinTable,
+                  cosTable, phase, linePhaseInc, pedestal, amplitude,
+                  noiseStdDev, maxValue, seed);
+         });
+}
+
+} // anonymous namespace
+
+/**
+* Generates the same moving waves as the default mode, plus Gaussian read
+* noise, fast enough to use DemoCamera as a load generator at high frame
+* rates. Only 8bit and 16bit pixel types are supported, and the drop and
+* saturate pixel options and multiple ROIs are ignored. Returns false (and
+* leaves the image unchanged) for other pixel types.
+*/
+bool CDemoCamera::GenerateFastSyntheticImage(ImgBuffer& img, double exp)
+{
+   const unsigned width = img.Width();
+   const unsigned height = img.Height();
+   if (width == 0 || height == 0 || (img.Depth() != 1 && img.Depth() != 2))
+      return false;
+
+   const double lSinePeriod = 3.14159265358979 * stripeWidth_;
+   if (fastTableWidth_ != width || fastTableStripeWidth_ != stripeWidth_)
+   {
+      const double lPeriod = static_cast<long>(width / 2);
+      fastSinTable_.resize(width);
+      fastCosTable_.resize(width);
+      for (unsigned k = 0; k < width; ++k)
+      {
+         const double columnPhase = (2.0 * lSinePeriod * k) / lPeriod;
+         fastSinTable_[k] = static_cast<float>(sin(columnPhase));
+         fastCosTable_[k] = static_cast<float>(cos(columnPhase));
+      }
+      fastTableWidth_ = width;
+      fastTableStripeWidth_ = stripeWidth_;
+   }
+
+   double linePhaseInc = 2.0 * lSinePeriod / 4.0 / height;
+   if (shouldRotateImages_)
+      linePhaseInc *= (((int) dPhase_ / 6) % 24) - 12;
+
+   const long maxValue = (1L << bitDepth_) - 1;
+   const double binFactor = GetBinning() * GetBinning();
+   const uint32_t seed = HashCounter(++fastFrameCounter_);
+   const float noiseStdDev = static_cast<float>(readNoise_ / pcf_);
+   if (img.Depth() == 1)
+   {
+      FillWavesAndNoise(img.GetPixelsRW(), width, height,
+            &fastSinTable_[0], &fastCosTable_[0], dPhase_, linePhaseInc,
+            static_cast<float>(g_IntensityFactor_ * 127 * exp / 100.0 * binFactor),
+            static_cast<float>(g_IntensityFactor_ * exp),
+            noiseStdDev, static_cast<float>(maxValue), seed);
+   }
+   else
+   {
+      FillWavesAndNoise(reinterpret_cast<unsigned short*>(img.GetPixelsRW()),
+            width, height, &fastSinTable_[0], &fastCosTable_[0], dPhase_,
+            linePhaseInc,
+            static_cast<float>(g_IntensityFactor_ * (maxValue / 2) * exp / 100.0 * binFactor),
+            static_cast<float>(g_IntensityFactor_ * exp * maxValue / 255.0),
+            noiseStdDev, static_cast<float>(maxValue), seed);
+   }
+
+   if (imgManpl_ != 0)
+      imgManpl_->ChangePixels(img);
+   dPhase_ += lSinePeriod / 4.;
+   return true;
+}
+
+/**
+* Returns the PixelType property value corresponding to the image format,
+* without the cost of reading the property.
+*/
+const char* CDemoCamera::GetPixelTypeName(const ImgBuffer& img) const
+{
+   switch (img.Depth())
+   {
+      case 1:
+         return g_PixelType_8bit;
+      case 2:
+         return g_PixelType_16bit;
+      case 4:
+         return nComponents_ == 4 ? g_PixelType_32bitRGB : g_PixelType_32bit;
+      case 8:
+         return g_PixelType_64bitRGB;
+   }
+   return g_PixelType_8bit;
+}
+
+
 void CDemoCamera::TestResourceLocking(const bool recurse)
 {
    if(recurse)
@@ -2541,9 +2742,7 @@ void CDemoCamera::TestResourceLocking(const bool recurse)
 */
 void CDemoCamera::AddBackgroundAndNoise(ImgBuffer& img, double mean, double stdDev)
 { 
-	char buf[MM::MaxStrLength];
-   GetProperty(MM::g_Keyword_PixelType, buf);
-	std::string pixelType(buf);
+   std::string pixelType(GetPixelTypeName(img));
 
    int maxValue = 1 << GetBitDepth();
    long nrPixels = img.Width() * img.Height();
@@ -2593,9 +2792,7 @@ void CDemoCamera::AddBackgroundAndNoise(ImgBuffer& img, double mean, double stdD
 */
 void CDemoCamera::AddSignal(ImgBuffer& img, double photonFlux, double exp, double cf)
 { 
-	char buf[MM::MaxStrLength];
-   GetProperty(MM::g_Keyword_PixelType, buf);
-	std::string pixelType(buf);
+   std::string pixelType(GetPixelTypeName(img));
 
    int maxValue = (1 << GetBitDepth()) -1;
    long nrPixels = img.Width() * img.Height();
@@ -3361,6 +3558,65 @@ int CDemoObjectiveTurret::OnTrigger(MM::PropertyBase* pProp, MM::ActionType eAct
    return DEVICE_OK;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// DemoMoveNotifier implementation
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+DemoMoveNotifier::DemoMoveNotifier(std::function<MM::MMTime()> clock,
+      std::function<void()> onIdle) :
+   clock_(clock),
+   onIdle_(onIdle),
+   pending_(false),
+   stop_(false)
+{
+   thread_ = std::thread([this] { Run(); });
+}
+
+DemoMoveNotifier::~DemoMoveNotifier()
+{
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+   }
+   cond_.notify_one();
+   thread_.join();
+}
+
+void DemoMoveNotifier::MoveUntil(MM::MMTime end)
+{
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      end_ = end;
+      pending_ = true;
+   }
+   cond_.notify_one();
+}
+
+void DemoMoveNotifier::Run()
+{
+   std::unique_lock<std::mutex> lock(mutex_);
+   while (!stop_)
+   {
+      if (!pending_)
+      {
+         cond_.wait(lock);
+         continue;
+      }
+      const MM::MMTime remaining = end_ - clock_();
+      if (remaining >= MM::MMTime())
+      {
+         // Wake up just after the end time; a new move may replace end_
+         cond_.wait_for(lock, std::chrono::microseconds(
+                  static_cast<long long>(remaining.getUsec()) + 1));
+         continue;
+      }
+      pending_ = false;
+      lock.unlock();
+      onIdle_();
+      lock.lock();
+   }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // CDemoStage implementation
 // ~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -3368,17 +3624,23 @@ int CDemoObjectiveTurret::OnTrigger(MM::PropertyBase* pProp, MM::ActionType eAct
 CDemoStage::CDemoStage() : 
    stepSize_um_(0.025),
    pos_um_(0.0),
-   busy_(false),
    initialized_(false),
    lowerLimit_(-300.0),
    upperLimit_(300.0),
-   sequenceable_(false)
+   sequenceable_(false),
+   settlingTimeMs_(0.0)
 {
    InitializeDefaultErrorMessages();
    SetErrorText(ERR_UNKNOWN_POSITION, "Position out of range");
 
    // parent ID display
    CreateHubIDProperty();
+
+   // Whether to tell the Core when a move has finished (so that it does not
+   // need to poll Busy())
+   CreateStringProperty("BusyNotification", "Yes", false, 0, true);
+   AddAllowedValue("BusyNotification", "No");
+   AddAllowedValue("BusyNotification", "Yes");
 }
 
 CDemoStage::~CDemoStage()
@@ -3435,6 +3697,23 @@ int CDemoStage::Initialize()
    if (ret != DEVICE_OK)
       return ret;
 
+   // Simulated settling time (the stage is busy for this long after a move)
+   // --------
+   pAct = new CPropertyAction (this, &CDemoStage::OnSettlingTime);
+   ret = CreateFloatProperty("SettlingTimeMs", settlingTimeMs_, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   SetPropertyLimits("SettlingTimeMs", 0.0, 10000.0);
+
+   char notify[MM::MaxStrLength];
+   GetProperty("BusyNotification", notify);
+   if (strcmp(notify, "Yes") == 0)
+   {
+      moveNotifier_.reset(new DemoMoveNotifier(
+               [this] { return GetCurrentMMTime(); },
+               [this] { OnBusyChanged(false); }));
+   }
+
    ret = UpdateStatus();
    if (ret != DEVICE_OK)
       return ret;
@@ -3448,11 +3727,29 @@ int CDemoStage::Shutdown()
 {
    if (initialized_)
    {
+      moveNotifier_.reset();
       initialized_ = false;
    }
    return DEVICE_OK;
 }
 
+bool CDemoStage::Busy()
+{
+   return settlingTimeMs_ > 0.0 && !(GetCurrentMMTime() > settlingEndTime_);
+}
+
+void CDemoStage::StartSettling()
+{
+   if (settlingTimeMs_ <= 0.0)
+      return;
+   settlingEndTime_ = GetCurrentMMTime() + MM::MMTime::fromMs(settlingTimeMs_);
+   if (moveNotifier_)
+   {
+      moveNotifier_->MoveUntil(settlingEndTime_);
+      OnBusyChanged(true);
+   }
+}
+
 int CDemoStage::SetPositionUm(double pos) 
 {
    if (pos > upperLimit_ || lowerLimit_ > pos)
@@ -3461,6 +3758,7 @@ int CDemoStage::SetPositionUm(double pos)
    }
    pos_um_ = pos; 
    SetIntensityFactor(pos);
+   StartSettling();
    return OnStagePositionChanged(pos_um_);
 }
 
@@ -3558,6 +3856,7 @@ int CDemoStage::OnPosition(MM::PropertyBase* pProp, MM::ActionType eAct)
       }
       pos_um_ = pos;
       SetIntensityFactor(pos);
+      StartSettling();
    }
 
    return DEVICE_OK;
@@ -3583,6 +3882,19 @@ int CDemoStage::OnSequence(MM::PropertyBase* pProp, MM::ActionType eAct)
    }
    return DEVICE_OK;
 }
+
+int CDemoStage::OnSettlingTime(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(settlingTimeMs_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(settlingTimeMs_);
+   }
+   return DEVICE_OK;
+}
 ///////////////////////////////////////////////////////////////////////////////
 // CDemoXYStage implementation
 // ~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -3603,6 +3915,12 @@ upperLimit_(20000.0)
 
    // parent ID display
    CreateHubIDProperty();
+
+   // Whether to tell the Core when a move has finished (so that it does not
+   // need to poll Busy())
+   CreateStringProperty("BusyNotification", "Yes", false, 0, true);
+   AddAllowedValue("BusyNotification", "No");
+   AddAllowedValue("BusyNotification", "Yes");
 }
 
 CDemoXYStage::~CDemoXYStage()
@@ -3648,6 +3966,15 @@ int CDemoXYStage::Initialize()
    if (ret != DEVICE_OK)
       return ret;
 
+   char notify[MM::MaxStrLength];
+   GetProperty("BusyNotification", notify);
+   if (strcmp(notify, "Yes") == 0)
+   {
+      moveNotifier_.reset(new DemoMoveNotifier(
+               [this] { return GetCurrentMMTime(); },
+               [this] { OnBusyChanged(false); }));
+   }
+
    ret = UpdateStatus();
    if (ret != DEVICE_OK)
       return ret;
@@ -3661,6 +3988,7 @@ int CDemoXYStage::Shutdown()
 {
    if (initialized_)
    {
+      moveNotifier_.reset();
       initialized_ = false;
    }
    return DEVICE_OK;
@@ -3715,6 +4043,11 @@ int CDemoXYStage::SetPositionSteps(long x, long y)
 
    moveStartTime_ = currentTime;
    timeOutTimer_ = new MM::TimeoutMs(currentTime, moveDuration_ms_);
+   if (moveNotifier_)
+   {
+      moveNotifier_->MoveUntil(currentTime + MM::MMTime::fromMs(moveDuration_ms_));
+      OnBusyChanged(true);
+   }
 
    // Optionally, notify listeners of the starting position (as an acknowledgement)
    int ret = OnXYStagePositionChanged(startPosX_um_, startPosY_um_);
@@ -4935,6 +5268,7 @@ int ImageFlipX::Initialize()
 {
     CPropertyAction* pAct = new CPropertyAction (this, &ImageFlipX::OnPerformanceTiming);
     (void)CreateFloatProperty("PeformanceTiming (microseconds)", 0, true, pAct);
+    (void)CreateStringProperty(MM::g_Keyword_TileSafe, "Yes", true);
    return DEVICE_OK;
 }
 
@@ -4945,6 +5279,7 @@ int ImageFlipX::OnPerformanceTiming(MM::PropertyBase* pProp, MM::ActionType eAct
 
    if (eAct == MM::BeforeGet)
    {
+      MMThreadGuard g(timingLock_);
       pProp->Set( performanceTiming_.getUsec());
    }
    else if (eAct == MM::AfterSet)
@@ -4958,13 +5293,9 @@ int ImageFlipX::OnPerformanceTiming(MM::PropertyBase* pProp, MM::ActionType eAct
 
 int ImageFlipX::Process(unsigned char *pBuffer, unsigned int width, unsigned int height, unsigned int byteDepth)
 {
-   if(busy_)
-      return DEVICE_ERR;
-
    int ret = DEVICE_OK;
  
-   busy_ = true;
-   performanceTiming_ = MM::MMTime(0.);
+   ++busy_;
    MM::MMTime  s0 = GetCurrentMMTime();
 
 
@@ -4989,8 +5320,11 @@ int ImageFlipX::Process(unsigned char *pBuffer, unsigned int width, unsigned int
       ret =  DEVICE_NOT_SUPPORTED;
    }
 
-   performanceTiming_ = GetCurrentMMTime() - s0;
-   busy_ = false;
+   {
+      MMThreadGuard g(timingLock_);
+      performanceTiming_ = GetCurrentMMTime() - s0;
+   }
+   --busy_;
 
    return ret;
 }
@@ -31,12 +31,19 @@
 
 #include "DeviceBase.h"
 #include "ImgBuffer.h"
+#include "Median3x3.h"
 #include "DeviceThreads.h"
 #include <string>
 #include <map>
 #include <algorithm>
 #include <stdint.h>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
 #include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 //////////////////////////////////////////////////////////////////////////////
 // Error codes
@@ -221,6 +228,8 @@ private:
    void GenerateEmptyImage(ImgBuffer& img);
    void GenerateSyntheticImage(ImgBuffer& img, double exp);
    bool GenerateColorTestPattern(ImgBuffer& img);
+   bool GenerateFastSyntheticImage(ImgBuffer& img, double exp);
+   const char* GetPixelTypeName(const ImgBuffer& img) const;
    int ResizeImageBuffer();
 
    static const double nominalPixelSizeUm_;
@@ -281,6 +290,12 @@ private:
    double pcf_;
    double photonFlux_;
    double readNoise_;
+   // Per-column sine and cosine of the wave phase, for the fast mode
+   std::vector<float> fastSinTable_;
+   std::vector<float> fastCosTable_;
+   unsigned fastTableWidth_;
+   double fastTableStripeWidth_;
+   uint32_t fastFrameCounter_;
 };
 
 class MySequenceThread : public MMDeviceThreadBase
@@ -456,6 +471,36 @@ private:
    long position_;
 };
 
+//////////////////////////////////////////////////////////////////////////////
+// DemoMoveNotifier class
+// Tells the Core when a simulated stage move has finished
+//////////////////////////////////////////////////////////////////////////////
+
+class DemoMoveNotifier
+{
+public:
+   // clock must return the device's GetCurrentMMTime(); onIdle is called on
+   // the notifier thread once the end time of the last move has passed
+   DemoMoveNotifier(std::function<MM::MMTime()> clock,
+         std::function<void()> onIdle);
+   ~DemoMoveNotifier();
+
+   // The device is busy until clock() > end
+   void MoveUntil(MM::MMTime end);
+
+private:
+   void Run();
+
+   std::function<MM::MMTime()> clock_;
+   std::function<void()> onIdle_;
+   std::mutex mutex_;
+   std::condition_variable cond_;
+   MM::MMTime end_;
+   bool pending_;
+   bool stop_;
+   std::thread thread_;
+};
+
 //////////////////////////////////////////////////////////////////////////////
 // CDemoStage class
 // Simulation of the single axis stage
@@ -467,7 +512,7 @@ public:
    CDemoStage();
    ~CDemoStage();
 
-   bool Busy() {return busy_;}
+   bool Busy();
    void GetName(char* pszName) const;
 
    int Initialize();
@@ -480,6 +525,7 @@ public:
    int SetPositionSteps(long steps) 
    {
       pos_um_ = steps * stepSize_um_; 
+      StartSettling();
       return  OnStagePositionChanged(pos_um_);
    }
    int GetPositionSteps(long& steps)
@@ -502,6 +548,7 @@ public:
    // ----------------
    int OnPosition(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnSequence(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSettlingTime(MM::PropertyBase* pProp, MM::ActionType eAct);
 
    // Sequence functions
    int IsStageSequenceable(bool& isSequenceable) const;
@@ -514,13 +561,16 @@ public:
 
 private:
    void SetIntensityFactor(double pos);
+   void StartSettling();
    double stepSize_um_;
    double pos_um_;
-   bool busy_;
    bool initialized_;
    double lowerLimit_;
    double upperLimit_;
    bool sequenceable_;
+   double settlingTimeMs_;        // busy time after each move
+   MM::MMTime settlingEndTime_;
+   std::unique_ptr<DemoMoveNotifier> moveNotifier_; // if BusyNotification
 };
 
 //////////////////////////////////////////////////////////////////////////////
@@ -598,6 +648,7 @@ private:
    bool initialized_;
    double lowerLimit_;
    double upperLimit_;
+   std::unique_ptr<DemoMoveNotifier> moveNotifier_; // if BusyNotification
 
    void ComputeIntermediatePosition(const MM::MMTime& currentTime,
       double& currentPosX,
@@ -855,30 +906,25 @@ private:
 class ImageFlipX : public CImageProcessorBase<ImageFlipX>
 {
 public:
-   ImageFlipX () :  busy_(false) {}
+   ImageFlipX () :  busy_(0) {}
    ~ImageFlipX () {  }
 
    int Shutdown() {return DEVICE_OK;}
    void GetName(char* name) const {strcpy(name,"ImageFlipX");}
 
    int Initialize();
-   bool Busy(void) { return busy_;};
+   bool Busy(void) { return busy_ > 0;};
 
+   // Rows are independent, so Process() may run concurrently on bands of
+   // rows (the TileSafe property)
    template <typename PixelType>
    int Flip(PixelType* pI, unsigned int width, unsigned int height)
    {
-      PixelType tmp;
-      int ret = DEVICE_OK;
       for( unsigned long iy = 0; iy < height; ++iy)
       {
-         for( unsigned long ix = 0; ix <  (width>>1) ; ++ix)
-         {
-            tmp = pI[ ix + iy*width];
-            pI[ ix + iy*width] = pI[ width - 1 - ix + iy*width];
-            pI[ width -1 - ix + iy*width] = tmp;
-         }
+         std::reverse(pI + iy*width, pI + (iy + 1)*width);
       }
-      return ret;
+      return DEVICE_OK;
    }
 
    int Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth);
@@ -886,7 +932,8 @@ public:
    int OnPerformanceTiming(MM::PropertyBase* pProp, MM::ActionType eAct);
 
 private:
-   bool busy_;
+   std::atomic<int> busy_; // Number of Process() calls running
+   MMThreadLock timingLock_;
    MM::MMTime performanceTiming_;
 };
 
@@ -961,19 +1008,10 @@ public:
    int Initialize();
    bool Busy(void) { return busy_;};
 
-   // NOTE: this utility MODIFIES the argument, make a copy yourself if you want the original data preserved
-   template <class U> U FindMedian(std::vector<U>& values ) {
-      std::sort(values.begin(), values.end());
-      return values[(values.size())>>1];
-   };
-
-
    template <typename PixelType>
    int Filter(PixelType* pI, unsigned int width, unsigned int height)
    {
       int ret = DEVICE_OK;
-      int x[9];
-      int y[9];
 
       const unsigned long thisSize = sizeof(*pI)*width*height;
       if( thisSize != sizeOfSmoothedIm_)
@@ -995,51 +1033,10 @@ public:
 
       if(NULL != pSmooth)
       {
-      /*Apply 3x3 median filter to reduce shot noise*/
-      for (unsigned int i=0; i<width; i++) {
-         for (unsigned int j=0; j<height; j++) {
-            x[0]=i-1;
-            y[0]=(j-1);
-            x[1]=i;
-            y[1]=(j-1);
-            x[2]=i+1;
-            y[2]=(j-1);
-            x[3]=i-1;
-            y[3]=(j);
-            x[4]=i;
-            y[4]=(j);
-            x[5]=i+1;
-            y[5]=(j);
-            x[6]=i-1;
-            y[6]=(j+1);
-            x[7]=i;
-            y[7]=(j+1);
-            x[8]=i+1;
-            y[8]=(j+1);
-            // truncate the median filter window  -- duplicate edge points
-            // this could be more efficient, we could fill in the interior image [1,w0-1]x[1,h0-1] then explicitly fill in the edge pixels.
-            // also the temporary image could be as small as 2 rasters of the image
-            for(int ij =0; ij < 9; ++ij)
-            {
-               if( x[ij] < 0)
-                  x[ij] = 0;
-               else if( int(width-1) < x[ij])
-                  x[ij] = int(width-1);
-               if( y[ij] < 0)
-                  y[ij] = 0;
-               else if( int(height-1) < y[ij])
-                  y[ij] = (int)(height-1);
-            }
-            std::vector<PixelType> windo;
-            for(int ij = 0; ij < 9; ++ij)
-            {
-               windo.push_back(pI[ x[ij] + width*y[ij]]);
-            }
-            pSmooth[i + j*width] = FindMedian(windo);
-         }
-      }
-
-      memcpy( pI, pSmoothedIm_, thisSize);
+         /*Apply 3x3 median filter to reduce shot noise; edge pixels are duplicated*/
+         MM::Median3x3(pI, pSmooth, width, height,
+               (std::max)(1u, std::thread::hardware_concurrency()));
+         memcpy( pI, pSmoothedIm_, thisSize);
       }
       else
          ret = DEVICE_ERR;
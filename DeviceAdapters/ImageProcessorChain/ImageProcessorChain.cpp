@@ -28,6 +28,7 @@
 #include "ModuleInterface.h"
 #include <sstream>
 #include <algorithm>
+#include <thread>
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -63,7 +64,9 @@ MODULE_API void DeleteDevice(MM::Device* pDevice)
 
 int ImageProcessorChain::Initialize()
 {
-
+   maxThreads_ = std::max(1L, (long)std::thread::hardware_concurrency());
+   maxThreads_ = std::min(maxThreads_, 64L);
+   ResizeWorkers();
 
    std::vector<std::string> availableProcessors;
    availableProcessors.clear();
@@ -97,6 +100,17 @@ int ImageProcessorChain::Initialize()
 
    }
 
+   // Tile-safe processors run on bands of rows of about TileSizeKB, on up
+   // to MaxThreads threads
+   CPropertyAction* pActThreads = new CPropertyAction (this, &ImageProcessorChain::OnMaxThreads);
+   (void)CreateIntegerProperty("MaxThreads", maxThreads_, false, pActThreads);
+   SetPropertyLimits("MaxThreads", 1, 64);
+   CPropertyAction* pActTile = new CPropertyAction (this, &ImageProcessorChain::OnTileKB);
+   (void)CreateIntegerProperty("TileSizeKB", tileKB_, false, pActTile);
+   SetPropertyLimits("TileSizeKB", 16, 16384);
+   CPropertyAction* pActTiming = new CPropertyAction (this, &ImageProcessorChain::OnPerformanceTiming);
+   (void)CreateFloatProperty("PerformanceTiming (microseconds)", 0, true, pActTiming);
+
    return DEVICE_OK;
 }
 
@@ -120,13 +134,20 @@ int ImageProcessorChain::OnProcessor(MM::PropertyBase* pProp, MM::ActionType eAc
       for( int islot = 0; islot < this->nSlots_; ++islot)
       {
          processors_[islot] = NULL;
+         tileSafe_[islot] = false;
          if( processorNames_.end() != processorNames_.find(islot))
             if ( 0 < processorNames_[islot].length())
             {
                MM::Device* pDevice = GetDevice(processorNames_[islot].c_str());
                if( NULL != pDevice)
                   if( MM::ImageProcessorDevice == pDevice->GetType())
+                  {
                      processors_[islot] = (MM::ImageProcessor*) pDevice;
+                     char value[MM::MaxStrLength];
+                     if( pDevice->HasProperty(MM::g_Keyword_TileSafe) &&
+                           DEVICE_OK == pDevice->GetProperty(MM::g_Keyword_TileSafe, value))
+                        tileSafe_[islot] = (0 == strcmp(value, "Yes"));
+                  }
             }
       }
       
@@ -136,37 +157,133 @@ int ImageProcessorChain::OnProcessor(MM::PropertyBase* pProp, MM::ActionType eAc
 }
 
 
+int ImageProcessorChain::OnMaxThreads(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(maxThreads_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(maxThreads_);
+      ResizeWorkers();
+   }
+   return DEVICE_OK;
+}
+
+int ImageProcessorChain::OnTileKB(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(tileKB_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(tileKB_);
+   }
+   return DEVICE_OK;
+}
+
+int ImageProcessorChain::OnPerformanceTiming(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(performanceTiming_.getUsec());
+   }
+   return DEVICE_OK;
+}
+
+
 int ImageProcessorChain::Process(unsigned char *pBuffer, unsigned int width, unsigned int height, unsigned int byteDepth)
 {
    int ret = DEVICE_OK;
    busy_ = true;
+   MM::MMTime s0 = GetCurrentMMTime();
 
-
+   // Consecutive tile-safe processors are run together on each band of
+   // rows while it is in cache, so that the image is streamed through
+   // memory once for all of them. Other processors run on the whole image.
+   std::vector<MM::ImageProcessor*> tiledStages;
    for( int islot = 0; islot < this->nSlots_; ++islot)
    {
-      if( processors_.end() != processors_.find(islot))
-      {
+      std::map< int, MM::ImageProcessor*>::const_iterator it = processors_.find(islot);
+      if( processors_.end() == it || NULL == it->second)
+         continue;
 
-         MM::ImageProcessor* pP = processors_[islot];
-         if( NULL != pP)
-         {
-            try
-            {
-               pP->Process(pBuffer, width, height,byteDepth);
-            }
-            catch(...)
-            {
-               std::ostringstream m;
-               char name[MM::MaxStrLength];
-               pP->GetName(name);
-               m << "Error in processor " << name;
-               LogMessage(m.str().c_str(), false);
-            }
-         }
+      if( tileSafe_[islot])
+      {
+         tiledStages.push_back(it->second);
+         continue;
       }
+      if( !tiledStages.empty())
+      {
+         ProcessTiled(tiledStages, pBuffer, width, height, byteDepth);
+         tiledStages.clear();
+      }
+      ProcessFullFrame(it->second, pBuffer, width, height, byteDepth);
    }
+   if( !tiledStages.empty())
+      ProcessTiled(tiledStages, pBuffer, width, height, byteDepth);
 
+   performanceTiming_ = GetCurrentMMTime() - s0;
    busy_ = false;
 
    return ret;
 }
+
+void ImageProcessorChain::ProcessFullFrame(MM::ImageProcessor* pP, unsigned char* pBuffer, unsigned width, unsigned height, unsigned byteDepth)
+{
+   try
+   {
+      pP->Process(pBuffer, width, height,byteDepth);
+   }
+   catch(...)
+   {
+      LogProcessorError(pP);
+   }
+}
+
+void ImageProcessorChain::ProcessTiled(const std::vector<MM::ImageProcessor*>& stages, unsigned char* pBuffer, unsigned width, unsigned height, unsigned byteDepth)
+{
+   const size_t rowBytes = (size_t)width * byteDepth;
+   if( 0 == rowBytes || 0 == height)
+      return;
+   const unsigned tileRows = (unsigned)std::min<size_t>(height,
+         std::max<size_t>(1, (size_t)tileKB_ * 1024 / rowBytes));
+
+   workers_.Run(height, tileRows, [&](unsigned y0, unsigned y1)
+   {
+      unsigned char* pTile = pBuffer + y0 * rowBytes;
+      for( std::vector<MM::ImageProcessor*>::const_iterator it = stages.begin(); it != stages.end(); ++it)
+      {
+         try
+         {
+            (*it)->Process(pTile, width, y1 - y0, byteDepth);
+         }
+         catch(...)
+         {
+            LogProcessorError(*it);
+         }
+      }
+   });
+}
+
+void ImageProcessorChain::ResizeWorkers()
+{
+   const unsigned nThreads = workers_.Resize((unsigned)maxThreads_);
+   if( nThreads < (unsigned)maxThreads_)
+   {
+      std::ostringstream m;
+      m << "Could only start " << nThreads << " of " << maxThreads_ << " threads";
+      LogMessage(m.str().c_str(), false);
+   }
+}
+
+void ImageProcessorChain::LogProcessorError(MM::ImageProcessor* pP)
+{
+   std::ostringstream m;
+   char name[MM::MaxStrLength];
+   pP->GetName(name);
+   m << "Error in processor " << name;
+   LogMessage(m.str().c_str(), false);
+}
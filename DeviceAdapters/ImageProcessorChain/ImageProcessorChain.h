@@ -29,8 +29,10 @@
 #include "DeviceBase.h"
 #include "ImgBuffer.h"
 #include "DeviceThreads.h"
+#include "BandWorkers.h"
 #include <string>
 #include <map>
+#include <vector>
 
 
 
@@ -41,10 +43,10 @@
 class ImageProcessorChain : public CImageProcessorBase<ImageProcessorChain>
 {
 public:
-   ImageProcessorChain () : nSlots_(10), busy_(false) {}
+   ImageProcessorChain () : nSlots_(10), busy_(false), maxThreads_(1), tileKB_(256), performanceTiming_(0.) {}
    ~ImageProcessorChain () { }
 
-   int Shutdown() {return DEVICE_OK;}
+   int Shutdown() {workers_.Resize(1); return DEVICE_OK;}
    void GetName(char* name) const {strcpy(name,"ImageProcessorChain");}
 
    int Initialize();
@@ -56,12 +58,27 @@ public:
    // action interface
    // ----------------
    int OnProcessor(MM::PropertyBase* pProp, MM::ActionType eAct, long indexx);
+   int OnMaxThreads(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnTileKB(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnPerformanceTiming(MM::PropertyBase* pProp, MM::ActionType eAct);
 
 private:
+   void ProcessFullFrame(MM::ImageProcessor* pP, unsigned char* pBuffer, unsigned width, unsigned height, unsigned byteDepth);
+   void ProcessTiled(const std::vector<MM::ImageProcessor*>& stages, unsigned char* pBuffer, unsigned width, unsigned height, unsigned byteDepth);
+   void LogProcessorError(MM::ImageProcessor* pP);
+   void ResizeWorkers();
+
    const int nSlots_;
    bool busy_;
+   long maxThreads_;
+   long tileKB_;
+   MM::MMTime performanceTiming_;
    std::map< int, std::string> processorNames_;
    std::map< int, MM::ImageProcessor*> processors_;
+   // Processors declaring the TileSafe property, by slot
+   std::map< int, bool> tileSafe_;
+   // Run tile-safe processors; kept between frames
+   MM::BandWorkers workers_;
 
    ImageProcessorChain& operator=( const ImageProcessorChain& ){ 
       return *this;
@@ -0,0 +1,278 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          AdapterMetadataCache.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Cache of device adapter metadata, so that unchanged device
+//                adapter libraries need not be loaded to list their devices.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "AdapterMetadataCache.h"
+
+#include "../MMDevice/MMDevice.h"
+#include "../MMDevice/ModuleInterface.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#ifdef _WIN32
+#   define WIN32_LEAN_AND_MEAN
+#   include <windows.h>
+#else
+#   include <sys/stat.h>
+#endif
+
+namespace mm {
+
+namespace {
+
+const char* const cacheFileHeader = "MMAdapterMetadataCache";
+const int cacheFileFormatVersion = 1;
+
+std::string Escape(const std::string& s)
+{
+   std::string result;
+   result.reserve(s.size());
+   for (char c : s)
+   {
+      switch (c)
+      {
+         case '\\': result += "\\\\"; break;
+         case '\t': result += "\\t"; break;
+         case '\n': result += "\\n"; break;
+         case '\r': result += "\\r"; break;
+         default: result += c;
+      }
+   }
+   return result;
+}
+
+std::string Unescape(const std::string& s)
+{
+   std::string result;
+   result.reserve(s.size());
+   for (size_t i = 0; i < s.size(); ++i)
+   {
+      if (s[i] != '\\' || i + 1 == s.size())
+      {
+         result += s[i];
+         continue;
+      }
+      switch (s[++i])
+      {
+         case 't': result += '\t'; break;
+         case 'n': result += '\n'; break;
+         case 'r': result += '\r'; break;
+         default: result += s[i];
+      }
+   }
+   return result;
+}
+
+std::vector<std::string> SplitFields(const std::string& line)
+{
+   std::vector<std::string> fields;
+   size_t start = 0;
+   for (;;)
+   {
+      const size_t tab = line.find('\t', start);
+      fields.push_back(Unescape(line.substr(start, tab - start)));
+      if (tab == std::string::npos)
+         return fields;
+      start = tab + 1;
+   }
+}
+
+} // anonymous namespace
+
+bool FileStamp::Get(const std::string& path, FileStamp& stamp)
+{
+#ifdef _WIN32
+   WIN32_FILE_ATTRIBUTE_DATA data;
+   if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data))
+      return false;
+   stamp.size = (static_cast<std::uint64_t>(data.nFileSizeHigh) << 32) |
+      data.nFileSizeLow;
+   const std::int64_t ticks = static_cast<std::int64_t>(
+         (static_cast<std::uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) |
+         data.ftLastWriteTime.dwLowDateTime);
+   stamp.mtimeNs = ticks * 100;
+#else
+   struct stat st;
+   if (stat(path.c_str(), &st) != 0)
+      return false;
+   stamp.size = static_cast<std::uint64_t>(st.st_size);
+#   ifdef __APPLE__
+   const long nsec = st.st_mtimespec.tv_nsec;
+#   else
+   const long nsec = st.st_mtim.tv_nsec;
+#   endif
+   stamp.mtimeNs = static_cast<std::int64_t>(st.st_mtime) * 1000000000 + nsec;
+#endif
+   return true;
+}
+
+void AdapterMetadataCache::SetCacheFile(const std::string& filename)
+{
+   Save(); // Pending changes belong to the previous file
+   cacheFile_ = filename;
+   if (!cacheFile_.empty())
+   {
+      Load();
+      Save(); // Write any entries obtained before the file was set
+   }
+}
+
+bool AdapterMetadataCache::Lookup(const std::string& path,
+      const FileStamp& stamp, AdapterMetadata& metadata) const
+{
+   std::map<std::string, AdapterMetadata>::const_iterator it =
+      entries_.find(path);
+   if (it == entries_.end() || it->second.stamp != stamp)
+      return false;
+   metadata = it->second;
+   return true;
+}
+
+void AdapterMetadataCache::Store(const AdapterMetadata& metadata)
+{
+   entries_[metadata.path] = metadata;
+   dirty_ = true;
+}
+
+/*
+ * File format (text; fields separated by tabs, with tab, newline, carriage
+ * return and backslash escaped):
+ *
+ *    MMAdapterMetadataCache  format-version  module-interface-version  device-interface-version
+ *    A  path  size  mtime-ns  module-interface-version  device-interface-version  device-count
+ *    D  name  type  has-description  description
+ *    ...
+ */
+bool AdapterMetadataCache::Load()
+{
+   std::ifstream f(cacheFile_.c_str(), std::ios_base::binary);
+   if (!f)
+      return false;
+
+   std::string line;
+   if (!std::getline(f, line))
+      return false;
+   std::vector<std::string> fields = SplitFields(line);
+   if (fields.size() != 4 || fields[0] != cacheFileHeader ||
+         fields[1] != std::to_string(cacheFileFormatVersion) ||
+         fields[2] != std::to_string(MODULE_INTERFACE_VERSION) ||
+         fields[3] != std::to_string(DEVICE_INTERFACE_VERSION))
+      return false;
+
+   std::map<std::string, AdapterMetadata> entries;
+   try
+   {
+      while (std::getline(f, line))
+      {
+         fields = SplitFields(line);
+         if (fields.size() != 7 || fields[0] != "A")
+            return false;
+         AdapterMetadata metadata;
+         metadata.path = fields[1];
+         metadata.stamp.size = std::stoull(fields[2]);
+         metadata.stamp.mtimeNs = std::stoll(fields[3]);
+         metadata.moduleInterfaceVersion = std::stol(fields[4]);
+         metadata.deviceInterfaceVersion = std::stol(fields[5]);
+         const unsigned long deviceCount = std::stoul(fields[6]);
+         for (unsigned long i = 0; i < deviceCount; ++i)
+         {
+            if (!std::getline(f, line))
+               return false;
+            fields = SplitFields(line);
+            if (fields.size() != 5 || fields[0] != "D")
+               return false;
+            AdapterDeviceMetadata device;
+            device.name = fields[1];
+            device.type = static_cast<MM::DeviceType>(std::stoi(fields[2]));
+            device.hasDescription = fields[3] == "1";
+            device.description = fields[4];
+            metadata.devices.push_back(device);
+         }
+         entries[metadata.path] = metadata;
+      }
+   }
+   catch (const std::exception&) // Number parsing
+   {
+      return false;
+   }
+
+   // Entries obtained in this session take precedence
+   for (std::map<std::string, AdapterMetadata>::const_iterator
+         it = entries_.begin(), end = entries_.end(); it != end; ++it)
+      entries[it->first] = it->second;
+   entries_.swap(entries);
+   return true;
+}
+
+bool AdapterMetadataCache::Save()
+{
+   if (cacheFile_.empty() || !dirty_)
+      return true;
+
+   // Write to a temporary file and rename, so that other processes never
+   // see a partially written cache
+   const std::string tmpFile = cacheFile_ + ".tmp";
+   {
+      std::ofstream f(tmpFile.c_str(), std::ios_base::binary | std::ios_base::trunc);
+      if (!f)
+         return false;
+
+      f << cacheFileHeader << '\t' << cacheFileFormatVersion << '\t' <<
+         MODULE_INTERFACE_VERSION << '\t' << DEVICE_INTERFACE_VERSION << '\n';
+      for (std::map<std::string, AdapterMetadata>::const_iterator
+            it = entries_.begin(), end = entries_.end(); it != end; ++it)
+      {
+         const AdapterMetadata& metadata = it->second;
+         f << "A\t" << Escape(metadata.path) << '\t' << metadata.stamp.size <<
+            '\t' << metadata.stamp.mtimeNs << '\t' <<
+            metadata.moduleInterfaceVersion << '\t' <<
+            metadata.deviceInterfaceVersion << '\t' <<
+            metadata.devices.size() << '\n';
+         for (const AdapterDeviceMetadata& device : metadata.devices)
+         {
+            f << "D\t" << Escape(device.name) << '\t' <<
+               static_cast<int>(device.type) << '\t' <<
+               (device.hasDescription ? 1 : 0) << '\t' <<
+               Escape(device.description) << '\n';
+         }
+      }
+      f.close();
+      if (!f)
+      {
+         std::remove(tmpFile.c_str());
+         return false;
+      }
+   }
+
+#ifdef _WIN32
+   // rename() does not replace an existing file on Windows
+   if (!MoveFileExA(tmpFile.c_str(), cacheFile_.c_str(), MOVEFILE_REPLACE_EXISTING))
+#else
+   if (std::rename(tmpFile.c_str(), cacheFile_.c_str()) != 0)
+#endif
+   {
+      std::remove(tmpFile.c_str());
+      return false;
+   }
+   dirty_ = false;
+   return true;
+}
+
+} // namespace mm
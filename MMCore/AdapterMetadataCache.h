@@ -0,0 +1,116 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          AdapterMetadataCache.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Cache of device adapter metadata, so that unchanged device
+//                adapter libraries need not be loaded to list their devices.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "../MMDevice/MMDeviceConstants.h"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace mm {
+
+/**
+ * Size and modification time of a file (or directory).
+ */
+struct FileStamp
+{
+   std::uint64_t size;
+   std::int64_t mtimeNs; // Resolution depends on the platform
+
+   FileStamp() : size(0), mtimeNs(0) {}
+
+   bool operator==(const FileStamp& other) const
+   { return size == other.size && mtimeNs == other.mtimeNs; }
+   bool operator!=(const FileStamp& other) const
+   { return !(*this == other); }
+
+   // Returns false if the file does not exist
+   static bool Get(const std::string& path, FileStamp& stamp);
+};
+
+struct AdapterDeviceMetadata
+{
+   std::string name;
+   std::string description;
+   bool hasDescription; // False if the adapter failed to provide one
+   MM::DeviceType type; // UnknownType if the adapter failed to provide it
+
+   AdapterDeviceMetadata() : hasDescription(false), type(MM::UnknownType) {}
+};
+
+struct AdapterMetadata
+{
+   std::string path;
+   FileStamp stamp;
+   long moduleInterfaceVersion;
+   long deviceInterfaceVersion;
+   std::vector<AdapterDeviceMetadata> devices;
+
+   AdapterMetadata() : moduleInterfaceVersion(0), deviceInterfaceVersion(0) {}
+};
+
+/**
+ * Device adapter metadata (available devices and interface versions), keyed
+ * by library path and valid as long as the library's size and modification
+ * time are unchanged.
+ *
+ * If a cache file is set, the cache is loaded from it. Changes are written
+ * by Save(), which is also called when the file is changed and on
+ * destruction, so that a listing of many adapters writes the file once. The
+ * file records the Core's interface versions and is ignored if they differ
+ * (or if it cannot be parsed).
+ *
+ * Not thread-safe.
+ */
+class AdapterMetadataCache
+{
+public:
+   AdapterMetadataCache() : dirty_(false) {}
+   ~AdapterMetadataCache() { Save(); }
+
+   AdapterMetadataCache(const AdapterMetadataCache&) = delete;
+   AdapterMetadataCache& operator=(const AdapterMetadataCache&) = delete;
+
+   // Loads the cache from the given file (keeping the entries in memory if
+   // the file is empty or invalid). An empty filename disables persistence.
+   void SetCacheFile(const std::string& filename);
+   std::string GetCacheFile() const { return cacheFile_; }
+
+   // Returns false if there is no entry for path or if stamp differs.
+   bool Lookup(const std::string& path, const FileStamp& stamp,
+         AdapterMetadata& metadata) const;
+
+   void Store(const AdapterMetadata& metadata);
+
+   // Writes the cache file if there are unsaved changes (returns false on
+   // failure; the cache is still valid in memory).
+   bool Save();
+
+private:
+   bool Load();
+
+   std::string cacheFile_;
+   std::map<std::string, AdapterMetadata> entries_;
+   bool dirty_;
+};
+
+} // namespace mm
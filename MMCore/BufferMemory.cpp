@@ -0,0 +1,223 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          BufferMemory.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Contiguous, page-allocated memory for the circular buffer.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "BufferMemory.h"
+
+#include <fstream>
+#include <new>
+#include <string>
+
+#ifdef _WIN32
+#   define WIN32_LEAN_AND_MEAN
+#   include <windows.h>
+#else
+#   include <sys/mman.h>
+#   include <unistd.h>
+#   ifdef __linux__
+#      include <sys/syscall.h>
+#   endif
+#endif
+
+namespace mm {
+
+namespace {
+
+std::size_t RoundUp(std::size_t size, std::size_t unit)
+{
+   return (size + unit - 1) / unit * unit;
+}
+
+std::size_t PageSize()
+{
+#ifdef _WIN32
+   SYSTEM_INFO info;
+   GetSystemInfo(&info);
+   return info.dwPageSize;
+#else
+   return static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+#ifdef __linux__
+
+const std::size_t hugePageSize = 2 * 1024 * 1024;
+
+int CurrentNumaNode()
+{
+   unsigned cpu = 0;
+   unsigned node = 0;
+   if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0)
+      return -1;
+   return static_cast<int>(node);
+}
+
+// Same as mbind(MPOL_PREFERRED) from libnuma's <numaif.h>, which we do not
+// depend on.
+bool PreferNumaNode(void* addr, std::size_t len, int node)
+{
+   const int mpolPreferred = 1;
+   const unsigned bitsPerWord = 8 * sizeof(unsigned long);
+   unsigned long nodeMask[16] = {};
+   if (node < 0 || static_cast<unsigned>(node) >= 16 * bitsPerWord)
+      return false;
+   nodeMask[node / bitsPerWord] = 1UL << (node % bitsPerWord);
+   return syscall(SYS_mbind, addr, len, mpolPreferred, nodeMask,
+         16 * bitsPerWord + 1, 0) == 0;
+}
+
+bool TransparentHugePagesAvailable()
+{
+   std::ifstream setting("/sys/kernel/mm/transparent_hugepage/enabled");
+   std::string line;
+   if (!std::getline(setting, line))
+      return false;
+   return line.find("[never]") == std::string::npos;
+}
+
+#endif // __linux__
+
+} // anonymous namespace
+
+#ifdef _WIN32
+
+BufferMemory::BufferMemory(std::size_t size, bool bindToCurrentNumaNode) :
+   data_(0),
+   size_(0),
+   hugePages_(false),
+   locked_(false),
+   numaNode_(-1)
+{
+   if (bindToCurrentNumaNode)
+   {
+      PROCESSOR_NUMBER processor;
+      GetCurrentProcessorNumberEx(&processor);
+      USHORT node;
+      if (GetNumaProcessorNodeEx(&processor, &node))
+         numaNode_ = node;
+   }
+   const DWORD preferredNode = numaNode_ >= 0 ?
+      static_cast<DWORD>(numaNode_) : NUMA_NO_PREFERRED_NODE;
+
+   // Large pages are only granted if the user holds the "Lock pages in
+   // memory" privilege; they are always resident.
+   const SIZE_T largePageSize = GetLargePageMinimum();
+   if (largePageSize > 0)
+   {
+      const std::size_t largeSize = RoundUp(size, largePageSize);
+      data_ = static_cast<unsigned char*>(VirtualAllocExNuma(GetCurrentProcess(),
+               NULL, largeSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+               PAGE_READWRITE, preferredNode));
+      if (data_)
+      {
+         size_ = largeSize;
+         hugePages_ = true;
+         locked_ = true;
+         return;
+      }
+   }
+
+   size_ = RoundUp(size, PageSize());
+   data_ = static_cast<unsigned char*>(VirtualAllocExNuma(GetCurrentProcess(),
+            NULL, size_, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE,
+            preferredNode));
+   if (!data_)
+      throw std::bad_alloc();
+}
+
+BufferMemory::~BufferMemory()
+{
+   VirtualFree(data_, 0, MEM_RELEASE);
+}
+
+#else // _WIN32
+
+BufferMemory::BufferMemory(std::size_t size, bool bindToCurrentNumaNode) :
+   data_(0),
+   size_(0),
+   hugePages_(false),
+   locked_(false),
+   numaNode_(-1)
+{
+   void* p = MAP_FAILED;
+#ifdef __linux__
+   // Explicit huge pages are only available if reserved by the administrator
+   // (vm.nr_hugepages); fall back to transparent huge pages.
+   size_ = RoundUp(size, hugePageSize);
+   p = mmap(NULL, size_, PROT_READ | PROT_WRITE,
+         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+   if (p != MAP_FAILED)
+   {
+      hugePages_ = true;
+   }
+   else
+   {
+      p = mmap(NULL, size_, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p != MAP_FAILED)
+         hugePages_ = madvise(p, size_, MADV_HUGEPAGE) == 0 &&
+            TransparentHugePagesAvailable();
+   }
+#else
+   size_ = RoundUp(size, PageSize());
+   p = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+#endif
+   if (p == MAP_FAILED)
+      throw std::bad_alloc();
+   data_ = static_cast<unsigned char*>(p);
+
+#ifdef __linux__
+   // Must happen before the pages are faulted in
+   if (bindToCurrentNumaNode)
+   {
+      const int node = CurrentNumaNode();
+      if (PreferNumaNode(data_, size_, node))
+         numaNode_ = node;
+   }
+#else
+   (void)bindToCurrentNumaNode;
+#endif
+}
+
+BufferMemory::~BufferMemory()
+{
+   munmap(data_, size_);
+}
+
+#endif // _WIN32
+
+void BufferMemory::Prefault()
+{
+   if (!locked_)
+   {
+#ifdef _WIN32
+      locked_ = VirtualLock(data_, size_) != 0;
+#else
+      locked_ = mlock(data_, size_) == 0;
+#endif
+   }
+   if (locked_)
+      return; // Locking makes the pages resident
+
+   // Writing (not just reading) is needed to get private pages allocated
+   volatile unsigned char* p = data_;
+   const std::size_t step = PageSize();
+   for (std::size_t offset = 0; offset < size_; offset += step)
+      p[offset] = 0;
+}
+
+} // namespace mm
@@ -0,0 +1,68 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          BufferMemory.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Contiguous, page-allocated memory for the circular buffer.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <cstddef>
+
+namespace mm {
+
+/**
+ * A single block of memory obtained directly from the operating system (not
+ * from the heap), for storing image pixels.
+ *
+ * Huge (large) pages are used when the system provides them; otherwise normal
+ * pages are used. Optionally, the memory is bound to the NUMA node of the
+ * thread that constructs the object.
+ */
+class BufferMemory
+{
+public:
+   /**
+    * Allocates size bytes (rounded up to a whole number of pages).
+    * Throws std::bad_alloc on failure.
+    */
+   BufferMemory(std::size_t size, bool bindToCurrentNumaNode);
+   ~BufferMemory();
+
+   unsigned char* GetData() const { return data_; }
+   std::size_t GetSize() const { return size_; }
+
+   bool IsHugePages() const { return hugePages_; }
+   bool IsLocked() const { return locked_; }
+   // The NUMA node the memory is bound to, or -1 if not bound.
+   int GetNumaNode() const { return numaNode_; }
+
+   /**
+    * Makes the memory resident, so that no page faults occur when it is first
+    * written: locks it in RAM if permitted, otherwise touches every page.
+    */
+   void Prefault();
+
+private:
+   BufferMemory(const BufferMemory&);
+   BufferMemory& operator=(const BufferMemory&);
+
+   unsigned char* data_;
+   std::size_t size_;
+   bool hugePages_;
+   bool locked_;
+   int numaNode_;
+};
+
+} // namespace mm
@@ -7,6 +7,9 @@
 //                allows only one thread to enter at a time by using a mutex lock.
 //                This makes the buffer susceptible to race conditions if the
 //                calling threads are mutually dependent.
+//                When the LockFreeCircularBuffer Core feature is enabled, the
+//                buffer instead operates as a single-producer/single-consumer
+//                ring in which inserting and popping never take a lock.
 //              
 // COPYRIGHT:     University of California, San Francisco, 2007,
 //
@@ -24,7 +27,10 @@
 // AUTHOR:        Nenad Amodaj, nenad@amodaj.com, 01/05/2007
 // 
 #include "CircularBuffer.h"
+#include "BufferMemory.h"
+#include "CoreFeatures.h"
 #include "CoreUtils.h"
+#include "ImageBatch.h"
 
 #include "TaskSet_CopyMemory.h"
 
@@ -32,6 +38,7 @@
 
 #include <chrono>
 #include <cstdio>
+#include <cstring>
 #include <ctime>
 #include <memory>
 #include <string>
@@ -53,22 +60,50 @@ const long adjustThreshold = LONG_MAX / 2;
 // division by zero can be added.
 const unsigned long maxCBSize = 10000000;
 
-CircularBuffer::CircularBuffer(unsigned int memorySizeMB) :
+// In variable-size mode, the number of entries is chosen so that the buffer
+// can be filled with images of this size (128x128 at 8 bits); smaller images
+// can use only part of the memory.
+const std::size_t minVariableSizeSlotBytes = 16 * 1024;
+
+CircularBuffer::CircularBuffer(unsigned int memorySizeMB, std::shared_ptr<ThreadPool> threadPool) :
    width_(0), 
    height_(0), 
    pixDepth_(0), 
    imageCounter_(0), 
+   cachedTimeSecs_(-1),
+   firstFillUs_(-1),
    insertIndex_(0), 
    saveIndex_(0), 
    memorySizeMB_(memorySizeMB), 
    overflow_(false),
-   threadPool_(std::make_shared<ThreadPool>()),
+   lockFree_(false),
+   variableSize_(false),
+   nominalSize_(0),
+   arenaHead_(0),
+   writeSlotPending_(false),
+   writeSlotOwner_(0),
+   writeSlotImage_(0),
+   writeSlotComponents_(1),
+   writeSlotPrevArenaHead_(0),
+   pinnedCount_(0),
+   threadPool_(threadPool ? threadPool : std::make_shared<ThreadPool>()),
    tasksMemCopy_(std::make_shared<TaskSet_CopyMemory>(threadPool_))
 {
 }
 
 CircularBuffer::~CircularBuffer() {}
 
+/**
+* Switches to a different thread pool for copying images. Must not be called
+* while images are being inserted.
+*/
+void CircularBuffer::SetThreadPool(std::shared_ptr<ThreadPool> threadPool)
+{
+   MMThreadGuard insertGuard(g_insertLock);
+   threadPool_ = threadPool;
+   tasksMemCopy_ = std::make_shared<TaskSet_CopyMemory>(threadPool_);
+}
+
 bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int h, unsigned int pixDepth)
 {
    MMThreadGuard guard(g_bufferLock);
@@ -81,10 +116,43 @@ bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int
       if (w == 0 || h==0 || pixDepth == 0 || channels == 0)
          return false; // does not make sense
 
-      if (w == width_ && height_ == h && pixDepth_ == pixDepth && channels == numChannels_)
+      const bool lockFree = mm::features::flags().lockFreeCircularBuffer;
+      const bool variableSize = mm::features::flags().variableSizeCircularBuffer;
+
+      // calculate the size of the entire buffer array once all images get allocated
+      // the actual size at the time of the creation is going to be less, because
+      // images are not allocated until pixels become available
+      unsigned long frameSizeBytes = w * h * pixDepth * channels;
+      unsigned long cbSize = (unsigned long) ((memorySizeMB_ * bytesInMB) / frameSizeBytes);
+
+      // set a reasonable limit to circular buffer capacity 
+      if (cbSize > maxCBSize)
+         cbSize = maxCBSize; 
+
+      if (variableSize && variableSize_ && lockFree == lockFree_ &&
+            cbSize > 0 && !frameArray_.empty())
+      {
+         // Each entry has its own geometry, so the buffered frames stay
+         // valid; only the nominal image size changes.
+         width_ = w;
+         height_ = h;
+         pixDepth_ = pixDepth;
+         numChannels_ = channels;
+         nominalSize_ = (std::min)(cbSize, (unsigned long)frameArray_.size());
+         return true;
+      }
+
+      if (w == width_ && height_ == h && pixDepth_ == pixDepth && channels == numChannels_ && lockFree == lockFree_ && variableSize == variableSize_)
          if (frameArray_.size() > 0)
             return true; // nothing to change
 
+      // The slots' memory may be freed below
+      if (pinnedCount_.load() > 0)
+         return false;
+      CancelWriteSlot();
+
+      lockFree_ = lockFree;
+      variableSize_ = variableSize;
       width_ = w;
       height_ = h;
       pixDepth_ = pixDepth;
@@ -93,65 +161,114 @@ bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int
       insertIndex_ = 0;
       saveIndex_ = 0;
       overflow_ = false;
-
-      // calculate the size of the entire buffer array once all images get allocated
-      // the actual size at the time of the creation is going to be less, because
-      // images are not allocated until pixels become available
-      unsigned long frameSizeBytes = width_ * height_ * pixDepth_ * numChannels_;
-      unsigned long cbSize = (unsigned long) ((memorySizeMB_ * bytesInMB) / frameSizeBytes);
+      arenaHead_ = 0;
 
       if (cbSize == 0) 
       {
          frameArray_.resize(0);
+         slotSequence_.reset();
+         nominalSize_ = 0;
          return false; // memory footprint too small
       }
 
-      // set a reasonable limit to circular buffer capacity 
-      if (cbSize > maxCBSize)
-         cbSize = maxCBSize; 
-
       // TODO: verify if we have enough RAM to satisfy this request
 
       for (unsigned long i=0; i<frameArray_.size(); i++)
          frameArray_[i].Clear();
 
+      // In variable-size mode, the number of entries does not depend on the
+      // image size; their pixels are placed in a single block when inserted.
+      unsigned long numSlots = cbSize;
+      if (variableSize_)
+      {
+         const std::size_t arenaBytes = (std::size_t)(memorySizeMB_ * bytesInMB);
+         if (!memory_)
+            memory_.reset(new mm::BufferMemory(arenaBytes, false));
+         numSlots = (std::max)(cbSize,
+               (unsigned long)(arenaBytes / minVariableSizeSlotBytes));
+         if (numSlots > maxCBSize)
+            numSlots = maxCBSize;
+      }
+
       // allocate buffers  - could conceivably throw an out-of-memory exception
-      frameArray_.resize(cbSize);
+      frameArray_.resize(numSlots);
       for (unsigned long i=0; i<frameArray_.size(); i++)
       {
          frameArray_[i].Resize(w, h, pixDepth);
-         frameArray_[i].Preallocate(numChannels_);
+         if (variableSize_)
+            continue;
+         if (memory_)
+            frameArray_[i].Preallocate(numChannels_,
+                  memory_->GetData() + (std::size_t)i * frameSizeBytes);
+         else
+            frameArray_[i].Preallocate(numChannels_);
       }
+      entryOffsets_.assign(variableSize_ ? numSlots : 0, 0);
+      nominalSize_ = cbSize;
+      firstFillUs_ = -1;
+
+      slotSequence_.reset(new std::atomic<long long>[numSlots]);
+      ResetSlotSequences();
    }
 
    catch( ... /* std::bad_alloc& ex */)
    {
       frameArray_.resize(0);
+      slotSequence_.reset();
+      nominalSize_ = 0;
       ret = false;
    }
    return ret;
 }
 
+/**
+* In lock-free mode, the caller must ensure that no image is being inserted
+* or popped concurrently (typically, Clear() is called before starting a
+* sequence acquisition).
+*/
 void CircularBuffer::Clear() 
 {
+   // Wait for any insertion to finish; a reserved write slot is cancelled
+   MMThreadGuard insertGuard(lockFree_ ? nullptr : &g_insertLock);
+   CancelWriteSlot();
    MMThreadGuard guard(g_bufferLock); 
    insertIndex_=0; 
    saveIndex_=0; 
    overflow_ = false;
+   arenaHead_ = 0;
    startTime_ = std::chrono::steady_clock::now();
    imageNumbers_.clear();
+   firstFillUs_ = -1;
+   ResetSlotSequences();
+}
+
+void CircularBuffer::ResetSlotSequences()
+{
+   if (!slotSequence_)
+      return;
+   for (unsigned long i=0; i<frameArray_.size(); i++)
+      slotSequence_[i].store(-1, std::memory_order_relaxed);
 }
 
+/**
+* Returns the number of images of the size given to Initialize() that the
+* buffer can hold.
+*/
 unsigned long CircularBuffer::GetSize() const
 {
    MMThreadGuard guard(g_bufferLock);
-   return (unsigned long)frameArray_.size();
+   return nominalSize_;
 }
 
+/**
+* In variable-size mode, the result is only an estimate, based on the image
+* size given to Initialize().
+*/
 unsigned long CircularBuffer::GetFreeSize() const
 {
    MMThreadGuard guard(g_bufferLock);
-   long freeSize = (long)frameArray_.size() - (insertIndex_ - saveIndex_);
+   long long freeSize = (long long)nominalSize_ -
+      (insertIndex_.load(std::memory_order_acquire) - saveIndex_.load(std::memory_order_acquire));
    if (freeSize < 0)
       return 0;
    else
@@ -161,16 +278,27 @@ unsigned long CircularBuffer::GetFreeSize() const
 unsigned long CircularBuffer::GetRemainingImageCount() const
 {
    MMThreadGuard guard(g_bufferLock);
-   return (unsigned long)(insertIndex_ - saveIndex_);
+   return (unsigned long)(insertIndex_.load(std::memory_order_acquire) -
+         saveIndex_.load(std::memory_order_acquire));
 }
 
-static std::string FormatLocalTime(std::chrono::time_point<std::chrono::system_clock> tp) {
+/**
+* Formats tp as "yyyy-mm-dd hh:mm:ss.uuuuuu" (local time).
+* The date-time part is cached, so that the calendar conversion is done at
+* most once per second; must only be called by the (single) inserting thread.
+*/
+std::string CircularBuffer::FormatLocalTime(std::chrono::time_point<std::chrono::system_clock> tp) {
    using namespace std::chrono;
    auto us = duration_cast<microseconds>(tp.time_since_epoch());
    auto secs = duration_cast<seconds>(us);
    auto whole = duration_cast<microseconds>(secs);
    auto frac = static_cast<int>((us - whole).count());
 
+   char fracBuf[8];
+   std::snprintf(fracBuf, sizeof(fracBuf), ".%06d", frac);
+   if (secs.count() == cachedTimeSecs_ && !cachedTimePrefix_.empty())
+      return cachedTimePrefix_ + fracBuf;
+
    // As of C++14/17, it is simpler (and probably faster) to use C functions for
    // date-time formatting
 
@@ -187,8 +315,48 @@ static std::string FormatLocalTime(std::chrono::time_point<std::chrono::system_c
    const char *timeFmt = "%Y-%m-%d %H:%M:%S";
    char buf[32];
    std::size_t len = std::strftime(buf, sizeof(buf), timeFmt, ptm);
-   std::snprintf(buf + len, sizeof(buf) - len, ".%06d", frac);
-   return buf;
+   cachedTimePrefix_.assign(buf, len);
+   cachedTimeSecs_ = secs.count();
+   return cachedTimePrefix_ + fracBuf;
+}
+
+/**
+* Adds the tags that the Core attaches to every image in the buffer.
+*/
+void CircularBuffer::AddImageTags(Metadata& md, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents)
+{
+   if (!md.HasTag(MM::g_Keyword_Elapsed_Time_ms))
+   {
+      // if time tag was not supplied by the camera insert current timestamp
+      using namespace std::chrono;
+      auto elapsed = steady_clock::now() - startTime_;
+      md.PutImageTag(MM::g_Keyword_Elapsed_Time_ms,
+         std::to_string(duration_cast<milliseconds>(elapsed).count()));
+   }
+
+   // Note: It is not ideal to use local time. I think this tag is rarely
+   // used. Consider replacing with UTC (micro)seconds-since-epoch (with
+   // different tag key) after addressing current usage.
+   auto now = std::chrono::system_clock::now();
+   md.PutImageTag(MM::g_Keyword_Metadata_TimeInCore, FormatLocalTime(now));
+
+   md.PutImageTag(MM::g_Keyword_Metadata_Width, width);
+   md.PutImageTag(MM::g_Keyword_Metadata_Height, height);
+   if (byteDepth == 1)
+      md.PutImageTag(MM::g_Keyword_PixelType, MM::g_Keyword_PixelType_GRAY8);
+   else if (byteDepth == 2)
+      md.PutImageTag(MM::g_Keyword_PixelType, MM::g_Keyword_PixelType_GRAY16);
+   else if (byteDepth == 4)
+   {
+      if (nComponents == 1)
+         md.PutImageTag(MM::g_Keyword_PixelType, MM::g_Keyword_PixelType_GRAY32);
+      else
+         md.PutImageTag(MM::g_Keyword_PixelType, MM::g_Keyword_PixelType_RGB32);
+   }
+   else if (byteDepth == 8)
+      md.PutImageTag(MM::g_Keyword_PixelType, MM::g_Keyword_PixelType_RGB64);
+   else
+      md.PutImageTag(MM::g_Keyword_PixelType, MM::g_Keyword_PixelType_Unknown);
 }
 
 /**
@@ -220,20 +388,20 @@ bool CircularBuffer::InsertImage(const unsigned char* pixArray, unsigned int wid
 */
 bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd) throw (CMMError)
 {
-    MMThreadGuard insertGuard(g_insertLock);
+    if (lockFree_)
+       return InsertMultiChannelLockFree(pixArray, numChannels, width, height, byteDepth, nComponents, pMd);
+
+    InsertionGuard insertGuard(*this, 0);
  
     mm::ImgBuffer* pImg;
+    mm::FrameBuffer* pFrame;
     unsigned long singleChannelSize = (unsigned long)width * height * byteDepth;
  
     {
        MMThreadGuard guard(g_bufferLock);
  
-       // check image dimensions
-       if (width != width_ || height != height_ || byteDepth != pixDepth_)
-          throw CMMError("Incompatible image dimensions in the circular buffer", MMERR_CircularBufferIncompatibleImage);
- 
-       bool overflowed = (insertIndex_ - saveIndex_) >= static_cast<long>(frameArray_.size());
-       if (overflowed) {
+       pFrame = ReserveSlot(insertIndex_, saveIndex_, numChannels, width, height, byteDepth);
+       if (!pFrame) {
           overflow_ = true;
           return false;
        }
@@ -245,7 +413,7 @@ bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned
        {
           MMThreadGuard guard(g_bufferLock);
           // we assume that all buffers are pre-allocated
-          pImg = frameArray_[insertIndex_ % frameArray_.size()].FindImage(i);
+          pImg = pFrame->FindImage(i);
           if (!pImg)
              return false;
  
@@ -267,38 +435,7 @@ bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned
          ++imageNumbers_[cameraName];
       }
 
-      if (!md.HasTag(MM::g_Keyword_Elapsed_Time_ms))
-      {
-         // if time tag was not supplied by the camera insert current timestamp
-         using namespace std::chrono;
-         auto elapsed = steady_clock::now() - startTime_;
-         md.PutImageTag(MM::g_Keyword_Elapsed_Time_ms,
-            std::to_string(duration_cast<milliseconds>(elapsed).count()));
-      }
-
-      // Note: It is not ideal to use local time. I think this tag is rarely
-      // used. Consider replacing with UTC (micro)seconds-since-epoch (with
-      // different tag key) after addressing current usage.
-      auto now = std::chrono::system_clock::now();
-      md.PutImageTag(MM::g_Keyword_Metadata_TimeInCore, FormatLocalTime(now));
-
-      md.PutImageTag(MM::g_Keyword_Metadata_Width, width);
-      md.PutImageTag(MM::g_Keyword_Metadata_Height, height);
-      if (byteDepth == 1)
-         md.PutImageTag(MM::g_Keyword_PixelType, MM::g_Keyword_PixelType_GRAY8);
-      else if (byteDepth == 2)
-         md.PutImageTag(MM::g_Keyword_PixelType, MM::g_Keyword_PixelType_GRAY16);
-      else if (byteDepth == 4)
-      {
-         if (nComponents == 1)
-            md.PutImageTag(MM::g_Keyword_PixelType, MM::g_Keyword_PixelType_GRAY32);
-         else
-            md.PutImageTag(MM::g_Keyword_PixelType, MM::g_Keyword_PixelType_RGB32);
-      }
-      else if (byteDepth == 8)
-         md.PutImageTag(MM::g_Keyword_PixelType, MM::g_Keyword_PixelType_RGB64);
-      else
-         md.PutImageTag(MM::g_Keyword_PixelType, MM::g_Keyword_PixelType_Unknown);
+      AddImageTags(md, width, height, byteDepth, nComponents);
 
       pImg->SetMetadata(md);
       //pImg->SetPixels(pixArray + i * singleChannelSize);
@@ -310,22 +447,392 @@ bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned
             pixArray + i * singleChannelSize, singleChannelSize);
    }
 
+   PublishInsertedFrame();
+   return true;
+}
+
+/**
+* Makes the frame just written at the insert index visible to readers.
+*/
+void CircularBuffer::PublishInsertedFrame()
+{
+   RecordFillTime(insertIndex_.load(std::memory_order_relaxed));
+
+   if (lockFree_)
    {
-      MMThreadGuard guard(g_bufferLock);
+      // Publish the slot content before the new insert index
+      const long long insertIndex = insertIndex_.load(std::memory_order_relaxed);
+      ++imageCounter_;
+      slotSequence_[insertIndex % frameArray_.size()].store(insertIndex, std::memory_order_release);
+      insertIndex_.store(insertIndex + 1, std::memory_order_release);
+      return;
+   }
 
-      imageCounter_++;
-      insertIndex_++;
-      if ((insertIndex_ - (long)frameArray_.size()) > adjustThreshold && (saveIndex_- (long)frameArray_.size()) > adjustThreshold)
+   MMThreadGuard guard(g_bufferLock);
+
+   imageCounter_++;
+   insertIndex_++;
+   if ((insertIndex_ - (long long)frameArray_.size()) > adjustThreshold && (saveIndex_- (long long)frameArray_.size()) > adjustThreshold)
+   {
+      // adjust buffer indices to avoid overflowing integer size
+      insertIndex_ -= adjustThreshold;
+      saveIndex_ -= adjustThreshold;
+   }
+}
+
+/**
+* Records the time taken to fill every slot once since the buffer was last
+* initialized or cleared, given the index of the frame being inserted.
+*/
+void CircularBuffer::RecordFillTime(long long insertIndex)
+{
+   if (variableSize_)
+      return; // The number of entries that fill the buffer varies
+   if (insertIndex == 0)
+      fillStartTime_ = std::chrono::steady_clock::now();
+   if (insertIndex == static_cast<long long>(frameArray_.size()) - 1)
+   {
+      using namespace std::chrono;
+      firstFillUs_.store(duration_cast<microseconds>(
+               steady_clock::now() - fillStartTime_).count());
+   }
+}
+
+/**
+* Allocates the whole memory footprint of the buffer as a single block, so
+* that (re)initialization does not allocate pixel memory. The memory is
+* bound to the NUMA node of the calling thread if bindToCurrentNumaNode is
+* set, and made resident before this function returns.
+*
+* Throws std::bad_alloc on failure.
+*/
+void CircularBuffer::AllocateContiguousMemory(bool bindToCurrentNumaNode)
+{
+   MMThreadGuard guard(g_bufferLock);
+
+   // Images must not refer to the old block
+   for (unsigned long i=0; i<frameArray_.size(); i++)
+      frameArray_[i].Clear();
+   frameArray_.clear();
+   slotSequence_.reset();
+   memory_.reset();
+
+   memory_.reset(new mm::BufferMemory(
+            static_cast<std::size_t>(memorySizeMB_ * bytesInMB),
+            bindToCurrentNumaNode));
+   memory_->Prefault();
+}
+
+const mm::BufferMemory* CircularBuffer::GetContiguousMemory() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return memory_.get();
+}
+
+/**
+* Returns the time, in microseconds, between the insertion of the first and
+* the last frame that filled all slots, or -1 if the buffer has not been
+* filled since it was last initialized or cleared.
+*/
+long long CircularBuffer::GetFirstFillMicroseconds() const
+{
+   return firstFillUs_.load();
+}
+
+/**
+* Lock-free variant of InsertMultiChannel(). Must only ever be called from a
+* single thread at a time (normally the camera's sequence thread).
+*/
+bool CircularBuffer::InsertMultiChannelLockFree(const unsigned char* pixArray, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd) throw (CMMError)
+{
+   // We are the only writer of insertIndex_; saveIndex_ is written by the
+   // consumer, and acquiring it ensures the consumer is done with the slot we
+   // are about to overwrite.
+   const long long insertIndex = insertIndex_.load(std::memory_order_relaxed);
+   const long long saveIndex = saveIndex_.load(std::memory_order_acquire);
+   mm::FrameBuffer* pFrame = ReserveSlot(insertIndex, saveIndex, numChannels, width, height, byteDepth);
+   if (!pFrame)
+   {
+      overflow_.store(true, std::memory_order_relaxed);
+      return false;
+   }
+
+   unsigned long singleChannelSize = (unsigned long)width * height * byteDepth;
+
+   for (unsigned i=0; i<numChannels; i++)
+   {
+      mm::ImgBuffer* pImg = pFrame->FindImage(i);
+      if (!pImg)
+         return false;
+
+      Metadata md;
+      if (pMd)
+         md = *pMd;
+      md.put(MM::g_Keyword_Metadata_ImageNumber, CDeviceUtils::ConvertToString(NextImageNumber(md)));
+      AddImageTags(md, width, height, byteDepth, nComponents);
+
+      pImg->SetMetadata(md);
+      tasksMemCopy_->MemCopy((void*)pImg->GetPixels(),
+            pixArray + i * singleChannelSize, singleChannelSize);
+   }
+
+   PublishInsertedFrame();
+   return true;
+}
+
+/**
+* Returns the slot for the frame with the given insert index, prepared for
+* an image of the given geometry, or null if the buffer is full. Throws if
+* the image cannot be stored in this buffer.
+*
+* In variable-size mode, the frame's pixels are placed in the memory block
+* after those of the previously inserted frame, wrapping around to the start
+* of the block when there is no room at the end.
+*
+* Must only be called by the inserting thread, with g_bufferLock held in the
+* default mode.
+*/
+mm::FrameBuffer* CircularBuffer::ReserveSlot(long long insertIndex, long long saveIndex, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth) throw (CMMError)
+{
+   if (!variableSize_ && (width != width_ || height != height_ || byteDepth != pixDepth_))
+      throw CMMError("Incompatible image dimensions in the circular buffer", MMERR_CircularBufferIncompatibleImage);
+
+   if (insertIndex - saveIndex >= static_cast<long long>(frameArray_.size()))
+      return 0;
+
+   mm::FrameBuffer& frame = frameArray_[insertIndex % frameArray_.size()];
+   if (!variableSize_)
+   {
+      if (IsFramePinned(frame, numChannels, (std::size_t)width * height * byteDepth))
+         return 0;
+      return &frame;
+   }
+
+   const std::size_t bytes = (std::size_t)width * height * byteDepth * numChannels;
+   const std::size_t arenaSize = memory_->GetSize();
+   if (bytes == 0 || bytes > arenaSize)
+      throw CMMError("Image does not fit in the circular buffer", MMERR_CircularBufferIncompatibleImage);
+
+   // Free space is between the end of the newest frame (arenaHead_) and the
+   // start of the oldest frame that has not been popped (tail). When all
+   // frames have been popped, we still continue after the newest frame so
+   // that the most recently popped images stay intact as long as possible.
+   std::size_t offset = 0;
+   if (insertIndex == saveIndex)
+   {
+      if (arenaHead_ + bytes <= arenaSize)
+         offset = arenaHead_;
+   }
+   else
+   {
+      const std::size_t tail = entryOffsets_[saveIndex % frameArray_.size()];
+      if (arenaHead_ > tail)
       {
-         // adjust buffer indices to avoid overflowing integer size
-         insertIndex_ -= adjustThreshold;
-         saveIndex_ -= adjustThreshold;
+         if (arenaHead_ + bytes <= arenaSize)
+            offset = arenaHead_;
+         else if (bytes > tail)
+            return 0;
       }
+      else if (arenaHead_ + bytes <= tail)
+         offset = arenaHead_;
+      else
+         return 0; // Includes arenaHead_ == tail, meaning full
+   }
+   if (IsPinned(memory_->GetData() + offset, bytes))
+      return 0;
+
+   entryOffsets_[insertIndex % frameArray_.size()] = offset;
+   arenaHead_ = offset + bytes;
+   frame.UseExternalPixels(numChannels, width, height, byteDepth,
+         memory_->GetData() + offset);
+   return &frame;
+}
+
+/**
+* Returns the next image number for the camera named in md, and increments it.
+* In the default mode, must be called with g_bufferLock held.
+*/
+long CircularBuffer::NextImageNumber(Metadata& md)
+{
+   std::string cameraName;
+   if (md.HasTag(MM::g_Keyword_Metadata_CameraLabel))
+      cameraName = md.GetSingleTag(MM::g_Keyword_Metadata_CameraLabel).GetValue();
+   return imageNumbers_[cameraName]++;
+}
+
+CircularBuffer::InsertionGuard::InsertionGuard(CircularBuffer& cb, const void* owner) :
+   cb_(cb)
+{
+   if (cb_.lockFree_)
+      return;
+   for (;;)
+   {
+      cb_.g_insertLock.Lock();
+      std::unique_lock<std::mutex> lock(cb_.writeSlotMutex_);
+      if (!cb_.writeSlotPending_ || (owner && cb_.writeSlotOwner_ == owner))
+         return;
+      // Let the reserving producer commit or abandon its slot
+      cb_.g_insertLock.Unlock();
+      cb_.writeSlotReleased_.wait(lock, [&] {
+         return !cb_.writeSlotPending_ || (owner && cb_.writeSlotOwner_ == owner);
+      });
+   }
+}
+
+CircularBuffer::InsertionGuard::~InsertionGuard()
+{
+   if (!cb_.lockFree_)
+      cb_.g_insertLock.Unlock();
+}
+
+/**
+* Reserves the slot that the next frame will occupy and returns a pointer to
+* its pixels, so that the frame can be written in place instead of being
+* copied by InsertImage(). Returns null if the buffer is full.
+*
+* The frame becomes visible to readers when CommitWriteSlot() is called with
+* the same owner (any non-null value identifying the producer, such as the
+* camera). Only single-channel frames are supported. Calling this again while
+* the owner's slot is pending returns the same slot.
+*
+* Only one slot can be reserved at a time: in the default mode, other
+* producers' insertions wait until the slot is committed or abandoned, or the
+* buffer is cleared (which cancels the reservation). No lock is held between
+* the calls.
+*/
+unsigned char* CircularBuffer::AcquireWriteSlot(const void* owner, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents) throw (CMMError)
+{
+   InsertionGuard insertGuard(*this, owner);
+   {
+      std::lock_guard<std::mutex> lock(writeSlotMutex_);
+      if (writeSlotPending_)
+         return const_cast<unsigned char*>(writeSlotImage_->GetPixels());
+   }
+
+   MMThreadGuard guard(lockFree_ ? nullptr : &g_bufferLock);
+
+   const std::size_t prevArenaHead = arenaHead_;
+   mm::FrameBuffer* pFrame = ReserveSlot(insertIndex_.load(std::memory_order_relaxed),
+         saveIndex_.load(std::memory_order_acquire), 1, width, height, byteDepth);
+   mm::ImgBuffer* pImg = pFrame ? pFrame->FindImage(0) : 0;
+   if (!pImg)
+   {
+      if (!pFrame)
+         overflow_ = true;
+      return 0;
    }
 
+   std::lock_guard<std::mutex> lock(writeSlotMutex_);
+   writeSlotPending_ = true;
+   writeSlotOwner_ = owner;
+   writeSlotImage_ = pImg;
+   writeSlotComponents_ = nComponents;
+   writeSlotPrevArenaHead_ = prevArenaHead;
+   return const_cast<unsigned char*>(pImg->GetPixels());
+}
+
+/**
+* Returns the pixels of the slot reserved by AcquireWriteSlot() for owner, or
+* null if there is none.
+*/
+unsigned char* CircularBuffer::GetPendingWriteSlot(const void* owner) const
+{
+   const mm::ImgBuffer* pImg = GetPendingWriteSlotImage(owner);
+   return pImg ? const_cast<unsigned char*>(pImg->GetPixels()) : 0;
+}
+
+/**
+* Returns the image (giving the geometry) of the slot reserved by
+* AcquireWriteSlot() for owner, or null if there is none.
+*/
+const mm::ImgBuffer* CircularBuffer::GetPendingWriteSlotImage(const void* owner) const
+{
+   std::lock_guard<std::mutex> lock(writeSlotMutex_);
+   if (!writeSlotPending_ || writeSlotOwner_ != owner)
+      return 0;
+   return writeSlotImage_;
+}
+
+/**
+* Publishes the frame written into the slot reserved by AcquireWriteSlot() for
+* owner. Returns false if owner has no pending slot (e.g., because the buffer
+* was cleared in the meantime).
+*/
+bool CircularBuffer::CommitWriteSlot(const void* owner, const Metadata* pMd)
+{
+   // Checked first so that other producers do not wait for the slot
+   if (!GetPendingWriteSlotImage(owner))
+      return false;
+   InsertionGuard insertGuard(*this, owner);
+   mm::ImgBuffer* pImg;
+   unsigned int nComponents;
+   {
+      std::lock_guard<std::mutex> lock(writeSlotMutex_);
+      if (!writeSlotPending_ || writeSlotOwner_ != owner)
+         return false;
+      pImg = writeSlotImage_;
+      nComponents = writeSlotComponents_;
+   }
+
+   Metadata md;
+   if (pMd)
+      md = *pMd;
+   {
+      MMThreadGuard guard(lockFree_ ? nullptr : &g_bufferLock);
+      md.put(MM::g_Keyword_Metadata_ImageNumber, CDeviceUtils::ConvertToString(NextImageNumber(md)));
+   }
+   AddImageTags(md, pImg->Width(), pImg->Height(), pImg->Depth(), nComponents);
+   pImg->SetMetadata(md);
+
+   PublishInsertedFrame();
+
+   {
+      std::lock_guard<std::mutex> lock(writeSlotMutex_);
+      writeSlotPending_ = false;
+      writeSlotOwner_ = 0;
+      writeSlotImage_ = 0;
+   }
+   writeSlotReleased_.notify_all();
    return true;
 }
- 
+
+/**
+* Gives back the slot reserved by AcquireWriteSlot() for owner without
+* inserting a frame. Does nothing if owner has no pending slot.
+*/
+void CircularBuffer::AbandonWriteSlot(const void* owner)
+{
+   if (!GetPendingWriteSlotImage(owner))
+      return;
+   InsertionGuard insertGuard(*this, owner);
+   {
+      std::lock_guard<std::mutex> lock(writeSlotMutex_);
+      if (!writeSlotPending_ || writeSlotOwner_ != owner)
+         return;
+   }
+   {
+      MMThreadGuard guard(lockFree_ ? nullptr : &g_bufferLock);
+      arenaHead_ = writeSlotPrevArenaHead_;
+   }
+   CancelWriteSlot();
+}
+
+/**
+* Ends the current reservation, if any, without inserting a frame. In the
+* default mode, must be called with g_insertLock held.
+*/
+void CircularBuffer::CancelWriteSlot()
+{
+   {
+      std::lock_guard<std::mutex> lock(writeSlotMutex_);
+      if (!writeSlotPending_)
+         return;
+      writeSlotPending_ = false;
+      writeSlotOwner_ = 0;
+      writeSlotImage_ = 0;
+   }
+   writeSlotReleased_.notify_all();
+}
 
 const unsigned char* CircularBuffer::GetTopImage() const
 {
@@ -348,13 +855,16 @@ const mm::ImgBuffer* CircularBuffer::GetNthFromTopImageBuffer(unsigned long n) c
 const mm::ImgBuffer* CircularBuffer::GetNthFromTopImageBuffer(long n,
       unsigned channel) const
 {
+   if (lockFree_)
+      return GetNthFromTopImageBufferLockFree(n, channel);
+
    MMThreadGuard guard(g_bufferLock);
 
-   long availableImages = insertIndex_ - saveIndex_;
+   long long availableImages = insertIndex_ - saveIndex_;
    if (n + 1 > availableImages)
       return 0;
 
-   long targetIndex = insertIndex_ - n - 1L;
+   long long targetIndex = insertIndex_ - n - 1L;
    while (targetIndex < 0)
       targetIndex += (long) frameArray_.size();
    targetIndex %= frameArray_.size();
@@ -362,6 +872,25 @@ const mm::ImgBuffer* CircularBuffer::GetNthFromTopImageBuffer(long n,
    return frameArray_[targetIndex].FindImage(channel);
 }
 
+const mm::ImgBuffer* CircularBuffer::GetNthFromTopImageBufferLockFree(long n,
+      unsigned channel) const
+{
+   const long long insertIndex = insertIndex_.load(std::memory_order_acquire);
+   const long long saveIndex = saveIndex_.load(std::memory_order_acquire);
+   if (n + 1 > insertIndex - saveIndex)
+      return 0;
+
+   const long long targetIndex = insertIndex - n - 1L;
+   const unsigned long slot = (unsigned long)(targetIndex % frameArray_.size());
+
+   // The slot may have been popped and overwritten since we read the indices
+   // (only possible if the consumer is far ahead of us); do not return it then.
+   if (slotSequence_[slot].load(std::memory_order_acquire) != targetIndex)
+      return 0;
+
+   return frameArray_[slot].FindImage(channel);
+}
+
 const unsigned char* CircularBuffer::GetNextImage()
 {
    const mm::ImgBuffer* img = GetNextImageBuffer(0);
@@ -372,13 +901,251 @@ const unsigned char* CircularBuffer::GetNextImage()
 
 const mm::ImgBuffer* CircularBuffer::GetNextImageBuffer(unsigned channel)
 {
+   if (lockFree_)
+      return GetNextImageBufferLockFree(channel);
+
    MMThreadGuard guard(g_bufferLock);
 
-   long availableImages = insertIndex_ - saveIndex_;
+   long long availableImages = insertIndex_ - saveIndex_;
    if (availableImages < 1)
       return 0;
 
-   long targetIndex = saveIndex_ % frameArray_.size();
+   long long targetIndex = saveIndex_ % frameArray_.size();
    ++saveIndex_;
    return frameArray_[targetIndex].FindImage(channel);
 }
+
+/**
+* Lock-free variant of GetNextImageBuffer(). Must only ever be called from a
+* single thread at a time.
+*/
+const mm::ImgBuffer* CircularBuffer::GetNextImageBufferLockFree(unsigned channel)
+{
+   // We are the only writer of saveIndex_; acquiring insertIndex_ makes the
+   // content of all slots below it visible.
+   const long long saveIndex = saveIndex_.load(std::memory_order_relaxed);
+   const long long insertIndex = insertIndex_.load(std::memory_order_acquire);
+   if (insertIndex - saveIndex < 1)
+      return 0;
+
+   const unsigned long slot = (unsigned long)(saveIndex % frameArray_.size());
+   saveIndex_.store(saveIndex + 1, std::memory_order_release);
+   return frameArray_[slot].FindImage(channel);
+}
+
+/**
+* Copies up to maxCount of the oldest images (pixels and metadata) into batch,
+* replacing its previous contents, and removes them from the buffer. Returns
+* the number of images copied.
+*
+* The images are only removed after they have been copied, so the camera
+* cannot overwrite them in the meantime; the buffer lock is not held while
+* copying. This requires that no other thread pops images at the same time.
+*/
+unsigned long CircularBuffer::PopNextImages(unsigned long maxCount, unsigned channel, ImageBatch& batch)
+{
+   batch.clear();
+
+   std::vector<const mm::ImgBuffer*> images;
+   long long saveIndex;
+   {
+      MMThreadGuard guard(lockFree_ ? nullptr : &g_bufferLock);
+      saveIndex = saveIndex_.load(std::memory_order_relaxed);
+      const long long available = insertIndex_.load(std::memory_order_acquire) - saveIndex;
+      const long long count = (std::min)(available, (long long)maxCount);
+      images.reserve(count > 0 ? (std::size_t)count : 0);
+      for (long long i = 0; i < count; ++i)
+         images.push_back(frameArray_[(saveIndex + i) % frameArray_.size()].FindImage(channel));
+   }
+   if (images.empty())
+      return 0;
+
+   std::size_t totalBytes = 0;
+   for (std::size_t i = 0; i < images.size(); ++i)
+   {
+      if (images[i])
+         totalBytes += (std::size_t)images[i]->Width() * images[i]->Height() * images[i]->Depth();
+   }
+   batch.reservePixels(totalBytes);
+
+   for (std::size_t i = 0; i < images.size(); ++i)
+   {
+      const mm::ImgBuffer* img = images[i];
+      if (!img)
+         continue; // Channel not present in this frame
+
+      // The number of components is not stored with the image, but is
+      // implied by the pixel type tag added on insertion
+      unsigned nComponents = 1;
+      const Metadata& md = img->GetMetadata();
+      if (md.HasTag(MM::g_Keyword_PixelType))
+      {
+         const std::string pixelType = md.GetSingleTag(MM::g_Keyword_PixelType).GetValue();
+         if (pixelType == MM::g_Keyword_PixelType_RGB32 || pixelType == MM::g_Keyword_PixelType_RGB64)
+            nComponents = 4;
+      }
+
+      unsigned char* dest = batch.append(img->Width(), img->Height(), img->Depth(), nComponents, md);
+      std::memcpy(dest, img->GetPixels(), (std::size_t)img->Width() * img->Height() * img->Depth());
+   }
+
+   {
+      MMThreadGuard guard(lockFree_ ? nullptr : &g_bufferLock);
+      // Unless the buffer was cleared while we were copying
+      if (saveIndex_.load(std::memory_order_relaxed) == saveIndex)
+         saveIndex_.store(saveIndex + (long long)images.size(), std::memory_order_release);
+   }
+   return (unsigned long)images.size();
+}
+
+/**
+* Like GetNthFromTopImageBuffer(), but also pins the image: it will not be
+* overwritten (new frames are refused as if the buffer were full) until
+* ReleasePinnedImage() is called with its pixels. An image may be pinned more
+* than once, and must then be released as many times.
+*/
+const mm::ImgBuffer* CircularBuffer::PinNthFromTopImageBuffer(long n, unsigned channel)
+{
+   if (!lockFree_)
+   {
+      MMThreadGuard guard(g_bufferLock);
+      const mm::ImgBuffer* pImg = GetNthFromTopImageBuffer(n, channel);
+      if (pImg)
+         PinImage(pImg);
+      return pImg;
+   }
+
+   // The image is not popped (so cannot be overwritten) when we find it, but
+   // may be popped and overwritten before our pin becomes visible to the
+   // inserting thread. Check that it is still not popped after pinning, and
+   // look again if it is.
+   for (int attempt = 0; attempt < 3; ++attempt)
+   {
+      const long long insertIndex = insertIndex_.load(std::memory_order_acquire);
+      const long long saveIndex = saveIndex_.load(std::memory_order_acquire);
+      if (n + 1 > insertIndex - saveIndex)
+         return 0;
+
+      const long long targetIndex = insertIndex - n - 1L;
+      const unsigned long slot = (unsigned long)(targetIndex % frameArray_.size());
+      if (slotSequence_[slot].load(std::memory_order_acquire) != targetIndex)
+         return 0;
+      const mm::ImgBuffer* pImg = frameArray_[slot].FindImage(channel);
+      if (!pImg)
+         return 0;
+
+      PinImage(pImg);
+      if (saveIndex_.load() <= targetIndex)
+         return pImg;
+      ReleasePinnedImage(pImg->GetPixels());
+   }
+   return 0;
+}
+
+/**
+* Like GetNextImageBuffer(), but also pins the image (see
+* PinNthFromTopImageBuffer()).
+*/
+const mm::ImgBuffer* CircularBuffer::PinNextImageBuffer(unsigned channel)
+{
+   MMThreadGuard guard(lockFree_ ? nullptr : &g_bufferLock);
+
+   const long long saveIndex = saveIndex_.load(std::memory_order_relaxed);
+   const long long insertIndex = insertIndex_.load(std::memory_order_acquire);
+   if (insertIndex - saveIndex < 1)
+      return 0;
+
+   // Pin before popping, so that the inserting thread sees the pin whenever
+   // it sees the slot as free
+   const mm::ImgBuffer* pImg = frameArray_[saveIndex % frameArray_.size()].FindImage(channel);
+   if (pImg)
+      PinImage(pImg);
+   saveIndex_.store(saveIndex + 1, std::memory_order_release);
+   return pImg;
+}
+
+/**
+* Releases one pin of the image with the given pixels. Returns false if the
+* image was not pinned.
+*/
+bool CircularBuffer::ReleasePinnedImage(const unsigned char* pixels)
+{
+   MMThreadGuard guard(pinLock_);
+   std::map<const unsigned char*, PinnedImage>::iterator it = pinnedImages_.find(pixels);
+   if (it == pinnedImages_.end())
+      return false;
+   if (--it->second.count == 0)
+   {
+      pinnedImages_.erase(it);
+      pinnedCount_.fetch_sub(1);
+   }
+   return true;
+}
+
+/**
+* Returns the size in bytes of the pinned image with the given pixels, or 0 if
+* the image is not pinned.
+*/
+std::size_t CircularBuffer::GetPinnedImageBytes(const unsigned char* pixels) const
+{
+   MMThreadGuard guard(pinLock_);
+   std::map<const unsigned char*, PinnedImage>::const_iterator it = pinnedImages_.find(pixels);
+   return it == pinnedImages_.end() ? 0 : it->second.bytes;
+}
+
+/**
+* Returns the number of distinct images currently pinned.
+*/
+unsigned long CircularBuffer::GetPinnedImageCount() const
+{
+   return pinnedCount_.load();
+}
+
+void CircularBuffer::PinImage(const mm::ImgBuffer* pImg)
+{
+   MMThreadGuard guard(pinLock_);
+   PinnedImage& pin = pinnedImages_[pImg->GetPixels()];
+   if (pin.count++ == 0)
+   {
+      pin.bytes = (std::size_t)pImg->Width() * pImg->Height() * pImg->Depth();
+      // Sequentially consistent, paired with the fence in IsPinned()
+      pinnedCount_.fetch_add(1);
+   }
+}
+
+/**
+* Returns true if any pinned image overlaps the given memory. Must only be
+* called by the inserting thread, after loading saveIndex_.
+*/
+bool CircularBuffer::IsPinned(const unsigned char* pixels, std::size_t bytes) const
+{
+   // Either we see a pin made before the pinning thread checked saveIndex_,
+   // or that thread sees the frame as popped and does not use the image.
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   if (pinnedCount_.load(std::memory_order_relaxed) == 0)
+      return false;
+
+   MMThreadGuard guard(pinLock_);
+   // The first pinned image ending after the start of the range
+   std::map<const unsigned char*, PinnedImage>::const_iterator it =
+      pinnedImages_.lower_bound(pixels);
+   if (it != pinnedImages_.begin())
+   {
+      std::map<const unsigned char*, PinnedImage>::const_iterator prev = it;
+      --prev;
+      if (prev->first + prev->second.bytes > pixels)
+         return true;
+   }
+   return it != pinnedImages_.end() && it->first < pixels + bytes;
+}
+
+bool CircularBuffer::IsFramePinned(const mm::FrameBuffer& frame, unsigned int numChannels, std::size_t channelBytes) const
+{
+   for (unsigned i = 0; i < numChannels; ++i)
+   {
+      const mm::ImgBuffer* pImg = frame.FindImage(i);
+      if (pImg && IsPinned(pImg->GetPixels(), channelBytes))
+         return true;
+   }
+   return false;
+}
@@ -31,8 +31,14 @@
 #include "../MMDevice/DeviceThreads.h"
 #include "../MMDevice/MMDevice.h"
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
 
 #ifdef _MSC_VER
@@ -46,13 +52,20 @@
 #pragma GCC diagnostic ignored "-Wdeprecated"
 #endif
 
+class ImageBatch;
 class ThreadPool;
 class TaskSet_CopyMemory;
 
+namespace mm {
+class BufferMemory;
+}
+
 class CircularBuffer
 {
 public:
-   CircularBuffer(unsigned int memorySizeMB);
+   // A thread pool is created if none is given
+   CircularBuffer(unsigned int memorySizeMB,
+         std::shared_ptr<ThreadPool> threadPool = std::shared_ptr<ThreadPool>());
    ~CircularBuffer();
 
    unsigned GetMemorySizeMB() const { return memorySizeMB_; }
@@ -70,37 +83,135 @@ public:
    bool InsertMultiChannel(const unsigned char* pixArray, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth, const Metadata* pMd) throw (CMMError);
    bool InsertImage(const unsigned char* pixArray, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd) throw (CMMError);
    bool InsertMultiChannel(const unsigned char* pixArray, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd) throw (CMMError);
+   unsigned char* AcquireWriteSlot(const void* owner, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents) throw (CMMError);
+   unsigned char* GetPendingWriteSlot(const void* owner) const;
+   const mm::ImgBuffer* GetPendingWriteSlotImage(const void* owner) const;
+   bool CommitWriteSlot(const void* owner, const Metadata* pMd);
+   void AbandonWriteSlot(const void* owner);
    const unsigned char* GetTopImage() const;
    const unsigned char* GetNextImage();
    const mm::ImgBuffer* GetTopImageBuffer(unsigned channel) const;
    const mm::ImgBuffer* GetNthFromTopImageBuffer(unsigned long n) const;
    const mm::ImgBuffer* GetNthFromTopImageBuffer(long n, unsigned channel) const;
    const mm::ImgBuffer* GetNextImageBuffer(unsigned channel);
+   unsigned long PopNextImages(unsigned long maxCount, unsigned channel, ImageBatch& batch);
+   const mm::ImgBuffer* PinNthFromTopImageBuffer(long n, unsigned channel);
+   const mm::ImgBuffer* PinNextImageBuffer(unsigned channel);
+   bool ReleasePinnedImage(const unsigned char* pixels);
+   std::size_t GetPinnedImageBytes(const unsigned char* pixels) const;
+   unsigned long GetPinnedImageCount() const;
    void Clear(); 
 
+   void SetThreadPool(std::shared_ptr<ThreadPool> threadPool);
+
+   void AllocateContiguousMemory(bool bindToCurrentNumaNode);
+   const mm::BufferMemory* GetContiguousMemory() const;
+   long long GetFirstFillMicroseconds() const;
+
    bool Overflow() {MMThreadGuard guard(g_bufferLock); return overflow_;}
+   bool IsLockFree() const {MMThreadGuard guard(g_bufferLock); return lockFree_;}
+   bool IsVariableSize() const {MMThreadGuard guard(g_bufferLock); return variableSize_;}
 
    mutable MMThreadLock g_bufferLock;
    mutable MMThreadLock g_insertLock;
 
 private:
+   // In the default mode, holds g_insertLock, acquired once no write slot is
+   // reserved by a producer other than owner (null: by any producer)
+   class InsertionGuard
+   {
+   public:
+      InsertionGuard(CircularBuffer& cb, const void* owner);
+      ~InsertionGuard();
+   private:
+      InsertionGuard(const InsertionGuard&);
+      InsertionGuard& operator=(const InsertionGuard&);
+      CircularBuffer& cb_;
+   };
+
+   void CancelWriteSlot();
+   bool InsertMultiChannelLockFree(const unsigned char* pixArray, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd) throw (CMMError);
+   const mm::ImgBuffer* GetNthFromTopImageBufferLockFree(long n, unsigned channel) const;
+   const mm::ImgBuffer* GetNextImageBufferLockFree(unsigned channel);
+   mm::FrameBuffer* ReserveSlot(long long insertIndex, long long saveIndex, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth) throw (CMMError);
+   void PublishInsertedFrame();
+   void RecordFillTime(long long insertIndex);
+   long NextImageNumber(Metadata& md);
+   void AddImageTags(Metadata& md, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents);
+   std::string FormatLocalTime(std::chrono::time_point<std::chrono::system_clock> tp);
+   void ResetSlotSequences();
+   void PinImage(const mm::ImgBuffer* pImg);
+   bool IsPinned(const unsigned char* pixels, std::size_t bytes) const;
+   bool IsFramePinned(const mm::FrameBuffer& frame, unsigned int numChannels, std::size_t channelBytes) const;
+
    unsigned int width_;
    unsigned int height_;
    unsigned int pixDepth_;
    long imageCounter_;
    std::chrono::time_point<std::chrono::steady_clock> startTime_;
+   long long cachedTimeSecs_;
+   std::string cachedTimePrefix_;
+   // Only accessed by the inserting thread
+   std::chrono::time_point<std::chrono::steady_clock> fillStartTime_;
+   std::atomic<long long> firstFillUs_;
    std::map<std::string, long> imageNumbers_;
 
    // Invariants:
    // 0 <= saveIndex_ <= insertIndex_
    // insertIndex_ - saveIndex_ <= frameArray_.size()
-   long insertIndex_;
-   long saveIndex_;
+   //
+   // In the default mode, the indices are only accessed with g_bufferLock
+   // held. In lock-free mode (single producer, single consumer), only the
+   // inserting thread writes insertIndex_ and only the popping thread writes
+   // saveIndex_; each reads the other's index with acquire ordering.
+   std::atomic<long long> insertIndex_;
+   std::atomic<long long> saveIndex_;
 
    unsigned long memorySizeMB_;
    unsigned int numChannels_;
-   bool overflow_;
+   std::atomic<bool> overflow_;
+   bool lockFree_;
+   bool variableSize_;
+   // Capacity in images of the size given to Initialize()
+   unsigned long nominalSize_;
    std::vector<mm::FrameBuffer> frameArray_;
+   // If set, holds the pixels of all frames (see AllocateContiguousMemory()).
+   // Always set in variable-size mode.
+   std::unique_ptr<mm::BufferMemory> memory_;
+
+   // Variable-size mode only: offset in memory_ of each slot's pixels, and
+   // the end of the newest frame's pixels. Only accessed by the inserting
+   // thread (with g_bufferLock held in the default mode).
+   std::vector<std::size_t> entryOffsets_;
+   std::size_t arenaHead_;
+
+   // Zero-copy insertion state (see AcquireWriteSlot()). The reservation is
+   // guarded by writeSlotMutex_, and only changed with g_insertLock held in
+   // the default mode; writeSlotReleased_ is notified when it ends.
+   mutable std::mutex writeSlotMutex_;
+   std::condition_variable writeSlotReleased_;
+   bool writeSlotPending_;
+   const void* writeSlotOwner_;
+   mm::ImgBuffer* writeSlotImage_;
+   unsigned int writeSlotComponents_;
+   std::size_t writeSlotPrevArenaHead_;
+
+   // Lock-free mode only: for each slot, the insert index of the frame it
+   // currently holds (-1 if none), published after the slot is written.
+   std::unique_ptr<std::atomic<long long>[]> slotSequence_;
+
+   // Images handed out by the Pin functions, which the inserting thread must
+   // not overwrite until they are released: pixel address -> (size, number
+   // of pins). pinnedCount_ (the map's size) lets the inserting thread skip
+   // the lookup when nothing is pinned.
+   struct PinnedImage
+   {
+      std::size_t bytes;
+      unsigned count;
+   };
+   mutable MMThreadLock pinLock_;
+   std::map<const unsigned char*, PinnedImage> pinnedImages_;
+   std::atomic<unsigned long> pinnedCount_;
 
    std::shared_ptr<ThreadPool> threadPool_;
    std::shared_ptr<TaskSet_CopyMemory> tasksMemCopy_;
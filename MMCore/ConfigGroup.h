@@ -35,6 +35,8 @@
 
 #include "Configuration.h"
 #include "Error.h"
+#include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -60,7 +62,10 @@ public:
    void Define(const char* configName, const char* deviceLabel, const char* propName, const char* value)
    {
       PropertySetting setting(deviceLabel, propName, value);
-      configs_[configName].addSetting(setting);
+      T& config = configs_[configName];
+      IndexPreset(config, false);
+      config.addSetting(setting);
+      IndexPreset(config, true);
 	}
 
    /**
@@ -88,6 +93,10 @@ public:
       if (it == configs_.end())
          return false;
 	  
+	  // A preset being replaced no longer counts
+	  typename std::map<std::string, T>::const_iterator replaced = configs_.find(newConfigName);
+	  if (replaced != configs_.end())
+	     IndexPreset(replaced->second, false);
 	  configs_[newConfigName] = it->second;
       configs_.erase(it->first);
       return true;
@@ -105,6 +114,7 @@ public:
       typename std::map<std::string, T>::const_iterator it = configs_.find(configName);
       if (it == configs_.end())
          return false;
+      IndexPreset(it->second, false);
       configs_.erase(configName);
       return true;
    }
@@ -124,7 +134,10 @@ public:
 		  return false;
 	  
 	  // Delete the specified property
-      configs_[configName].deleteSetting(deviceLabel,propName);
+      T& config = configs_[configName];
+      IndexPreset(config, false);
+      config.deleteSetting(deviceLabel,propName);
+      IndexPreset(config, true);
 	  return true;
    }
 
@@ -146,11 +159,72 @@ public:
       return configs_.size() == 0;
    }
 
+   /**
+    * Checks if any preset with at least the number of settings given to the
+    * constructor includes the property. Takes time independent of the
+    * number of presets.
+    */
+   bool IsPropertyIncluded(const char* deviceLabel, const char* propName) const
+   {
+      return IsPropertyIncluded(PropertySetting::generateKey(deviceLabel, propName));
+   }
+
+   /**
+    * Same as above, given the property key (see PropertySetting::getKey()).
+    */
+   bool IsPropertyIncluded(const std::string& propertyKey) const
+   {
+      return presetCounts_.find(propertyKey) != presetCounts_.end();
+   }
+
+   /**
+    * Returns the keys of all properties for which IsPropertyIncluded() is true.
+    */
+   std::vector<std::string> GetIncludedPropertyKeys() const
+   {
+      std::vector<std::string> keys;
+      keys.reserve(presetCounts_.size());
+      std::map<std::string, unsigned>::const_iterator it = presetCounts_.begin();
+      while (it != presetCounts_.end())
+         keys.push_back(it++->first);
+      return keys;
+   }
+
 protected:
-   ConfigGroupBase() {}
+   explicit ConfigGroupBase(size_t minIndexedPresetSize = 1) :
+      minIndexedPresetSize_(minIndexedPresetSize)
+   {}
    virtual ~ConfigGroupBase() {}
 
+   /**
+    * Adds the properties of a preset to the index used by
+    * IsPropertyIncluded(), or removes them. Must be called to remove a preset
+    * before it is changed and to add it again afterwards.
+    */
+   void IndexPreset(const T& config, bool add)
+   {
+      if (config.size() < minIndexedPresetSize_)
+         return;
+      for (size_t i = 0; i < config.size(); ++i)
+      {
+         const std::string key = config.getSetting(i).getKey();
+         if (add)
+         {
+            ++presetCounts_[key];
+            continue;
+         }
+         std::map<std::string, unsigned>::iterator it = presetCounts_.find(key);
+         if (it != presetCounts_.end() && --it->second == 0)
+            presetCounts_.erase(it);
+      }
+   }
+
    std::map<std::string, T> configs_;
+
+private:
+   size_t minIndexedPresetSize_;
+   // Property key -> number of indexed presets that include the property
+   std::map<std::string, unsigned> presetCounts_;
 };
 
 
@@ -159,6 +233,11 @@ protected:
  */
 class ConfigGroup : public ConfigGroupBase<Configuration>
 {
+public:
+   // Only presets with more than 1 property are indexed, since the UI
+   // treats groups with one property differently (see
+   // CoreCallback::OnPropertyChanged())
+   ConfigGroup() : ConfigGroupBase<Configuration>(2) {}
 };
 
 /**
@@ -182,7 +261,10 @@ public:
     */
    void Define(const char* groupName, const char* configName, const char* deviceLabel, const char* propName, const char* value)
    {
+      std::vector<std::string> keys = GetPresetPropertyKeys(groupName, configName);
+      keys.push_back(PropertySetting::generateKey(deviceLabel, propName));
       groups_[groupName].Define(configName, deviceLabel, propName, value);
+      UpdatePropertyIndex(groupName, keys);
    }
 
    /**
@@ -238,8 +320,11 @@ public:
          std::map<std::string, ConfigGroup>::iterator it = groups_.find(groupName);
          if (it == groups_.end())
             return false; // group not found
+         // In case a preset is replaced
+         const std::vector<std::string> keys = GetPresetPropertyKeys(groupName, newConfigName);
          if (it->second.Rename(oldConfigName, newConfigName))
          {
+            UpdatePropertyIndex(groupName, keys);
             // NOTE: changed to not remove empty groups, N.A. 1.31.2006
             // check if the config group is empty, and if so remove it
             //if (it->second.IsEmpty())
@@ -265,8 +350,10 @@ public:
       std::map<std::string, ConfigGroup>::iterator it = groups_.find(groupName);
       if (it == groups_.end())
          return false; // group not found
+      const std::vector<std::string> keys = GetPresetPropertyKeys(groupName, configName);
       if (it->second.Delete(configName, deviceLabel, propName))
       {
+         UpdatePropertyIndex(groupName, keys);
          return true;
       }
       else
@@ -286,8 +373,10 @@ public:
       std::map<std::string, ConfigGroup>::iterator it = groups_.find(groupName);
       if (it == groups_.end())
          return false; // group not found
+      const std::vector<std::string> keys = GetPresetPropertyKeys(groupName, configName);
       if (it->second.Delete(configName))
       {
+         UpdatePropertyIndex(groupName, keys);
          // NOTE: changed to not remove empty groups, N.A. 1.31.2006
          // check if the config group is empty, and if so remove it
          //if (it->second.IsEmpty())
@@ -310,7 +399,9 @@ public:
       std::map<std::string, ConfigGroup>::iterator it = groups_.find(groupName);
       if (it != groups_.end())
       {
+         const std::vector<std::string> keys = it->second.GetIncludedPropertyKeys();
          groups_.erase(it->first);
+         UpdatePropertyIndex(groupName, keys);
          return true;
       }
       return false; //not found
@@ -330,8 +421,17 @@ public:
          std::map<std::string, ConfigGroup>::iterator it = groups_.find(oldGroupName);
          if (it != groups_.end())
          {
+            std::vector<std::string> keys = it->second.GetIncludedPropertyKeys();
+            std::map<std::string, ConfigGroup>::iterator replaced = groups_.find(newGroupName);
+            if (replaced != groups_.end())
+            {
+               const std::vector<std::string> replacedKeys = replaced->second.GetIncludedPropertyKeys();
+               keys.insert(keys.end(), replacedKeys.begin(), replacedKeys.end());
+            }
             groups_[newGroupName] = it->second;
             groups_.erase(it->first);
+            UpdatePropertyIndex(oldGroupName, keys);
+            UpdatePropertyIndex(newGroupName, keys);
             return true;
          }
          return false; //not found
@@ -371,14 +471,66 @@ public:
       return confList;
    }
 
+   /**
+    * Returns the names of the groups that have a preset with more than 1
+    * property including the given one. Takes time independent of the number
+    * of groups and presets.
+    */
+   std::vector<std::string> GetGroupsIncludingProperty(const char* deviceLabel, const char* propName) const
+   {
+      std::vector<std::string> groupList;
+      std::map<std::string, std::set<std::string> >::const_iterator it =
+         propertyGroups_.find(PropertySetting::generateKey(deviceLabel, propName));
+      if (it != propertyGroups_.end())
+         groupList.assign(it->second.begin(), it->second.end());
+      return groupList;
+   }
+
    void Clear()
    {
       groups_.clear();
+      propertyGroups_.clear();
    }
 
 
 private:
+   std::vector<std::string> GetPresetPropertyKeys(const char* groupName, const char* configName)
+   {
+      std::vector<std::string> keys;
+      Configuration* config = Find(groupName, configName);
+      if (config)
+      {
+         for (size_t i = 0; i < config->size(); ++i)
+            keys.push_back(config->getSetting(i).getKey());
+      }
+      return keys;
+   }
+
+   // Brings propertyGroups_ up to date for the given properties of a group
+   // that was changed
+   void UpdatePropertyIndex(const char* groupName, const std::vector<std::string>& propertyKeys)
+   {
+      std::map<std::string, ConfigGroup>::const_iterator group = groups_.find(groupName);
+      for (std::vector<std::string>::const_iterator key = propertyKeys.begin();
+            key != propertyKeys.end(); ++key)
+      {
+         if (group != groups_.end() && group->second.IsPropertyIncluded(*key))
+            propertyGroups_[*key].insert(groupName);
+         else
+         {
+            std::map<std::string, std::set<std::string> >::iterator it = propertyGroups_.find(*key);
+            if (it == propertyGroups_.end())
+               continue;
+            it->second.erase(groupName);
+            if (it->second.empty())
+               propertyGroups_.erase(it);
+         }
+      }
+   }
+
    std::map<std::string, ConfigGroup> groups_;
+   // Property key -> groups for which GetGroupsIncludingProperty() returns it
+   std::map<std::string, std::set<std::string> > propertyGroups_;
 };
 
 /**
@@ -444,7 +596,10 @@ public:
    bool DefinePixelSize(const char* resolutionID, const char* deviceLabel, const char* propName, const char* value, double pixSizeUm)
    {
       PropertySetting setting(deviceLabel, propName, value);
-      configs_[resolutionID].addSetting(setting);
+      PixelSizeConfiguration& config = configs_[resolutionID];
+      IndexPreset(config, false);
+      config.addSetting(setting);
+      IndexPreset(config, true);
       if (configs_[resolutionID].getPixelSizeUm() == 0.0)
       {
          // this is the first setting, so it is OK to set pixel size
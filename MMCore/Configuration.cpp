@@ -98,9 +98,9 @@ PropertySetting Configuration::getSetting(size_t index) const throw (CMMError)
   * Checks whether the property is included in the  configuration.
   */
 
-bool Configuration::isPropertyIncluded(const char* device, const char* prop)
+bool Configuration::isPropertyIncluded(const char* device, const char* prop) const
 {
-   std::map<std::string, int>::iterator it = index_.find(PropertySetting::generateKey(device, prop));
+   std::map<std::string, int>::const_iterator it = index_.find(PropertySetting::generateKey(device, prop));
    if (it != index_.end())
       return true;
    else
@@ -111,9 +111,9 @@ bool Configuration::isPropertyIncluded(const char* device, const char* prop)
   * Get the setting with specified device name and property name.
   */
 
-PropertySetting Configuration::getSetting(const char* device, const char* prop)
+PropertySetting Configuration::getSetting(const char* device, const char* prop) const
 {
-   std::map<std::string, int>::iterator it = index_.find(PropertySetting::generateKey(device, prop));
+   std::map<std::string, int>::const_iterator it = index_.find(PropertySetting::generateKey(device, prop));
    if (it == index_.end())
    {
       std::ostringstream errTxt;
@@ -107,12 +107,12 @@ public:
    void addSetting(const PropertySetting& setting);
    void deleteSetting(const char* device, const char* prop);
 
-   bool isPropertyIncluded(const char* device, const char* property);
+   bool isPropertyIncluded(const char* device, const char* property) const;
    bool isSettingIncluded(const PropertySetting& ps);
    bool isConfigurationIncluded(const Configuration& cfg);
 
    PropertySetting getSetting(size_t index) const throw (CMMError);
-   PropertySetting getSetting(const char* device, const char* prop);
+   PropertySetting getSetting(const char* device, const char* prop) const;
    
    /**
     * Returns the number of settings.
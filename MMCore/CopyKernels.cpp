@@ -0,0 +1,244 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          CopyKernels.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Memory copy using non-temporal (streaming) stores, with the
+//                instruction set chosen at run time.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "CopyKernels.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#   define MM_COPY_X86_64
+#   include <immintrin.h>
+#   ifdef _MSC_VER
+#      include <intrin.h>
+#   endif
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+#   define MM_COPY_ARM64
+#   include <arm_neon.h>
+#endif
+
+// Allows using instructions beyond the compiler's baseline in a function
+// that is only called after checking for CPU support. MSVC does not need it.
+#if defined(__GNUC__) || defined(__clang__)
+#   define MM_TARGET(isa) __attribute__((target(isa)))
+#else
+#   define MM_TARGET(isa)
+#endif
+
+namespace mm {
+
+namespace {
+
+typedef void (*CopyFunc)(unsigned char*, const unsigned char*, std::size_t);
+
+// Copy with memcpy up to the first address in dst that is a multiple of
+// alignment; returns the number of bytes copied.
+inline std::size_t CopyHead(unsigned char* dst, const unsigned char* src,
+      std::size_t bytes, std::size_t alignment)
+{
+   const std::size_t misalignment =
+      reinterpret_cast<std::uintptr_t>(dst) & (alignment - 1);
+   std::size_t head = misalignment ? alignment - misalignment : 0;
+   if (head > bytes)
+      head = bytes;
+   std::memcpy(dst, src, head);
+   return head;
+}
+
+#if !defined(MM_COPY_X86_64) && !defined(MM_COPY_ARM64)
+void CopyMemcpy(unsigned char* dst, const unsigned char* src, std::size_t bytes)
+{
+   std::memcpy(dst, src, bytes);
+}
+#endif
+
+#ifdef MM_COPY_X86_64
+
+// SSE2 is always available on x86-64
+void CopySSE2(unsigned char* dst, const unsigned char* src, std::size_t bytes)
+{
+   const std::size_t head = CopyHead(dst, src, bytes, 16);
+   dst += head;
+   src += head;
+   bytes -= head;
+   for (; bytes >= 64; bytes -= 64, dst += 64, src += 64)
+   {
+      const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+      const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+      const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));
+      const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 48));
+      _mm_stream_si128(reinterpret_cast<__m128i*>(dst), a);
+      _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 16), b);
+      _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 32), c);
+      _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 48), d);
+   }
+   // Streaming stores are weakly ordered; make them visible before the
+   // copy is reported as done
+   _mm_sfence();
+   std::memcpy(dst, src, bytes);
+}
+
+MM_TARGET("avx2")
+void CopyAVX2(unsigned char* dst, const unsigned char* src, std::size_t bytes)
+{
+   const std::size_t head = CopyHead(dst, src, bytes, 32);
+   dst += head;
+   src += head;
+   bytes -= head;
+   for (; bytes >= 128; bytes -= 128, dst += 128, src += 128)
+   {
+      const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+      const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 32));
+      const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 64));
+      const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 96));
+      _mm256_stream_si256(reinterpret_cast<__m256i*>(dst), a);
+      _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + 32), b);
+      _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + 64), c);
+      _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + 96), d);
+   }
+   _mm_sfence();
+   _mm256_zeroupper();
+   std::memcpy(dst, src, bytes);
+}
+
+MM_TARGET("avx512f")
+void CopyAVX512(unsigned char* dst, const unsigned char* src, std::size_t bytes)
+{
+   const std::size_t head = CopyHead(dst, src, bytes, 64);
+   dst += head;
+   src += head;
+   bytes -= head;
+   for (; bytes >= 256; bytes -= 256, dst += 256, src += 256)
+   {
+      const __m512i a = _mm512_loadu_si512(src);
+      const __m512i b = _mm512_loadu_si512(src + 64);
+      const __m512i c = _mm512_loadu_si512(src + 128);
+      const __m512i d = _mm512_loadu_si512(src + 192);
+      _mm512_stream_si512(reinterpret_cast<__m512i*>(dst), a);
+      _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + 64), b);
+      _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + 128), c);
+      _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + 192), d);
+   }
+   _mm_sfence();
+   _mm256_zeroupper();
+   std::memcpy(dst, src, bytes);
+}
+
+#ifdef _MSC_VER
+// Whether the OS saves the given XSAVE state components (XCR0 bits)
+bool OSSupportsState(unsigned long long mask)
+{
+   int info[4];
+   __cpuid(info, 1);
+   const bool osxsave = (info[2] & (1 << 27)) != 0;
+   return osxsave && (_xgetbv(0) & mask) == mask;
+}
+#endif
+
+bool HasAVX2()
+{
+#ifdef _MSC_VER
+   int info[4];
+   __cpuidex(info, 7, 0);
+   return (info[1] & (1 << 5)) != 0 && OSSupportsState(0x6);
+#else
+   return __builtin_cpu_supports("avx2");
+#endif
+}
+
+bool HasAVX512()
+{
+#ifdef _MSC_VER
+   int info[4];
+   __cpuidex(info, 7, 0);
+   return (info[1] & (1 << 16)) != 0 && OSSupportsState(0xe6);
+#else
+   return __builtin_cpu_supports("avx512f");
+#endif
+}
+
+#endif // MM_COPY_X86_64
+
+#ifdef MM_COPY_ARM64
+
+// NEON is always available on ARM64; STNP is the non-temporal store pair
+void CopyNEON(unsigned char* dst, const unsigned char* src, std::size_t bytes)
+{
+   for (; bytes >= 64; bytes -= 64, dst += 64, src += 64)
+   {
+      const uint8x16_t a = vld1q_u8(src);
+      const uint8x16_t b = vld1q_u8(src + 16);
+      const uint8x16_t c = vld1q_u8(src + 32);
+      const uint8x16_t d = vld1q_u8(src + 48);
+      __asm__ volatile(
+            "stnp %q[a], %q[b], [%[p]]\n\t"
+            "stnp %q[c], %q[d], [%[p], #32]"
+            :
+            : [a] "w" (a), [b] "w" (b), [c] "w" (c), [d] "w" (d), [p] "r" (dst)
+            : "memory");
+   }
+   // Order the non-temporal stores before the copy is reported as done
+   __asm__ volatile("dmb ishst" ::: "memory");
+   std::memcpy(dst, src, bytes);
+}
+
+#endif // MM_COPY_ARM64
+
+struct Kernel
+{
+   CopyFunc func;
+   const char* name;
+};
+
+Kernel SelectKernel()
+{
+#if defined(MM_COPY_X86_64)
+   if (HasAVX512())
+      return Kernel{ CopyAVX512, "AVX-512" };
+   if (HasAVX2())
+      return Kernel{ CopyAVX2, "AVX2" };
+   return Kernel{ CopySSE2, "SSE2" };
+#elif defined(MM_COPY_ARM64)
+   return Kernel{ CopyNEON, "NEON" };
+#else
+   return Kernel{ CopyMemcpy, "memcpy" };
+#endif
+}
+
+const Kernel& GetKernel()
+{
+   // Thread-safe initialization on first use
+   static const Kernel kernel = SelectKernel();
+   return kernel;
+}
+
+} // anonymous namespace
+
+void StreamingCopy(void* dst, const void* src, std::size_t bytes)
+{
+   GetKernel().func(static_cast<unsigned char*>(dst),
+         static_cast<const unsigned char*>(src), bytes);
+}
+
+const char* StreamingCopyKernelName()
+{
+   return GetKernel().name;
+}
+
+} // namespace mm
@@ -0,0 +1,40 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          CopyKernels.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Memory copy using non-temporal (streaming) stores, with the
+//                instruction set chosen at run time.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <cstddef>
+
+namespace mm {
+
+/**
+ * Copies bytes from src to dst (which must not overlap), writing dst with
+ * non-temporal stores that bypass the cache where the CPU supports them
+ * (AVX-512, AVX2 or SSE2 on x86-64; NEON on ARM64), and with std::memcpy
+ * otherwise.
+ *
+ * This is faster than std::memcpy for large copies whose destination is not
+ * read again soon, and avoids evicting other data from the cache.
+ */
+void StreamingCopy(void* dst, const void* src, std::size_t bytes);
+
+// The name of the kernel used by StreamingCopy() on this CPU
+const char* StreamingCopyKernelName();
+
+} // namespace mm
@@ -29,8 +29,12 @@
 #include "../MMDevice/DeviceUtils.h"
 #include "../MMDevice/ImgBuffer.h"
 #include "CircularBuffer.h"
+#include "ConfigGroup.h"
 #include "CoreCallback.h"
 #include "DeviceManager.h"
+#include "IdleSignal.h"
+#include "ImageProcessingPipeline.h"
+#include "SystemStateCache.h"
 
 #include <cassert>
 #include <chrono>
@@ -206,24 +210,17 @@ CoreCallback::Sleep(const MM::Device*, double intervalMs)
 
 
 /**
- * Get the metadata tags attached to device caller, and merge them with metadata
- * in pMd (if not null). Returns a metadata object.
+ * Add the camera label and the metadata tags attached to device caller to md.
  */
-Metadata
-CoreCallback::AddCameraMetadata(const MM::Device* caller, const Metadata* pMd)
+void
+CoreCallback::AddCameraMetadata(const MM::Device* caller, Metadata& md)
 {
-   Metadata newMD;
-   if (pMd)
-   {
-      newMD = *pMd;
-   }
-
    std::shared_ptr<CameraInstance> camera =
       std::static_pointer_cast<CameraInstance>(
             core_->deviceManager_->GetDevice(caller));
 
    std::string label = camera->GetLabel();
-   newMD.put(MM::g_Keyword_Metadata_CameraLabel, label);
+   md.put(MM::g_Keyword_Metadata_CameraLabel, label);
 
    std::string serializedMD;
    try
@@ -232,60 +229,92 @@ CoreCallback::AddCameraMetadata(const MM::Device* caller, const Metadata* pMd)
    }
    catch (const CMMError&)
    {
-      return newMD;
+      return;
    }
 
    Metadata devMD;
    devMD.Restore(serializedMD.c_str());
-   newMD.Merge(devMD);
+   md.Merge(devMD);
+}
 
-   return newMD;
+/**
+ * Add tags handed over by a device (see MM::Core::InsertImage()) to md.
+ */
+void
+AddImageMetadataTags(Metadata& md, const MM::ImageMetadataTag* tags, unsigned numTags)
+{
+   if (!tags)
+      return;
+   for (unsigned i = 0; i < numTags; ++i)
+   {
+      if (!tags[i].key || !tags[i].value)
+         continue;
+      MetadataSingleTag tag(tags[i].key, tags[i].deviceLabel ? tags[i].deviceLabel : "_", true);
+      tag.SetValue(tags[i].value);
+      md.SetTag(tag);
+   }
 }
 
 int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const char* serializedMetadata, const bool doProcess)
 {
    Metadata md;
    md.Restore(serializedMetadata);
-   return InsertImage(caller, buf, width, height, byteDepth, &md, doProcess);
+   return InsertImage(caller, buf, width, height, byteDepth, 1, md, doProcess);
 }
 
 int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const Metadata* pMd, bool doProcess)
 {
-   try 
-   {
-      Metadata md = AddCameraMetadata(caller, pMd);
-
-      if(doProcess)
-      {
-         MM::ImageProcessor* ip = GetImageProcessor(caller);
-         if( NULL != ip)
-         {
-            ip->Process(const_cast<unsigned char*>(buf), width, height, byteDepth);
-         }
-      }
-      if (core_->cbuf_->InsertImage(buf, width, height, byteDepth, &md))
-         return DEVICE_OK;
-      else
-         return DEVICE_BUFFER_OVERFLOW;
-   }
-   catch (CMMError& /*e*/)
-   {
-      return DEVICE_INCOMPATIBLE_IMAGE;
-   }
+   Metadata md;
+   if (pMd)
+      md = *pMd;
+   return InsertImage(caller, buf, width, height, byteDepth, 1, md, doProcess);
 }
 
 int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const char* serializedMetadata, const bool doProcess)
 {
    Metadata md;
    md.Restore(serializedMetadata);
-   return InsertImage(caller, buf, width, height, byteDepth, nComponents, &md, doProcess);
+   return InsertImage(caller, buf, width, height, byteDepth, nComponents, md, doProcess);
+}
+
+int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const MM::ImageMetadataTag* tags, unsigned numTags, const bool doProcess)
+{
+   Metadata md;
+   AddImageMetadataTags(md, tags, numTags);
+   return InsertImage(caller, buf, width, height, byteDepth, nComponents, md, doProcess);
 }
 
 int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const Metadata* pMd, bool doProcess)
+{
+   Metadata md;
+   if (pMd)
+      md = *pMd;
+   return InsertImage(caller, buf, width, height, byteDepth, nComponents, md, doProcess);
+}
+
+/**
+ * Common implementation of the InsertImage() overloads; md is modified.
+ */
+int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, Metadata& md, bool doProcess)
 {
    try 
    {
-      Metadata md = AddCameraMetadata(caller, pMd);
+      // A camera inserting a frame has given up any slot it reserved
+      if (core_->cbuf_->GetPendingWriteSlotImage(caller))
+         core_->cbuf_->AbandonWriteSlot(caller);
+
+      AddCameraMetadata(caller, md);
+
+      // With the ImageProcessorThreads Core property set, processing happens
+      // on a copy, off the camera thread, and doProcess is ignored (the
+      // camera's buffer is never modified).
+      std::shared_ptr<mm::ImageProcessingPipeline> pipeline =
+         core_->getImageProcessorPipeline();
+      std::shared_ptr<ImageProcessorInstance> processor =
+         core_->currentImageProcessor_.lock();
+      if (pipeline && processor)
+         return SubmitImage(*pipeline, processor, buf, width, height,
+               byteDepth, nComponents, md);
 
       if(doProcess)
       {
@@ -306,11 +335,50 @@ int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf
    }
 }
 
+int CoreCallback::SubmitImage(mm::ImageProcessingPipeline& pipeline,
+      std::shared_ptr<ImageProcessorInstance> processor,
+      const unsigned char* buf, unsigned width, unsigned height,
+      unsigned byteDepth, unsigned nComponents, const Metadata& md)
+{
+   // A frame that could not be inserted is reported on the next one
+   if (pipeline.TakeOverflow())
+      return DEVICE_BUFFER_OVERFLOW;
+
+   std::unique_ptr<mm::ImageProcessingPipeline::Frame> frame =
+      pipeline.AcquireFrame();
+   frame->pixels.assign(buf, buf + static_cast<std::size_t>(width) * height *
+         byteDepth * nComponents);
+   frame->width = width;
+   frame->height = height;
+   frame->byteDepth = byteDepth;
+   frame->nComponents = nComponents;
+   frame->md = md;
+
+   mm::logging::Logger logger = core_->coreLogger_;
+   pipeline.Submit(std::move(frame),
+         [processor, logger](mm::ImageProcessingPipeline::Frame& f)
+         {
+            try
+            {
+               const int err = processor->ProcessConcurrently(f.pixels.data(),
+                     f.width, f.height, f.byteDepth);
+               if (err != DEVICE_OK)
+                  LOG_ERROR(logger) << "Image processor failed with error " << err;
+            }
+            catch (const CMMError& e)
+            {
+               LOG_ERROR(logger) << "Image processor failed: " << e.getMsg();
+            }
+         });
+   return DEVICE_OK;
+}
+
 int CoreCallback::InsertImage(const MM::Device* caller, const ImgBuffer & imgBuf)
 {
    Metadata md = imgBuf.GetMetadata();
    unsigned char* p = const_cast<unsigned char*>(imgBuf.GetPixels());
-   MM::ImageProcessor* ip = GetImageProcessor(caller);
+   MM::ImageProcessor* ip = core_->getImageProcessorPipeline() ?
+      0 : GetImageProcessor(caller);
    if( NULL != ip)
    {
       ip->Process(p, imgBuf.Width(), imgBuf.Height(), imgBuf.Depth());
@@ -320,8 +388,56 @@ int CoreCallback::InsertImage(const MM::Device* caller, const ImgBuffer & imgBuf
       imgBuf.Height(), imgBuf.Depth(), &md);
 }
 
+int CoreCallback::AcquireImageWriteSlot(const MM::Device* caller, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, unsigned char** pixels)
+{
+   if (!pixels)
+      return DEVICE_INVALID_INPUT_PARAM;
+
+   try
+   {
+      *pixels = core_->cbuf_->AcquireWriteSlot(caller, width, height, byteDepth, nComponents);
+      if (*pixels)
+         return DEVICE_OK;
+      else
+         return DEVICE_BUFFER_OVERFLOW;
+   }
+   catch (CMMError& /*e*/)
+   {
+      return DEVICE_INCOMPATIBLE_IMAGE;
+   }
+}
+
+int CoreCallback::CommitImageWriteSlot(const MM::Device* caller, const char* serializedMetadata)
+{
+   const mm::ImgBuffer* slot = core_->cbuf_->GetPendingWriteSlotImage(caller);
+   if (!slot)
+      return DEVICE_INVALID_INPUT_PARAM;
+   unsigned char* pixels = const_cast<unsigned char*>(slot->GetPixels());
+
+   Metadata md;
+   md.Restore(serializedMetadata);
+   AddCameraMetadata(caller, md);
+
+   MM::ImageProcessor* ip = GetImageProcessor(caller);
+   if( NULL != ip)
+   {
+      ip->Process(pixels, slot->Width(), slot->Height(), slot->Depth());
+   }
+   // Fails if the buffer was cleared since the slot was acquired
+   if (!core_->cbuf_->CommitWriteSlot(caller, &md))
+      return DEVICE_INVALID_INPUT_PARAM;
+   return DEVICE_OK;
+}
+
+void CoreCallback::AbandonImageWriteSlot(const MM::Device* caller)
+{
+   core_->cbuf_->AbandonWriteSlot(caller);
+}
+
 void CoreCallback::ClearImageBuffer(const MM::Device* /*caller*/)
 {
+   // Frames being processed would otherwise be inserted after clearing
+   core_->flushImageProcessorPipeline(true);
    core_->cbuf_->Clear();
 }
 
@@ -332,6 +448,7 @@ bool CoreCallback::InitializeImageBuffer(unsigned channels, unsigned slices,
    if (slices != 1)
       return false;
 
+   core_->flushImageProcessorPipeline(true);
    return core_->cbuf_->Initialize(channels, w, h, pixDepth);
 }
 
@@ -345,7 +462,10 @@ int CoreCallback::InsertMultiChannel(const MM::Device* caller,
 {
    try
    {
-      Metadata md = AddCameraMetadata(caller, pMd);
+      Metadata md;
+      if (pMd)
+         md = *pMd;
+      AddCameraMetadata(caller, md);
 
       MM::ImageProcessor* ip = GetImageProcessor(caller);
       if( NULL != ip)
@@ -381,6 +501,20 @@ int CoreCallback::AcqFinished(const MM::Device* caller, int /*statusCode*/)
    std::shared_ptr<DeviceInstance> currentCamera =
       core_->currentCameraDevice_.lock();
 
+   // Frames still being processed belong to the finished sequence
+   std::shared_ptr<mm::ImageProcessingPipeline> pipeline =
+      core_->getImageProcessorPipeline();
+   if (pipeline)
+      pipeline->Drain();
+
+   const long long firstFillUs = core_->cbuf_->GetFirstFillMicroseconds();
+   if (firstFillUs >= 0)
+   {
+      LOG_INFO(core_->coreLogger_) << "Circular buffer (" <<
+         core_->cbuf_->GetSize() << " images) was first filled in " <<
+         firstFillUs / 1000 << " ms";
+   }
+
    if (core_->autoShutter_)
    {
       std::shared_ptr<ShutterInstance> shutter =
@@ -472,65 +606,37 @@ int CoreCallback::OnPropertyChanged(const MM::Device* device, const char* propNa
       bool readOnly;
       device->GetPropertyReadOnly(propName, readOnly);
       const PropertySetting* ps = new PropertySetting(label, propName, value, readOnly);
-      {
-         MMThreadGuard scg(core_->stateCacheLock_);
-         core_->stateCache_.addSetting(*ps);
-      }
+      core_->stateCache_->Set(*ps);
       core_->externalCallback_->onPropertyChanged(label, propName, value);
 
-      // Find all configs that contain this property and callback to indicate 
-      // that the config group changed
-      // TODO: Assess whether performance is better by maintaining a map tying
-      // property to configurations
-      std::vector<std::string> configGroups = 
-         core_->getAvailableConfigGroups ();
-      for (std::vector<std::string>::iterator it = configGroups.begin(); 
-            it != configGroups.end(); ++it) 
+      // Find all groups with a config that contains this property and
+      // callback to indicate that the config group changed. Only groups with
+      // configs of more than 1 property are returned, since the UI treats
+      // groups with one property differently, whereas the core does not.
+      std::vector<std::string> configGroups =
+         core_->configGroups_->GetGroupsIncludingProperty(label, propName);
+      for (std::vector<std::string>::iterator it = configGroups.begin();
+            it != configGroups.end(); ++it)
       {
-         std::vector<std::string> configs = 
-            core_->getAvailableConfigs((*it).c_str());
-         bool found = false;
-         for (std::vector<std::string>::iterator itc = configs.begin();
-               itc != configs.end() && !found; itc++) 
-         {
-            Configuration config = 
-               core_->getConfigData((*it).c_str(), (*itc).c_str());
-            // only callback when there is more than 1 property in a group
-            // This is needed, since the UI treats groups with one 
-            // property differently, whereas the core does not....
-            if (config.size() > 1 && config.isPropertyIncluded(label, propName)) {
-               found = true;
-               // If we are part of this configuration, notify that it 
-               // was changed. Get the new config from cache rather 
-               // than by querying the hardware
-               std::string currentConfig = 
-                  core_->getCurrentConfigFromCache( (*it).c_str() );
-               OnConfigGroupChanged((*it).c_str(), currentConfig.c_str());
-            }
-         }
+         // Get the new config from cache rather than by querying the
+         // hardware
+         std::string currentConfig =
+            core_->getCurrentConfigFromCache( (*it).c_str() );
+         OnConfigGroupChanged((*it).c_str(), currentConfig.c_str());
       }
-          
 
       // Check if pixel size was potentially affected.  If so, update from cache
-      std::vector<std::string> pixelSizeConfigs = core_->getAvailablePixelSizeConfigs();
-      bool found = false;
-      for (std::vector<std::string>::iterator itpsc = pixelSizeConfigs.begin();
-            itpsc != pixelSizeConfigs.end() && !found; itpsc++) 
-      {
-         Configuration pixelSizeConfig = core_->getPixelSizeConfigData( (*itpsc).c_str());
-         if (pixelSizeConfig.isPropertyIncluded(label, propName)) {
-            found = true;
-            double pixSizeUm;
-            try {
-               // update pixel size from cache
-               pixSizeUm = core_->getPixelSizeUm(true);
-               OnPixelSizeAffineChanged(core_->getPixelSizeAffine(true));
-            }
-            catch (const CMMError&) {
-               pixSizeUm = 0.0;
-            }
-            OnPixelSizeChanged(pixSizeUm);
+      if (core_->pixelSizeGroup_->IsPropertyIncluded(label, propName)) {
+         double pixSizeUm;
+         try {
+            // update pixel size from cache
+            pixSizeUm = core_->getPixelSizeUm(true);
+            OnPixelSizeAffineChanged(core_->getPixelSizeAffine(true));
+         }
+         catch (const CMMError&) {
+            pixSizeUm = 0.0;
          }
+         OnPixelSizeChanged(pixSizeUm);
       }
    }
 
@@ -659,6 +765,31 @@ int CoreCallback::OnMagnifierChanged(const MM::Device* /* device */)
    return DEVICE_OK;
 }
 
+/**
+ * Handler for the end (or start) of a busy period
+ *
+ * Wakes up waitForDevice() if it is waiting for this (or any other) device.
+ */
+int CoreCallback::OnBusyChanged(const MM::Device* device, bool busy)
+{
+   std::shared_ptr<DeviceInstance> instance;
+   try
+   {
+      instance = core_->deviceManager_->GetDevice(device);
+   }
+   catch (const CMMError&)
+   {
+      return DEVICE_OK; // Not (or no longer) loaded
+   }
+   if (!instance)
+      return DEVICE_OK; // Being unloaded
+   instance->SetNotifiesBusyChanges();
+
+   if (!busy)
+      core_->idleSignal_->Notify();
+   return DEVICE_OK;
+}
+
 
 
 int CoreCallback::SetSerialProperties(const char* portName,
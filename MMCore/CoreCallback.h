@@ -40,6 +40,8 @@ namespace mm
 // CoreCallback class
 // ------------------
 
+void AddImageMetadataTags(Metadata& md, const MM::ImageMetadataTag* tags, unsigned numTags);
+
 class CoreCallback : public MM::Core
 {
 public:
@@ -86,11 +88,15 @@ public:
    /*Deprecated*/ int InsertImage(const MM::Device* caller, const ImgBuffer& imgBuf); // Note: _not_ mm::ImgBuffer
    int InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const char* serializedMetadata, const bool doProcess = true);
    int InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const char* serializedMetadata, const bool doProcess = true);
+   int InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const MM::ImageMetadataTag* tags, unsigned numTags, const bool doProcess = true);
 
    /*Deprecated*/ int InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const Metadata* pMd = 0, const bool doProcess = true);
    /*Deprecated*/ int InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const Metadata* pMd = 0, const bool doProcess = true);
 
    /*Deprecated*/ int InsertMultiChannel(const MM::Device* caller, const unsigned char* buf, unsigned numChannels, unsigned width, unsigned height, unsigned byteDepth, Metadata* pMd = 0);
+   int AcquireImageWriteSlot(const MM::Device* caller, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, unsigned char** pixels);
+   int CommitImageWriteSlot(const MM::Device* caller, const char* serializedMetadata);
+   void AbandonImageWriteSlot(const MM::Device* caller);
    void ClearImageBuffer(const MM::Device* caller);
    bool InitializeImageBuffer(unsigned channels, unsigned slices, unsigned int w, unsigned int h, unsigned int pixDepth);
 
@@ -120,6 +126,7 @@ public:
    int OnExposureChanged(const MM::Device* device, double newExposure);
    int OnSLMExposureChanged(const MM::Device* device, double newExposure);
    int OnMagnifierChanged(const MM::Device* device);
+   int OnBusyChanged(const MM::Device* device, bool busy);
 
 
    void NextPostedError(int& errorCode, char* pMessage, int maxlen, int& messageLength);
@@ -140,7 +147,12 @@ private:
    CMMCore* core_;
    MMThreadLock* pValueChangeLock_;
 
-   Metadata AddCameraMetadata(const MM::Device* caller, const Metadata* pMd);
+   void AddCameraMetadata(const MM::Device* caller, Metadata& md);
+   int InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, Metadata& md, bool doProcess);
+   int SubmitImage(mm::ImageProcessingPipeline& pipeline,
+         std::shared_ptr<ImageProcessorInstance> processor,
+         const unsigned char* buf, unsigned width, unsigned height,
+         unsigned byteDepth, unsigned nComponents, const Metadata& md);
 
    int OnConfigGroupChanged(const char* groupName, const char* newConfigName);
    int OnPixelSizeChanged(double newPixelSizeUm);
@@ -118,6 +118,48 @@ const auto& featureMap() {
             [](bool e) { g_flags.ParallelDeviceInitialization = e; }
          }
       },
+      {
+         "LockFreeCircularBuffer", {
+            [] { return g_flags.lockFreeCircularBuffer; },
+            [](bool e) { g_flags.lockFreeCircularBuffer = e; }
+            // Takes effect the next time the circular buffer is initialized
+            // (e.g., when a sequence acquisition is started). Only safe when
+            // at most one camera inserts and at most one thread pops images
+            // at any given time.
+         }
+      },
+      {
+         "ContiguousCircularBuffer", {
+            [] { return g_flags.contiguousCircularBuffer; },
+            [](bool e) { g_flags.contiguousCircularBuffer = e; }
+            // Takes effect at the next setCircularBufferMemoryFootprint().
+         }
+      },
+      {
+         "VariableSizeCircularBuffer", {
+            [] { return g_flags.variableSizeCircularBuffer; },
+            [](bool e) { g_flags.variableSizeCircularBuffer = e; }
+            // Takes effect the next time the circular buffer is initialized.
+         }
+      },
+      {
+         "ParallelSystemState", {
+            [] { return g_flags.parallelSystemState; },
+            [](bool e) { g_flags.parallelSystemState = e; }
+         }
+      },
+      {
+         "ParallelSetConfig", {
+            [] { return g_flags.parallelSetConfig; },
+            [](bool e) { g_flags.parallelSetConfig = e; }
+         }
+      },
+      {
+         "ParallelConfigLoading", {
+            [] { return g_flags.parallelConfigLoading; },
+            [](bool e) { g_flags.parallelConfigLoading = e; }
+         }
+      },
       // How to add a new Core feature: see the comment at the top of this file.
       // Features (the string names) must never be removed once added!
    };
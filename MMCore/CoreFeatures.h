@@ -27,6 +27,12 @@ namespace features {
 struct Flags {
    bool strictInitializationChecks = false;
    bool ParallelDeviceInitialization = true;
+   bool lockFreeCircularBuffer = false;
+   bool contiguousCircularBuffer = false;
+   bool variableSizeCircularBuffer = false;
+   bool parallelSystemState = false;
+   bool parallelSetConfig = false;
+   bool parallelConfigLoading = false;
    // How to add a new Core feature: see the comment in the .cpp file.
 };
 
@@ -28,6 +28,7 @@
 #include "CoreUtils.h"
 #include "MMCore.h"
 #include "Error.h"
+#include "ImageProcessingPipeline.h"
 #include "../MMDevice/DeviceUtils.h"
 
 #include <cassert>
@@ -156,6 +157,53 @@ void CorePropertyCollection::Execute(const char* propName, const char* value)
    {
       core_->setTimeoutMs(atol(value));
    }
+   else if (strcmp(propName, MM::g_Keyword_CoreThreadPoolSize) == 0 ||
+         strcmp(propName, MM::g_Keyword_CoreThreadPoolPinning) == 0)
+   {
+      try
+      {
+         const long threadCount = atol(Get(MM::g_Keyword_CoreThreadPoolSize).c_str());
+         if (threadCount < 0 || threadCount > 1024)
+            throw CMMError("Invalid thread pool size \"" + ToString(value) + "\"",
+                  MMERR_InvalidCoreValue);
+         core_->setThreadPool(threadCount,
+               Get(MM::g_Keyword_CoreThreadPoolPinning) == "1");
+      }
+      catch (const CMMError&)
+      {
+         Refresh(); // Restore the values in effect
+         throw;
+      }
+   }
+   else if (strcmp(propName, MM::g_Keyword_CoreSystemStateSlowPropertyMs) == 0)
+   {
+      const long ms = atol(value);
+      if (ms < 0)
+      {
+         Refresh();
+         throw CMMError("Invalid slow property time \"" + ToString(value) + "\"",
+               MMERR_InvalidCoreValue);
+      }
+      core_->setSlowPropertyMs(ms);
+   }
+   else if (strcmp(propName, MM::g_Keyword_CoreImageProcessorThreads) == 0 ||
+         strcmp(propName, MM::g_Keyword_CoreImageProcessorQueueCapacity) == 0)
+   {
+      try
+      {
+         const long threadCount = atol(Get(MM::g_Keyword_CoreImageProcessorThreads).c_str());
+         const long capacity = atol(Get(MM::g_Keyword_CoreImageProcessorQueueCapacity).c_str());
+         if (threadCount < 0 || threadCount > 64 || capacity < 1 || capacity > 4096)
+            throw CMMError("Invalid image processor pipeline setting \"" +
+                  ToString(value) + "\"", MMERR_InvalidCoreValue);
+         core_->setImageProcessorPipeline(threadCount, capacity);
+      }
+      catch (const CMMError&)
+      {
+         Refresh(); // Restore the values in effect
+         throw;
+      }
+   }
    else if (strcmp(propName, MM::g_Keyword_CoreChannelGroup) == 0)
    {
       core_->setChannelGroup(value);
@@ -181,6 +229,25 @@ std::string CorePropertyCollection::Get(const char* propName) const
             ToString(propName) + ")",
             MMERR_InvalidCoreProperty);
 
+   // Pipeline statistics change with every image; read them when requested
+   if (strcmp(propName, MM::g_Keyword_CoreImageProcessorQueueDepth) == 0 ||
+         strcmp(propName, MM::g_Keyword_CoreImageProcessorWaitLatencyMs) == 0 ||
+         strcmp(propName, MM::g_Keyword_CoreImageProcessorProcessLatencyMs) == 0 ||
+         strcmp(propName, MM::g_Keyword_CoreImageProcessorPublishLatencyMs) == 0)
+   {
+      std::shared_ptr<mm::ImageProcessingPipeline> pipeline =
+         core_->getImageProcessorPipeline();
+      if (!pipeline)
+         return "0";
+      if (strcmp(propName, MM::g_Keyword_CoreImageProcessorQueueDepth) == 0)
+         return CDeviceUtils::ConvertToString(static_cast<long>(pipeline->GetQueueDepth()));
+      if (strcmp(propName, MM::g_Keyword_CoreImageProcessorWaitLatencyMs) == 0)
+         return CDeviceUtils::ConvertToString(pipeline->GetWaitLatencyMs());
+      if (strcmp(propName, MM::g_Keyword_CoreImageProcessorProcessLatencyMs) == 0)
+         return CDeviceUtils::ConvertToString(pipeline->GetProcessLatencyMs());
+      return CDeviceUtils::ConvertToString(pipeline->GetPublishLatencyMs());
+   }
+
    return it->second.Get();
 }
 
@@ -238,6 +305,15 @@ void CorePropertyCollection::Refresh()
    // Timeout for Device Busy checking
    Set(MM::g_Keyword_CoreTimeoutMs, CDeviceUtils::ConvertToString(core_->getTimeoutMs()));
 
+   // Thread pool
+   Set(MM::g_Keyword_CoreThreadPoolSize, CDeviceUtils::ConvertToString((long)core_->getThreadPoolSize()));
+   Set(MM::g_Keyword_CoreThreadPoolPinning, core_->getThreadPoolPinning() ? "1" : "0");
+   Set(MM::g_Keyword_CoreSystemStateSlowPropertyMs, CDeviceUtils::ConvertToString(core_->getSlowPropertyMs()));
+
+   // Image processor pipeline
+   Set(MM::g_Keyword_CoreImageProcessorThreads, CDeviceUtils::ConvertToString((long)core_->getImageProcessorThreads()));
+   Set(MM::g_Keyword_CoreImageProcessorQueueCapacity, CDeviceUtils::ConvertToString((long)core_->getImageProcessorQueueCapacity()));
+
    // Channel group
    Set(MM::g_Keyword_CoreChannelGroup, core_->getChannelGroup().c_str());
 
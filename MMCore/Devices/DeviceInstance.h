@@ -23,6 +23,7 @@
 #include "../Error.h"
 #include "../Logging/Logger.h"
 
+#include <atomic>
 #include <cstring>
 #include <functional>
 #include <memory>
@@ -73,6 +74,7 @@ private:
    mm::logging::Logger coreLogger_;
    bool initializeCalled_ = false;
    bool initialized_ = false;
+   std::atomic<bool> notifiesBusyChanges_{false};
 
 public:
    DeviceInstance(const DeviceInstance&) = delete;
@@ -93,6 +95,11 @@ public:
    bool IsInitialized() const { return initialized_; }
    bool HasInitializationBeenAttempted() const { return initializeCalled_; }
 
+   // Set once the device has called OnBusyChanged(); waitForDevice() then
+   // relies on notifications rather than polling Busy()
+   bool NotifiesBusyChanges() const { return notifiesBusyChanges_.load(); }
+   void SetNotifiesBusyChanges() { notifiesBusyChanges_.store(true); }
+
 protected:
    // The DeviceInstance object owns the raw device pointer (pDevice) as soon
    // as the constructor is called, even if the constructor throws.
@@ -23,3 +23,21 @@
 
 
 int ImageProcessorInstance::Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth) { RequireInitialized(__func__); return GetImpl()->Process(buffer, width, height, byteDepth); }
+
+int ImageProcessorInstance::ProcessConcurrently(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth)
+{
+   RequireInitialized(__func__);
+   {
+      std::unique_lock<std::mutex> lock(processMutex_);
+      if (!concurrencyChecked_)
+      {
+         // TileSafe is read-only, so it is only read once
+         concurrent_ = HasProperty(MM::g_Keyword_TileSafe) &&
+            GetProperty(MM::g_Keyword_TileSafe) == "Yes";
+         concurrencyChecked_ = true;
+      }
+      if (!concurrent_)
+         return GetImpl()->Process(buffer, width, height, byteDepth);
+   }
+   return GetImpl()->Process(buffer, width, height, byteDepth);
+}
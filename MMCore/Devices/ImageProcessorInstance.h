@@ -21,6 +21,8 @@
 
 #include "DeviceInstanceBase.h"
 
+#include <mutex>
+
 
 class ImageProcessorInstance : public DeviceInstanceBase<MM::ImageProcessor>
 {
@@ -37,4 +39,14 @@ public:
    {}
 
    int Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth);
+
+   // For callers on several threads (the image processor pipeline): calls
+   // are serialized unless the processor declares the TileSafe property,
+   // which allows Process() to run concurrently
+   int ProcessConcurrently(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth);
+
+private:
+   std::mutex processMutex_;
+   bool concurrencyChecked_ = false; // Guarded by processMutex_
+   bool concurrent_ = false;
 };
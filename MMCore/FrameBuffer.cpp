@@ -24,15 +24,21 @@
 namespace mm {
 
 ImgBuffer::ImgBuffer(unsigned xSize, unsigned ySize, unsigned pixDepth) :
-   pixels_(0), width_(xSize), height_(ySize), pixDepth_(pixDepth)
+   pixels_(0), ownsPixels_(true), width_(xSize), height_(ySize), pixDepth_(pixDepth)
 {
    pixels_ = new unsigned char[xSize * ySize * pixDepth];
    memset(pixels_, 0, xSize * ySize * pixDepth);
 }
 
+ImgBuffer::ImgBuffer(unsigned xSize, unsigned ySize, unsigned pixDepth, unsigned char* pixels) :
+   pixels_(pixels), ownsPixels_(false), width_(xSize), height_(ySize), pixDepth_(pixDepth)
+{
+}
+
 ImgBuffer::~ImgBuffer()
 {
-   delete[] pixels_;
+   if (ownsPixels_)
+      delete[] pixels_;
 }
 
 const unsigned char* ImgBuffer::GetPixels() const
@@ -50,8 +56,10 @@ void ImgBuffer::Resize(unsigned xSize, unsigned ySize, unsigned pixDepth)
    // re-allocate internal buffer if it is not big enough
    if (width_ * height_ * pixDepth_ < xSize * ySize * pixDepth)
    {
-      delete[] pixels_;
+      if (ownsPixels_)
+         delete[] pixels_;
       pixels_ = new unsigned char [xSize * ySize * pixDepth];
+      ownsPixels_ = true;
    }
 
    width_ = xSize;
@@ -64,8 +72,10 @@ void ImgBuffer::Resize(unsigned xSize, unsigned ySize)
    // re-allocate internal buffer if it is not big enough
    if (width_ * height_ < xSize * ySize)
    {
-      delete[] pixels_;
+      if (ownsPixels_)
+         delete[] pixels_;
       pixels_ = new unsigned char[xSize * ySize * pixDepth_];
+      ownsPixels_ = true;
    }
 
    width_ = xSize;
@@ -74,13 +84,23 @@ void ImgBuffer::Resize(unsigned xSize, unsigned ySize)
    memset(pixels_, 0, width_ * height_ * pixDepth_);
 }
 
+void ImgBuffer::UseExternalPixels(unsigned char* pixels, unsigned xSize, unsigned ySize, unsigned pixDepth)
+{
+   if (ownsPixels_)
+      delete[] pixels_;
+   pixels_ = pixels;
+   ownsPixels_ = false;
+   width_ = xSize;
+   height_ = ySize;
+   pixDepth_ = pixDepth;
+}
+
 void ImgBuffer::SetMetadata(const Metadata& md)
 {
-   //metadata_ = md;
-   // Serialize/Restore instead of =operator used to avoid object new/delete
-   // issues across the DLL boundary (on Windows)
-   // TODO: this is inefficient and should be revised
-    metadata_.Restore(md.Serialize().c_str());
+   // Both objects are owned by MMCore (metadata from devices arrives
+   // serialized or as MM::ImageMetadataTag arrays), so plain assignment does
+   // not allocate and free tags across the DLL boundary.
+   metadata_ = md;
 }
 
 
@@ -127,6 +147,17 @@ void FrameBuffer::Preallocate(unsigned channels)
    }
 }
 
+void FrameBuffer::Preallocate(unsigned channels, unsigned char* pixels)
+{
+   const std::size_t channelSize = (std::size_t)width_ * height_ * depth_;
+   for (unsigned i=0; i<channels; i++)
+   {
+      ImgBuffer* img = FindImage(i);
+      if (!img)
+         InsertNewImage(i, pixels + i * channelSize);
+   }
+}
+
 void FrameBuffer::Resize(unsigned xSize, unsigned ySize, unsigned byteDepth)
 {
    Clear();
@@ -135,6 +166,27 @@ void FrameBuffer::Resize(unsigned xSize, unsigned ySize, unsigned byteDepth)
    depth_ = byteDepth;
 }
 
+void FrameBuffer::UseExternalPixels(unsigned channels, unsigned xSize,
+      unsigned ySize, unsigned byteDepth, unsigned char* pixels)
+{
+   for (unsigned i = channels; i < channels_.size(); ++i)
+      delete channels_[i];
+   channels_.resize(channels, 0);
+
+   width_ = xSize;
+   height_ = ySize;
+   depth_ = byteDepth;
+   const std::size_t channelSize = (std::size_t)xSize * ySize * byteDepth;
+   for (unsigned i = 0; i < channels; ++i)
+   {
+      unsigned char* channelPixels = pixels + i * channelSize;
+      if (channels_[i])
+         channels_[i]->UseExternalPixels(channelPixels, xSize, ySize, byteDepth);
+      else
+         InsertNewImage(i, channelPixels);
+   }
+}
+
 bool FrameBuffer::SetPixels(unsigned channel, const unsigned char* pixels)
 {
    ImgBuffer* img = FindImage(channel);
@@ -170,11 +222,13 @@ ImgBuffer* FrameBuffer::FindImage(unsigned channel) const
    return channels_[channel];
 }
 
-ImgBuffer* FrameBuffer::InsertNewImage(unsigned channel)
+ImgBuffer* FrameBuffer::InsertNewImage(unsigned channel, unsigned char* pixels)
 {
    if (channel >= channels_.size())
       channels_.resize(channel + 1, 0);
-   ImgBuffer* img = new ImgBuffer(width_, height_, depth_);
+   ImgBuffer* img = pixels ?
+      new ImgBuffer(width_, height_, depth_, pixels) :
+      new ImgBuffer(width_, height_, depth_);
    channels_[channel] = img;
    return img;
 }
@@ -29,6 +29,7 @@ namespace mm {
 class ImgBuffer
 {
    unsigned char* pixels_;
+   bool ownsPixels_;
    unsigned int width_;
    unsigned int height_;
    unsigned int pixDepth_;
@@ -36,6 +37,8 @@ class ImgBuffer
 
 public:
    ImgBuffer(unsigned xSize, unsigned ySize, unsigned pixDepth);
+   // Use the given memory (not owned) for the pixels
+   ImgBuffer(unsigned xSize, unsigned ySize, unsigned pixDepth, unsigned char* pixels);
    ~ImgBuffer();
 
    unsigned int Width() const {return width_;}
@@ -46,6 +49,8 @@ public:
 
    void Resize(unsigned xSize, unsigned ySize, unsigned pixDepth);
    void Resize(unsigned xSize, unsigned ySize);
+   // Switch to the given memory (not owned) for the pixels
+   void UseExternalPixels(unsigned char* pixels, unsigned xSize, unsigned ySize, unsigned pixDepth);
 
    void SetMetadata(const Metadata& md);
    const Metadata& GetMetadata() const {return metadata_;}
@@ -71,6 +76,13 @@ public:
    void Resize(unsigned xSize, unsigned ySize, unsigned pixDepth);
    void Clear();
    void Preallocate(unsigned channels);
+   // Preallocate, placing the channels' pixels consecutively in the given
+   // memory (which must outlive the images)
+   void Preallocate(unsigned channels, unsigned char* pixels);
+   // Resize to exactly the given number of channels, placing their pixels
+   // consecutively in the given memory (which must outlive the images)
+   void UseExternalPixels(unsigned channels, unsigned xSize, unsigned ySize,
+         unsigned byteDepth, unsigned char* pixels);
 
    ImgBuffer* FindImage(unsigned channel) const;
    const unsigned char* GetPixels(unsigned channel) const;
@@ -87,7 +99,7 @@ private:
    // FrameBuffer& operator=(const FrameBuffer&);
 
 private:
-   ImgBuffer* InsertNewImage(unsigned channel);
+   ImgBuffer* InsertNewImage(unsigned channel, unsigned char* pixels = 0);
 };
 
 } // namespace mm
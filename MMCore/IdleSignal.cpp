@@ -0,0 +1,51 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          IdleSignal.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Wakes up threads waiting for devices to become non-busy.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "IdleSignal.h"
+
+namespace mm {
+
+IdleSignal::IdleSignal() :
+   count_(0)
+{
+}
+
+unsigned long long IdleSignal::GetCount() const
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   return count_;
+}
+
+void IdleSignal::Notify()
+{
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++count_;
+   }
+   cond_.notify_all();
+}
+
+bool IdleSignal::WaitForChange(unsigned long long count,
+      TimePoint deadline) const
+{
+   std::unique_lock<std::mutex> lock(mutex_);
+   return cond_.wait_until(lock, deadline,
+         [&] { return count_ != count; });
+}
+
+} // namespace mm
@@ -0,0 +1,66 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          IdleSignal.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Wakes up threads waiting for devices to become non-busy.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+namespace mm {
+
+/**
+ * Counts the "no longer busy" notifications from devices.
+ *
+ * A waiter reads the count before checking Busy(), and if the device is
+ * busy, waits for the count to change. A notification that arrives between
+ * the two is therefore never missed. One signal is shared by all devices;
+ * waking up for another device's notification only costs a Busy() call.
+ *
+ * All member functions are thread-safe.
+ */
+class IdleSignal
+{
+public:
+   typedef std::chrono::steady_clock::time_point TimePoint;
+
+   IdleSignal();
+
+   unsigned long long GetCount() const;
+
+   /**
+    * Increments the count and wakes up all waiters.
+    */
+   void Notify();
+
+   /**
+    * Waits until the count differs from count or until deadline.
+    * Returns true if the count changed.
+    */
+   bool WaitForChange(unsigned long long count, TimePoint deadline) const;
+
+private:
+   IdleSignal(const IdleSignal&);
+   IdleSignal& operator=(const IdleSignal&);
+
+   mutable std::mutex mutex_;
+   mutable std::condition_variable cond_;
+   unsigned long long count_;
+};
+
+} // namespace mm
@@ -0,0 +1,108 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ImageBatch.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Images (pixels and metadata) popped from the circular
+//                buffer in a single call
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "ImageBatch.h"
+
+#include <sstream>
+
+#ifdef _MSC_VER
+#pragma warning(disable: 4290) // 'C++ exception specification ignored'
+#endif
+
+#if defined(__GNUC__) && !defined(__clang__)
+// 'dynamic exception specifications are deprecated in C++11 [-Wdeprecated]'
+#pragma GCC diagnostic ignored "-Wdeprecated"
+#endif
+
+const ImageBatch::Entry& ImageBatch::getEntry(long index) const throw (CMMError)
+{
+   if (index < 0 || index >= size())
+   {
+      std::ostringstream errTxt;
+      errTxt << index << " - invalid image batch index";
+      throw CMMError(errTxt.str().c_str(), MMERR_DEVICE_GENERIC);
+   }
+   return entries_[index];
+}
+
+unsigned ImageBatch::getImageWidth(long index) const throw (CMMError)
+{
+   return getEntry(index).width;
+}
+
+unsigned ImageBatch::getImageHeight(long index) const throw (CMMError)
+{
+   return getEntry(index).height;
+}
+
+unsigned ImageBatch::getBytesPerPixel(long index) const throw (CMMError)
+{
+   return getEntry(index).byteDepth;
+}
+
+unsigned ImageBatch::getNumberOfComponents(long index) const throw (CMMError)
+{
+   return getEntry(index).nComponents;
+}
+
+/**
+ * Returns the pixels of the image with the given index. The pointer is valid
+ * until the batch is refilled or destroyed. Throws if there is no such image.
+ */
+void* ImageBatch::getImagePixels(long index) throw (CMMError)
+{
+   // Not &pixels_[offset]: the vector is empty if all images are empty
+   return pixels_.data() + getEntry(index).offset;
+}
+
+Metadata ImageBatch::getImageMetadata(long index) const throw (CMMError)
+{
+   return getEntry(index).md;
+}
+
+void ImageBatch::clear()
+{
+   entries_.clear();
+   usedBytes_ = 0;
+}
+
+void ImageBatch::reservePixels(std::size_t bytes)
+{
+   if (pixels_.size() < usedBytes_ + bytes)
+      pixels_.resize(usedBytes_ + bytes);
+}
+
+unsigned char* ImageBatch::append(unsigned width, unsigned height,
+      unsigned byteDepth, unsigned nComponents, const Metadata& md)
+{
+   const std::size_t bytes = (std::size_t)width * height * byteDepth;
+   reservePixels(bytes);
+
+   Entry entry;
+   entry.offset = usedBytes_;
+   entry.width = width;
+   entry.height = height;
+   entry.byteDepth = byteDepth;
+   entry.nComponents = nComponents;
+   entry.md = md;
+   entries_.push_back(entry);
+
+   usedBytes_ += bytes;
+   return pixels_.data() + entry.offset;
+}
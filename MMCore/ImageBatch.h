@@ -0,0 +1,98 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ImageBatch.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Images (pixels and metadata) popped from the circular
+//                buffer in a single call
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable: 4290) // 'C++ exception specification ignored'
+#endif
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+// 'dynamic exception specifications are deprecated in C++11 [-Wdeprecated]'
+#pragma GCC diagnostic ignored "-Wdeprecated"
+#endif
+
+#include "../MMDevice/ImageMetadata.h"
+#include "Error.h"
+
+#include <cstddef>
+#include <vector>
+
+
+/**
+ * A number of images, with their metadata, removed from the circular buffer
+ * by CMMCore::popNextImages().
+ *
+ * The pixels of all images are stored one after another in a single block
+ * owned by the batch. Reusing the same batch for successive calls avoids
+ * reallocating that block.
+ */
+class ImageBatch
+{
+public:
+   ImageBatch() : usedBytes_(0) {}
+
+   long size() const { return static_cast<long>(entries_.size()); }
+
+   unsigned getImageWidth(long index) const throw (CMMError);
+   unsigned getImageHeight(long index) const throw (CMMError);
+   unsigned getBytesPerPixel(long index) const throw (CMMError);
+   unsigned getNumberOfComponents(long index) const throw (CMMError);
+   void* getImagePixels(long index) throw (CMMError);
+   Metadata getImageMetadata(long index) const throw (CMMError);
+
+#ifndef SWIG
+   void clear();
+   // Add an image; returns where its pixels are to be written. Pointers
+   // returned by earlier calls are invalidated.
+   unsigned char* append(unsigned width, unsigned height, unsigned byteDepth,
+         unsigned nComponents, const Metadata& md);
+   // Reserve room for images totalling the given number of bytes
+   void reservePixels(std::size_t bytes);
+#endif
+
+private:
+   struct Entry
+   {
+      std::size_t offset;
+      unsigned width;
+      unsigned height;
+      unsigned byteDepth;
+      unsigned nComponents;
+      Metadata md;
+   };
+
+   const Entry& getEntry(long index) const throw (CMMError);
+
+   std::vector<Entry> entries_;
+   // Grown as needed but never shrunk, so that a reused batch does not
+   // allocate (or zero) memory again
+   std::vector<unsigned char> pixels_;
+   std::size_t usedBytes_;
+};
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
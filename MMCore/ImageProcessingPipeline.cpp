@@ -0,0 +1,209 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ImageProcessingPipeline.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Runs the image processor on worker threads, off the camera's
+//                acquisition thread.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "ImageProcessingPipeline.h"
+
+#include <utility>
+
+namespace mm {
+
+ImageProcessingPipeline::ImageProcessingPipeline(unsigned threadCount,
+      std::size_t capacity, PublishFunction publish) :
+   capacity_(capacity > 0 ? capacity : 1),
+   publish_(publish),
+   stop_(false),
+   nextSubmitSeq_(0),
+   nextPublishSeq_(0),
+   publishing_(false),
+   overflow_(false),
+   waitLatencyMs_(0.0),
+   processLatencyMs_(0.0),
+   publishLatencyMs_(0.0)
+{
+   if (threadCount == 0)
+      threadCount = 1;
+   for (unsigned i = 0; i < threadCount; ++i)
+      threads_.emplace_back([this] { WorkerFunc(); });
+}
+
+ImageProcessingPipeline::~ImageProcessingPipeline()
+{
+   Drain();
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+   }
+   workCond_.notify_all();
+   for (std::thread& t : threads_)
+      t.join();
+}
+
+std::unique_ptr<ImageProcessingPipeline::Frame>
+ImageProcessingPipeline::AcquireFrame()
+{
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!freeFrames_.empty())
+      {
+         std::unique_ptr<Frame> frame = std::move(freeFrames_.back());
+         freeFrames_.pop_back();
+         return frame;
+      }
+   }
+   return std::unique_ptr<Frame>(new Frame());
+}
+
+void ImageProcessingPipeline::Submit(std::unique_ptr<Frame> frame,
+      ProcessFunction process)
+{
+   {
+      std::unique_lock<std::mutex> lock(mutex_);
+      publishedCond_.wait(lock,
+            [this] { return nextSubmitSeq_ - nextPublishSeq_ < capacity_; });
+      Job job;
+      job.seq = nextSubmitSeq_++;
+      job.frame = std::move(frame);
+      job.process = process;
+      job.submitTime = Clock::now();
+      job.discarded = false;
+      pending_.push_back(std::move(job));
+   }
+   workCond_.notify_one();
+}
+
+void ImageProcessingPipeline::DiscardPending()
+{
+   std::unique_lock<std::mutex> lock(mutex_);
+   while (!pending_.empty())
+   {
+      Job& job = pending_.front();
+      job.discarded = true;
+      const unsigned long long seq = job.seq;
+      completed_[seq] = std::move(job);
+      pending_.pop_front();
+   }
+   PublishReady(lock);
+}
+
+void ImageProcessingPipeline::Drain()
+{
+   std::unique_lock<std::mutex> lock(mutex_);
+   publishedCond_.wait(lock,
+         [this] { return nextPublishSeq_ == nextSubmitSeq_; });
+}
+
+bool ImageProcessingPipeline::TakeOverflow()
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   const bool overflow = overflow_;
+   overflow_ = false;
+   return overflow;
+}
+
+std::size_t ImageProcessingPipeline::GetQueueDepth() const
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   return static_cast<std::size_t>(nextSubmitSeq_ - nextPublishSeq_);
+}
+
+double ImageProcessingPipeline::GetWaitLatencyMs() const
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   return waitLatencyMs_;
+}
+
+double ImageProcessingPipeline::GetProcessLatencyMs() const
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   return processLatencyMs_;
+}
+
+double ImageProcessingPipeline::GetPublishLatencyMs() const
+{
+   std::lock_guard<std::mutex> lock(mutex_);
+   return publishLatencyMs_;
+}
+
+void ImageProcessingPipeline::WorkerFunc()
+{
+   std::unique_lock<std::mutex> lock(mutex_);
+   for (;;)
+   {
+      workCond_.wait(lock, [this] { return stop_ || !pending_.empty(); });
+      if (pending_.empty())
+         return; // Stopped
+
+      Job job = std::move(pending_.front());
+      pending_.pop_front();
+      const Clock::time_point startTime = Clock::now();
+      UpdateAverage(waitLatencyMs_, startTime - job.submitTime);
+      lock.unlock();
+
+      job.process(*job.frame);
+
+      lock.lock();
+      job.processedTime = Clock::now();
+      UpdateAverage(processLatencyMs_, job.processedTime - startTime);
+      const unsigned long long seq = job.seq;
+      completed_[seq] = std::move(job);
+      PublishReady(lock);
+   }
+}
+
+// Publishes the completed frames that are next in order. Only one thread
+// publishes at a time, so that the publish function sees frames in order.
+void ImageProcessingPipeline::PublishReady(std::unique_lock<std::mutex>& lock)
+{
+   if (publishing_)
+      return; // The publishing thread will pick up our frame
+   publishing_ = true;
+   for (;;)
+   {
+      std::map<unsigned long long, Job>::iterator it = completed_.begin();
+      if (it == completed_.end() || it->first != nextPublishSeq_)
+         break;
+      Job job = std::move(it->second);
+      completed_.erase(it);
+
+      if (!job.discarded)
+      {
+         lock.unlock();
+         const bool ok = publish_(*job.frame);
+         lock.lock();
+         if (!ok)
+            overflow_ = true;
+         UpdateAverage(publishLatencyMs_, Clock::now() - job.processedTime);
+      }
+      ++nextPublishSeq_;
+      freeFrames_.push_back(std::move(job.frame));
+   }
+   publishing_ = false;
+   publishedCond_.notify_all();
+}
+
+void ImageProcessingPipeline::UpdateAverage(double& average,
+      Clock::duration sample)
+{
+   // Exponential moving average over roughly the last 16 frames
+   const double ms =
+      std::chrono::duration<double, std::milli>(sample).count();
+   average += (ms - average) / 16.0;
+}
+
+} // namespace mm
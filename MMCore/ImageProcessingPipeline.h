@@ -0,0 +1,154 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ImageProcessingPipeline.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Runs the image processor on worker threads, off the camera's
+//                acquisition thread.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "../MMDevice/ImageMetadata.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mm {
+
+/**
+ * Pipelined image processing stage.
+ *
+ * The camera thread copies each frame into a pooled buffer and submits it,
+ * which is all it waits for. Worker threads run the processing function on
+ * the frames (in parallel if there is more than one worker), and the
+ * processed frames are published (inserted into the circular buffer) in
+ * the order they were submitted. Reordering is bounded by the capacity,
+ * the maximum number of frames submitted but not yet published, which is
+ * also the burst that can be absorbed without slowing down the camera.
+ *
+ * All public member functions are thread-safe.
+ */
+class ImageProcessingPipeline
+{
+public:
+   struct Frame
+   {
+      std::vector<unsigned char> pixels;
+      unsigned width;
+      unsigned height;
+      unsigned byteDepth;
+      unsigned nComponents;
+      Metadata md;
+   };
+
+   typedef std::function<void (Frame&)> ProcessFunction;
+   // Returns false if the frame could not be stored (buffer overflow)
+   typedef std::function<bool (const Frame&)> PublishFunction;
+
+   ImageProcessingPipeline(unsigned threadCount, std::size_t capacity,
+         PublishFunction publish);
+   ~ImageProcessingPipeline(); // Publishes the remaining frames
+
+   unsigned GetThreadCount() const { return static_cast<unsigned>(threads_.size()); }
+   std::size_t GetCapacity() const { return capacity_; }
+
+   /**
+    * Returns a frame (possibly recycled, with its old contents) to fill and
+    * submit.
+    */
+   std::unique_ptr<Frame> AcquireFrame();
+
+   /**
+    * Queues the frame to be processed and published. If the pipeline is at
+    * capacity, blocks until the oldest frame has been published (a camera
+    * outrunning the processor is slowed down, rather than losing frames).
+    */
+   void Submit(std::unique_ptr<Frame> frame, ProcessFunction process);
+
+   /**
+    * Drops the frames that have not started processing yet.
+    */
+   void DiscardPending();
+
+   /**
+    * Blocks until all submitted frames have been published (or dropped).
+    */
+   void Drain();
+
+   /**
+    * Returns true, and clears the flag, if publishing a frame has failed
+    * since the last call.
+    */
+   bool TakeOverflow();
+
+   // Frames submitted but not yet published
+   std::size_t GetQueueDepth() const;
+
+   // Recent average time spent waiting for a worker, processing, and
+   // waiting for earlier frames and being published, respectively
+   double GetWaitLatencyMs() const;
+   double GetProcessLatencyMs() const;
+   double GetPublishLatencyMs() const;
+
+private:
+   typedef std::chrono::steady_clock Clock;
+
+   struct Job
+   {
+      unsigned long long seq;
+      std::unique_ptr<Frame> frame;
+      ProcessFunction process;
+      Clock::time_point submitTime;
+      Clock::time_point processedTime;
+      bool discarded;
+   };
+
+   ImageProcessingPipeline(const ImageProcessingPipeline&);
+   ImageProcessingPipeline& operator=(const ImageProcessingPipeline&);
+
+   void WorkerFunc();
+   void PublishReady(std::unique_lock<std::mutex>& lock);
+   static void UpdateAverage(double& average, Clock::duration sample);
+
+   const std::size_t capacity_;
+   const PublishFunction publish_;
+
+   mutable std::mutex mutex_;
+   std::condition_variable workCond_;
+   std::condition_variable publishedCond_;
+   bool stop_;
+   std::deque<Job> pending_;
+   // Processed (or discarded) frames waiting for earlier ones, by seq
+   std::map<unsigned long long, Job> completed_;
+   unsigned long long nextSubmitSeq_;
+   unsigned long long nextPublishSeq_;
+   bool publishing_; // A thread is in PublishReady()
+   bool overflow_;
+   std::vector<std::unique_ptr<Frame>> freeFrames_;
+   double waitLatencyMs_;
+   double processLatencyMs_;
+   double publishLatencyMs_;
+
+   std::vector<std::thread> threads_;
+};
+
+} // namespace mm
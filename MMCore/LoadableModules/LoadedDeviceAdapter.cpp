@@ -24,13 +24,16 @@
 #include "../Devices/DeviceInstances.h"
 #include "../CoreUtils.h"
 #include "../Error.h"
+#include "../MockDeviceAdapter.h"
 
+#include <algorithm>
 #include <functional>
 #include <memory>
 
 
 LoadedDeviceAdapter::LoadedDeviceAdapter(const std::string& name, const std::string& filename) :
    name_(name),
+   mock_(0),
    InitializeModuleData_(0),
    CreateDevice_(0),
    DeleteDevice_(0),
@@ -66,6 +69,25 @@ LoadedDeviceAdapter::LoadedDeviceAdapter(const std::string& name, const std::str
 }
 
 
+LoadedDeviceAdapter::LoadedDeviceAdapter(const std::string& name, MockDeviceAdapter* mock) :
+   name_(name),
+   mock_(mock),
+   InitializeModuleData_(0),
+   CreateDevice_(0),
+   DeleteDevice_(0),
+   GetModuleVersion_(0),
+   GetDeviceInterfaceVersion_(0),
+   GetNumberOfDevices_(0),
+   GetDeviceName_(0),
+   GetDeviceType_(0),
+   GetDeviceDescription_(0)
+{
+   if (!mock_)
+      throw CMMError("Null mock device adapter " + ToQuotedString(name_));
+   InitializeModuleData();
+}
+
+
 MMThreadLock*
 LoadedDeviceAdapter::GetLock()
 {
@@ -237,6 +259,24 @@ LoadedDeviceAdapter::CheckInterfaceVersion() const
 void
 LoadedDeviceAdapter::InitializeModuleData()
 {
+   if (mock_)
+   {
+      // Like RegisterDevice(), ignore devices that are already registered
+      mock_->InitializeModuleData([this](const char* deviceName,
+            MM::DeviceType type, const char* description)
+      {
+         if (!deviceName || std::find_if(mockDevices_.begin(), mockDevices_.end(),
+               [deviceName](const MockDevice& d) { return d.name == deviceName; })
+               != mockDevices_.end())
+            return;
+         MockDevice device;
+         device.name = deviceName;
+         device.type = type;
+         device.description = description ? description : "";
+         mockDevices_.push_back(device);
+      });
+      return;
+   }
    if (!InitializeModuleData_)
       InitializeModuleData_ = reinterpret_cast<fnInitializeModuleData>
          (module_->GetFunction("InitializeModuleData"));
@@ -247,6 +287,8 @@ LoadedDeviceAdapter::InitializeModuleData()
 MM::Device*
 LoadedDeviceAdapter::CreateDevice(const char* deviceName)
 {
+   if (mock_)
+      return mock_->CreateDevice(deviceName);
    if (!CreateDevice_)
       CreateDevice_ = reinterpret_cast<fnCreateDevice>
          (module_->GetFunction("CreateDevice"));
@@ -257,6 +299,8 @@ LoadedDeviceAdapter::CreateDevice(const char* deviceName)
 void
 LoadedDeviceAdapter::DeleteDevice(MM::Device* device)
 {
+   if (mock_)
+      return mock_->DeleteDevice(device);
    if (!DeleteDevice_)
       DeleteDevice_ = reinterpret_cast<fnDeleteDevice>
          (module_->GetFunction("DeleteDevice"));
@@ -267,6 +311,8 @@ LoadedDeviceAdapter::DeleteDevice(MM::Device* device)
 long
 LoadedDeviceAdapter::GetModuleVersion() const
 {
+   if (mock_)
+      return MODULE_INTERFACE_VERSION;
    if (!GetModuleVersion_)
       GetModuleVersion_ = reinterpret_cast<fnGetModuleVersion>
          (module_->GetFunction("GetModuleVersion"));
@@ -277,6 +323,8 @@ LoadedDeviceAdapter::GetModuleVersion() const
 long
 LoadedDeviceAdapter::GetDeviceInterfaceVersion() const
 {
+   if (mock_)
+      return DEVICE_INTERFACE_VERSION;
    if (!GetDeviceInterfaceVersion_)
       GetDeviceInterfaceVersion_ = reinterpret_cast<fnGetDeviceInterfaceVersion>
          (module_->GetFunction("GetDeviceInterfaceVersion"));
@@ -287,6 +335,8 @@ LoadedDeviceAdapter::GetDeviceInterfaceVersion() const
 unsigned
 LoadedDeviceAdapter::GetNumberOfDevices() const
 {
+   if (mock_)
+      return static_cast<unsigned>(mockDevices_.size());
    if (!GetNumberOfDevices_)
       GetNumberOfDevices_ = reinterpret_cast<fnGetNumberOfDevices>
          (module_->GetFunction("GetNumberOfDevices"));
@@ -297,6 +347,12 @@ LoadedDeviceAdapter::GetNumberOfDevices() const
 bool
 LoadedDeviceAdapter::GetDeviceName(unsigned index, char* buf, unsigned bufLen) const
 {
+   if (mock_)
+   {
+      if (index >= mockDevices_.size())
+         return false;
+      return CopyMockString(mockDevices_[index].name, buf, bufLen);
+   }
    if (!GetDeviceName_)
       GetDeviceName_ = reinterpret_cast<fnGetDeviceName>
          (module_->GetFunction("GetDeviceName"));
@@ -307,6 +363,14 @@ LoadedDeviceAdapter::GetDeviceName(unsigned index, char* buf, unsigned bufLen) c
 bool
 LoadedDeviceAdapter::GetDeviceType(const char* deviceName, int* type) const
 {
+   if (mock_)
+   {
+      const MockDevice* device = FindMockDevice(deviceName);
+      if (!device)
+         return false;
+      *type = device->type;
+      return true;
+   }
    if (!GetDeviceType_)
       GetDeviceType_ = reinterpret_cast<fnGetDeviceType>
          (module_->GetFunction("GetDeviceType"));
@@ -317,8 +381,38 @@ LoadedDeviceAdapter::GetDeviceType(const char* deviceName, int* type) const
 bool
 LoadedDeviceAdapter::GetDeviceDescription(const char* deviceName, char* buf, unsigned bufLen) const
 {
+   if (mock_)
+   {
+      const MockDevice* device = FindMockDevice(deviceName);
+      if (!device)
+         return false;
+      return CopyMockString(device->description, buf, bufLen);
+   }
    if (!GetDeviceDescription_)
       GetDeviceDescription_ = reinterpret_cast<fnGetDeviceDescription>
          (module_->GetFunction("GetDeviceDescription"));
    return GetDeviceDescription_(deviceName, buf, bufLen);
 }
+
+
+const LoadedDeviceAdapter::MockDevice*
+LoadedDeviceAdapter::FindMockDevice(const char* deviceName) const
+{
+   for (const auto& device : mockDevices_)
+   {
+      if (device.name == deviceName)
+         return &device;
+   }
+   return 0;
+}
+
+
+bool
+LoadedDeviceAdapter::CopyMockString(const std::string& s, char* buf, unsigned bufLen)
+{
+   // As in ModuleInterface.cpp, fail rather than truncate
+   if (s.size() >= bufLen)
+      return false;
+   std::memcpy(buf, s.c_str(), s.size() + 1);
+   return true;
+}
@@ -29,8 +29,11 @@
 
 #include <cstring>
 #include <memory>
+#include <string>
+#include <vector>
 
 class CMMCore;
+class MockDeviceAdapter;
 
 
 class DeviceInstance;
@@ -44,10 +47,12 @@ public:
    LoadedDeviceAdapter& operator=(const LoadedDeviceAdapter&) = delete;
 
    LoadedDeviceAdapter(const std::string& name, const std::string& filename);
+   // Use an adapter implemented in the application (not owned)
+   LoadedDeviceAdapter(const std::string& name, MockDeviceAdapter* mock);
 
    // TODO Unload() should mark the instance invalid (or require instance
    // deletion to unload)
-   void Unload() { module_->Unload(); } // For developer use only
+   void Unload() { if (module_) module_->Unload(); } // For developer use only
 
    std::string GetName() const { return name_; }
 
@@ -59,6 +64,9 @@ public:
    std::string GetDeviceDescription(const std::string& deviceName) const;
    MM::DeviceType GetAdvertisedDeviceType(const std::string& deviceName) const;
 
+   long GetModuleVersion() const;
+   long GetDeviceInterfaceVersion() const;
+
    std::shared_ptr<DeviceInstance> LoadDevice(CMMCore* core,
          const std::string& name, const std::string& label,
          mm::logging::Logger deviceLogger,
@@ -98,8 +106,6 @@ private:
 
    // Wrappers around raw module interface functions
    void InitializeModuleData();
-   long GetModuleVersion() const;
-   long GetDeviceInterfaceVersion() const;
    unsigned GetNumberOfDevices() const;
    bool GetDeviceName(unsigned index, char* buf, unsigned bufLen) const;
    bool GetDeviceDescription(const char* deviceName,
@@ -111,6 +117,20 @@ private:
    const std::string name_;
    std::shared_ptr<LoadedModule> module_;
 
+   // Set instead of module_ for mock adapters, with the devices registered by
+   // the mock
+   struct MockDevice
+   {
+      std::string name;
+      MM::DeviceType type;
+      std::string description;
+   };
+   MockDeviceAdapter* mock_;
+   std::vector<MockDevice> mockDevices_;
+
+   const MockDevice* FindMockDevice(const char* deviceName) const;
+   static bool CopyMockString(const std::string& s, char* buf, unsigned bufLen);
+
    MMThreadLock lock_;
 
    // Cached function pointers
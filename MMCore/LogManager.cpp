@@ -37,10 +37,23 @@ LogManager::LogManager() :
    internalLogger_(loggingCore_->NewLogger("LogManager")),
    primaryLogLevel_(logging::LogLevelInfo),
    usingStdErr_(false),
+   primaryFormat_(FileFormatText),
+   primaryMaxFileSize_(0),
    nextSecondaryHandle_(0)
 {}
 
 
+std::shared_ptr<logging::LogSink>
+LogManager::NewFileSink(const std::string& filename, bool truncate,
+      FileFormat format, std::uint64_t maxFileSize)
+{
+   if (format == FileFormatBinary)
+      return std::make_shared<logging::BinaryFileLogSink>(filename, !truncate,
+            maxFileSize);
+   return std::make_shared<logging::FileLogSink>(filename, !truncate);
+}
+
+
 void
 LogManager::SetUseStdErr(bool flag)
 {
@@ -80,14 +93,18 @@ LogManager::IsUsingStdErr() const
 
 
 void
-LogManager::SetPrimaryLogFilename(const std::string& filename, bool truncate)
+LogManager::SetPrimaryLogFilename(const std::string& filename, bool truncate,
+      FileFormat format, std::uint64_t maxFileSize)
 {
    std::lock_guard<std::mutex> lock(mutex_);
 
-   if (filename == primaryFilename_)
+   if (filename == primaryFilename_ && format == primaryFormat_ &&
+         maxFileSize == primaryMaxFileSize_)
       return;
 
    primaryFilename_ = filename;
+   primaryFormat_ = format;
+   primaryMaxFileSize_ = maxFileSize;
 
    if (primaryFilename_.empty())
    {
@@ -103,7 +120,7 @@ LogManager::SetPrimaryLogFilename(const std::string& filename, bool truncate)
    std::shared_ptr<logging::LogSink> newSink;
    try
    {
-      newSink = std::make_shared<logging::FileLogSink>(primaryFilename_, !truncate);
+      newSink = NewFileSink(primaryFilename_, truncate, format, maxFileSize);
    }
    catch (const logging::CannotOpenFileException&)
    {
@@ -219,14 +236,15 @@ LogManager::GetPrimaryLogLevel() const
 
 LogManager::LogFileHandle
 LogManager::AddSecondaryLogFile(logging::LogLevel level,
-      const std::string& filename, bool truncate, logging::SinkMode mode)
+      const std::string& filename, bool truncate, logging::SinkMode mode,
+      FileFormat format, std::uint64_t maxFileSize)
 {
    std::lock_guard<std::mutex> lock(mutex_);
 
    std::shared_ptr<logging::LogSink> sink;
    try
    {
-      sink = std::make_shared<logging::FileLogSink>(filename, !truncate);
+      sink = NewFileSink(filename, truncate, format, maxFileSize);
    }
    catch (const logging::CannotOpenFileException&)
    {
@@ -2,6 +2,7 @@
 
 #include "Logging/Logging.h"
 
+#include <cstdint>
 #include <map>
 #include <mutex>
 #include <string>
@@ -17,6 +18,12 @@ class LogManager
 public:
    typedef int LogFileHandle;
 
+   enum FileFormat
+   {
+      FileFormatText,
+      FileFormatBinary, // See Logging/BinaryLogFormat.h
+   };
+
 private:
    std::shared_ptr<logging::LoggingCore> loggingCore_;
    logging::Logger internalLogger_;
@@ -29,6 +36,8 @@ private:
    std::shared_ptr<logging::LogSink> stdErrSink_;
 
    std::string primaryFilename_;
+   FileFormat primaryFormat_;
+   std::uint64_t primaryMaxFileSize_;
    std::shared_ptr<logging::LogSink> primaryFileSink_;
 
    LogFileHandle nextSecondaryHandle_;
@@ -56,7 +65,9 @@ public:
    void SetUseStdErr(bool flag);
    bool IsUsingStdErr() const;
 
-   void SetPrimaryLogFilename(const std::string& filename, bool truncate);
+   // maxFileSize (nonzero for rotation) is only supported by FileFormatBinary
+   void SetPrimaryLogFilename(const std::string& filename, bool truncate,
+         FileFormat format = FileFormatText, std::uint64_t maxFileSize = 0);
    std::string GetPrimaryLogFilename() const;
    bool IsUsingPrimaryLogFile() const;
 
@@ -65,12 +76,18 @@ public:
 
    LogFileHandle AddSecondaryLogFile(logging::LogLevel level,
          const std::string& filename, bool truncate = true,
-         logging::SinkMode mode = logging::SinkModeAsynchronous);
+         logging::SinkMode mode = logging::SinkModeAsynchronous,
+         FileFormat format = FileFormatText, std::uint64_t maxFileSize = 0);
    void RemoveSecondaryLogFile(LogFileHandle handle);
    // We could add an atomic SwapSecondaryLogFile(handle, filename, truncate),
    // nice for log rotation, but we don't need it now.
 
    logging::Logger NewLogger(const std::string& label);
+
+private:
+   static std::shared_ptr<logging::LogSink> NewFileSink(
+         const std::string& filename, bool truncate, FileFormat format,
+         std::uint64_t maxFileSize);
 };
 
 } // namespace mm
@@ -0,0 +1,107 @@
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+namespace mm
+{
+namespace logging
+{
+namespace internal
+{
+
+
+/*
+ * Binary log file format
+ *
+ * A file is a sequence of segments, each starting with a fixed 16-byte
+ * header (appending to an existing file starts a new segment):
+ *
+ *    8 bytes  magic "MMLOGBIN"
+ *    2 bytes  format version (little endian)
+ *    2 bytes  flags (little endian; see BinaryLogFlag*)
+ *    4 bytes  reserved (zero)
+ *
+ * followed by records, each starting with a tag byte. Integers are unsigned
+ * LEB128 varints; signed integers are zigzag-encoded first.
+ *
+ *    BinaryLogTagLabel   id, length, label bytes
+ *    BinaryLogTagThread  id, thread id
+ *    BinaryLogTagEntry + level
+ *                        label id, thread id index, timestamp delta (signed,
+ *                        microseconds since the previous entry of the
+ *                        segment, or since the epoch), text length, text
+ *                        (lines separated by '\n')
+ *
+ * Labels and thread ids are defined (once per segment) before the first entry
+ * referring to them, so that each segment can be decoded on its own.
+ */
+
+const char BinaryLogMagic[8] = { 'M', 'M', 'L', 'O', 'G', 'B', 'I', 'N' };
+const std::size_t BinaryLogHeaderSize = 16;
+const unsigned BinaryLogVersion = 1;
+
+// Thread ids are pointers (formatted in hex in text logs)
+const unsigned BinaryLogFlagPointerThreadIds = 1;
+
+const unsigned char BinaryLogTagLabel = 0x01;
+const unsigned char BinaryLogTagThread = 0x02;
+const unsigned char BinaryLogTagEntry = 0x10; // Plus LogLevel (< 16)
+
+
+inline void
+AppendVarint(std::string& buf, std::uint64_t value)
+{
+   while (value >= 0x80)
+   {
+      buf.push_back(static_cast<char>((value & 0x7f) | 0x80));
+      value >>= 7;
+   }
+   buf.push_back(static_cast<char>(value));
+}
+
+
+inline std::uint64_t
+ZigzagEncode(std::int64_t value)
+{
+   return (static_cast<std::uint64_t>(value) << 1) ^
+      static_cast<std::uint64_t>(value >> 63);
+}
+
+
+inline std::int64_t
+ZigzagDecode(std::uint64_t value)
+{
+   return static_cast<std::int64_t>(value >> 1) ^
+      -static_cast<std::int64_t>(value & 1);
+}
+
+
+inline void
+AppendBinaryLogHeader(std::string& buf, unsigned flags)
+{
+   buf.append(BinaryLogMagic, sizeof(BinaryLogMagic));
+   buf.push_back(static_cast<char>(BinaryLogVersion & 0xff));
+   buf.push_back(static_cast<char>(BinaryLogVersion >> 8));
+   buf.push_back(static_cast<char>(flags & 0xff));
+   buf.push_back(static_cast<char>(flags >> 8));
+   buf.append(4, '\0');
+}
+
+
+} // namespace internal
+} // namespace logging
+} // namespace mm
@@ -0,0 +1,188 @@
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "BinaryLogReader.h"
+
+#include "BinaryLogFormat.h"
+
+#include <cstring>
+
+
+namespace mm
+{
+namespace logging
+{
+
+
+BinaryLogReader::BinaryLogReader(std::istream& stream) :
+   stream_(stream),
+   flags_(0),
+   lastTimestamp_(0)
+{
+   const int first = stream_.get();
+   if (first != internal::BinaryLogMagic[0])
+      throw BinaryLogFormatError("Not a binary log file");
+   ReadHeaderAfterFirstByte();
+}
+
+
+void
+BinaryLogReader::ReadHeaderAfterFirstByte()
+{
+   char header[internal::BinaryLogHeaderSize];
+   header[0] = internal::BinaryLogMagic[0];
+   stream_.read(header + 1, sizeof(header) - 1);
+   if (!stream_ || std::memcmp(header, internal::BinaryLogMagic,
+            sizeof(internal::BinaryLogMagic)) != 0)
+      throw BinaryLogFormatError("Not a binary log file");
+
+   const unsigned char* p = reinterpret_cast<const unsigned char*>(header);
+   const unsigned version = p[8] | (p[9] << 8);
+   if (version > internal::BinaryLogVersion)
+      throw BinaryLogFormatError("Unsupported binary log version " +
+            std::to_string(version));
+   flags_ = p[10] | (p[11] << 8);
+
+   labels_.clear();
+   threadIds_.clear();
+   lastTimestamp_ = 0;
+}
+
+
+bool
+BinaryLogReader::ReadEntry(BinaryLogEntry& entry)
+{
+   using namespace internal;
+
+   for (;;)
+   {
+      const int tag = stream_.get();
+      if (tag == std::char_traits<char>::eof())
+         return false;
+
+      if (tag == BinaryLogMagic[0]) // Start of appended segment
+      {
+         ReadHeaderAfterFirstByte();
+      }
+      else if (tag == BinaryLogTagLabel)
+      {
+         const std::uint64_t id = ReadVarint();
+         if (id != labels_.size())
+            throw BinaryLogFormatError("Bad label definition");
+         labels_.emplace_back();
+         ReadBytes(labels_.back(), ReadVarint());
+      }
+      else if (tag == BinaryLogTagThread)
+      {
+         const std::uint64_t id = ReadVarint();
+         if (id != threadIds_.size())
+            throw BinaryLogFormatError("Bad thread definition");
+         threadIds_.push_back(ReadVarint());
+      }
+      else if (tag >= BinaryLogTagEntry && tag <= BinaryLogTagEntry + LogLevelFatal)
+      {
+         entry.level = static_cast<LogLevel>(tag - BinaryLogTagEntry);
+         const std::uint64_t labelId = ReadVarint();
+         const std::uint64_t tidIndex = ReadVarint();
+         if (labelId >= labels_.size() || tidIndex >= threadIds_.size())
+            throw BinaryLogFormatError("Undefined label or thread");
+         entry.label = labels_[labelId];
+         entry.threadId = threadIds_[tidIndex];
+         entry.pointerThreadId =
+            (flags_ & BinaryLogFlagPointerThreadIds) != 0;
+
+         lastTimestamp_ += ZigzagDecode(ReadVarint());
+         entry.timestamp = std::chrono::time_point<std::chrono::system_clock>(
+               std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                  std::chrono::microseconds(lastTimestamp_)));
+
+         ReadBytes(entry.text, ReadVarint());
+         return true;
+      }
+      else
+      {
+         throw BinaryLogFormatError("Bad record tag " + std::to_string(tag));
+      }
+   }
+}
+
+
+std::uint64_t
+BinaryLogReader::ReadVarint()
+{
+   std::uint64_t value = 0;
+   for (unsigned shift = 0; shift < 64; shift += 7)
+   {
+      const unsigned char byte = ReadByte();
+      value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+         return value;
+   }
+   throw BinaryLogFormatError("Bad varint");
+}
+
+
+void
+BinaryLogReader::ReadBytes(std::string& dest, std::uint64_t count)
+{
+   // Guard against allocating huge buffers for corrupt lengths
+   const std::uint64_t maxLen = 1 << 30;
+   if (count > maxLen)
+      throw BinaryLogFormatError("Bad length");
+   dest.resize(static_cast<std::size_t>(count));
+   if (count > 0)
+      stream_.read(&dest[0], static_cast<std::streamsize>(count));
+   if (!stream_)
+      throw BinaryLogFormatError("Truncated binary log file");
+}
+
+
+unsigned char
+BinaryLogReader::ReadByte()
+{
+   const int byte = stream_.get();
+   if (byte == std::char_traits<char>::eof())
+      throw BinaryLogFormatError("Truncated binary log file");
+   return static_cast<unsigned char>(byte);
+}
+
+
+void
+WriteBinaryLogEntryAsText(std::ostream& stream, const BinaryLogEntry& entry,
+      internal::MetadataFormatter& formatter)
+{
+   if (entry.pointerThreadId)
+      formatter.FormatLinePrefix(stream, entry.timestamp,
+            reinterpret_cast<const void*>(
+               static_cast<std::uintptr_t>(entry.threadId)),
+            entry.level, entry.label.c_str());
+   else
+      formatter.FormatLinePrefix(stream, entry.timestamp, entry.threadId,
+            entry.level, entry.label.c_str());
+
+   std::string::size_type start = 0;
+   for (;;)
+   {
+      const std::string::size_type end = entry.text.find('\n', start);
+      stream << ' ';
+      stream.write(entry.text.data() + start, static_cast<std::streamsize>(
+               (end == std::string::npos ? entry.text.size() : end) - start));
+      stream << '\n';
+      if (end == std::string::npos)
+         break;
+      formatter.FormatContinuationPrefix(stream);
+      start = end + 1;
+   }
+}
+
+
+} // namespace logging
+} // namespace mm
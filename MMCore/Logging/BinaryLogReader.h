@@ -0,0 +1,91 @@
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "Metadata.h"
+#include "MetadataFormatter.h"
+
+#include <chrono>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+namespace mm
+{
+namespace logging
+{
+
+
+class BinaryLogFormatError : public std::runtime_error
+{
+public:
+   explicit BinaryLogFormatError(const std::string& what) :
+      std::runtime_error(what)
+   {}
+};
+
+
+struct BinaryLogEntry
+{
+   std::chrono::time_point<std::chrono::system_clock> timestamp;
+   std::uint64_t threadId;
+   bool pointerThreadId; // Thread id was a pointer (shown in hex)
+   LogLevel level;
+   std::string label;
+   std::string text; // Lines separated by '\n'
+};
+
+
+/**
+ * Decoder for files written by BinaryFileLogSink
+ */
+class BinaryLogReader
+{
+   std::istream& stream_;
+   unsigned flags_;
+   std::vector<std::string> labels_;
+   std::vector<std::uint64_t> threadIds_;
+   std::int64_t lastTimestamp_;
+
+public:
+   BinaryLogReader(const BinaryLogReader&) = delete;
+   BinaryLogReader& operator=(const BinaryLogReader&) = delete;
+
+   // Throws BinaryLogFormatError if the stream does not start with a binary
+   // log header.
+   explicit BinaryLogReader(std::istream& stream);
+
+   // Returns false at the end of the stream. Throws BinaryLogFormatError if
+   // the data is corrupt or truncated.
+   bool ReadEntry(BinaryLogEntry& entry);
+
+private:
+   void ReadHeaderAfterFirstByte();
+   std::uint64_t ReadVarint();
+   void ReadBytes(std::string& dest, std::uint64_t count);
+   unsigned char ReadByte();
+};
+
+
+/**
+ * Writes an entry in the same text format as the text log file sinks.
+ */
+void WriteBinaryLogEntryAsText(std::ostream& stream,
+      const BinaryLogEntry& entry, internal::MetadataFormatter& formatter);
+
+
+} // namespace logging
+} // namespace mm
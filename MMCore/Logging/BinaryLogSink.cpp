@@ -0,0 +1,261 @@
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "BinaryLogSink.h"
+
+#include "BinaryLogFormat.h"
+#include "GenericStreamSink.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <type_traits>
+
+
+namespace mm
+{
+namespace logging
+{
+
+namespace
+{
+
+template <typename T>
+std::uint64_t
+ThreadIdToInteger(T* tid)
+{ return reinterpret_cast<std::uintptr_t>(tid); }
+
+template <typename T>
+std::uint64_t
+ThreadIdToInteger(T tid)
+{ return static_cast<std::uint64_t>(tid); }
+
+bool
+FileExists(const std::string& filename)
+{
+   std::ifstream f(filename.c_str());
+   return f.good();
+}
+
+} // anonymous namespace
+
+
+BinaryFileLogSink::BinaryFileLogSink(const std::string& filename, bool append,
+      std::uint64_t maxFileSize) :
+   filename_(filename),
+   maxFileSize_(maxFileSize),
+   fileSize_(0),
+   nextRotationIndex_(1),
+   hadError_(false),
+   lastTimestamp_(0)
+{
+   std::ios_base::openmode mode = std::ios_base::out | std::ios_base::binary;
+   if (append)
+   {
+      std::ifstream existing(filename_.c_str(),
+            std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
+      if (existing)
+         fileSize_ = static_cast<std::uint64_t>(existing.tellg());
+      mode |= std::ios_base::app;
+   }
+   else
+   {
+      mode |= std::ios_base::trunc;
+   }
+
+   fileStream_.open(filename_.c_str(), mode);
+   if (!fileStream_)
+      throw CannotOpenFileException();
+
+   if (maxFileSize_ > 0)
+   {
+      while (FileExists(RotatedFilename(filename_, nextRotationIndex_)))
+         ++nextRotationIndex_;
+   }
+
+   StartSegment();
+   WriteBuffer();
+}
+
+
+std::string
+BinaryFileLogSink::RotatedFilename(const std::string& filename, unsigned index)
+{
+   char suffix[16];
+   std::snprintf(suffix, sizeof(suffix), ".%04u", index);
+   return filename + suffix;
+}
+
+
+void
+BinaryFileLogSink::Consume(const PacketArrayType& packets)
+{
+   // Reassemble the entries from their line packets
+   const Metadata* entryMetadata = 0;
+   for (PacketArrayType::ConstIteratorType it = packets.Begin(),
+         end = packets.End(); it != end; ++it)
+   {
+      if (GetFilter() && !GetFilter()->Filter(it->GetMetadataConstRef()))
+         continue;
+
+      switch (it->GetPacketState())
+      {
+         case internal::PacketStateEntryFirstLine:
+            if (entryMetadata)
+               EncodeEntry(*entryMetadata, text_);
+            entryMetadata = &it->GetMetadataConstRef();
+            text_ = it->GetText();
+            break;
+         case internal::PacketStateNewLine:
+            text_ += '\n';
+            text_ += it->GetText();
+            break;
+         case internal::PacketStateLineContinuation:
+            text_ += it->GetText();
+            break;
+      }
+   }
+   if (entryMetadata)
+      EncodeEntry(*entryMetadata, text_);
+
+   WriteBuffer();
+   fileStream_.flush();
+   if (!fileStream_)
+      ReportError("write failed");
+}
+
+
+void
+BinaryFileLogSink::StartSegment()
+{
+   internal::AppendBinaryLogHeader(buf_,
+         std::is_pointer<internal::ThreadIdType>::value ?
+         internal::BinaryLogFlagPointerThreadIds : 0);
+   labelIds_.clear();
+   threadIds_.clear();
+   lastTimestamp_ = 0;
+}
+
+
+void
+BinaryFileLogSink::EncodeEntry(const Metadata& metadata,
+      const std::string& text)
+{
+   using namespace internal;
+
+   const char* label = metadata.GetLoggerData().GetComponentLabel();
+   std::unordered_map<const char*, std::uint64_t>::const_iterator labelIt =
+      labelIds_.find(label);
+   std::uint64_t labelId;
+   if (labelIt != labelIds_.end())
+   {
+      labelId = labelIt->second;
+   }
+   else
+   {
+      labelId = labelIds_.size();
+      labelIds_.insert(std::make_pair(label, labelId));
+      const std::string labelStr(label);
+      buf_.push_back(static_cast<char>(BinaryLogTagLabel));
+      AppendVarint(buf_, labelId);
+      AppendVarint(buf_, labelStr.size());
+      buf_ += labelStr;
+   }
+
+   const std::uint64_t tid =
+      ThreadIdToInteger(metadata.GetStampData().GetThreadId());
+   std::unordered_map<std::uint64_t, std::uint64_t>::const_iterator tidIt =
+      threadIds_.find(tid);
+   std::uint64_t tidIndex;
+   if (tidIt != threadIds_.end())
+   {
+      tidIndex = tidIt->second;
+   }
+   else
+   {
+      tidIndex = threadIds_.size();
+      threadIds_.insert(std::make_pair(tid, tidIndex));
+      buf_.push_back(static_cast<char>(BinaryLogTagThread));
+      AppendVarint(buf_, tidIndex);
+      AppendVarint(buf_, tid);
+   }
+
+   // Entries from different threads are not strictly in timestamp order, so
+   // the delta is signed.
+   const std::int64_t timestamp =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+            metadata.GetStampData().GetTimestamp().time_since_epoch()).count();
+
+   buf_.push_back(static_cast<char>(BinaryLogTagEntry +
+            metadata.GetEntryData().GetLevel()));
+   AppendVarint(buf_, labelId);
+   AppendVarint(buf_, tidIndex);
+   AppendVarint(buf_, ZigzagEncode(timestamp - lastTimestamp_));
+   AppendVarint(buf_, text.size());
+   buf_ += text;
+   lastTimestamp_ = timestamp;
+
+   if (maxFileSize_ > 0 && fileSize_ + buf_.size() >= maxFileSize_)
+   {
+      WriteBuffer();
+      Rotate();
+   }
+}
+
+
+void
+BinaryFileLogSink::WriteBuffer()
+{
+   if (buf_.empty())
+      return;
+   fileStream_.write(buf_.data(), static_cast<std::streamsize>(buf_.size()));
+   fileSize_ += buf_.size();
+   buf_.clear();
+}
+
+
+void
+BinaryFileLogSink::Rotate()
+{
+   fileStream_.close();
+   const std::string rotated =
+      RotatedFilename(filename_, nextRotationIndex_++);
+   if (std::rename(filename_.c_str(), rotated.c_str()) != 0)
+      ReportError("cannot rename to " + rotated);
+
+   // If renaming failed, we keep writing to the same file
+   fileStream_.clear();
+   fileStream_.open(filename_.c_str(),
+         std::ios_base::out | std::ios_base::binary | std::ios_base::app);
+   if (!fileStream_)
+   {
+      ReportError("cannot reopen file");
+      return;
+   }
+   fileSize_ = static_cast<std::uint64_t>(fileStream_.tellp());
+   StartSegment();
+}
+
+
+void
+BinaryFileLogSink::ReportError(const std::string& message)
+{
+   if (!hadError_)
+   {
+      hadError_ = true;
+      std::cerr << "Logging: binary log file " << filename_ << ": " <<
+         message << '\n';
+   }
+}
+
+
+} // namespace logging
+} // namespace mm
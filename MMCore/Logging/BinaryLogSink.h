@@ -0,0 +1,84 @@
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "GenericSink.h"
+#include "Metadata.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+
+
+namespace mm
+{
+namespace logging
+{
+
+
+/**
+ * Log sink writing the compact binary format (see BinaryLogFormat.h)
+ *
+ * Nothing is formatted as text when logging; use the mmlogdecode tool (or
+ * BinaryLogReader) to convert the files to the usual text format.
+ *
+ * If maxFileSize is nonzero, the file is rotated when it reaches that size:
+ * it is renamed to filename.0001 (then .0002, etc., skipping existing
+ * files) and a new file is started under the original name.
+ */
+class BinaryFileLogSink : public internal::GenericSink<Metadata>
+{
+public:
+   typedef internal::GenericSink<Metadata> Super;
+   typedef Super::PacketArrayType PacketArrayType;
+
+private:
+   std::string filename_;
+   std::uint64_t maxFileSize_;
+   std::ofstream fileStream_;
+   std::uint64_t fileSize_;
+   unsigned nextRotationIndex_;
+   bool hadError_;
+
+   // Per-segment state
+   std::unordered_map<const char*, std::uint64_t> labelIds_;
+   std::unordered_map<std::uint64_t, std::uint64_t> threadIds_;
+   std::int64_t lastTimestamp_;
+
+   // Reused buffers
+   std::string buf_;
+   std::string text_;
+
+public:
+   BinaryFileLogSink(const BinaryFileLogSink&) = delete;
+   BinaryFileLogSink& operator=(const BinaryFileLogSink&) = delete;
+
+   BinaryFileLogSink(const std::string& filename, bool append = false,
+         std::uint64_t maxFileSize = 0);
+
+   virtual void Consume(const PacketArrayType& packets);
+
+   static std::string RotatedFilename(const std::string& filename,
+         unsigned index);
+
+private:
+   void StartSegment();
+   void EncodeEntry(const Metadata& metadata, const std::string& text);
+   void WriteBuffer();
+   void Rotate();
+   void ReportError(const std::string& message);
+};
+
+
+} // namespace logging
+} // namespace mm
@@ -0,0 +1,212 @@
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+namespace mm
+{
+namespace logging
+{
+namespace internal
+{
+
+
+/**
+ * Raw (not yet split into lines) log entry
+ *
+ * The text is stored separately (null-terminated, starting at textOffset),
+ * so that collecting entries does not allocate memory for each.
+ */
+template <class TMetadata>
+struct GenericRawEntry
+{
+   TMetadata metadata;
+   std::size_t textOffset;
+
+   GenericRawEntry(const TMetadata& m, std::size_t offset) :
+      metadata(m),
+      textOffset(offset)
+   {}
+};
+
+
+/**
+ * Single-producer, single-consumer lock-free ring of raw log entries
+ *
+ * Each logging thread gets its own ring, so that logging an entry does not
+ * take a lock or allocate memory. The entry text is stored in fixed-size
+ * slots (long entries take consecutive slots); the consumer (the
+ * asynchronous sink thread) reassembles it.
+ */
+template <class TMetadata>
+class GenericEntryRing
+{
+public:
+   static const std::size_t SlotTextLen = 96;
+
+   typedef GenericRawEntry<TMetadata> RawEntryType;
+
+private:
+   // Metadata is copied as raw bytes into slots that are reused without
+   // being destroyed.
+   static_assert(std::is_trivially_copyable<TMetadata>::value,
+         "Log metadata must be trivially copyable");
+   typedef typename std::aligned_storage<sizeof(TMetadata),
+           alignof(TMetadata)>::type MetadataStorage;
+
+   struct Slot
+   {
+      MetadataStorage metadata; // Valid if firstOfEntry
+      unsigned short textLen;
+      bool firstOfEntry;
+      bool lastOfEntry;
+      char text[SlotTextLen];
+   };
+
+   std::vector<Slot> slots_;
+   const std::size_t mask_;
+
+   // Written by producer only
+   std::atomic<std::size_t> head_;
+   char padding_[64]; // Keep head_ and tail_ in different cache lines
+   // Written by consumer only
+   std::atomic<std::size_t> tail_;
+
+   // Consumer-only state for an entry whose slots are not all written yet
+   MetadataStorage pendingMetadata_;
+   std::string pendingText_;
+
+   std::atomic<bool> closed_;
+
+public:
+   GenericEntryRing(const GenericEntryRing&) = delete;
+   GenericEntryRing& operator=(const GenericEntryRing&) = delete;
+
+   // capacity (in slots) is rounded up to a power of 2
+   explicit GenericEntryRing(std::size_t capacity = 1024) :
+      slots_(RoundUpToPowerOf2(capacity)),
+      mask_(slots_.size() - 1),
+      head_(0),
+      tail_(0),
+      closed_(false)
+   {}
+
+   /**
+    * Store an entry (producer thread only).
+    *
+    * If the ring is full, waitForSpace() is called repeatedly until the
+    * consumer has made room. Entries longer than the whole ring are handled
+    * this way, too.
+    */
+   template <typename TWaitFunc>
+   void Push(const TMetadata& metadata, const char* text,
+         TWaitFunc waitForSpace)
+   {
+      std::size_t remaining = std::strlen(text);
+      std::size_t head = head_.load(std::memory_order_relaxed);
+      bool first = true;
+      do
+      {
+         while (head - tail_.load(std::memory_order_acquire) == slots_.size())
+            waitForSpace();
+
+         Slot& slot = slots_[head & mask_];
+         if (first)
+            new (&slot.metadata) TMetadata(metadata);
+         const std::size_t len = (std::min)(remaining, SlotTextLen);
+         std::memcpy(slot.text, text, len);
+         slot.textLen = static_cast<unsigned short>(len);
+         slot.firstOfEntry = first;
+         slot.lastOfEntry = (len == remaining);
+         text += len;
+         remaining -= len;
+         first = false;
+
+         head_.store(++head, std::memory_order_release);
+      } while (remaining > 0);
+   }
+
+   /**
+    * Append the completely written entries to entries, and their text
+    * (null-terminated) to text (consumer thread only).
+    */
+   void Drain(std::vector<RawEntryType>& entries, std::string& text)
+   {
+      const std::size_t head = head_.load(std::memory_order_acquire);
+      std::size_t tail = tail_.load(std::memory_order_relaxed);
+      for (; tail != head; ++tail)
+      {
+         const Slot& slot = slots_[tail & mask_];
+         if (slot.firstOfEntry)
+         {
+            if (slot.lastOfEntry) // Common case: single slot
+            {
+               entries.emplace_back(
+                     *reinterpret_cast<const TMetadata*>(&slot.metadata),
+                     text.size());
+               text.append(slot.text, slot.textLen);
+               text.push_back('\0');
+               continue;
+            }
+            pendingMetadata_ = slot.metadata;
+            pendingText_.clear();
+         }
+         pendingText_.append(slot.text, slot.textLen);
+         if (slot.lastOfEntry)
+         {
+            entries.emplace_back(
+                  *reinterpret_cast<const TMetadata*>(&pendingMetadata_),
+                  text.size());
+            text.append(pendingText_);
+            text.push_back('\0');
+         }
+      }
+      tail_.store(tail, std::memory_order_release);
+   }
+
+   bool IsEmpty() const
+   {
+      return head_.load(std::memory_order_acquire) ==
+         tail_.load(std::memory_order_acquire);
+   }
+
+   // Marks the ring as no longer drained (its logging core is gone)
+   void Close() { closed_.store(true); }
+   bool IsClosed() const { return closed_.load(); }
+
+private:
+   static std::size_t RoundUpToPowerOf2(std::size_t n)
+   {
+      std::size_t p = 1;
+      while (p < n)
+         p <<= 1;
+      return p;
+   }
+};
+
+template <class TMetadata>
+const std::size_t GenericEntryRing<TMetadata>::SlotTextLen;
+
+
+} // namespace internal
+} // namespace logging
+} // namespace mm
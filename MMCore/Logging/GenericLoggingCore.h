@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include "GenericEntryRing.h"
 #include "GenericLinePacket.h"
 #include "GenericLogger.h"
 #include "GenericMetadata.h"
@@ -23,10 +24,14 @@
 #include "GenericSink.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 namespace mm
@@ -60,12 +65,27 @@ public:
 private:
    typedef internal::GenericLinePacket<TMetadata> LinePacketType;
    typedef GenericPacketArray<TMetadata> PacketArrayType;
+   typedef internal::GenericEntryRing<TMetadata> EntryRingType;
+   typedef typename EntryRingType::RawEntryType RawEntryType;
 
    // When acquiring both syncSinksMutex_ and asyncQueueMutex_, acquire in that
    // order.
 
    std::mutex syncSinksMutex_; // Protect all access to synchronousSinks_
    std::vector< std::shared_ptr<SinkType> > synchronousSinks_;
+   // Lets SendEntry() skip syncSinksMutex_ when there are no synchronous
+   // sinks (the usual case). Only changed with syncSinksMutex_ held.
+   std::atomic<std::size_t> synchronousSinkCount_;
+
+   // Entries for asynchronous sinks are written by each thread into its own
+   // ring (see GetThreadRing()) and collected by the receive loop, so that
+   // logging threads do not contend for a lock.
+   const unsigned long long id_; // Identifies this core to threads
+   std::mutex ringsMutex_; // Protect rings_
+   std::vector< std::shared_ptr<EntryRingType> > rings_;
+   // Used by receive loop
+   std::vector<RawEntryType> collected_;
+   std::string collectedText_;
 
    std::mutex asyncQueueMutex_; // Protect start/stop and sinks change
    internal::GenericPacketQueue<TMetadata> asyncQueue_;
@@ -74,8 +94,18 @@ private:
    std::vector< std::shared_ptr<SinkType> > asynchronousSinks_;
 
 public:
-   GenericLoggingCore() { StartAsyncReceiveLoop(); }
-   ~GenericLoggingCore() { StopAsyncReceiveLoop(); }
+   GenericLoggingCore() :
+      synchronousSinkCount_(0),
+      id_(NextId())
+   { StartAsyncReceiveLoop(); }
+
+   ~GenericLoggingCore()
+   {
+      StopAsyncReceiveLoop();
+      std::lock_guard<std::mutex> lock(ringsMutex_);
+      for (std::size_t i = 0; i < rings_.size(); ++i)
+         rings_[i]->Close();
+   }
 
    /**
     * Create a new logger.
@@ -102,6 +132,7 @@ public:
          {
             std::lock_guard<std::mutex> lock(syncSinksMutex_);
             synchronousSinks_.push_back(sink);
+            synchronousSinkCount_ = synchronousSinks_.size();
             break;
          }
          case SinkModeAsynchronous:
@@ -133,6 +164,7 @@ public:
                      sink);
             if (it != synchronousSinks_.end())
                synchronousSinks_.erase(it);
+            synchronousSinkCount_ = synchronousSinks_.size();
             break;
          }
          case SinkModeAsynchronous:
@@ -167,9 +199,11 @@ public:
          SinkModePairIterator lastToAdd)
    {
       // Lock both sink lists in the designated order. Since locking
-      // syncSinksMutex_ causes logging to block, subsequently draining the
-      // async queue by stopping the receive loop causes all sinks to
-      // synchronize (emit up to the same log entry).
+      // syncSinksMutex_ causes logging to synchronous sinks to block,
+      // subsequently draining the async queue by stopping the receive loop
+      // causes all sinks to synchronize (emit up to the same log entry).
+      // Entries logged to asynchronous sinks in the meantime stay in the
+      // thread rings and go to the new sinks.
       std::lock_guard<std::mutex> lockSyncs(syncSinksMutex_);
       std::lock_guard<std::mutex> lockAsyncQ(asyncQueueMutex_);
       StopAsyncReceiveLoop();
@@ -206,6 +240,7 @@ public:
                break;
          }
       }
+      synchronousSinkCount_ = synchronousSinks_.size();
 
       StartAsyncReceiveLoop();
    }
@@ -268,10 +303,11 @@ private:
       StampDataType stampData;
       stampData.Stamp();
 
-      PacketArrayType packets;
-      packets.AppendEntry(loggerData, entryData, stampData, entryText);
-
+      if (synchronousSinkCount_.load(std::memory_order_relaxed) > 0)
       {
+         PacketArrayType packets;
+         packets.AppendEntry(loggerData, entryData, stampData, entryText);
+
          std::lock_guard<std::mutex> lock(syncSinksMutex_);
 
          for (typename std::vector< std::shared_ptr<SinkType> >::iterator
@@ -281,7 +317,109 @@ private:
             (*it)->Consume(packets);
          }
       }
-      asyncQueue_.SendPackets(packets.Begin(), packets.End());
+
+      // Line splitting and formatting are left to the receive thread.
+      EntryRingType* ring = GetThreadRing();
+      if (ring)
+      {
+         ring->Push(TMetadata(loggerData, entryData, stampData), entryText,
+               [this] { asyncQueue_.RequestReceive(); std::this_thread::yield(); });
+         asyncQueue_.Notify();
+      }
+      else
+      {
+         PacketArrayType packets;
+         packets.AppendEntry(loggerData, entryData, stampData, entryText);
+         asyncQueue_.SendPackets(packets.Begin(), packets.End());
+      }
+   }
+
+   static unsigned long long NextId()
+   {
+      static std::atomic<unsigned long long> nextId(0);
+      return ++nextId;
+   }
+
+   // Returns the calling thread's ring for this core, creating it on first
+   // use. Returns null if the thread's ring list has already been destroyed
+   // (logging from static destructors at exit).
+   EntryRingType* GetThreadRing()
+   {
+      struct ThreadRings
+      {
+         std::vector< std::pair<unsigned long long,
+            std::shared_ptr<EntryRingType> > > rings;
+         bool& destroyed;
+
+         explicit ThreadRings(bool& d) : destroyed(d) {}
+         ~ThreadRings() { destroyed = true; }
+      };
+      static thread_local bool destroyed = false;
+      if (destroyed)
+         return 0;
+      static thread_local ThreadRings threadRings(destroyed);
+
+      for (std::size_t i = 0; i < threadRings.rings.size(); ++i)
+      {
+         if (threadRings.rings[i].first == id_)
+            return threadRings.rings[i].second.get();
+      }
+
+      // Forget rings of destroyed cores
+      threadRings.rings.erase(std::remove_if(threadRings.rings.begin(),
+               threadRings.rings.end(),
+               [](const std::pair<unsigned long long,
+                  std::shared_ptr<EntryRingType> >& r)
+               { return r.second->IsClosed(); }),
+            threadRings.rings.end());
+
+      std::shared_ptr<EntryRingType> ring = std::make_shared<EntryRingType>();
+      {
+         std::lock_guard<std::mutex> lock(ringsMutex_);
+         rings_.push_back(ring);
+      }
+      threadRings.rings.push_back(std::make_pair(id_, ring));
+      return ring.get();
+   }
+
+   // Called on the receive thread of GenericPacketQueue
+   void CollectEntries(PacketArrayType& packets)
+   {
+      {
+         std::lock_guard<std::mutex> lock(ringsMutex_);
+         for (std::size_t i = 0; i < rings_.size(); )
+         {
+            // Only we hold the ring once its thread has exited, after which
+            // nothing more is pushed.
+            const bool orphaned = rings_[i].use_count() == 1;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            rings_[i]->Drain(collected_, collectedText_);
+            if (orphaned)
+               rings_.erase(rings_.begin() + i);
+            else
+               ++i;
+         }
+      }
+      if (collected_.empty())
+         return;
+
+      // Each ring is in order; restore the order across threads.
+      auto earlier = [](const RawEntryType& a, const RawEntryType& b)
+      {
+         return a.metadata.GetStampData().GetTimestamp() <
+            b.metadata.GetStampData().GetTimestamp();
+      };
+      if (!std::is_sorted(collected_.begin(), collected_.end(), earlier))
+         std::stable_sort(collected_.begin(), collected_.end(), earlier);
+      for (typename std::vector<RawEntryType>::const_iterator
+            it = collected_.begin(), end = collected_.end(); it != end; ++it)
+      {
+         const TMetadata& m = it->metadata;
+         packets.AppendEntry(m.GetLoggerData(), m.GetEntryData(),
+               m.GetStampData(), collectedText_.c_str() + it->textOffset);
+      }
+      collected_.clear();
+      collectedText_.clear();
    }
 
    // Called on the receive thread of GenericPacketQueue
@@ -298,7 +436,8 @@ private:
    void StartAsyncReceiveLoop()
    {
       asyncQueue_.RunReceiveLoop(
-            std::bind(&GenericLoggingCore::RunAsynchronousSinks, this, std::placeholders::_1));
+            std::bind(&GenericLoggingCore::RunAsynchronousSinks, this, std::placeholders::_1),
+            std::bind(&GenericLoggingCore::CollectEntries, this, std::placeholders::_1));
    }
 
    void StopAsyncReceiveLoop()
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <functional>
@@ -45,6 +46,11 @@ private:
    PacketArrayType received_;
 
    bool shutdownRequested_; // Protected by mutex_
+   bool wakeRequested_; // Protected by mutex_
+
+   // Set while the receive loop is about to wait (untimed) for data; see
+   // Notify().
+   std::atomic<bool> idle_;
 
    // threadMutex_ protects the start/stop of loopThread_; it must be acquired
    // before mutex_.
@@ -53,7 +59,9 @@ private:
 
 public:
    GenericPacketQueue() :
-      shutdownRequested_(false)
+      shutdownRequested_(false),
+      wakeRequested_(false),
+      idle_(false)
    {}
 
    template <typename TPacketIter>
@@ -64,8 +72,48 @@ public:
       condVar_.notify_one();
    }
 
-   void RunReceiveLoop(std::function<void (PacketArrayType&)>
-         consume)
+   /**
+    * Wake the receive loop if it is waiting for data.
+    *
+    * To be called after storing data that the collect function (see
+    * RunReceiveLoop()) will find. Only takes the mutex if the loop is idle,
+    * i.e., for the first entry after a pause in logging.
+    */
+   void Notify()
+   {
+      // Pairs with the fence in ReceiveLoop(): either the loop sees our data
+      // when it collects after setting idle_, or we see idle_ set.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (idle_.load(std::memory_order_relaxed) && idle_.exchange(false))
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         wakeRequested_ = true;
+         condVar_.notify_one();
+      }
+   }
+
+   /**
+    * Wake the receive loop now, even if it is in its timed wait.
+    *
+    * To be called when a producer is blocked because data has not been
+    * collected.
+    */
+   void RequestReceive()
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      wakeRequested_ = true;
+      condVar_.notify_one();
+   }
+
+   /**
+    * Start the receive loop thread.
+    *
+    * Each time the loop wakes up, packets sent with SendPackets() are
+    * gathered, then collect() is called to append any packets stored
+    * elsewhere, and the resulting array is passed to consume().
+    */
+   void RunReceiveLoop(std::function<void (PacketArrayType&)> consume,
+         std::function<void (PacketArrayType&)> collect)
    {
       std::lock_guard<std::mutex> tLock(threadMutex_);
 
@@ -81,7 +129,7 @@ public:
       }
 
       std::thread t(std::bind(&GenericPacketQueue::ReceiveLoop,
-               this, consume));
+               this, consume, collect));
       using std::swap;
       swap(loopThread_, t);
    }
@@ -106,14 +154,15 @@ public:
    }
 
 private:
-   void ReceiveLoop(std::function<void (PacketArrayType&)> consume)
+   void ReceiveLoop(std::function<void (PacketArrayType&)> consume,
+         std::function<void (PacketArrayType&)> collect)
    {
       using namespace std::chrono_literals;
 
       // The loop operates in one of two modes: timed wait and untimed wait.
       //
-      // When in timed wait mode, the loop unconditionally waits for a fixed
-      // interval before checking for data. If data is available, it is
+      // When in timed wait mode, the loop waits for a fixed interval (unless
+      // a producer is blocked; see RequestReceive()) before checking for data. If data is available, it is
       // processed and the loop repeats an unconditional wait. If no data is
       // available, the loop switches to untimed wait mode.
       //
@@ -132,23 +181,25 @@ private:
       {
          if (timedWaitMode)
          {
-            // TODO Make interval configurable
-            std::this_thread::sleep_for(10ms);
-
             {
-               std::lock_guard<std::mutex> lock(mutex_);
+               // TODO Make interval configurable
+               std::unique_lock<std::mutex> lock(mutex_);
+               condVar_.wait_for(lock, 10ms, [this]
+                     { return wakeRequested_ || shutdownRequested_; });
+               wakeRequested_ = false;
                if (shutdownRequested_)
                {
                   shutdownRequested_ = false; // Allow for restarting
                   shuttingDown = true;
                }
-               if (!shuttingDown && queue_.IsEmpty())
-               {
-                  timedWaitMode = false;
-                  continue;
-               }
                queue_.Swap(received_);
             }
+            collect(received_);
+            if (!shuttingDown && received_.IsEmpty())
+            {
+               timedWaitMode = false;
+               continue;
+            }
             consume(received_);
             received_.Clear();
 
@@ -157,20 +208,25 @@ private:
          }
          else // untimed wait mode
          {
+            idle_.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            collect(received_); // Data stored before idle_ was visible
             {
                std::unique_lock<std::mutex> lock(mutex_);
-               while (queue_.IsEmpty())
-               {
+               while (received_.IsEmpty() && queue_.IsEmpty() &&
+                     !wakeRequested_ && !shutdownRequested_)
                   condVar_.wait(lock);
-                  if (shutdownRequested_)
-                  {
-                     shutdownRequested_ = false; // Allow for restarting
-                     shuttingDown = true;
-                     break;
-                  }
+               wakeRequested_ = false;
+               if (shutdownRequested_)
+               {
+                  shutdownRequested_ = false; // Allow for restarting
+                  shuttingDown = true;
                }
-               queue_.Swap(received_);
+               received_.Append(queue_.Begin(), queue_.End());
+               queue_.Clear();
             }
+            idle_.store(false);
+            collect(received_);
             consume(received_);
             received_.Clear();
 
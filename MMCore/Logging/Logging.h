@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include "BinaryLogSink.h"
 #include "GenericStreamSink.h"
 #include "GenericEntryFilter.h"
 #include "GenericLoggingCore.h"
@@ -66,6 +66,12 @@ public:
    // Format the line prefix for the first line of an entry
    void FormatLinePrefix(std::ostream& stream, const Metadata& metadata);
 
+   // Same, from the individual fields (used when decoding binary logs)
+   template <typename TThreadId>
+   void FormatLinePrefix(std::ostream& stream,
+         std::chrono::time_point<std::chrono::system_clock> timestamp,
+         TThreadId threadId, LogLevel level, const char* componentLabel);
+
    // Format the line prefix for subsequent lines of an entry
    void FormatContinuationPrefix(std::ostream& stream);
 };
@@ -104,22 +110,35 @@ FormatLocalTime(std::chrono::time_point<std::chrono::system_clock> tp)
 inline void
 MetadataFormatter::FormatLinePrefix(std::ostream& stream,
       const Metadata& metadata)
+{
+   FormatLinePrefix(stream, metadata.GetStampData().GetTimestamp(),
+         metadata.GetStampData().GetThreadId(),
+         metadata.GetEntryData().GetLevel(),
+         metadata.GetLoggerData().GetComponentLabel());
+}
+
+
+template <typename TThreadId>
+inline void
+MetadataFormatter::FormatLinePrefix(std::ostream& stream,
+      std::chrono::time_point<std::chrono::system_clock> timestamp,
+      TThreadId threadId, LogLevel level, const char* componentLabel)
 {
    // Pre-forming string is more efficient than writing bit by bit to stream.
 
-   buf_ = FormatLocalTime(metadata.GetStampData().GetTimestamp());
+   buf_ = FormatLocalTime(timestamp);
    buf_ += " tid";
    sstrm_.str(std::string());
-   sstrm_ << metadata.GetStampData().GetThreadId();
+   sstrm_ << threadId;
    buf_ += sstrm_.str();
    buf_ += ' ';
 
    openBracketCol_ = buf_.size();
    buf_ += '[';
 
-   buf_ += LevelString(metadata.GetEntryData().GetLevel());
+   buf_ += LevelString(level);
    buf_ += ',';
-   buf_ += metadata.GetLoggerData().GetComponentLabel();
+   buf_ += componentLabel;
 
    closeBracketCol_ = buf_.size();
    buf_ += ']';
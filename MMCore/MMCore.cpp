@@ -41,7 +41,9 @@
 #include "../MMDevice/DeviceUtils.h"
 #include "../MMDevice/ImageMetadata.h"
 #include "../MMDevice/ModuleInterface.h"
+#include "BufferMemory.h"
 #include "CircularBuffer.h"
+#include "CopyKernels.h"
 #include "ConfigGroup.h"
 #include "Configuration.h"
 #include "CoreCallback.h"
@@ -50,10 +52,15 @@
 #include "CoreUtils.h"
 #include "DeviceManager.h"
 #include "Devices/DeviceInstances.h"
+#include "IdleSignal.h"
+#include "ImageProcessingPipeline.h"
 #include "LogManager.h"
 #include "MMCore.h"
 #include "MMEventCallback.h"
 #include "PluginManager.h"
+#include "SystemStateCache.h"
+#include "TaskSet_CopyMemory.h"
+#include "ThreadPool.h"
 
 #include <algorithm>
 #include <cassert>
@@ -61,7 +68,10 @@
 #include <cstring>
 #include <deque>
 #include <fstream>
+#include <exception>
 #include <future>
+#include <iomanip>
+#include <iterator>
 #include <map>
 #include <set>
 #include <sstream>
@@ -138,8 +148,15 @@ CMMCore::CMMCore() :
    externalCallback_(0),
    pixelSizeGroup_(0),
    cbuf_(0),
+   threadPoolSize_(0),
+   threadPoolPinning_(false),
+   slowPropertyMs_(0),
    pluginManager_(new CPluginManager()),
    deviceManager_(new mm::DeviceManager()),
+   stateCache_(std::make_shared<mm::SystemStateCache>()),
+   idleSignal_(std::make_shared<mm::IdleSignal>()),
+   imagePipelineThreads_(0),
+   imagePipelineCapacity_(16),
    pPostedErrorsLock_(NULL)
 {
    configGroups_ = new ConfigGroupCollection();
@@ -150,8 +167,10 @@ CMMCore::CMMCore() :
 
    callback_ = new CoreCallback(this);
 
+   threadPool_ = std::make_shared<ThreadPool>();
+
    const unsigned seqBufMegabytes = (sizeof(void*) > 4) ? 250 : 25;
-   cbuf_ = new CircularBuffer(seqBufMegabytes);
+   cbuf_ = new CircularBuffer(seqBufMegabytes, threadPool_);
 
    nullAffine_ = new std::vector<double>(6);
    for (int i = 0; i < 6; i++) {
@@ -178,6 +197,9 @@ CMMCore::~CMMCore()
       LOG_ERROR(coreLogger_) << "Exception caught in CMMCore destructor.";
    }
 
+   // Publishes the remaining frames into cbuf_
+   imagePipeline_.reset();
+
    delete callback_;
    delete configGroups_;
    delete properties_;
@@ -205,6 +227,49 @@ CMMCore::~CMMCore()
  *   multiple threads, one per device module.  Early testing shows this to be 
  *   reliable, but switch this off when issues are encountered during 
  *   device initialization.
+ * - "LockFreeCircularBuffer" (default: disabled) When enabled, the circular
+ *   buffer inserts and pops images without taking locks, so that the camera
+ *   thread and the thread draining the buffer do not block each other. This
+ *   requires that images are inserted by a single camera and popped by a
+ *   single thread at a time. The setting takes effect the next time the
+ *   circular buffer is initialized (such as when starting a sequence
+ *   acquisition).
+ * - "ContiguousCircularBuffer" (default: disabled) When enabled,
+ *   setCircularBufferMemoryFootprint() allocates the whole buffer as a single
+ *   block of memory, using huge pages where available, bound to the NUMA node
+ *   of the calling thread (which should therefore be on the same node as the
+ *   thread that will pop the images), and made resident before returning, so
+ *   that the first pass of an acquisition does not incur page faults. The
+ *   setting takes effect at the next call to
+ *   setCircularBufferMemoryFootprint().
+ * - "VariableSizeCircularBuffer" (default: disabled) When enabled, the
+ *   circular buffer stores each image in as many bytes as it needs, recording
+ *   its own width, height, and pixel type (in the image metadata), instead of
+ *   dividing the memory into fixed slots of the current camera image size.
+ *   Images of different sizes (e.g., from an ROI or binning change during an
+ *   acquisition) can then be inserted without reinitializing the buffer and
+ *   discarding its contents. getBufferTotalCapacity() and
+ *   getBufferFreeCapacity() are then in units of images of the size current
+ *   when the buffer was last initialized. The setting takes effect the next
+ *   time the circular buffer is initialized.
+ * - "ParallelSystemState" (default: disabled) When enabled, getSystemState()
+ *   and updateSystemStateCache() read devices belonging to different device
+ *   adapters concurrently, one thread per adapter. Devices of the same adapter
+ *   are still read in turn. The time taken by each device is logged (debug).
+ * - "ParallelSetConfig" (default: disabled) When enabled, setConfig() (and
+ *   setPixelSizeConfig()) first applies the Core properties of the preset,
+ *   then sets the device properties on one thread per device adapter, so that
+ *   the time taken is that of the slowest adapter rather than the sum over
+ *   all adapters. Properties of devices of the same adapter are set in the
+ *   order of the preset. Settings that fail are retried as when disabled.
+ *   Presets that rely on the order of properties across different adapters
+ *   should not be used with this feature.
+ * - "ParallelConfigLoading" (default: disabled) When enabled,
+ *   loadSystemConfiguration() loads all device adapters named in the file
+ *   concurrently before executing its commands, and sets each run of
+ *   pre-initialization properties on one thread per device adapter (in file
+ *   order for the devices of each adapter). Device initialization is
+ *   controlled by "ParallelDeviceInitialization" as usual.
  *
  * Permanently enabled features:
  * - None so far.
@@ -258,6 +323,35 @@ void CMMCore::setPrimaryLogFile(const char* filename, bool truncate) throw (CMME
    logManager_->SetPrimaryLogFilename(filenameStr, truncate);
 }
 
+/**
+ * Set the primary Core log file, written in the compact binary format.
+ *
+ * Binary logs are faster to write and much smaller than text logs. Use the
+ * mmlogdecode tool to convert them to text (optionally selecting devices or a
+ * time range).
+ *
+ * @param filename The log filename. If empty or null, the primary log file is
+ * disabled.
+ * @param maxFileSize If positive, the file is rotated when it reaches this
+ * size (in bytes): it is renamed to filename.0001 (.0002, etc.) and a new
+ * file is started.
+ * @param truncate If false, append to the file.
+ */
+void CMMCore::setPrimaryBinaryLogFile(const char* filename,
+      long long maxFileSize, bool truncate) throw (CMMError)
+{
+   if (maxFileSize < 0)
+      throw CMMError("Negative maximum log file size");
+
+   std::string filenameStr;
+   if (filename)
+      filenameStr = filename;
+
+   logManager_->SetPrimaryLogFilename(filenameStr, truncate,
+         mm::LogManager::FileFormatBinary,
+         static_cast<std::uint64_t>(maxFileSize));
+}
+
 /**
  * Return the name of the primary Core log file.
  */
@@ -351,6 +445,40 @@ int CMMCore::startSecondaryLogFile(const char* filename, bool enableDebug,
 }
 
 
+/**
+ * Start capturing logging output into an additional file, in the compact
+ * binary format (see setPrimaryBinaryLogFile()).
+ *
+ * @param filename The filename to which the log will be captured
+ * @param enableDebug Whether to include debug logging.
+ * @param maxFileSize If positive, rotate the file when it reaches this size
+ * (in bytes).
+ * @param truncate If false, append to the file.
+ * @param synchronous If true, enable synchronous logging for this file.
+ * @returns A handle required when calling stopSecondaryLogFile().
+ */
+int CMMCore::startSecondaryBinaryLogFile(const char* filename,
+      bool enableDebug, long long maxFileSize, bool truncate,
+      bool synchronous) throw (CMMError)
+{
+   if (!filename)
+      throw CMMError("Filename is null");
+   if (maxFileSize < 0)
+      throw CMMError("Negative maximum log file size");
+
+   using namespace mm::logging;
+   typedef mm::LogManager::LogFileHandle LogFileHandle;
+
+   LogFileHandle handle = logManager_->AddSecondaryLogFile(
+            (enableDebug ? LogLevelTrace : LogLevelInfo),
+            filename, truncate,
+            (synchronous ? SinkModeSynchronous : SinkModeAsynchronous),
+            mm::LogManager::FileFormatBinary,
+            static_cast<std::uint64_t>(maxFileSize));
+   return static_cast<int>(handle);
+}
+
+
 /**
  * Stop capturing logging output into an additional file.
  *
@@ -380,9 +508,15 @@ std::string CMMCore::getVersionInfo() const
 std::vector<std::string>
 CMMCore::getAvailableDevices(const char* moduleName) throw (CMMError)
 {
-   std::shared_ptr<LoadedDeviceAdapter> module =
-      pluginManager_->GetDeviceAdapter(moduleName);
-   return module->GetAvailableDeviceNames();
+   if (!moduleName)
+      throw CMMError("Null device adapter module name");
+   const mm::AdapterMetadata metadata =
+      pluginManager_->GetDeviceAdapterMetadata(moduleName);
+   std::vector<std::string> names;
+   names.reserve(metadata.devices.size());
+   for (const mm::AdapterDeviceMetadata& device : metadata.devices)
+      names.push_back(device.name);
+   return names;
 }
 
 /**
@@ -393,15 +527,19 @@ CMMCore::getAvailableDeviceDescriptions(const char* moduleName) throw (CMMError)
 {
    // XXX It is a little silly that we return the list of descriptions, rather
    // than provide access to the description of each device.
-   std::shared_ptr<LoadedDeviceAdapter> module =
-      pluginManager_->GetDeviceAdapter(moduleName);
-   std::vector<std::string> names = module->GetAvailableDeviceNames();
+   if (!moduleName)
+      throw CMMError("Null device adapter module name");
+   const mm::AdapterMetadata metadata =
+      pluginManager_->GetDeviceAdapterMetadata(moduleName);
    std::vector<std::string> descriptions;
-   descriptions.reserve(names.size());
-   for (std::vector<std::string>::const_iterator
-         it = names.begin(), end = names.end(); it != end; ++it)
+   descriptions.reserve(metadata.devices.size());
+   for (const mm::AdapterDeviceMetadata& device : metadata.devices)
    {
-      descriptions.push_back(module->GetDeviceDescription(*it));
+      if (!device.hasDescription)
+         throw CMMError("Cannot get description for device " +
+               ToQuotedString(device.name) + " of device adapter module " +
+               ToQuotedString(moduleName));
+      descriptions.push_back(device.description);
    }
    return descriptions;
 }
@@ -414,16 +552,19 @@ CMMCore::getAvailableDeviceTypes(const char* moduleName) throw (CMMError)
 {
    // XXX It is a little silly that we return the list of types, rather than
    // provide access to the type of each device.
-   std::shared_ptr<LoadedDeviceAdapter> module =
-      pluginManager_->GetDeviceAdapter(moduleName);
-   std::vector<std::string> names = module->GetAvailableDeviceNames();
+   if (!moduleName)
+      throw CMMError("Null device adapter module name");
+   const mm::AdapterMetadata metadata =
+      pluginManager_->GetDeviceAdapterMetadata(moduleName);
    std::vector<long> types;
-   types.reserve(names.size());
-   for (std::vector<std::string>::const_iterator
-         it = names.begin(), end = names.end(); it != end; ++it)
+   types.reserve(metadata.devices.size());
+   for (const mm::AdapterDeviceMetadata& device : metadata.devices)
    {
-      MM::DeviceType devType = module->GetAdvertisedDeviceType(*it);
-      types.push_back(static_cast<long>(devType));
+      if (device.type == MM::UnknownType)
+         throw CMMError("Cannot get type of device " +
+               ToQuotedString(device.name) + " of device adapter module " +
+               ToQuotedString(moduleName));
+      types.push_back(static_cast<long>(device.type));
    }
    return types;
 }
@@ -449,39 +590,109 @@ std::string CMMCore::getAPIVersionInfo() const
  */
 Configuration CMMCore::getSystemState()
 {
-   Configuration config;
-   std::vector<std::string> devices = deviceManager_->GetDeviceList();
-   for (std::vector<std::string>::const_iterator i = devices.begin(), dend = devices.end(); i != dend; ++i)
+   return readSystemState(false);
+}
+
+/**
+ * Implements getSystemState(). If useCachedValues is set, the values of
+ * properties that are slow to read (see the SystemStateSlowPropertyMs Core
+ * property), and of pre-initialization properties of initialized devices
+ * (which do not change), are taken from the system state cache when present.
+ *
+ * With the ParallelSystemState feature enabled, devices from different
+ * device adapters are read concurrently (one thread per adapter).
+ */
+Configuration CMMCore::readSystemState(bool useCachedValues)
+{
+   using namespace std::chrono;
+   const auto start = steady_clock::now();
+
+   std::shared_ptr<const Configuration> cache;
+   if (useCachedValues)
+      cache = stateCache_->GetSnapshot();
+
+   const std::vector<std::string> devices = deviceManager_->GetDeviceList();
+   std::vector<std::vector<PropertySetting> > deviceSettings(devices.size());
+   std::vector<long long> deviceMicroseconds(devices.size(), 0);
+   auto readDevices = [&](const std::vector<size_t>& indices)
    {
-      std::shared_ptr<DeviceInstance> pDev = deviceManager_->GetDevice(*i);
-      mm::DeviceModuleLockGuard guard(pDev);
-      std::vector<std::string> propertyNames = pDev->GetPropertyNames();
-      for (std::vector<std::string>::const_iterator it = propertyNames.begin(), end = propertyNames.end();
-            it != end; ++it)
+      for (size_t i : indices)
+      {
+         const auto deviceStart = steady_clock::now();
+         readDeviceState(devices[i], cache.get(), deviceSettings[i]);
+         deviceMicroseconds[i] =
+            duration_cast<microseconds>(steady_clock::now() - deviceStart).count();
+      }
+   };
+
+   // Devices of the same adapter share the module lock, so are read in turn
+   std::map<std::shared_ptr<LoadedDeviceAdapter>, std::vector<size_t> > moduleDevices;
+   if (mm::features::flags().parallelSystemState)
+   {
+      for (size_t i = 0; i < devices.size(); ++i)
       {
-         std::string val;
+         std::shared_ptr<LoadedDeviceAdapter> module;
          try
          {
-            val = pDev->GetProperty(*it);
+            module = deviceManager_->GetDevice(devices[i])->GetAdapterModule();
          }
          catch (const CMMError&)
          {
-            // XXX BUG This should not be ignored, but the interface does not
-            // allow throwing from this function. Keeping old behavior for now.
+            // Unloaded in the meantime; readDeviceState() skips it
          }
+         moduleDevices[module].push_back(i);
+      }
+   }
 
-         bool readOnly = false;
+   if (moduleDevices.size() > 1)
+   {
+      std::vector<std::future<void> > futures;
+      for (auto it = moduleDevices.begin(); it != moduleDevices.end(); ++it)
+         futures.push_back(std::async(std::launch::async, readDevices, std::cref(it->second)));
+      // Wait for all threads before rethrowing (e.g. std::bad_alloc)
+      std::exception_ptr error;
+      for (size_t i = 0; i < futures.size(); ++i)
+      {
          try
          {
-            readOnly = pDev->GetPropertyReadOnly(it->c_str());
+            futures[i].get();
          }
-         catch (const CMMError&)
+         catch (...)
          {
-            // XXX BUG This should not be ignored, but the interface does not
-            // allow throwing from this function. Keeping old behavior for now.
+            if (!error)
+               error = std::current_exception();
          }
-         config.addSetting(PropertySetting(i->c_str(), it->c_str(), val.c_str(), readOnly));
       }
+      if (error)
+         std::rethrow_exception(error);
+   }
+   else
+   {
+      std::vector<size_t> indices(devices.size());
+      for (size_t i = 0; i < indices.size(); ++i)
+         indices[i] = i;
+      readDevices(indices);
+   }
+
+   Configuration config;
+   size_t slowestDevice = 0;
+   for (size_t i = 0; i < devices.size(); ++i)
+   {
+      LOG_DEBUG(coreLogger_) << "Read " << deviceSettings[i].size() <<
+         " properties of device " << devices[i] << " in " <<
+         deviceMicroseconds[i] / 1000.0 << " ms";
+      if (deviceMicroseconds[i] > deviceMicroseconds[slowestDevice])
+         slowestDevice = i;
+      for (size_t j = 0; j < deviceSettings[i].size(); ++j)
+         config.addSetting(deviceSettings[i][j]);
+   }
+   if (!devices.empty())
+   {
+      LOG_DEBUG(coreLogger_) << "Read state of " << devices.size() <<
+         " devices in " <<
+         duration_cast<microseconds>(steady_clock::now() - start).count() / 1000.0 <<
+         " ms (slowest: " << devices[slowestDevice] << ", " <<
+         deviceMicroseconds[slowestDevice] / 1000.0 << " ms)";
    }
 
    // add core properties
@@ -496,6 +707,106 @@ Configuration CMMCore::getSystemState()
    return config;
 }
 
+/**
+ * Appends the property settings of one device to settings. Errors are
+ * ignored (see getSystemState()). If cache is given, it is used as described
+ * for readSystemState().
+ */
+void CMMCore::readDeviceState(const std::string& label, const Configuration* cache,
+      std::vector<PropertySetting>& settings)
+{
+   std::shared_ptr<DeviceInstance> pDev;
+   try
+   {
+      pDev = deviceManager_->GetDevice(label);
+   }
+   catch (const CMMError&)
+   {
+      return;
+   }
+
+   const long slowMs = getSlowPropertyMs();
+   mm::DeviceModuleLockGuard guard(pDev);
+   const bool initialized = pDev->IsInitialized();
+   std::vector<std::string> propertyNames = pDev->GetPropertyNames();
+   for (std::vector<std::string>::const_iterator it = propertyNames.begin(), end = propertyNames.end();
+         it != end; ++it)
+   {
+      if (cache && cache->isPropertyIncluded(label.c_str(), it->c_str()))
+      {
+         bool useCache = false;
+         try
+         {
+            useCache = initialized && pDev->GetPropertyInitStatus(it->c_str());
+         }
+         catch (const CMMError&)
+         {
+         }
+         if (!useCache)
+         {
+            MMThreadGuard g(slowPropertiesLock_);
+            useCache = slowProperties_.count(PropertySetting::generateKey(label.c_str(), it->c_str())) > 0;
+         }
+         if (useCache)
+         {
+            settings.push_back(cache->getSetting(label.c_str(), it->c_str()));
+            continue;
+         }
+      }
+
+      std::string val;
+      const auto start = std::chrono::steady_clock::now();
+      try
+      {
+         val = pDev->GetProperty(*it);
+      }
+      catch (const CMMError&)
+      {
+         // XXX BUG This should not be ignored, but the interface does not
+         // allow throwing from this function. Keeping old behavior for now.
+      }
+      const std::chrono::duration<double, std::milli> elapsed =
+         std::chrono::steady_clock::now() - start;
+      if (slowMs > 0 && elapsed.count() >= slowMs)
+      {
+         LOG_DEBUG(coreLogger_) << "Property " << label << "-" << *it <<
+            " took " << elapsed.count() << " ms to read; will use cached value";
+         MMThreadGuard g(slowPropertiesLock_);
+         slowProperties_.insert(PropertySetting::generateKey(label.c_str(), it->c_str()));
+      }
+
+      bool readOnly = false;
+      try
+      {
+         readOnly = pDev->GetPropertyReadOnly(it->c_str());
+      }
+      catch (const CMMError&)
+      {
+         // XXX BUG This should not be ignored, but the interface does not
+         // allow throwing from this function. Keeping old behavior for now.
+      }
+      settings.push_back(PropertySetting(label.c_str(), it->c_str(), val.c_str(), readOnly));
+   }
+}
+
+/**
+ * Sets the time above which reading a property makes it be taken from the
+ * cache by updateSystemStateCache() (0 to disable). Forgets which properties
+ * were slow.
+ */
+void CMMCore::setSlowPropertyMs(long ms)
+{
+   MMThreadGuard g(slowPropertiesLock_);
+   slowPropertyMs_ = ms;
+   slowProperties_.clear();
+}
+
+long CMMCore::getSlowPropertyMs() const
+{
+   MMThreadGuard g(slowPropertiesLock_);
+   return slowPropertyMs_;
+}
+
 /**
  * Returns the entire system state, i.e. the collection of all property values from all devices.
  * This method will return cached values instead of querying each device
@@ -503,8 +814,48 @@ Configuration CMMCore::getSystemState()
  */
 Configuration CMMCore::getSystemStateCache() const
 {
-   MMThreadGuard scg(stateCacheLock_);
-   return stateCache_;
+   return *stateCache_->GetSnapshot();
+}
+
+/**
+ * Returns the version of the system state cache, which increases every time
+ * a cached value changes. Pass it to getSystemStateCacheChanges() later to
+ * find out what changed in between.
+ */
+long long CMMCore::getSystemStateCacheVersion() const
+{
+   return stateCache_->GetVersion();
+}
+
+/**
+ * Returns the cached settings that changed after the given version (see
+ * getSystemStateCacheVersion()), which is much cheaper than getting the whole
+ * cache when polling it.
+ *
+ * To keep a copy of the cache up to date, get the version first, then the
+ * changes since the previous version; settings changing in between are
+ * returned again next time.
+ *
+ * updateSystemStateCache() removes the properties of devices that no longer
+ * exist. If that happened after the given version (i.e., the version is less
+ * than getSystemStateCacheRemovalVersion()), the whole cache is returned and
+ * should replace the caller's copy.
+ *
+ * @param sinceVersion  a version previously returned by
+ *                      getSystemStateCacheVersion(), or 0
+ */
+Configuration CMMCore::getSystemStateCacheChanges(long long sinceVersion) const
+{
+   return stateCache_->GetChangesSince(sinceVersion);
+}
+
+/**
+ * Returns the version at which properties were last removed from the system
+ * state cache (0 if never). See getSystemStateCacheChanges().
+ */
+long long CMMCore::getSystemStateCacheRemovalVersion() const
+{
+   return stateCache_->GetRemovalVersion();
 }
 
 /**
@@ -663,6 +1014,33 @@ std::vector<std::string> CMMCore::getDeviceAdapterNames() throw (CMMError)
    return pluginManager_->GetAvailableDeviceAdapters();
 }
 
+/**
+ * Set the file used to persist the device adapter metadata cache.
+ *
+ * getAvailableDevices(), getAvailableDeviceDescriptions() and
+ * getAvailableDeviceTypes() cache the information obtained from each device
+ * adapter library, keyed by the library's path, size and modification time,
+ * so that unchanged libraries need not be loaded again. With a cache file,
+ * this also applies across sessions. The file is read when set; information
+ * cached since is written when another file is set and when the Core is
+ * destroyed.
+ *
+ * @param filename The cache file. If empty or null, the cache is kept in
+ * memory only.
+ */
+void CMMCore::setDeviceAdapterCacheFile(const char* filename)
+{
+   pluginManager_->SetMetadataCacheFile(filename ? filename : "");
+}
+
+/**
+ * Return the device adapter metadata cache file (empty if none).
+ */
+std::string CMMCore::getDeviceAdapterCacheFile() const
+{
+   return pluginManager_->GetMetadataCacheFile();
+}
+
 /**
  * Loads a device from the plugin library.
  * @param label    assigned name for the device during the core session
@@ -765,6 +1143,9 @@ void CMMCore::unloadDevice(const char* label///< the name of the device to unloa
 
    std::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
 
+   // Queued frames may be processed by this device
+   flushImageProcessorPipeline(false);
+
    try {
       mm::DeviceModuleLockGuard guard(pDevice);
       LOG_DEBUG(coreLogger_) << "Will unload device " << label;
@@ -801,6 +1182,7 @@ void CMMCore::unloadAllDevices() throw (CMMError)
       }
 
       LOG_DEBUG(coreLogger_) << "Will unload all devices";
+      flushImageProcessorPipeline(false);
       deviceManager_->UnloadAllDevices();
       LOG_INFO(coreLogger_) << "Did unload all devices";
 
@@ -1105,11 +1487,8 @@ CMMCore::getDeviceInitializationState(const char* label) const throw (CMMError)
 void CMMCore::updateSystemStateCache()
 {
    LOG_DEBUG(coreLogger_) << "Will update system state cache";
-   Configuration wk = getSystemState();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_ = wk;
-   }
+   Configuration wk = readSystemState(getSlowPropertyMs() > 0);
+   stateCache_->Replace(wk);
    LOG_INFO(coreLogger_) << "Did update system state cache";
 }
 
@@ -1140,6 +1519,22 @@ std::string CMMCore::getDeviceLibrary(const char* label) throw (CMMError)
    return pDevice->GetAdapterModule()->GetName();
 }
 
+/**
+ * Make a device adapter implemented in the application available under the
+ * given name, as if it were a device adapter module found in the search path.
+ *
+ * This is intended for testing. The implementation is not owned and must
+ * outlive this CMMCore instance.
+ */
+void CMMCore::loadMockDeviceAdapter(const char* name,
+      MockDeviceAdapter* implementation) throw (CMMError)
+{
+   if (name == 0 || implementation == 0)
+      throw CMMError(errorText_[MMERR_NullPointerException], MMERR_NullPointerException);
+
+   pluginManager_->LoadMockDeviceAdapter(name, implementation);
+}
+
 /**
  * Forcefully unload a library. Experimental. Don't use.
  */
@@ -1336,6 +1731,11 @@ void CMMCore::waitForDevice(const char* label) throw (CMMError)
 
 /**
  * Waits (blocks the calling thread) until the specified device becomes
+ * non-busy.
+ *
+ * Devices that report the end of busy periods through OnBusyChanged() are
+ * waited for on idleSignal_, so that we return as soon as they are done;
+ * other devices are polled every pollingIntervalMs_.
  * @param device   the device label
  */
 void CMMCore::waitForDevice(std::shared_ptr<DeviceInstance> pDev) throw (CMMError)
@@ -1346,8 +1746,16 @@ void CMMCore::waitForDevice(std::shared_ptr<DeviceInstance> pDev) throw (CMMErro
    auto timeout = std::chrono::duration<long long, std::milli>(timeoutMs_);
    auto deadline = now + timeout;
 
+   // Even notifying devices are polled now and then, in case a notification
+   // is missing
+   const auto notifiedRecheckInterval = std::chrono::milliseconds(
+         (std::max)(10 * pollingIntervalMs_, 100L));
+
    while (true)
    {
+      // Must be read before calling Busy(), so that a notification sent
+      // after Busy() returns is not missed
+      const unsigned long long idleCount = idleSignal_->GetCount();
       {
          mm::DeviceModuleLockGuard guard(pDev);
          if (!pDev->Busy())
@@ -1367,7 +1775,18 @@ void CMMCore::waitForDevice(std::shared_ptr<DeviceInstance> pDev) throw (CMMErro
                MMERR_DevicePollingTimeout);
       }
 
-     sleep(pollingIntervalMs_);
+      if (pDev->NotifiesBusyChanges())
+      {
+         mm::IdleSignal::TimePoint wakeUp =
+            std::chrono::steady_clock::now() + notifiedRecheckInterval;
+         if (deadline < wakeUp)
+            wakeUp = deadline;
+         idleSignal_->WaitForChange(idleCount, wakeUp);
+      }
+      else
+      {
+         sleep(pollingIntervalMs_);
+      }
    }
    LOG_DEBUG(coreLogger_) << "Finished waiting for device " << pDev->GetLabel();
 }
@@ -2569,10 +2988,7 @@ void CMMCore::setAutoShutter(bool state)
 {
    properties_->Set(MM::g_Keyword_CoreAutoShutter, state ? "1" : "0");
    autoShutter_ = state;
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreAutoShutter, state ? "1" : "0"));
-   }
+   stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreAutoShutter, state ? "1" : "0"));
    LOG_DEBUG(coreLogger_) << "Autoshutter turned " << (state ? "on" : "off");
 }
 
@@ -2604,10 +3020,7 @@ void CMMCore::setShutterOpen(const char* shutterLabel, bool state) throw (CMMErr
 
       if (pShutter->HasProperty(MM::g_Keyword_State))
       {
-         {
-            MMThreadGuard scg(stateCacheLock_);
-            stateCache_.addSetting(PropertySetting(shutterLabel, MM::g_Keyword_State, CDeviceUtils::ConvertToString(state)));
-         }
+         stateCache_->Set(PropertySetting(shutterLabel, MM::g_Keyword_State, CDeviceUtils::ConvertToString(state)));
       }
    }
 }
@@ -2827,6 +3240,7 @@ void CMMCore::startSequenceAcquisition(long numImages, double intervalMs, bool s
 
 		try
 		{
+			flushImageProcessorPipeline(true);
 			if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
 			{
 				logError(getDeviceName(camera).c_str(), getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str());
@@ -2871,6 +3285,7 @@ void CMMCore::startSequenceAcquisition(const char* label, long numImages, double
       throw CMMError(getCoreErrorText(MMERR_NotAllowedDuringSequenceAcquisition).c_str(),
                      MMERR_NotAllowedDuringSequenceAcquisition);
 
+   flushImageProcessorPipeline(true);
    if (!cbuf_->Initialize(pCam->GetNumberOfChannels(), pCam->GetImageWidth(), pCam->GetImageHeight(), pCam->GetImageBytesPerPixel()))
    {
       logError(getDeviceName(pCam).c_str(), getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str());
@@ -2922,6 +3337,7 @@ void CMMCore::initializeCircularBuffer() throw (CMMError)
    if (camera)
    {
       mm::DeviceModuleLockGuard guard(camera);
+      flushImageProcessorPipeline(true);
       if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
       {
          logError(getDeviceName(camera).c_str(), getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str());
@@ -2974,6 +3390,7 @@ void CMMCore::startContinuousSequenceAcquisition(double intervalMs) throw (CMMEr
             ,MMERR_NotAllowedDuringSequenceAcquisition);
       }
 
+      flushImageProcessorPipeline(true);
       if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
       {
          logError(getDeviceName(camera).c_str(), getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str());
@@ -3059,6 +3476,14 @@ bool CMMCore::isSequenceRunning(const char* label) throw (CMMError)
  * Returns 0 if the buffer is empty.
  */
 void* CMMCore::getLastImage() throw (CMMError)
+{
+   return const_cast<unsigned char*>(getLastImageBuffer()->GetPixels());
+}
+
+/**
+ * Like getLastImage(), returning the image in the circular buffer.
+ */
+const mm::ImgBuffer* CMMCore::getLastImageBuffer() throw (CMMError)
 {
 
    // scope for the thread guard
@@ -3075,7 +3500,7 @@ void* CMMCore::getLastImage() throw (CMMError)
       }
    }
 
-   unsigned char* pBuf = const_cast<unsigned char*>(cbuf_->GetTopImage());
+   const mm::ImgBuffer* pBuf = cbuf_->GetTopImageBuffer(0);
    if (pBuf != 0)
       return pBuf;
    else
@@ -3086,6 +3511,14 @@ void* CMMCore::getLastImage() throw (CMMError)
 }
 
 void* CMMCore::getLastImageMD(unsigned channel, unsigned slice, Metadata& md) const throw (CMMError)
+{
+   return const_cast<unsigned char*>(getLastImageBufferMD(channel, slice, md)->GetPixels());
+}
+
+/**
+ * Like getLastImageMD(), returning the image in the circular buffer.
+ */
+const mm::ImgBuffer* CMMCore::getLastImageBufferMD(unsigned channel, unsigned slice, Metadata& md) const throw (CMMError)
 {
    // Slices have never been implemented on the device interface side
    if (slice != 0)
@@ -3095,7 +3528,7 @@ void* CMMCore::getLastImageMD(unsigned channel, unsigned slice, Metadata& md) co
    if (pBuf != 0)
    {
       md = pBuf->GetMetadata();
-      return const_cast<unsigned char*>(pBuf->GetPixels());
+      return pBuf;
    }
    else
       throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
@@ -3118,6 +3551,14 @@ void* CMMCore::getLastImageMD(Metadata& md) const throw (CMMError)
    return getLastImageMD(0, 0, md);
 }
 
+/**
+ * Like getLastImageMD(), returning the image in the circular buffer.
+ */
+const mm::ImgBuffer* CMMCore::getLastImageBufferMD(Metadata& md) const throw (CMMError)
+{
+   return getLastImageBufferMD(0, 0, md);
+}
+
 /**
  * Returns a pointer to the pixels of the image that was inserted n images ago
  * Also provides all metadata associated with that image
@@ -3131,12 +3572,20 @@ void* CMMCore::getLastImageMD(Metadata& md) const throw (CMMError)
  * (see: https://en.wikipedia.org/wiki/RGBA_color_model).
  */
 void* CMMCore::getNBeforeLastImageMD(unsigned long n, Metadata& md) const throw (CMMError)
+{
+   return const_cast<unsigned char*>(getNBeforeLastImageBufferMD(n, md)->GetPixels());
+}
+
+/**
+ * Like getNBeforeLastImageMD(), returning the image in the circular buffer.
+ */
+const mm::ImgBuffer* CMMCore::getNBeforeLastImageBufferMD(unsigned long n, Metadata& md) const throw (CMMError)
 {
    const mm::ImgBuffer* pBuf = cbuf_->GetNthFromTopImageBuffer(n);
    if (pBuf != 0)
    {
       md = pBuf->GetMetadata();
-      return const_cast<unsigned char*>(pBuf->GetPixels());
+      return pBuf;
    }
    else
       throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
@@ -3156,7 +3605,15 @@ void* CMMCore::getNBeforeLastImageMD(unsigned long n, Metadata& md) const throw
  */
 void* CMMCore::popNextImage() throw (CMMError)
 {
-   unsigned char* pBuf = const_cast<unsigned char*>(cbuf_->GetNextImage());
+   return const_cast<unsigned char*>(popNextImageBuffer()->GetPixels());
+}
+
+/**
+ * Like popNextImage(), returning the image in the circular buffer.
+ */
+const mm::ImgBuffer* CMMCore::popNextImageBuffer() throw (CMMError)
+{
+   const mm::ImgBuffer* pBuf = cbuf_->GetNextImageBuffer(0);
    if (pBuf != 0)
       return pBuf;
    else
@@ -3169,6 +3626,14 @@ void* CMMCore::popNextImage() throw (CMMError)
  * slice has not been implement and should always be 0
  */
 void* CMMCore::popNextImageMD(unsigned channel, unsigned slice, Metadata& md) throw (CMMError)
+{
+   return const_cast<unsigned char*>(popNextImageBufferMD(channel, slice, md)->GetPixels());
+}
+
+/**
+ * Like popNextImageMD(), returning the image in the circular buffer.
+ */
+const mm::ImgBuffer* CMMCore::popNextImageBufferMD(unsigned channel, unsigned slice, Metadata& md) throw (CMMError)
 {
    // Slices have never been implemented on the device interface side
    if (slice != 0)
@@ -3178,7 +3643,7 @@ void* CMMCore::popNextImageMD(unsigned channel, unsigned slice, Metadata& md) th
    if (pBuf != 0)
    {
       md = pBuf->GetMetadata();
-      return const_cast<unsigned char*>(pBuf->GetPixels());
+      return pBuf;
    }
    else
       throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
@@ -3192,6 +3657,168 @@ void* CMMCore::popNextImageMD(Metadata& md) throw (CMMError)
    return popNextImageMD(0, 0, md);
 }
 
+/**
+ * Like popNextImageMD(), returning the image in the circular buffer.
+ */
+const mm::ImgBuffer* CMMCore::popNextImageBufferMD(Metadata& md) throw (CMMError)
+{
+   return popNextImageBufferMD(0, 0, md);
+}
+
+/**
+ * Gets and removes up to maxCount images (and their metadata) from the
+ * circular buffer, in the order in which they were inserted.
+ *
+ * This is equivalent to calling popNextImageMD() repeatedly, but the buffer
+ * is accessed once for the whole batch, and the pixels of all images are
+ * copied into a single block owned by the batch. The images are removed from
+ * the buffer only after they have been copied, so they cannot be overwritten
+ * by the camera in the meantime. Reusing the same batch avoids reallocating
+ * memory.
+ *
+ * Unlike popNextImageMD(), this must not be called while another thread is
+ * popping images.
+ *
+ * @param maxCount the maximum number of images to pop
+ * @param batch receives the images (previous contents are discarded)
+ * @return the number of images popped (0 if the buffer is empty)
+ */
+long CMMCore::popNextImages(long maxCount, ImageBatch& batch) throw (CMMError)
+{
+   return popNextImages(0, maxCount, batch);
+}
+
+/**
+ * Gets and removes up to maxCount images (and their metadata) from the
+ * circular buffer. channel indicates which cameraChannel images should be
+ * retrieved. See popNextImages(long, ImageBatch&).
+ */
+long CMMCore::popNextImages(unsigned channel, long maxCount, ImageBatch& batch) throw (CMMError)
+{
+   if (maxCount < 0)
+      throw CMMError("Image count must not be negative");
+   return (long)cbuf_->PopNextImages((unsigned long)maxCount, channel, batch);
+}
+
+/**
+ * Returns a pointer to the pixels of the image that was last inserted into
+ * the circular buffer, and pins the image so that it is not overwritten.
+ *
+ * Unlike getLastImage(), the pointer stays valid after more images are
+ * inserted, until it is passed to releaseImage(). This allows the pixels to be
+ * used in place (in Java, as a direct ByteBuffer) instead of being copied.
+ * While an image is pinned, the camera cannot insert images into the memory it
+ * occupies: holding pinned images for long will cause the buffer to overflow,
+ * and the buffer cannot be resized or reinitialized for a different image
+ * size until all pinned images are released.
+ */
+void* CMMCore::getLastImagePinned() throw (CMMError)
+{
+   Metadata md;
+   return getLastImagePinnedMD(0, md);
+}
+
+/**
+ * Like getLastImagePinned(), for the given camera channel, also providing the
+ * image's metadata.
+ */
+void* CMMCore::getLastImagePinnedMD(unsigned channel, Metadata& md) throw (CMMError)
+{
+   const mm::ImgBuffer* pBuf = cbuf_->PinNthFromTopImageBuffer(0, channel);
+   if (!pBuf)
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+   md = pBuf->GetMetadata();
+   return const_cast<unsigned char*>(pBuf->GetPixels());
+}
+
+/**
+ * Gets and removes the next image from the circular buffer, and pins it so
+ * that it is not overwritten until passed to releaseImage(). See
+ * getLastImagePinned().
+ */
+void* CMMCore::popNextImagePinned() throw (CMMError)
+{
+   Metadata md;
+   return popNextImagePinnedMD(0, md);
+}
+
+/**
+ * Like popNextImagePinned(), for the given camera channel, also providing the
+ * image's metadata.
+ */
+void* CMMCore::popNextImagePinnedMD(unsigned channel, Metadata& md) throw (CMMError)
+{
+   const mm::ImgBuffer* pBuf = cbuf_->PinNextImageBuffer(channel);
+   if (!pBuf)
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+   md = pBuf->GetMetadata();
+   return const_cast<unsigned char*>(pBuf->GetPixels());
+}
+
+/**
+ * Allows the circular buffer to reuse the memory of an image obtained from
+ * getLastImagePinned() or popNextImagePinned(). The pixels must not be
+ * accessed afterwards. An image obtained more than once must be released as
+ * many times.
+ */
+void CMMCore::releaseImage(void* pinnedPixels) throw (CMMError)
+{
+   if (!cbuf_->ReleasePinnedImage(static_cast<const unsigned char*>(pinnedPixels)))
+      throw CMMError("Image is not pinned (or was already released)");
+}
+
+/**
+ * Returns the size in bytes of a pinned image (see getLastImagePinned()).
+ */
+long CMMCore::getPinnedImageBufferSize(void* pinnedPixels) throw (CMMError)
+{
+   const std::size_t bytes = cbuf_->GetPinnedImageBytes(static_cast<const unsigned char*>(pinnedPixels));
+   if (bytes == 0)
+      throw CMMError("Image is not pinned (or was already released)");
+   return (long)bytes;
+}
+
+/**
+ * Returns the geometry of an image just obtained from the circular buffer
+ * (e.g., with popNextImageBuffer()). This is that of the current camera,
+ * except in variable-size mode (the VariableSizeCircularBuffer feature),
+ * where each image has its own.
+ */
+void CMMCore::getBufferedImageGeometry(const mm::ImgBuffer* pImg,
+      unsigned& width, unsigned& height, unsigned& bytesPerPixel,
+      unsigned& numComponents)
+{
+   if (!cbuf_->IsVariableSize())
+   {
+      width = getImageWidth();
+      height = getImageHeight();
+      bytesPerPixel = getBytesPerPixel();
+      numComponents = getNumberOfComponents();
+      return;
+   }
+   width = pImg->Width();
+   height = pImg->Height();
+   bytesPerPixel = pImg->Depth();
+   // Only RGB images have more than one component
+   numComponents = 1;
+   const Metadata& md = pImg->GetMetadata();
+   if (md.HasTag(MM::g_Keyword_PixelType))
+   {
+      const std::string pixelType = md.GetSingleTag(MM::g_Keyword_PixelType).GetValue();
+      if (pixelType == MM::g_Keyword_PixelType_RGB32 || pixelType == MM::g_Keyword_PixelType_RGB64)
+         numComponents = 4;
+   }
+}
+
+/**
+ * Returns the number of images from the circular buffer that are currently
+ * pinned (see getLastImagePinned()).
+ */
+long CMMCore::getPinnedImageCount()
+{
+   return (long)cbuf_->GetPinnedImageCount();
+}
+
 /**
  * Removes all images from the circular buffer.
  *
@@ -3200,6 +3827,7 @@ void* CMMCore::popNextImageMD(Metadata& md) throw (CMMError)
  */
 void CMMCore::clearCircularBuffer() throw (CMMError)
 {
+   flushImageProcessorPipeline(true);
    cbuf_->Clear();
 }
 
@@ -3209,12 +3837,18 @@ void CMMCore::clearCircularBuffer() throw (CMMError)
 void CMMCore::setCircularBufferMemoryFootprint(unsigned sizeMB ///< n megabytes
                                                ) throw (CMMError)
 {
+   if (cbuf_->GetPinnedImageCount() > 0)
+      throw CMMError("Cannot resize the circular buffer while images from it are pinned");
+
+   // Frames still in the image processor pipeline go to the old buffer
+   flushImageProcessorPipeline(false);
+
    delete cbuf_; // discard old buffer
    LOG_DEBUG(coreLogger_) << "Will set circular buffer size to " <<
       sizeMB << " MB";
 	try
 	{
-		cbuf_ = new CircularBuffer(sizeMB);
+		cbuf_ = new CircularBuffer(sizeMB, threadPool_);
 	}
 	catch (std::bad_alloc& ex)
 	{
@@ -3228,14 +3862,33 @@ void CMMCore::setCircularBufferMemoryFootprint(unsigned sizeMB ///< n megabytes
 
 	try
 	{
+      using namespace std::chrono;
+      if (mm::features::flags().contiguousCircularBuffer)
+      {
+         const auto start = steady_clock::now();
+         cbuf_->AllocateContiguousMemory(true);
+         const mm::BufferMemory* memory = cbuf_->GetContiguousMemory();
+         LOG_INFO(coreLogger_) << "Allocated circular buffer memory (" <<
+            (memory->GetSize() >> 20) << " MB, huge pages: " <<
+            (memory->IsHugePages() ? "yes" : "no") << ", locked: " <<
+            (memory->IsLocked() ? "yes" : "no") << ", NUMA node: " <<
+            memory->GetNumaNode() << ") in " <<
+            duration_cast<milliseconds>(steady_clock::now() - start).count() <<
+            " ms";
+      }
 
 		// attempt to initialize based on the current camera settings
       std::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
       if (camera)
 		{
          mm::DeviceModuleLockGuard guard(camera);
+         const auto start = steady_clock::now();
          if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
 				throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
+         LOG_INFO(coreLogger_) << "Initialized circular buffer (" <<
+            cbuf_->GetSize() << " images) in " <<
+            duration_cast<milliseconds>(steady_clock::now() - start).count() <<
+            " ms";
 		}
 
       LOG_DEBUG(coreLogger_) << "Did set circular buffer size to " <<
@@ -3263,6 +3916,119 @@ unsigned CMMCore::getCircularBufferMemoryFootprint()
    return 0;
 }
 
+/**
+ * Replaces the worker thread pool (set through the ThreadPoolSize and
+ * ThreadPoolPinning Core properties).
+ */
+void CMMCore::setThreadPool(unsigned threadCount, bool pinThreads) throw (CMMError)
+{
+   if (threadCount == threadPoolSize_ && pinThreads == threadPoolPinning_)
+      return;
+
+   // Images are copied on the camera's thread using the pool
+   if (isSequenceRunning())
+   {
+      throw CMMError(getCoreErrorText(
+         MMERR_NotAllowedDuringSequenceAcquisition).c_str(),
+         MMERR_NotAllowedDuringSequenceAcquisition);
+   }
+
+   std::shared_ptr<ThreadPool> pool =
+      std::make_shared<ThreadPool>(threadCount, pinThreads);
+   if (pinThreads && !pool->IsPinned())
+      LOG_WARNING(coreLogger_) << "Could not bind thread pool threads to CPUs";
+   cbuf_->SetThreadPool(pool);
+   threadPool_ = pool;
+   threadPoolSize_ = threadCount;
+   threadPoolPinning_ = pinThreads;
+   LOG_INFO(coreLogger_) << "Thread pool now has " << pool->GetSize() <<
+      " threads" << (pool->IsPinned() ? " (bound to CPUs)" : "");
+
+   const TaskSet_CopyMemory::Tuning tuning = TaskSet_CopyMemory::GetTuning();
+   LOG_INFO(coreLogger_) << "Image copy: " << tuning.bytesPerTask <<
+      " bytes per thread, at most " << tuning.maxTaskCount <<
+      " threads, streaming (" << mm::StreamingCopyKernelName() <<
+      ") from " << tuning.streamingThreshold << " bytes";
+}
+
+/**
+ * Sets up (or, with threadCount 0, removes) the pipeline running the image
+ * processor off the camera thread (set through the ImageProcessorThreads and
+ * ImageProcessorQueueCapacity Core properties).
+ *
+ * With more than one thread, frames are processed concurrently only if the
+ * image processor declares the TileSafe property; otherwise its Process()
+ * calls are serialized.
+ */
+void CMMCore::setImageProcessorPipeline(unsigned threadCount, unsigned capacity) throw (CMMError)
+{
+   if (threadCount == imagePipelineThreads_ && capacity == imagePipelineCapacity_)
+      return;
+
+   if (isSequenceRunning())
+   {
+      throw CMMError(getCoreErrorText(
+         MMERR_NotAllowedDuringSequenceAcquisition).c_str(),
+         MMERR_NotAllowedDuringSequenceAcquisition);
+   }
+
+   std::shared_ptr<mm::ImageProcessingPipeline> pipeline;
+   if (threadCount > 0)
+   {
+      // cbuf_ is read when publishing, as it is replaced when the buffer is
+      // resized (after draining the pipeline)
+      mm::logging::Logger logger = coreLogger_;
+      pipeline = std::make_shared<mm::ImageProcessingPipeline>(threadCount,
+            capacity, [this, logger](const mm::ImageProcessingPipeline::Frame& f)
+            {
+               try
+               {
+                  return cbuf_->InsertImage(f.pixels.data(), f.width, f.height,
+                        f.byteDepth, f.nComponents, &f.md);
+               }
+               catch (const CMMError& e)
+               {
+                  LOG_ERROR(logger) << "Cannot insert processed image: " << e.getMsg();
+                  return false;
+               }
+            });
+   }
+   // The old pipeline (if any) publishes its remaining frames when destroyed
+   std::atomic_store(&imagePipeline_, pipeline);
+   imagePipelineThreads_ = threadCount;
+   imagePipelineCapacity_ = capacity;
+   if (threadCount > 0)
+   {
+      LOG_INFO(coreLogger_) << "Image processor runs on " << threadCount <<
+         " pipeline threads, with up to " << capacity << " queued images";
+   }
+   else
+   {
+      LOG_INFO(coreLogger_) << "Image processor runs on the camera thread";
+   }
+}
+
+std::shared_ptr<mm::ImageProcessingPipeline> CMMCore::getImageProcessorPipeline() const
+{
+   return std::atomic_load(&imagePipeline_);
+}
+
+/**
+ * Waits until no frame is left in the image processor pipeline (if any), so
+ * that none is processed or inserted into the circular buffer afterwards.
+ * With discard, frames that have not started processing are dropped rather
+ * than processed.
+ */
+void CMMCore::flushImageProcessorPipeline(bool discard)
+{
+   std::shared_ptr<mm::ImageProcessingPipeline> pipeline = getImageProcessorPipeline();
+   if (!pipeline)
+      return;
+   if (discard)
+      pipeline->DiscardPending();
+   pipeline->Drain();
+}
+
 /**
  * Returns number ofimages available in the Circular Buffer
  */
@@ -3396,10 +4162,7 @@ void CMMCore::setAutoFocusDevice(const char* autofocusLabel) throw (CMMError)
    }
    properties_->Refresh(); // TODO: more efficient
    std::string newAutofocusLabel = getAutoFocusDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreAutoFocus, newAutofocusLabel.c_str()));
-   }
+   stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreAutoFocus, newAutofocusLabel.c_str()));
 }
 
 /**
@@ -3463,10 +4226,7 @@ void CMMCore::setImageProcessorDevice(const char* procLabel) throw (CMMError)
    }
    properties_->Refresh(); // TODO: more efficient
    std::string newProcLabel = getImageProcessorDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreImageProcessor, newProcLabel.c_str()));
-   }
+   stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreImageProcessor, newProcLabel.c_str()));
 }
 
 /**
@@ -3487,10 +4247,7 @@ void CMMCore::setSLMDevice(const char* slmLabel) throw (CMMError)
    }
    properties_->Refresh(); // TODO: more efficient
    std::string newSLMLabel = getSLMDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreSLM, newSLMLabel.c_str()));
-   }
+   stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreSLM, newSLMLabel.c_str()));
 }
 
 
@@ -3512,10 +4269,7 @@ void CMMCore::setGalvoDevice(const char* galvoLabel) throw (CMMError)
    }
    properties_->Refresh(); // TODO: more efficient
    std::string newGalvoLabel = getGalvoDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreGalvo, newGalvoLabel.c_str()));
-   }
+   stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreGalvo, newGalvoLabel.c_str()));
 }
 
 /**
@@ -3539,10 +4293,7 @@ void CMMCore::setChannelGroup(const char* chGroup) throw (CMMError)
    channelGroup_ = chGroup;
    LOG_INFO(coreLogger_) << "Channel group set to " << chGroup;
 
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreChannelGroup, channelGroup_.c_str()));
-   }
+   stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreChannelGroup, channelGroup_.c_str()));
    if (externalCallback_ != 0) 
    {
       externalCallback_->onChannelGroupChanged(channelGroup_.c_str());
@@ -3601,10 +4352,7 @@ void CMMCore::setShutterDevice(const char* shutterLabel) throw (CMMError)
    }
    properties_->Refresh(); // TODO: more efficient
    std::string newShutterLabel = getShutterDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreShutter, newShutterLabel.c_str()));
-   }
+   stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreShutter, newShutterLabel.c_str()));
 }
 
 /**
@@ -3626,10 +4374,7 @@ void CMMCore::setFocusDevice(const char* focusLabel) throw (CMMError)
    }
    properties_->Refresh(); // TODO: more efficient
    std::string newFocusLabel = getFocusDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreFocus, newFocusLabel.c_str()));
-   }
+   stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreFocus, newFocusLabel.c_str()));
 }
 
 /**
@@ -3649,10 +4394,7 @@ void CMMCore::setXYStageDevice(const char* xyDeviceLabel) throw (CMMError)
       LOG_INFO(coreLogger_) << "Default xy stage unset";
    }
    std::string newXYStageLabel = getXYStageDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreXYStage, newXYStageLabel.c_str()));
-   }
+   stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreXYStage, newXYStageLabel.c_str()));
 }
 
 /**
@@ -3688,10 +4430,7 @@ void CMMCore::setCameraDevice(const char* cameraLabel) throw (CMMError)
    }
    properties_->Refresh(); // TODO: more efficient
    std::string newCameraLabel = getCameraDevice();
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreCamera, newCameraLabel.c_str()));
-   }
+   stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreCamera, newCameraLabel.c_str()));
 }
 
 /**
@@ -3790,12 +4529,8 @@ std::string CMMCore::getProperty(const char* label, const char* propName) throw
    std::string value = pDevice->GetProperty(propName);
 
    // use the opportunity to update the cache
-   // Note, stateCache is mutable so that we can update it from this const function
    PropertySetting s(label, propName, value.c_str());
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(s);
-   }
+   stateCache_->Set(s);
 
    return value;
 }
@@ -3814,15 +4549,12 @@ std::string CMMCore::getPropertyFromCache(const char* label, const char* propNam
    CheckDeviceLabel(label);
    CheckPropertyName(propName);
 
-   {
-      MMThreadGuard scg(stateCacheLock_);
-      if (!stateCache_.isPropertyIncluded(label, propName))
-         throw CMMError("Property " + ToQuotedString(propName) + " of device " +
-               ToQuotedString(label) + " not found in cache",
-               MMERR_PropertyNotInCache);
-      PropertySetting s = stateCache_.getSetting(label, propName);
-      return s.getPropertyValue();
-   }
+   PropertySetting s;
+   if (!stateCache_->Find(label, propName, s))
+      throw CMMError("Property " + ToQuotedString(propName) + " of device " +
+            ToQuotedString(label) + " not found in cache",
+            MMERR_PropertyNotInCache);
+   return s.getPropertyValue();
 }
 
 /**
@@ -3845,10 +4577,7 @@ void CMMCore::setProperty(const char* label, const char* propName,
          propName << " = " << propValue;
 
       properties_->Execute(propName, propValue);
-      {
-         MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, propName, propValue));
-      }
+      stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, propName, propValue));
 
       LOG_DEBUG(coreLogger_) << "Did set Core property: " <<
          propName << " = " << propValue;
@@ -3861,10 +4590,7 @@ void CMMCore::setProperty(const char* label, const char* propName,
 
       pDevice->SetProperty(propName, propValue);
 
-      {
-         MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(label, propName, propValue));
-      }
+      stateCache_->Set(PropertySetting(label, propName, propValue));
    }
 }
 
@@ -4328,10 +5054,7 @@ void CMMCore::setExposure(const char* label, double dExp) throw (CMMError)
       pCamera->SetExposure(dExp);
       if (pCamera->HasProperty(MM::g_Keyword_Exposure))
       {
-         {
-            MMThreadGuard scg(stateCacheLock_);
-            stateCache_.addSetting(PropertySetting(label, MM::g_Keyword_Exposure, CDeviceUtils::ConvertToString(dExp)));
-         }
+         stateCache_->Set(PropertySetting(label, MM::g_Keyword_Exposure, CDeviceUtils::ConvertToString(dExp)));
       }
    }
 
@@ -4409,6 +5132,7 @@ void CMMCore::setROI(int x, int y, int xSize, int ySize) throw (CMMError)
       // inconsistent with the current image size. There is no way to "fix"
       // popNextImage() to handle this correctly, so we need to make sure we
       // discard such images.
+      flushImageProcessorPipeline(true);
       cbuf_->Clear();
    }
    else
@@ -4488,6 +5212,7 @@ void CMMCore::setROI(const char* label, int x, int y, int xSize, int ySize) thro
      // inconsistent with the current image size. There is no way to "fix"
      // popNextImage() to handle this correctly, so we need to make sure we
      // discard such images.
+     flushImageProcessorPipeline(true);
      cbuf_->Clear();
   }
   else
@@ -4547,6 +5272,7 @@ void CMMCore::clearROI() throw (CMMError)
       // inconsistent with the current image size. There is no way to "fix"
       // popNextImage() to handle this correctly, so we need to make sure we
       // discard such images.
+      flushImageProcessorPipeline(true);
       cbuf_->Clear();
    }
 }
@@ -4685,19 +5411,13 @@ void CMMCore::setState(const char* deviceLabel, long state) throw (CMMError)
 
    if (pStateDev->HasProperty(MM::g_Keyword_State))
    {
-      {
-         MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(deviceLabel, MM::g_Keyword_State, CDeviceUtils::ConvertToString(state)));
-      }
+      stateCache_->Set(PropertySetting(deviceLabel, MM::g_Keyword_State, CDeviceUtils::ConvertToString(state)));
    }
    if (pStateDev->HasProperty(MM::g_Keyword_Label))
    {
       std::string posLbl = pStateDev->GetPositionLabel(state);
 
-      {
-         MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(deviceLabel, MM::g_Keyword_Label, posLbl.c_str()));
-      }
+      stateCache_->Set(PropertySetting(deviceLabel, MM::g_Keyword_Label, posLbl.c_str()));
    }
 
    LOG_DEBUG(coreLogger_) << "Did set " << deviceLabel << " to state " << state;
@@ -4766,19 +5486,13 @@ void CMMCore::setStateLabel(const char* deviceLabel, const char* stateLabel) thr
 
    if (pStateDev->HasProperty(MM::g_Keyword_Label))
    {
-      {
-         MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(deviceLabel, MM::g_Keyword_Label, stateLabel));
-      }
+      stateCache_->Set(PropertySetting(deviceLabel, MM::g_Keyword_Label, stateLabel));
    }
    if (pStateDev->HasProperty(MM::g_Keyword_State))
    {
       long state = getStateFromLabel(deviceLabel, stateLabel);
-      {
-         MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(deviceLabel, MM::g_Keyword_State,
-                  CDeviceUtils::ConvertToString(state)));
-      }
+      stateCache_->Set(PropertySetting(deviceLabel, MM::g_Keyword_State,
+               CDeviceUtils::ConvertToString(state)));
    }
 }
 
@@ -5555,8 +6269,7 @@ std::string CMMCore::getCurrentPixelSizeConfig(bool cached) throw (CMMError)
 				}
 				else
 				{
-               MMThreadGuard scg(stateCacheLock_);
-               value = stateCache_.getSetting(cs.getDeviceLabel().c_str(), cs.getPropertyName().c_str()).getPropertyValue();
+               value = stateCache_->GetSnapshot()->getSetting(cs.getDeviceLabel().c_str(), cs.getPropertyName().c_str()).getPropertyValue();
 				}
                PropertySetting ss(cs.getDeviceLabel().c_str(), cs.getPropertyName().c_str(), value.c_str()); // state setting
                curState.addSetting(ss);
@@ -7352,6 +8065,68 @@ void CMMCore::loadSystemConfiguration(const char* fileName) throw (CMMError)
 }
 
 
+namespace {
+
+struct ConfigFileCommand
+{
+   int lineNumber;
+   std::string line;
+   std::vector<std::string> tokens;
+};
+
+// Phases of loading a system configuration, for the startup timeline
+enum ConfigLoadPhase
+{
+   ConfigLoadPhaseParse,
+   ConfigLoadPhaseAdapters,
+   ConfigLoadPhaseDevices,
+   ConfigLoadPhasePreInitProperties,
+   ConfigLoadPhaseInitialization,
+   ConfigLoadPhaseOtherCommands,
+   ConfigLoadPhaseStartupConfig,
+   ConfigLoadPhaseSystemState,
+   ConfigLoadPhaseCount
+};
+
+const char* const configLoadPhaseNames[ConfigLoadPhaseCount] = {
+   "read and parse",
+   "load adapters",
+   "load devices",
+   "pre-init properties",
+   "initialize devices",
+   "other commands",
+   "startup configuration",
+   "update system state",
+};
+
+ConfigLoadPhase GetConfigLoadPhase(const ConfigFileCommand& command, bool initialized)
+{
+   const std::vector<std::string>& tokens = command.tokens;
+   if (tokens.empty())
+      return ConfigLoadPhaseOtherCommands;
+   if (tokens[0] == MM::g_CFGCommand_Device)
+      return ConfigLoadPhaseDevices;
+   if (tokens[0] == MM::g_CFGCommand_Property && tokens.size() == 4 &&
+         tokens[1] == MM::g_Keyword_CoreDevice &&
+         tokens[2] == MM::g_Keyword_CoreInitialize && tokens[3] == "1")
+      return ConfigLoadPhaseInitialization;
+   if (!initialized && tokens[0] == MM::g_CFGCommand_Property &&
+         (tokens.size() == 3 || tokens.size() == 4) &&
+         tokens[1] != MM::g_Keyword_CoreDevice)
+      return ConfigLoadPhasePreInitProperties;
+   return ConfigLoadPhaseOtherCommands;
+}
+
+} // anonymous namespace
+
+/*
+ * Implementation of loadSystemConfiguration().
+ *
+ * The whole file is parsed first. With the ParallelConfigLoading feature, the
+ * device adapters named in the file are then loaded concurrently, and runs of
+ * pre-initialization properties are set on one thread per device adapter.
+ * The time spent in each phase is logged.
+ */
 void CMMCore::loadSystemConfigurationImpl(const char* fileName) throw (CMMError)
 {
    if (!fileName)
@@ -7359,6 +8134,16 @@ void CMMCore::loadSystemConfigurationImpl(const char* fileName) throw (CMMError)
 
    LOG_INFO(coreLogger_) << "Loading system configuration from:" << ToQuotedString(fileName);
 
+   const auto loadStart = std::chrono::steady_clock::now();
+   double phaseMs[ConfigLoadPhaseCount] = {};
+   auto phaseStart = loadStart;
+   auto endPhase = [&](ConfigLoadPhase phase)
+   {
+      const auto now = std::chrono::steady_clock::now();
+      phaseMs[phase] += std::chrono::duration<double, std::milli>(now - phaseStart).count();
+      phaseStart = now;
+   };
+
    std::ifstream is;
    is.open(fileName, std::ios_base::in);
    if (!is.is_open())
@@ -7368,233 +8153,100 @@ void CMMCore::loadSystemConfigurationImpl(const char* fileName) throw (CMMError)
             MMERR_FileOpenFailed);
    }
 
-   // Process commands
-   const int maxLineLength = 4 * MM::MaxStrLength + 4; // accommodate up to 4 strings and delimiters
-   char line[maxLineLength+1];
-   std::vector<std::string> tokens;
-
+   // Read and parse the whole file before executing any command
+   std::vector<ConfigFileCommand> commands;
+   const std::string contents((std::istreambuf_iterator<char>(is)),
+         std::istreambuf_iterator<char>());
    int lineCount = 0;
-
-   while(is.getline(line, maxLineLength, '\n'))
+   for (size_t pos = 0; pos < contents.size(); )
    {
+      size_t eol = contents.find('\n', pos);
+      if (eol == std::string::npos)
+         eol = contents.size();
+      std::string line = contents.substr(pos, eol - pos);
+      pos = eol + 1;
+
       // strip a potential Windows/dos CR
-      std::istringstream il(line);
-      il.getline(line, maxLineLength, '\r');
+      const size_t cr = line.find('\r');
+      if (cr != std::string::npos)
+         line.erase(cr);
 
       lineCount++;
-      if (strlen(line) > 0)
-      {
-         if (line[0] == '#')
-         {
-            // comment, so skip processing
-            continue;
-         }
-
-         // parse tokens
-         tokens.clear();
-         CDeviceUtils::Tokenize(line, tokens, MM::g_FieldDelimiters);
+      if (line.empty() || line[0] == '#') // comment, so skip processing
+         continue;
 
-         try
-         {
+      ConfigFileCommand command;
+      command.lineNumber = lineCount;
+      command.line.swap(line);
+      CDeviceUtils::Tokenize(command.line, command.tokens, MM::g_FieldDelimiters);
+      commands.push_back(command);
+   }
+   endPhase(ConfigLoadPhaseParse);
 
-            // non-empty and non-comment lines mush have at least one token
-            if (tokens.size() < 1)
-               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                     ToQuotedString(line) + ")",
-                     MMERR_InvalidCFGEntry);
+   const bool parallel = mm::features::flags().parallelConfigLoading;
+   if (parallel)
+   {
+      std::vector<std::string> moduleNames;
+      for (const ConfigFileCommand& command : commands)
+      {
+         if (command.tokens.size() == 4 &&
+               command.tokens[0] == MM::g_CFGCommand_Device)
+            moduleNames.push_back(command.tokens[2]);
+      }
+      pluginManager_->PreloadDeviceAdapters(moduleNames);
+      endPhase(ConfigLoadPhaseAdapters);
+   }
 
-            if(tokens[0].compare(MM::g_CFGCommand_Device) == 0)
-            {
-               // load device command
-               // -------------------
-               if (tokens.size() != 4)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               loadDevice(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str());
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Property) == 0)
-            {
-               // set property command
-               // --------------------
-               if (tokens.size() == 4)
-                  setProperty(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str());
-               else if (tokens.size() == 3)
-                  // ...assuming here that the last missing toke represents an empty string
-                  setProperty(tokens[1].c_str(), tokens[2].c_str(), "");
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Delay) == 0)
-            {
-               // set delay command
-               // -----------------
-               if (tokens.size() != 3)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               setDeviceDelayMs(tokens[1].c_str(), atof(tokens[2].c_str()));
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_FocusDirection) == 0)
-            {
-               // set focus direction command
-               // ---------------------------
-               if (tokens.size() != 3)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               setFocusDirection(tokens[1].c_str(), atol(tokens[2].c_str()));
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Label) == 0)
-            {
-               // define label command
-               // --------------------
-               if (tokens.size() != 4)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               defineStateLabel(tokens[1].c_str(), atol(tokens[2].c_str()), tokens[3].c_str());
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Configuration) == 0)
-            {
-               // define configuration command
-               // ----------------------------
-               if (tokens.size() != 5)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               LOG_WARNING(coreLogger_) << "Obsolete command " << tokens[0] <<
-                  " ignored in configuration file";
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_ConfigGroup) == 0)
-            {
-               // define grouped configuration command
-               // ------------------------------------
-               if (tokens.size() == 6)
-                  defineConfig(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str(), tokens[4].c_str(), tokens[5].c_str());
-               else if (tokens.size() == 5)
-               {
-                  // we will assume here that the last (missing) token is representing an empty string
-                  defineConfig(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str(), tokens[4].c_str(), "");
-               }
-               else if (tokens.size() == 2)
-                  defineConfigGroup(tokens[1].c_str());
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_ConfigPixelSize) == 0)
-            {
-               // define pixel size configuration command
-               // ---------------------------------------
-               if (tokens.size() == 5)
-                  definePixelSizeConfig(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str(), tokens[4].c_str());
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_PixelSize_um) == 0)
-            {
-               // set pixel size
-               // --------------
-               if (tokens.size() == 3)
-                  setPixelSizeUm(tokens[1].c_str(), atof(tokens[2].c_str()));
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_PixelSizeAffine) == 0)
-            {
-               // set affine transform
-               // --------------
-               //
-               if (tokens.size() == 8)
-               {
-                  std::vector<double> *affineT = new std::vector<double>(6);
-                  for (int i = 0; i < 6; i++)
-                  {
-                     affineT->at(i) = atof(tokens[i + 2].c_str());
-                  }
-                  setPixelSizeAffine(tokens[1].c_str(), *affineT);
-                  delete affineT;
-               }
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if (tokens[0].compare(MM::g_CFGCommand_PixelSizedxdz) == 0)
-            {
-               if (tokens.size() == 3)
-                  setPixelSizedxdz(tokens[1].c_str(), atof(tokens[2].c_str()));
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if (tokens[0].compare(MM::g_CFGCommand_PixelSizedydz) == 0)
-            {
-               if (tokens.size() == 3)
-                  setPixelSizedydz(tokens[1].c_str(), atof(tokens[2].c_str()));
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if (tokens[0].compare(MM::g_CFGCommand_PixelSizeOptimalZUm) == 0)
-            {
-               if (tokens.size() == 3)
-                  setPixelSizeOptimalZUm(tokens[1].c_str(), atof(tokens[2].c_str()));
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Equipment) == 0)
-            {
-              // Property blocks have been removed
-              throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                    ToQuotedString(line) + ")",
-                    MMERR_InvalidCFGEntry);
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_ImageSynchro) == 0)
+   // Process commands
+   bool initialized = false;
+   for (size_t i = 0; i < commands.size(); )
+   {
+      const ConfigLoadPhase phase = GetConfigLoadPhase(commands[i], initialized);
+      size_t next = i + 1;
+      try
+      {
+         if (parallel && phase == ConfigLoadPhasePreInitProperties)
+         {
+            // Set consecutive pre-init properties per device adapter
+            std::vector<PropertySetting> props;
+            for (next = i; next < commands.size() &&
+                  GetConfigLoadPhase(commands[next], initialized) == phase; ++next)
             {
-               // ImageSynchro has been removed
-               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                     ToQuotedString(line) + ")",
-                     MMERR_InvalidCFGEntry);
+               const std::vector<std::string>& tokens = commands[next].tokens;
+               props.push_back(PropertySetting(tokens[1].c_str(), tokens[2].c_str(),
+                        tokens.size() == 4 ? tokens[3].c_str() : ""));
             }
-            else if(tokens[0].compare(MM::g_CFGCommand_ParentID) == 0)
+            std::exception_ptr error;
+            const size_t failed = setPropertiesPerModule(props, error);
+            if (failed < props.size())
             {
-               // set parent ID
-               // -------------
-               if (tokens.size() != 3)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-
-               setParentLabel(tokens[1].c_str(), tokens[2].c_str());
+               i += failed;
+               std::rethrow_exception(error);
             }
-
          }
-         catch (CMMError& err)
+         else
          {
-            if (externalCallback_)
-               externalCallback_->onSystemConfigurationLoaded();
-            std::ostringstream errorText;
-            errorText << "Line " << lineCount << ": " << line << '\n';
-            errorText << err.getFullMsg() << "\n\n";
-            throw CMMError(errorText.str().c_str(), MMERR_InvalidConfigurationFile);
+            executeConfigCommand(commands[i].tokens, commands[i].line);
          }
       }
+      catch (CMMError& err)
+      {
+         if (externalCallback_)
+            externalCallback_->onSystemConfigurationLoaded();
+         std::ostringstream errorText;
+         errorText << "Line " << commands[i].lineNumber << ": " << commands[i].line << '\n';
+         errorText << err.getFullMsg() << "\n\n";
+         throw CMMError(errorText.str().c_str(), MMERR_InvalidConfigurationFile);
+      }
+
+      if (phase == ConfigLoadPhaseInitialization)
+         initialized = true;
+      endPhase(phase);
+      i = next;
    }
 
    updateAllowedChannelGroups();
+   endPhase(ConfigLoadPhaseOtherCommands);
 
    // file parsing finished, try to set startup configuration
    if (isConfigDefined(MM::g_CFGGroup_System, MM::g_CFGGroup_System_Startup))
@@ -7605,10 +8257,21 @@ void CMMCore::loadSystemConfigurationImpl(const char* fileName) throw (CMMError)
       updateSystemStateCache();
 
       this->setConfig(MM::g_CFGGroup_System, MM::g_CFGGroup_System_Startup);
+      endPhase(ConfigLoadPhaseStartupConfig);
    }
 
    waitForSystem();
    updateSystemStateCache();
+   endPhase(ConfigLoadPhaseSystemState);
+
+   std::ostringstream timeline;
+   timeline << std::fixed << std::setprecision(1);
+   for (int phase = 0; phase < ConfigLoadPhaseCount; ++phase)
+      timeline << "; " << configLoadPhaseNames[phase] << " " << phaseMs[phase] << " ms";
+   LOG_INFO(coreLogger_) << "Loaded system configuration in " << std::fixed <<
+      std::setprecision(1) << std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - loadStart).count() << " ms" <<
+      timeline.str();
 
    if (externalCallback_)
    {
@@ -7617,6 +8280,272 @@ void CMMCore::loadSystemConfigurationImpl(const char* fileName) throw (CMMError)
 }
 
 
+/*
+ * Helper for loadSystemConfigurationImpl (ParallelConfigLoading feature)
+ * Sets the properties on one thread per device adapter, in order for the
+ * devices of each adapter, stopping an adapter's properties at its first
+ * failure. Returns the index of the first property (in the given order)
+ * that failed, with its error, or props.size() if all were set.
+ */
+size_t CMMCore::setPropertiesPerModule(const std::vector<PropertySetting>& props,
+      std::exception_ptr& error)
+{
+   const auto start = std::chrono::steady_clock::now();
+
+   std::map<std::shared_ptr<LoadedDeviceAdapter>, std::vector<size_t> > moduleProps;
+   for (size_t i = 0; i < props.size(); ++i)
+   {
+      std::shared_ptr<LoadedDeviceAdapter> module;
+      try
+      {
+         module = deviceManager_->GetDevice(props[i].getDeviceLabel())->GetAdapterModule();
+      }
+      catch (const CMMError&)
+      {
+         // Fails again (with the proper error) when set
+      }
+      moduleProps[module].push_back(i);
+   }
+
+   std::vector<std::exception_ptr> errors(props.size());
+   auto setProps = [&](const std::vector<size_t>& indices)
+   {
+      for (size_t i : indices)
+      {
+         try
+         {
+            setProperty(props[i].getDeviceLabel().c_str(),
+                  props[i].getPropertyName().c_str(),
+                  props[i].getPropertyValue().c_str());
+         }
+         catch (...)
+         {
+            errors[i] = std::current_exception();
+            return;
+         }
+      }
+   };
+
+   std::vector<std::future<void> > futures;
+   for (auto it = moduleProps.begin(); it != moduleProps.end(); ++it)
+   {
+      if (it != moduleProps.begin())
+         futures.push_back(std::async(std::launch::async, setProps, std::cref(it->second)));
+   }
+   // The first adapter's properties are set on this thread
+   if (!moduleProps.empty())
+      setProps(moduleProps.begin()->second);
+   for (size_t i = 0; i < futures.size(); ++i)
+      futures[i].get();
+
+   LOG_DEBUG(coreLogger_) << "Set " << props.size() << " properties of " <<
+      moduleProps.size() << " device adapters in " <<
+      std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count() << " ms";
+
+   for (size_t i = 0; i < props.size(); ++i)
+   {
+      if (errors[i])
+      {
+         error = errors[i];
+         return i;
+      }
+   }
+   return props.size();
+}
+
+/*
+ * Helper for loadSystemConfigurationImpl: executes one (tokenized) line of
+ * the configuration file.
+ */
+void CMMCore::executeConfigCommand(const std::vector<std::string>& tokens,
+      const std::string& line) throw (CMMError)
+{
+   // non-empty and non-comment lines mush have at least one token
+   if (tokens.size() < 1)
+      throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+            ToQuotedString(line) + ")",
+            MMERR_InvalidCFGEntry);
+
+   if(tokens[0].compare(MM::g_CFGCommand_Device) == 0)
+   {
+      // load device command
+      // -------------------
+      if (tokens.size() != 4)
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+      loadDevice(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str());
+   }
+   else if(tokens[0].compare(MM::g_CFGCommand_Property) == 0)
+   {
+      // set property command
+      // --------------------
+      if (tokens.size() == 4)
+         setProperty(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str());
+      else if (tokens.size() == 3)
+         // ...assuming here that the last missing toke represents an empty string
+         setProperty(tokens[1].c_str(), tokens[2].c_str(), "");
+      else
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+   }
+   else if(tokens[0].compare(MM::g_CFGCommand_Delay) == 0)
+   {
+      // set delay command
+      // -----------------
+      if (tokens.size() != 3)
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+      setDeviceDelayMs(tokens[1].c_str(), atof(tokens[2].c_str()));
+   }
+   else if(tokens[0].compare(MM::g_CFGCommand_FocusDirection) == 0)
+   {
+      // set focus direction command
+      // ---------------------------
+      if (tokens.size() != 3)
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+      setFocusDirection(tokens[1].c_str(), atol(tokens[2].c_str()));
+   }
+   else if(tokens[0].compare(MM::g_CFGCommand_Label) == 0)
+   {
+      // define label command
+      // --------------------
+      if (tokens.size() != 4)
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+      defineStateLabel(tokens[1].c_str(), atol(tokens[2].c_str()), tokens[3].c_str());
+   }
+   else if(tokens[0].compare(MM::g_CFGCommand_Configuration) == 0)
+   {
+      // define configuration command
+      // ----------------------------
+      if (tokens.size() != 5)
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+      LOG_WARNING(coreLogger_) << "Obsolete command " << tokens[0] <<
+         " ignored in configuration file";
+   }
+   else if(tokens[0].compare(MM::g_CFGCommand_ConfigGroup) == 0)
+   {
+      // define grouped configuration command
+      // ------------------------------------
+      if (tokens.size() == 6)
+         defineConfig(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str(), tokens[4].c_str(), tokens[5].c_str());
+      else if (tokens.size() == 5)
+      {
+         // we will assume here that the last (missing) token is representing an empty string
+         defineConfig(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str(), tokens[4].c_str(), "");
+      }
+      else if (tokens.size() == 2)
+         defineConfigGroup(tokens[1].c_str());
+      else
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+   }
+   else if(tokens[0].compare(MM::g_CFGCommand_ConfigPixelSize) == 0)
+   {
+      // define pixel size configuration command
+      // ---------------------------------------
+      if (tokens.size() == 5)
+         definePixelSizeConfig(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str(), tokens[4].c_str());
+      else
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+   }
+   else if(tokens[0].compare(MM::g_CFGCommand_PixelSize_um) == 0)
+   {
+      // set pixel size
+      // --------------
+      if (tokens.size() == 3)
+         setPixelSizeUm(tokens[1].c_str(), atof(tokens[2].c_str()));
+      else
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+   }
+   else if(tokens[0].compare(MM::g_CFGCommand_PixelSizeAffine) == 0)
+   {
+      // set affine transform
+      // --------------
+      //
+      if (tokens.size() == 8)
+      {
+         std::vector<double> *affineT = new std::vector<double>(6);
+         for (int i = 0; i < 6; i++)
+         {
+            affineT->at(i) = atof(tokens[i + 2].c_str());
+         }
+         setPixelSizeAffine(tokens[1].c_str(), *affineT);
+         delete affineT;
+      }
+      else
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+   }
+   else if (tokens[0].compare(MM::g_CFGCommand_PixelSizedxdz) == 0)
+   {
+      if (tokens.size() == 3)
+         setPixelSizedxdz(tokens[1].c_str(), atof(tokens[2].c_str()));
+      else
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+   }
+   else if (tokens[0].compare(MM::g_CFGCommand_PixelSizedydz) == 0)
+   {
+      if (tokens.size() == 3)
+         setPixelSizedydz(tokens[1].c_str(), atof(tokens[2].c_str()));
+      else
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+   }
+   else if (tokens[0].compare(MM::g_CFGCommand_PixelSizeOptimalZUm) == 0)
+   {
+      if (tokens.size() == 3)
+         setPixelSizeOptimalZUm(tokens[1].c_str(), atof(tokens[2].c_str()));
+      else
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+   }
+   else if(tokens[0].compare(MM::g_CFGCommand_Equipment) == 0)
+   {
+     // Property blocks have been removed
+     throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+           ToQuotedString(line) + ")",
+           MMERR_InvalidCFGEntry);
+   }
+   else if(tokens[0].compare(MM::g_CFGCommand_ImageSynchro) == 0)
+   {
+      // ImageSynchro has been removed
+      throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+            ToQuotedString(line) + ")",
+            MMERR_InvalidCFGEntry);
+   }
+   else if(tokens[0].compare(MM::g_CFGCommand_ParentID) == 0)
+   {
+      // set parent ID
+      // -------------
+      if (tokens.size() != 3)
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+
+      setParentLabel(tokens[1].c_str(), tokens[2].c_str());
+   }
+}
+
 /**
  * Register a callback (listener class).
  * MMCore will send notifications on internal events using this interface
@@ -7916,7 +8845,8 @@ void CMMCore::InitializeErrorMessages()
    errorText_[MMERR_DuplicateConfigGroup] = "Group name already in use.";
    errorText_[MMERR_CameraBufferReadFailed] = "Camera image buffer read failed.";
    errorText_[MMERR_CircularBufferFailedToInitialize] =
-      "Failed to initialize circular buffer - memory requirements not adequate.";
+      "Failed to initialize circular buffer - memory requirements not adequate, "
+      "or images from the buffer are still pinned.";
    errorText_[MMERR_CircularBufferEmpty] = "Circular buffer is empty.";
    errorText_[MMERR_ContFocusNotAvailable] = "Auto-focus focus device not defined.";
    errorText_[MMERR_BadConfigName] = "Configuration name contains illegal characters (/\\*!')";
@@ -7985,6 +8915,39 @@ void CMMCore::CreateCoreProperties()
    CoreProperty propBusyTimeoutMs;
    properties_->Add(MM::g_Keyword_CoreTimeoutMs, propBusyTimeoutMs);
 
+   // Number of worker threads for parallel operations (0: one per CPU)
+   CoreProperty propThreadPoolSize("0", false);
+   properties_->Add(MM::g_Keyword_CoreThreadPoolSize, propThreadPoolSize);
+
+   // Whether to bind each worker thread to a CPU
+   CoreProperty propThreadPoolPinning("0", false);
+   propThreadPoolPinning.AddAllowedValue("0");
+   propThreadPoolPinning.AddAllowedValue("1");
+   properties_->Add(MM::g_Keyword_CoreThreadPoolPinning, propThreadPoolPinning);
+
+   // Properties taking longer to read are served from the cache by
+   // updateSystemStateCache() (0: always read)
+   CoreProperty propSlowPropertyMs("0", false);
+   properties_->Add(MM::g_Keyword_CoreSystemStateSlowPropertyMs, propSlowPropertyMs);
+
+   // Number of threads running the image processor off the camera thread
+   // (0: run it on the camera thread), and the maximum number of images
+   // waiting to be processed or inserted into the circular buffer
+   CoreProperty propImageProcessorThreads("0", false);
+   properties_->Add(MM::g_Keyword_CoreImageProcessorThreads, propImageProcessorThreads);
+   CoreProperty propImageProcessorQueueCapacity("16", false);
+   properties_->Add(MM::g_Keyword_CoreImageProcessorQueueCapacity, propImageProcessorQueueCapacity);
+
+   // Image processor pipeline statistics (read when requested)
+   CoreProperty propImageProcessorQueueDepth("0", true);
+   properties_->Add(MM::g_Keyword_CoreImageProcessorQueueDepth, propImageProcessorQueueDepth);
+   CoreProperty propImageProcessorWaitLatency("0", true);
+   properties_->Add(MM::g_Keyword_CoreImageProcessorWaitLatencyMs, propImageProcessorWaitLatency);
+   CoreProperty propImageProcessorProcessLatency("0", true);
+   properties_->Add(MM::g_Keyword_CoreImageProcessorProcessLatencyMs, propImageProcessorProcessLatency);
+   CoreProperty propImageProcessorPublishLatency("0", true);
+   properties_->Add(MM::g_Keyword_CoreImageProcessorPublishLatencyMs, propImageProcessorPublishLatency);
+
    properties_->Refresh();
 }
 
@@ -8071,6 +9034,8 @@ void CMMCore::applyConfiguration(const Configuration& config) throw (CMMError)
    std::ostringstream sall;
    bool error = false;
    std::vector<PropertySetting> failedProps;
+   const bool perModule = mm::features::flags().parallelSetConfig;
+   std::vector<PropertySetting> deviceProps;
    for (size_t i=0; i<config.size(); i++)
    {
       PropertySetting setting = config.getSetting(i);
@@ -8079,10 +9044,11 @@ void CMMCore::applyConfiguration(const Configuration& config) throw (CMMError)
       if (setting.getDeviceLabel().compare(MM::g_Keyword_CoreDevice) == 0)
       {
          properties_->Execute(setting.getPropertyName().c_str(), setting.getPropertyValue().c_str());
-         {
-            MMThreadGuard scg(stateCacheLock_);
-            stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, setting.getPropertyName().c_str(), setting.getPropertyValue().c_str()));
-         }
+         stateCache_->Set(PropertySetting(MM::g_Keyword_CoreDevice, setting.getPropertyName().c_str(), setting.getPropertyValue().c_str()));
+      }
+      else if (perModule)
+      {
+         deviceProps.push_back(setting);
       }
       else
       {
@@ -8095,10 +9061,7 @@ void CMMCore::applyConfiguration(const Configuration& config) throw (CMMError)
             pDevice->SetProperty(setting.getPropertyName(),
                   setting.getPropertyValue());
 
-            {
-               MMThreadGuard scg(stateCacheLock_);
-               stateCache_.addSetting(setting);
-            }
+            stateCache_->Set(setting);
          }
          catch (const CMMError&)
          {
@@ -8107,6 +9070,12 @@ void CMMCore::applyConfiguration(const Configuration& config) throw (CMMError)
          }
       }
    }
+   if (!deviceProps.empty())
+   {
+      applyPropertiesPerModule(deviceProps, failedProps);
+      if (!failedProps.empty())
+         error = true;
+   }
    if (error)
    {
       std::string errorString;
@@ -8120,6 +9089,95 @@ void CMMCore::applyConfiguration(const Configuration& config) throw (CMMError)
    }
 }
 
+/*
+ * Helper function for applyConfiguration (ParallelSetConfig feature)
+ * Sets the properties on one thread per device adapter, preserving the order
+ * of the properties of each adapter's devices. The properties that could not
+ * be set are appended to failedProps, in their original order.
+ */
+void CMMCore::applyPropertiesPerModule(const std::vector<PropertySetting>& props,
+      std::vector<PropertySetting>& failedProps)
+{
+   const auto start = std::chrono::steady_clock::now();
+
+   // Look up all devices first, so that an unknown label throws before
+   // anything is set
+   std::vector<std::shared_ptr<DeviceInstance> > devices(props.size());
+   std::map<std::shared_ptr<LoadedDeviceAdapter>, std::vector<size_t> > moduleProps;
+   for (size_t i = 0; i < props.size(); ++i)
+   {
+      devices[i] = deviceManager_->GetDevice(props[i].getDeviceLabel());
+      moduleProps[devices[i]->GetAdapterModule()].push_back(i);
+   }
+
+   std::vector<char> failed(props.size(), 0);
+   auto applyProps = [&](const std::vector<size_t>& indices)
+   {
+      for (size_t i : indices)
+      {
+         mm::DeviceModuleLockGuard guard(devices[i]);
+         try
+         {
+            devices[i]->SetProperty(props[i].getPropertyName(),
+                  props[i].getPropertyValue());
+
+            stateCache_->Set(props[i]);
+         }
+         catch (const CMMError&)
+         {
+            failed[i] = 1;
+         }
+      }
+   };
+
+   if (moduleProps.size() > 1)
+   {
+      std::vector<std::future<void> > futures;
+      for (auto it = std::next(moduleProps.begin()); it != moduleProps.end(); ++it)
+         futures.push_back(std::async(std::launch::async, applyProps, std::cref(it->second)));
+      // The first adapter's properties are set on this thread
+      std::exception_ptr error;
+      try
+      {
+         applyProps(moduleProps.begin()->second);
+      }
+      catch (...)
+      {
+         error = std::current_exception();
+      }
+      // Wait for all threads before rethrowing (e.g. std::bad_alloc)
+      for (size_t i = 0; i < futures.size(); ++i)
+      {
+         try
+         {
+            futures[i].get();
+         }
+         catch (...)
+         {
+            if (!error)
+               error = std::current_exception();
+         }
+      }
+      if (error)
+         std::rethrow_exception(error);
+   }
+   else if (!moduleProps.empty())
+   {
+      applyProps(moduleProps.begin()->second);
+   }
+
+   for (size_t i = 0; i < props.size(); ++i)
+   {
+      if (failed[i])
+         failedProps.push_back(props[i]);
+   }
+
+   LOG_DEBUG(coreLogger_) << "Set " << props.size() << " properties of " <<
+      moduleProps.size() << " device adapters in " <<
+      std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count() / 1000.0 << " ms";
+}
+
 /*
  * Helper function for applyConfiguration
  * It is possible that setting certain properties failed because they are dependent
@@ -8142,10 +9200,7 @@ int CMMCore::applyProperties(std::vector<PropertySetting>& props, std::string& l
          pDevice->SetProperty(props[i].getPropertyName(),
                props[i].getPropertyValue());
 
-         {
-            MMThreadGuard scg(stateCacheLock_);
-            stateCache_.addSetting(props[i]);
-         }
+         stateCache_->Set(props[i]);
       }
       catch (const CMMError& e)
       {
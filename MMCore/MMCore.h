@@ -64,12 +64,15 @@
 #include "Configuration.h"
 #include "Error.h"
 #include "ErrorCodes.h"
+#include "ImageBatch.h"
 #include "Logging/Logger.h"
 
 #include <cstring>
 #include <deque>
+#include <exception>
 #include <map>
 #include <memory>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -94,7 +97,9 @@ class CoreCallback;
 class CorePropertyCollection;
 class MMEventCallback;
 class Metadata;
+class MockDeviceAdapter;
 class PixelSizeConfigGroup;
+class ThreadPool;
 
 class AutoFocusInstance;
 class CameraInstance;
@@ -112,7 +117,11 @@ class CMMCore;
 
 namespace mm {
    class DeviceManager;
+   class IdleSignal;
+   class ImgBuffer;
+   class ImageProcessingPipeline;
    class LogManager;
+   class SystemStateCache;
 } // namespace mm
 
 typedef unsigned int* imgRGB32;
@@ -168,6 +177,8 @@ public:
    void reset() throw (CMMError);
 
    void unloadLibrary(const char* moduleName) throw (CMMError);
+   void loadMockDeviceAdapter(const char* name,
+         MockDeviceAdapter* implementation) throw (CMMError);
 
    void updateCoreProperties() throw (CMMError);
 
@@ -189,6 +200,8 @@ public:
    /** \name Logging and log management. */
    ///@{
    void setPrimaryLogFile(const char* filename, bool truncate = false) throw (CMMError);
+   void setPrimaryBinaryLogFile(const char* filename, long long maxFileSize = 0,
+         bool truncate = false) throw (CMMError);
    std::string getPrimaryLogFile() const;
 
    void logMessage(const char* msg);
@@ -200,6 +213,9 @@ public:
 
    int startSecondaryLogFile(const char* filename, bool enableDebug,
          bool truncate = true, bool synchronous = false) throw (CMMError);
+   int startSecondaryBinaryLogFile(const char* filename, bool enableDebug,
+         long long maxFileSize = 0, bool truncate = true,
+         bool synchronous = false) throw (CMMError);
    void stopSecondaryLogFile(int handle) throw (CMMError);
 
    ///@}
@@ -208,6 +224,8 @@ public:
    ///@{
    std::vector<std::string> getDeviceAdapterSearchPaths();
    void setDeviceAdapterSearchPaths(const std::vector<std::string>& paths);
+   void setDeviceAdapterCacheFile(const char* filename);
+   std::string getDeviceAdapterCacheFile() const;
 
    std::vector<std::string> getDeviceAdapterNames() throw (CMMError);
 
@@ -298,6 +316,9 @@ public:
     */
    ///@{
    Configuration getSystemStateCache() const;
+   long long getSystemStateCacheVersion() const;
+   Configuration getSystemStateCacheChanges(long long sinceVersion) const;
+   long long getSystemStateCacheRemovalVersion() const;
    void updateSystemStateCache();
    std::string getPropertyFromCache(const char* deviceLabel,
          const char* propName) const throw (CMMError);
@@ -431,6 +452,33 @@ public:
    void* getNBeforeLastImageMD(unsigned long n, Metadata& md)
       const throw (CMMError);
    void* popNextImageMD(Metadata& md) throw (CMMError);
+   long popNextImages(long maxCount, ImageBatch& batch) throw (CMMError);
+   long popNextImages(unsigned channel, long maxCount, ImageBatch& batch)
+      throw (CMMError);
+   void* getLastImagePinned() throw (CMMError);
+   void* getLastImagePinnedMD(unsigned channel, Metadata& md)
+      throw (CMMError);
+   void* popNextImagePinned() throw (CMMError);
+   void* popNextImagePinnedMD(unsigned channel, Metadata& md)
+      throw (CMMError);
+   void releaseImage(void* pinnedPixels) throw (CMMError);
+   long getPinnedImageBufferSize(void* pinnedPixels) throw (CMMError);
+   // Variants of the above returning the buffered image, for MMCoreJ
+   const mm::ImgBuffer* getLastImageBuffer() throw (CMMError);
+   const mm::ImgBuffer* popNextImageBuffer() throw (CMMError);
+   const mm::ImgBuffer* getLastImageBufferMD(unsigned channel,
+         unsigned slice, Metadata& md) const throw (CMMError);
+   const mm::ImgBuffer* popNextImageBufferMD(unsigned channel,
+         unsigned slice, Metadata& md) throw (CMMError);
+   const mm::ImgBuffer* getLastImageBufferMD(Metadata& md) const
+      throw (CMMError);
+   const mm::ImgBuffer* getNBeforeLastImageBufferMD(unsigned long n,
+         Metadata& md) const throw (CMMError);
+   const mm::ImgBuffer* popNextImageBufferMD(Metadata& md) throw (CMMError);
+   void getBufferedImageGeometry(const mm::ImgBuffer* image,
+         unsigned& width, unsigned& height, unsigned& bytesPerPixel,
+         unsigned& numComponents);
+   long getPinnedImageCount();
 
    long getRemainingImageCount();
    long getBufferTotalCapacity();
@@ -707,14 +755,35 @@ private:
    PixelSizeConfigGroup* pixelSizeGroup_;
    CircularBuffer* cbuf_;
 
+   // Worker threads shared by parallel operations (such as copying images
+   // into the circular buffer)
+   std::shared_ptr<ThreadPool> threadPool_;
+   unsigned threadPoolSize_; // 0 for one thread per hardware thread
+   bool threadPoolPinning_;
+
+   // Keys (see PropertySetting::getKey()) of the device properties that took
+   // at least slowPropertyMs_ to read; updateSystemStateCache() takes their
+   // values from the cache. Both are synchronized by slowPropertiesLock_.
+   mutable MMThreadLock slowPropertiesLock_;
+   long slowPropertyMs_; // 0 to always read
+   std::set<std::string> slowProperties_;
+
    std::shared_ptr<CPluginManager> pluginManager_;
    std::shared_ptr<mm::DeviceManager> deviceManager_;
    std::map<int, std::string> errorText_;
 
-   // Must be unlocked when calling MMEventCallback or calling device methods
-   // or acquiring a module lock
-   mutable MMThreadLock stateCacheLock_;
-   mutable Configuration stateCache_; // Synchronized by stateCacheLock_
+   std::shared_ptr<mm::SystemStateCache> stateCache_;
+
+   // Notified when a device reports (via OnBusyChanged()) that it is no
+   // longer busy
+   std::shared_ptr<mm::IdleSignal> idleSignal_;
+
+   // If set, the image processor runs on the pipeline's threads instead of
+   // the camera's. Accessed with std::atomic_load()/atomic_store(), because
+   // camera threads read it.
+   std::shared_ptr<mm::ImageProcessingPipeline> imagePipeline_;
+   unsigned imagePipelineThreads_; // 0: process on the camera thread
+   unsigned imagePipelineCapacity_;
 
    MMThreadLock* pPostedErrorsLock_;
    mutable std::deque<std::pair< int, std::string> > postedErrors_;
@@ -734,6 +803,8 @@ private:
 
    void applyConfiguration(const Configuration& config) throw (CMMError);
    int applyProperties(std::vector<PropertySetting>& props, std::string& lastError);
+   void applyPropertiesPerModule(const std::vector<PropertySetting>& props,
+         std::vector<PropertySetting>& failedProps);
    void waitForDevice(std::shared_ptr<DeviceInstance> pDev) throw (CMMError);
    Configuration getConfigGroupState(const char* group, bool fromCache) throw (CMMError);
    std::string getDeviceErrorText(int deviceCode, std::shared_ptr<DeviceInstance> pDevice);
@@ -743,9 +814,26 @@ private:
    void assignDefaultRole(std::shared_ptr<DeviceInstance> pDev);
    void updateCoreProperty(const char* propName, MM::DeviceType devType) throw (CMMError);
    void loadSystemConfigurationImpl(const char* fileName) throw (CMMError);
+   void executeConfigCommand(const std::vector<std::string>& tokens,
+         const std::string& line) throw (CMMError);
+   size_t setPropertiesPerModule(const std::vector<PropertySetting>& props,
+         std::exception_ptr& error);
    void initializeAllDevicesSerial() throw (CMMError);
    void initializeAllDevicesParallel() throw (CMMError);
    int initializeVectorOfDevices(std::vector<std::pair<std::shared_ptr<DeviceInstance>, std::string> > pDevices);
+   void setThreadPool(unsigned threadCount, bool pinThreads) throw (CMMError);
+   unsigned getThreadPoolSize() const { return threadPoolSize_; }
+   bool getThreadPoolPinning() const { return threadPoolPinning_; }
+   Configuration readSystemState(bool useCachedValues);
+   void readDeviceState(const std::string& label, const Configuration* cache,
+         std::vector<PropertySetting>& settings);
+   void setSlowPropertyMs(long ms);
+   long getSlowPropertyMs() const;
+   void setImageProcessorPipeline(unsigned threadCount, unsigned capacity) throw (CMMError);
+   unsigned getImageProcessorThreads() const { return imagePipelineThreads_; }
+   unsigned getImageProcessorQueueCapacity() const { return imagePipelineCapacity_; }
+   std::shared_ptr<mm::ImageProcessingPipeline> getImageProcessorPipeline() const;
+   void flushImageProcessorPipeline(bool discard);
 };
 
 #if defined(__GNUC__) && !defined(__clang__)
@@ -0,0 +1,46 @@
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//
+// DESCRIPTION:   Interface for device adapters implemented in the application
+//                (for testing)
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "../MMDevice/MMDevice.h"
+#include "../MMDevice/MMDeviceConstants.h"
+
+#include <functional>
+
+/**
+ * A device adapter that is part of the application instead of a loadable
+ * module, mirroring the module interface (see ModuleInterface.h).
+ *
+ * Register an instance with CMMCore::loadMockDeviceAdapter(); its devices can
+ * then be loaded (including from configuration files) like those of any other
+ * device adapter. This is mainly useful for testing the Core with devices
+ * written in the test code.
+ */
+class MockDeviceAdapter
+{
+public:
+   typedef std::function<void(const char* deviceName, MM::DeviceType type,
+         const char* description)> RegisterDeviceFunction;
+
+   virtual ~MockDeviceAdapter() {}
+
+   // Call registerDevice once for each available device
+   virtual void InitializeModuleData(RegisterDeviceFunction registerDevice) = 0;
+   virtual MM::Device* CreateDevice(const char* deviceName) = 0;
+   virtual void DeleteDevice(MM::Device* device) = 0;
+};
@@ -41,6 +41,7 @@
 #include <algorithm>
 #include <cstring>
 #include <fstream>
+#include <future>
 #include <memory>
 #include <set>
 #include <string>
@@ -144,6 +145,115 @@ CPluginManager::GetDeviceAdapter(const std::string& moduleName)
    return module;
 }
 
+/**
+ * Load several device adapter modules concurrently.
+ *
+ * Modules that are already loaded are skipped. Modules that fail to load are
+ * ignored here; the error is reported when GetDeviceAdapter() is called for
+ * them.
+ */
+void
+CPluginManager::PreloadDeviceAdapters(const std::vector<std::string>& moduleNames)
+{
+   std::vector<std::string> names;
+   std::vector< std::future< std::shared_ptr<LoadedDeviceAdapter> > > futures;
+   for (std::vector<std::string>::const_iterator it = moduleNames.begin(),
+         end = moduleNames.end(); it != end; ++it)
+   {
+      if (it->empty() || moduleMap_.count(*it) ||
+            std::find(names.begin(), names.end(), *it) != names.end())
+         continue;
+
+      const std::string name = *it;
+      const std::string filename =
+         FindInSearchPath(LIB_NAME_PREFIX + name + LIB_NAME_SUFFIX);
+      names.push_back(name);
+      futures.push_back(std::async(std::launch::async, [name, filename]
+      {
+         return std::make_shared<LoadedDeviceAdapter>(name, filename);
+      }));
+   }
+
+   for (size_t i = 0; i < futures.size(); ++i)
+   {
+      try
+      {
+         moduleMap_[names[i]] = futures[i].get();
+      }
+      catch (const CMMError&)
+      {
+         // Reported by GetDeviceAdapter()
+      }
+   }
+}
+
+void
+CPluginManager::LoadMockDeviceAdapter(const std::string& moduleName,
+      MockDeviceAdapter* mock)
+{
+   if (moduleName.empty())
+   {
+      throw CMMError("Empty device adapter module name");
+   }
+   if (moduleMap_.count(moduleName))
+   {
+      throw CMMError("Device adapter " + ToQuotedString(moduleName) +
+            " is already loaded");
+   }
+   moduleMap_[moduleName] = std::make_shared<LoadedDeviceAdapter>(moduleName, mock);
+}
+
+mm::AdapterMetadata
+CPluginManager::GetDeviceAdapterMetadata(const std::string& moduleName)
+{
+   if (moduleName.empty())
+   {
+      throw CMMError("Empty device adapter module name");
+   }
+
+   mm::AdapterMetadata metadata;
+   metadata.path = FindInSearchPath(LIB_NAME_PREFIX + moduleName + LIB_NAME_SUFFIX);
+   // Not cached if not found in search paths (loaded from system paths)
+   const bool canCache = mm::FileStamp::Get(metadata.path, metadata.stamp);
+   if (canCache && !moduleMap_.count(moduleName) &&
+         metadataCache_.Lookup(metadata.path, metadata.stamp, metadata))
+   {
+      return metadata;
+   }
+
+   std::shared_ptr<LoadedDeviceAdapter> module = GetDeviceAdapter(moduleName);
+   metadata.moduleInterfaceVersion = module->GetModuleVersion();
+   metadata.deviceInterfaceVersion = module->GetDeviceInterfaceVersion();
+   const std::vector<std::string> names = module->GetAvailableDeviceNames();
+   metadata.devices.resize(names.size());
+   for (size_t i = 0; i < names.size(); ++i)
+   {
+      mm::AdapterDeviceMetadata& device = metadata.devices[i];
+      device.name = names[i];
+      // Failures are recorded, to be reported when the information is used
+      try
+      {
+         device.description = module->GetDeviceDescription(names[i]);
+         device.hasDescription = true;
+      }
+      catch (const CMMError&)
+      {
+      }
+      try
+      {
+         device.type = module->GetAdvertisedDeviceType(names[i]);
+      }
+      catch (const CMMError&)
+      {
+      }
+   }
+
+   // Written to the cache file when the file is changed or on destruction
+   if (canCache)
+      metadataCache_.Store(metadata);
+   return metadata;
+}
+
 std::shared_ptr<LoadedDeviceAdapter>
 CPluginManager::GetDeviceAdapter(const char* moduleName)
 {
@@ -288,7 +398,21 @@ CPluginManager::GetAvailableDeviceAdapters()
 {
    std::vector<std::string> modules;
    for (const auto& path : searchPaths_)
-      GetModules(modules, path.c_str());
+   {
+      // Rescan a directory only if it was modified
+      mm::FileStamp stamp;
+      if (!mm::FileStamp::Get(path, stamp))
+         continue;
+      auto it = moduleListings_.find(path);
+      if (it == moduleListings_.end() || it->second.first != stamp)
+      {
+         std::vector<std::string> listing;
+         GetModules(listing, path.c_str());
+         moduleListings_[path] = std::make_pair(stamp, listing);
+         it = moduleListings_.find(path);
+      }
+      modules.insert(modules.end(), it->second.second.begin(), it->second.second.end());
+   }
 
    // Check for duplicates
    // XXX Is this the right place to be doing this checking? Shouldn't it be an
@@ -23,6 +23,7 @@
 #pragma once
 
 #include "../MMDevice/DeviceThreads.h"
+#include "AdapterMetadataCache.h"
 
 #include <map>
 #include <memory>
@@ -30,6 +31,7 @@
 #include <vector>
 
 class LoadedDeviceAdapter;
+class MockDeviceAdapter;
 
 
 class CPluginManager /* final */
@@ -55,6 +57,25 @@ public:
    std::shared_ptr<LoadedDeviceAdapter>
    GetDeviceAdapter(const char* moduleName);
 
+   void PreloadDeviceAdapters(const std::vector<std::string>& moduleNames);
+
+   /**
+    * Register a device adapter implemented in the application (not owned)
+    */
+   void LoadMockDeviceAdapter(const std::string& moduleName,
+         MockDeviceAdapter* mock);
+
+   /**
+    * Return the available devices of a device adapter module, from the
+    * metadata cache if the library is unchanged, otherwise by loading it
+    */
+   mm::AdapterMetadata GetDeviceAdapterMetadata(const std::string& moduleName);
+
+   void SetMetadataCacheFile(const std::string& filename)
+   { metadataCache_.SetCacheFile(filename); }
+   std::string GetMetadataCacheFile() const
+   { return metadataCache_.GetCacheFile(); }
+
 private:
    static std::vector<std::string> GetDefaultSearchPaths();
    static void GetModules(std::vector<std::string> &modules, const char *path);
@@ -63,4 +84,8 @@ private:
    std::vector<std::string> searchPaths_;
 
    std::map< std::string, std::shared_ptr<LoadedDeviceAdapter> > moduleMap_;
+
+   mm::AdapterMetadataCache metadataCache_;
+   // Module names found in each search path, by directory stamp
+   std::map< std::string, std::pair< mm::FileStamp, std::vector<std::string> > > moduleListings_;
 };
@@ -0,0 +1,127 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          SystemStateCache.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Versioned cache of device property values.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "SystemStateCache.h"
+
+namespace mm {
+
+SystemStateCache::SystemStateCache() :
+   version_(0),
+   removalVersion_(0),
+   snapshot_(std::make_shared<const Configuration>()),
+   snapshotVersion_(0)
+{
+}
+
+void SystemStateCache::Set(const PropertySetting& setting)
+{
+   MMThreadGuard g(lock_);
+   SetUnlocked(setting);
+}
+
+void SystemStateCache::SetUnlocked(const PropertySetting& setting)
+{
+   const std::string key = setting.getKey();
+   std::map<std::string, long long>::iterator it = keyVersions_.find(key);
+   if (it != keyVersions_.end())
+   {
+      const PropertySetting& old = changes_[it->second];
+      if (old.getPropertyValue() == setting.getPropertyValue() &&
+            old.getReadOnly() == setting.getReadOnly())
+         return;
+      changes_.erase(it->second);
+   }
+   current_.addSetting(setting);
+   ++version_;
+   keyVersions_[key] = version_;
+   changes_[version_] = setting;
+}
+
+void SystemStateCache::Replace(const Configuration& state)
+{
+   MMThreadGuard g(lock_);
+   for (size_t i = 0; i < state.size(); ++i)
+      SetUnlocked(state.getSetting(i));
+
+   if (current_.size() == state.size())
+      return; // Nothing to remove
+
+   // Rebuild, keeping the versions of the remaining settings
+   std::map<std::string, long long> keyVersions;
+   std::map<long long, PropertySetting> changes;
+   for (size_t i = 0; i < state.size(); ++i)
+   {
+      const std::string key = state.getSetting(i).getKey();
+      const long long version = keyVersions_[key];
+      keyVersions[key] = version;
+      changes[version] = changes_[version];
+   }
+   current_ = state;
+   keyVersions_.swap(keyVersions);
+   changes_.swap(changes);
+   removalVersion_ = ++version_;
+}
+
+bool SystemStateCache::Find(const char* device, const char* prop,
+      PropertySetting& setting) const
+{
+   MMThreadGuard g(lock_);
+   if (!current_.isPropertyIncluded(device, prop))
+      return false;
+   setting = current_.getSetting(device, prop);
+   return true;
+}
+
+std::shared_ptr<const Configuration> SystemStateCache::GetSnapshot() const
+{
+   MMThreadGuard g(lock_);
+   if (snapshotVersion_ != version_)
+   {
+      snapshot_ = std::make_shared<const Configuration>(current_);
+      snapshotVersion_ = version_;
+   }
+   return snapshot_;
+}
+
+long long SystemStateCache::GetVersion() const
+{
+   MMThreadGuard g(lock_);
+   return version_;
+}
+
+long long SystemStateCache::GetRemovalVersion() const
+{
+   MMThreadGuard g(lock_);
+   return removalVersion_;
+}
+
+Configuration SystemStateCache::GetChangesSince(long long version) const
+{
+   MMThreadGuard g(lock_);
+   if (version < removalVersion_)
+      return current_;
+
+   Configuration changes;
+   for (std::map<long long, PropertySetting>::const_iterator it =
+         changes_.upper_bound(version), end = changes_.end();
+         it != end; ++it)
+      changes.addSetting(it->second);
+   return changes;
+}
+
+} // namespace mm
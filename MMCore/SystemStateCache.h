@@ -0,0 +1,96 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          SystemStateCache.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Versioned cache of device property values.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "../MMDevice/DeviceThreads.h"
+#include "Configuration.h"
+
+#include <map>
+#include <memory>
+#include <string>
+
+namespace mm {
+
+/**
+ * The system state cache: the last-set or last-read value of each property.
+ *
+ * Every change increments the version. Readers either take an immutable
+ * snapshot, which is shared by all readers until the next change (so that
+ * polling an unchanged cache copies nothing), or ask for just the settings
+ * changed since a version they saw before.
+ *
+ * All member functions are thread-safe.
+ */
+class SystemStateCache
+{
+public:
+   SystemStateCache();
+
+   /**
+    * Sets one value. The version is only incremented if the value or
+    * read-only flag differs from the cached one.
+    */
+   void Set(const PropertySetting& setting);
+
+   /**
+    * Replaces the whole contents (as read from the devices). Settings not in
+    * state are removed.
+    */
+   void Replace(const Configuration& state);
+
+   /**
+    * Looks up one setting; returns false if not cached.
+    */
+   bool Find(const char* device, const char* prop, PropertySetting& setting) const;
+
+   std::shared_ptr<const Configuration> GetSnapshot() const;
+
+   long long GetVersion() const;
+
+   /**
+    * The version at which settings were last removed, or 0.
+    */
+   long long GetRemovalVersion() const;
+
+   /**
+    * Returns the settings set to a new value after the given version. If
+    * settings were removed after that version, the whole cache is returned.
+    */
+   Configuration GetChangesSince(long long version) const;
+
+private:
+   SystemStateCache(const SystemStateCache&);
+   SystemStateCache& operator=(const SystemStateCache&);
+
+   void SetUnlocked(const PropertySetting& setting);
+
+   mutable MMThreadLock lock_;
+   Configuration current_;
+   long long version_;
+   long long removalVersion_;
+   std::map<std::string, long long> keyVersions_;
+   // The latest setting of each key, by the version it was set at
+   std::map<long long, PropertySetting> changes_;
+
+   // Rebuilt from current_ on demand when out of date
+   mutable std::shared_ptr<const Configuration> snapshot_;
+   mutable long long snapshotVersion_;
+};
+
+} // namespace mm
@@ -23,21 +23,60 @@
 
 #include "TaskSet_CopyMemory.h"
 
+#include "CopyKernels.h"
+
 #include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cstdint>
 #include <cstring>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+// Chunks start on cache line boundaries, so that no two tasks write to the
+// same line
+const size_t chunkAlignment = 64;
+
+// Largest copy timed during calibration (a large camera frame)
+const size_t calibrationBytes = 16 * 1024 * 1024;
+
+std::mutex g_tuningMutex;
+
+// Used until calibrated; the task split was found experimentally
+TaskSet_CopyMemory::Tuning g_tuning = {
+    1000000,
+    std::numeric_limits<size_t>::max(),
+    std::numeric_limits<size_t>::max(),
+};
+
+// Size of the largest pool the tuning was measured with
+size_t g_calibratedTaskCount = 0;
+
+void CopyChunk(void* dst, const void* src, size_t bytes, bool streaming)
+{
+    if (streaming)
+        mm::StreamingCopy(dst, src, bytes);
+    else
+        std::memcpy(dst, src, bytes);
+}
+
+} // anonymous namespace
 
 TaskSet_CopyMemory::ATask::ATask(std::shared_ptr<Semaphore> semDone, size_t taskIndex, size_t totalTaskCount)
     : Task(semDone, taskIndex, totalTaskCount)
 {
 }
 
-void TaskSet_CopyMemory::ATask::SetUp(void* dst, const void* src, size_t bytes, size_t usedTaskCount)
+void TaskSet_CopyMemory::ATask::SetUp(void* dst, const void* src, size_t bytes, size_t usedTaskCount, bool streaming)
 {
     dst_ = dst;
     src_ = src;
     bytes_ = bytes;
     usedTaskCount_ = usedTaskCount;
+    streaming_ = streaming;
 }
 
 void TaskSet_CopyMemory::ATask::Execute()
@@ -45,21 +84,35 @@ void TaskSet_CopyMemory::ATask::Execute()
     if (taskIndex_ >= usedTaskCount_)
         return;
 
-    size_t chunkBytes = bytes_ / usedTaskCount_;
+    size_t chunkBytes = bytes_ / usedTaskCount_ / chunkAlignment * chunkAlignment;
     const size_t chunkOffset = taskIndex_ * chunkBytes;
     if (taskIndex_ == usedTaskCount_ - 1)
-        chunkBytes += bytes_ % usedTaskCount_;
+        chunkBytes = bytes_ - chunkOffset;
 
     void* dst = static_cast<char*>(dst_) + chunkOffset;
     const void* src = static_cast<const char*>(src_) + chunkOffset;
 
-    std::memcpy(dst, src, chunkBytes);
+    CopyChunk(dst, src, chunkBytes, streaming_);
 }
 
 TaskSet_CopyMemory::TaskSet_CopyMemory(std::shared_ptr<ThreadPool> pool)
     : TaskSet(pool)
 {
     CreateTasks<ATask>();
+
+    std::lock_guard<std::mutex> lock(g_tuningMutex);
+    if (tasks_.size() > g_calibratedTaskCount)
+    {
+        Calibrate();
+        g_calibratedTaskCount = tasks_.size();
+    }
+    tuning_ = g_tuning;
+}
+
+TaskSet_CopyMemory::Tuning TaskSet_CopyMemory::GetTuning()
+{
+    std::lock_guard<std::mutex> lock(g_tuningMutex);
+    return g_tuning;
 }
 
 void TaskSet_CopyMemory::SetUp(void* dst, const void* src, size_t bytes)
@@ -68,18 +121,24 @@ void TaskSet_CopyMemory::SetUp(void* dst, const void* src, size_t bytes)
     assert(src);
     assert(bytes > 0);
 
-    // Call memcpy directly without threading for small frames up to 1MB
-    // Otherwise do parallel copy and add one thread for each 1MB
-    // The limits were found experimentally
-    usedTaskCount_ = std::min<size_t>(1 + bytes / 1000000, tasks_.size());
+    // Call memcpy directly without threading for small frames. Otherwise do
+    // parallel copy and add one task for each tuning_.bytesPerTask.
+    const size_t taskCount = std::min({ 1 + bytes / tuning_.bytesPerTask,
+        tuning_.maxTaskCount, tasks_.size() });
+    SetUp(dst, src, bytes, taskCount, bytes >= tuning_.streamingThreshold);
+}
+
+void TaskSet_CopyMemory::SetUp(void* dst, const void* src, size_t bytes, size_t taskCount, bool streaming)
+{
+    usedTaskCount_ = std::max<size_t>(taskCount, 1);
     if (usedTaskCount_ == 1)
     {
-        std::memcpy(dst, src, bytes);
+        CopyChunk(dst, src, bytes, streaming);
         return;
     }
 
     for (Task* task : tasks_)
-        static_cast<ATask*>(task)->SetUp(dst, src, bytes, usedTaskCount_);
+        static_cast<ATask*>(task)->SetUp(dst, src, bytes, usedTaskCount_, streaming);
 }
 
 void TaskSet_CopyMemory::Execute()
@@ -104,3 +163,81 @@ void TaskSet_CopyMemory::MemCopy(void* dst, const void* src, size_t bytes)
     Execute();
     Wait();
 }
+
+double TaskSet_CopyMemory::TimeCopy(void* dst, const void* src, size_t bytes, size_t taskCount, bool streaming)
+{
+    // Best of a few runs, to ignore preemption and the first-run warmup
+    double best = std::numeric_limits<double>::max();
+    for (int run = 0; run < 3; ++run)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        SetUp(dst, src, bytes, taskCount, streaming);
+        Execute();
+        Wait();
+        const std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+// Replaces g_tuning with values measured on this machine. Takes a few tens of
+// milliseconds. Must be called with g_tuningMutex held.
+void TaskSet_CopyMemory::Calibrate()
+{
+    // Filled, so that all pages are resident before timing
+    std::vector<unsigned char> src(calibrationBytes, 1);
+    std::vector<unsigned char> dst(calibrationBytes, 0);
+
+    // Streaming stores pay off once the copy no longer fits in the cache;
+    // use them from the smallest size above which they always win
+    size_t streamingThreshold = std::numeric_limits<size_t>::max();
+    for (size_t bytes = calibrationBytes; bytes >= 256 * 1024; bytes /= 2)
+    {
+        if (TimeCopy(dst.data(), src.data(), bytes, 1, true) >
+                TimeCopy(dst.data(), src.data(), bytes, 1, false))
+            break;
+        streamingThreshold = bytes;
+    }
+
+    size_t bytesPerTask = g_tuning.bytesPerTask;
+    size_t maxTaskCount = g_tuning.maxTaskCount;
+    if (tasks_.size() > 1)
+    {
+        // Smallest copy for which a second task pays for its dispatch cost
+        bytesPerTask = std::numeric_limits<size_t>::max();
+        for (size_t bytes = 64 * 1024; bytes <= calibrationBytes; bytes *= 2)
+        {
+            if (TimeCopy(dst.data(), src.data(), bytes, 2, false) <
+                    TimeCopy(dst.data(), src.data(), bytes, 1, false))
+            {
+                bytesPerTask = bytes;
+                break;
+            }
+        }
+
+        // Memory bandwidth usually saturates before all cores are busy; use
+        // the fewest tasks that come within 10% of the best time
+        std::vector<size_t> counts;
+        for (size_t count = 1; count < tasks_.size(); count *= 2)
+            counts.push_back(count);
+        counts.push_back(tasks_.size());
+        std::vector<double> times;
+        for (size_t count : counts)
+            times.push_back(TimeCopy(dst.data(), src.data(), calibrationBytes,
+                count, calibrationBytes >= streamingThreshold));
+        const double bestTime = *std::min_element(times.begin(), times.end());
+        for (size_t i = 0; i < counts.size(); ++i)
+        {
+            if (times[i] <= 1.1 * bestTime)
+            {
+                maxTaskCount = counts[i];
+                break;
+            }
+        }
+    }
+
+    g_tuning.bytesPerTask = bytesPerTask;
+    g_tuning.maxTaskCount = maxTaskCount;
+    g_tuning.streamingThreshold = streamingThreshold;
+}
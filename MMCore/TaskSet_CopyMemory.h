@@ -25,6 +25,8 @@
 
 #include "TaskSet.h"
 
+#include <cstddef>
+
 class TaskSet_CopyMemory : public TaskSet
 {
 private:
@@ -33,7 +35,7 @@ private:
     public:
         explicit ATask(std::shared_ptr<Semaphore> semDone, size_t taskIndex, size_t totalTaskCount);
 
-        void SetUp(void* dst, const void* src, size_t bytes, size_t usedTaskCount);
+        void SetUp(void* dst, const void* src, size_t bytes, size_t usedTaskCount, bool streaming);
 
         virtual void Execute() override;
 
@@ -41,11 +43,28 @@ private:
         void* dst_{ nullptr };
         const void* src_{ nullptr };
         size_t bytes_{ 0 };
+        bool streaming_{ false };
     };
 
 public:
+    // How copies are split among tasks and which copy kernel is used
+    struct Tuning
+    {
+        // Bytes copied by a single task before another one is added
+        size_t bytesPerTask;
+        // Largest number of tasks worth using, regardless of copy size
+        size_t maxTaskCount;
+        // Copies of at least this size use non-temporal (streaming) stores
+        size_t streamingThreshold;
+    };
+
+    // Measures the machine the first time a pool with more threads than any
+    // previous one is used (once per process in the usual case)
     explicit TaskSet_CopyMemory(std::shared_ptr<ThreadPool> pool);
 
+    // The tuning currently in effect for newly created task sets
+    static Tuning GetTuning();
+
     void SetUp(void* dst, const void* src, size_t bytes);
 
     virtual void Execute() override;
@@ -53,4 +72,11 @@ public:
 
     // Helper blocking method calling SetUp, Execute and Wait
     void MemCopy(void* dst, const void* src, size_t bytes);
+
+private:
+    void SetUp(void* dst, const void* src, size_t bytes, size_t taskCount, bool streaming);
+    void Calibrate();
+    double TimeCopy(void* dst, const void* src, size_t bytes, size_t taskCount, bool streaming);
+
+    Tuning tuning_;
 };
@@ -5,6 +5,8 @@
 //-----------------------------------------------------------------------------
 // DESCRIPTION:   A class executing queued tasks on separate threads
 //                and scaling number of threads based on hardware.
+//                Each thread has its own task queue and steals tasks
+//                from the other threads' queues when its own is empty.
 //
 // AUTHOR:        Tomas Hanak, tomas.hanak@teledyne.com, 03/03/2021
 //                Andrej Bencur, andrej.bencur@teledyne.com, 03/03/2021
@@ -31,12 +33,29 @@
 #include <mutex>
 #include <thread>
 
-ThreadPool::ThreadPool()
+#ifdef _WIN32
+#   define WIN32_LEAN_AND_MEAN
+#   include <windows.h>
+#elif defined(__linux__)
+#   include <pthread.h>
+#   include <sched.h>
+#endif
+
+ThreadPool::ThreadPool(size_t threadCount, bool pinThreads)
 {
     const size_t hwThreadCount = std::max<size_t>(1, std::thread::hardware_concurrency());
-    for (size_t n = 0; n < hwThreadCount; ++n)
+    if (threadCount == 0)
+        threadCount = hwThreadCount;
+
+    for (size_t n = 0; n < threadCount; ++n)
+        workers_.push_back(std::make_unique<Worker>());
+
+    pinned_ = pinThreads;
+    for (size_t n = 0; n < threadCount; ++n)
     {
-        auto thread = std::make_unique<std::thread>(&ThreadPool::ThreadFunc, this);
+        auto thread = std::make_unique<std::thread>(&ThreadPool::ThreadFunc, this, n);
+        if (pinThreads && !PinThread(*thread, n % hwThreadCount))
+            pinned_ = false;
         threads_.push_back(std::move(thread));
     }
 }
@@ -58,49 +77,130 @@ size_t ThreadPool::GetSize() const
     return threads_.size();
 }
 
+bool ThreadPool::IsPinned() const
+{
+    return pinned_;
+}
+
+bool ThreadPool::PinThread(std::thread& thread, size_t cpu)
+{
+#ifdef _WIN32
+    if (cpu >= 8 * sizeof(DWORD_PTR))
+        return false;
+    const DWORD_PTR mask = static_cast<DWORD_PTR>(1) << cpu;
+    return SetThreadAffinityMask(thread.native_handle(), mask) != 0;
+#elif defined(__linux__)
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    return pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus) == 0;
+#else
+    (void)thread;
+    (void)cpu;
+    return false;
+#endif
+}
+
 void ThreadPool::Execute(Task* task)
 {
-    assert(task);
-    {
-        std::lock_guard<std::mutex> lock(mx_);
-        if (abortFlag_)
-            return;
-        queue_.push_back(task);
-    }
-    cv_.notify_one();
+    Execute(std::vector<Task*>(1, task));
 }
 
 void ThreadPool::Execute(const std::vector<Task*>& tasks)
 {
     assert(!tasks.empty());
+    if (abortFlag_)
+        return;
 
+    // Spread the tasks over the workers' queues, so that each worker that is
+    // woken up finds a task in its own queue
+    const size_t workerCount = workers_.size();
+    const size_t first = nextWorker_.fetch_add(tasks.size(), std::memory_order_relaxed);
+    for (size_t i = 0; i < tasks.size(); ++i)
     {
+        assert(tasks[i]);
+        Worker& worker = *workers_[(first + i) % workerCount];
+        std::lock_guard<std::mutex> lock(worker.mx);
+        worker.queue.push_back(tasks[i]);
+    }
+    pendingCount_.fetch_add(tasks.size());
+
+    WakeWorkers(tasks.size());
+}
+
+void ThreadPool::WakeWorkers(size_t taskCount)
+{
+    // Workers increment sleepingCount_ before checking pendingCount_, and we
+    // increment pendingCount_ before checking sleepingCount_ (both
+    // sequentially consistent), so a worker cannot miss the new tasks.
+    const size_t sleeping = sleepingCount_.load();
+    if (sleeping == 0)
+        return; // All workers are busy and will look for more tasks
+
+    {
+        // Ensures that a worker that is about to wait is already waiting
         std::lock_guard<std::mutex> lock(mx_);
-        if (abortFlag_)
-            return;
-        for (Task* task : tasks)
+    }
+    if (taskCount >= sleeping)
+    {
+        cv_.notify_all();
+    }
+    else
+    {
+        for (size_t i = 0; i < taskCount; ++i)
+            cv_.notify_one();
+    }
+}
+
+Task* ThreadPool::TakeTask(size_t index)
+{
+    if (pendingCount_.load() == 0)
+        return nullptr;
+
+    // Our own queue first (oldest task first), then steal the newest task
+    // from one of the others
+    const size_t workerCount = workers_.size();
+    for (size_t i = 0; i < workerCount; ++i)
+    {
+        Worker& worker = *workers_[(index + i) % workerCount];
+        std::lock_guard<std::mutex> lock(worker.mx);
+        if (worker.queue.empty())
+            continue;
+        Task* task;
+        if (i == 0)
+        {
+            task = worker.queue.front();
+            worker.queue.pop_front();
+        }
+        else
         {
-            assert(task);
-            queue_.push_back(task);
+            task = worker.queue.back();
+            worker.queue.pop_back();
         }
+        pendingCount_.fetch_sub(1);
+        return task;
     }
-    cv_.notify_all();
+    return nullptr;
 }
 
-void ThreadPool::ThreadFunc()
+void ThreadPool::ThreadFunc(size_t index)
 {
     for (;;)
     {
-        Task* task = nullptr;
+        if (abortFlag_)
+            break;
+
+        Task* task = TakeTask(index);
+        if (task)
         {
-            std::unique_lock<std::mutex> lock(mx_);
-            cv_.wait(lock, [&]() { return abortFlag_ || !queue_.empty(); });
-            if (abortFlag_)
-                break;
-            task = queue_.front();
-            queue_.pop_front();
+            task->Execute();
+            task->Done();
+            continue;
         }
-        task->Execute();
-        task->Done();
+
+        std::unique_lock<std::mutex> lock(mx_);
+        sleepingCount_.fetch_add(1);
+        cv_.wait(lock, [&]() { return abortFlag_ || pendingCount_.load() > 0; });
+        sleepingCount_.fetch_sub(1);
     }
 }
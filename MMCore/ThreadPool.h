@@ -5,6 +5,8 @@
 //-----------------------------------------------------------------------------
 // DESCRIPTION:   A class executing queued tasks on separate threads
 //                and scaling number of threads based on hardware.
+//                Each thread has its own task queue and steals tasks
+//                from the other threads' queues when its own is empty.
 //
 // AUTHOR:        Tomas Hanak, tomas.hanak@teledyne.com, 03/03/2021
 //                Andrej Bencur, andrej.bencur@teledyne.com, 03/03/2021
@@ -24,6 +26,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <condition_variable>
 #include <deque>
 #include <memory>
@@ -36,21 +39,40 @@ class Task;
 class ThreadPool final
 {
 public:
-    explicit ThreadPool();
+    // threadCount 0 means one thread per hardware thread. If pinThreads is
+    // set, each thread is bound to a single CPU (where supported).
+    explicit ThreadPool(size_t threadCount = 0, bool pinThreads = false);
     ~ThreadPool();
 
     size_t GetSize() const;
+    bool IsPinned() const;
 
     void Execute(Task* task);
     void Execute(const std::vector<Task*>& tasks);
 
 private:
-    void ThreadFunc();
+    struct Worker
+    {
+        std::mutex mx{};
+        std::deque<Task*> queue{};
+    };
+
+    void ThreadFunc(size_t index);
+    Task* TakeTask(size_t index);
+    void WakeWorkers(size_t taskCount);
+    bool PinThread(std::thread& thread, size_t cpu);
 
 private:
+    std::vector<std::unique_ptr<Worker>> workers_{};
     std::vector<std::unique_ptr<std::thread>> threads_{};
-    bool abortFlag_{ false };
+    bool pinned_{ false };
+    // Next worker to queue a task on
+    std::atomic<size_t> nextWorker_{ 0 };
+    // Number of tasks queued and not yet taken by a worker
+    std::atomic<size_t> pendingCount_{ 0 };
+    // Number of workers waiting (or about to wait) on cv_
+    std::atomic<size_t> sleepingCount_{ 0 };
+    std::atomic<bool> abortFlag_{ false };
     std::mutex mx_{};
     std::condition_variable cv_{};
-    std::deque<Task*> queue_{};
 };
@@ -0,0 +1,193 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          mmlogdecode.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Converts binary Core logs to the text log format.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "../Logging/BinaryLogReader.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::time_point<std::chrono::system_clock> TimePoint;
+
+void PrintUsage(std::ostream& stream)
+{
+   stream <<
+      "Usage: mmlogdecode [options] FILE...\n"
+      "Convert binary Micro-Manager Core logs to the text log format.\n"
+      "Rotated files (FILE.0001, ...) should be given in order, before FILE.\n"
+      "\n"
+      "Options:\n"
+      "  --device LABEL   Only entries from device LABEL (repeatable)\n"
+      "  --label LABEL    Only entries from logger LABEL, e.g. Core\n"
+      "                   (repeatable)\n"
+      "  --from TIME      Only entries at or after TIME (local time,\n"
+      "                   yyyy-mm-ddThh:mm:ss[.uuuuuu])\n"
+      "  --to TIME        Only entries before TIME\n"
+      "  -o FILE          Write to FILE instead of standard output\n"
+      "  -h, --help       Show this help\n";
+}
+
+bool ParseLocalTime(const std::string& s, TimePoint& tp)
+{
+   int year, month, day, hour, minute;
+   double second;
+   char sep;
+   if (std::sscanf(s.c_str(), "%d-%d-%d%c%d:%d:%lf", &year, &month, &day,
+            &sep, &hour, &minute, &second) != 7 ||
+         (sep != 'T' && sep != ' '))
+      return false;
+
+   std::tm tm = {};
+   tm.tm_year = year - 1900;
+   tm.tm_mon = month - 1;
+   tm.tm_mday = day;
+   tm.tm_hour = hour;
+   tm.tm_min = minute;
+   tm.tm_sec = static_cast<int>(second);
+   tm.tm_isdst = -1;
+   const std::time_t t = std::mktime(&tm);
+   if (t == static_cast<std::time_t>(-1))
+      return false;
+
+   const long long us = static_cast<long long>(std::floor(
+            (second - tm.tm_sec) * 1e6 + 0.5));
+   tp = std::chrono::system_clock::from_time_t(t) +
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::microseconds(us));
+   return true;
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+   using namespace mm::logging;
+
+   std::set<std::string> labels;
+   bool haveFrom = false, haveTo = false;
+   TimePoint from, to;
+   std::string outputFile;
+   std::vector<std::string> inputFiles;
+
+   for (int i = 1; i < argc; ++i)
+   {
+      const std::string arg = argv[i];
+      const bool hasValue = i + 1 < argc;
+      if (arg == "-h" || arg == "--help")
+      {
+         PrintUsage(std::cout);
+         return 0;
+      }
+      else if (arg == "--device" && hasValue)
+      {
+         // Device loggers, and the Core's loggers for a device
+         labels.insert("dev:" + std::string(argv[++i]));
+         labels.insert("Core:dev:" + std::string(argv[i]));
+      }
+      else if (arg == "--label" && hasValue)
+      {
+         labels.insert(argv[++i]);
+      }
+      else if ((arg == "--from" || arg == "--to") && hasValue)
+      {
+         TimePoint& tp = (arg == "--from" ? from : to);
+         if (!ParseLocalTime(argv[++i], tp))
+         {
+            std::cerr << "mmlogdecode: invalid time: " << argv[i] << '\n';
+            return 2;
+         }
+         (arg == "--from" ? haveFrom : haveTo) = true;
+      }
+      else if (arg == "-o" && hasValue)
+      {
+         outputFile = argv[++i];
+      }
+      else if (!arg.empty() && arg[0] == '-')
+      {
+         PrintUsage(std::cerr);
+         return 2;
+      }
+      else
+      {
+         inputFiles.push_back(arg);
+      }
+   }
+   if (inputFiles.empty())
+   {
+      PrintUsage(std::cerr);
+      return 2;
+   }
+
+   std::ofstream outFile;
+   if (!outputFile.empty())
+   {
+      outFile.open(outputFile.c_str());
+      if (!outFile)
+      {
+         std::cerr << "mmlogdecode: cannot open " << outputFile << '\n';
+         return 1;
+      }
+   }
+   std::ostream& out = outputFile.empty() ? std::cout : outFile;
+
+   internal::MetadataFormatter formatter;
+   BinaryLogEntry entry;
+   int result = 0;
+   for (const std::string& filename : inputFiles)
+   {
+      std::ifstream in(filename.c_str(), std::ios_base::binary);
+      if (!in)
+      {
+         std::cerr << "mmlogdecode: cannot open " << filename << '\n';
+         result = 1;
+         continue;
+      }
+      try
+      {
+         BinaryLogReader reader(in);
+         while (reader.ReadEntry(entry))
+         {
+            if (!labels.empty() && !labels.count(entry.label))
+               continue;
+            if (haveFrom && entry.timestamp < from)
+               continue;
+            if (haveTo && !(entry.timestamp < to))
+               continue;
+            WriteBinaryLogEntryAsText(out, entry, formatter);
+         }
+      }
+      catch (const BinaryLogFormatError& e)
+      {
+         // Keep what was decoded (e.g., the end of a log cut short by a
+         // crash)
+         std::cerr << "mmlogdecode: " << filename << ": " << e.what() << '\n';
+         result = 1;
+      }
+   }
+   out.flush();
+   return out ? result : 1;
+}
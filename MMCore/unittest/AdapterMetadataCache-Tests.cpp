@@ -0,0 +1,139 @@
+#include <catch2/catch_all.hpp>
+
+#include "AdapterMetadataCache.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+namespace mm {
+
+namespace {
+
+void WriteFile(const std::string& filename, const std::string& contents)
+{
+   std::ofstream f(filename.c_str(), std::ios_base::binary | std::ios_base::trunc);
+   f << contents;
+}
+
+AdapterMetadata MakeMetadata(const std::string& path)
+{
+   AdapterMetadata metadata;
+   metadata.path = path;
+   REQUIRE(FileStamp::Get(path, metadata.stamp));
+   metadata.moduleInterfaceVersion = 10;
+   metadata.deviceInterfaceVersion = 75;
+   AdapterDeviceMetadata camera;
+   camera.name = "Cam\tera";
+   camera.description = "Line 1\nLine 2 \\ with backslash";
+   camera.hasDescription = true;
+   camera.type = MM::CameraDevice;
+   metadata.devices.push_back(camera);
+   AdapterDeviceMetadata unknown;
+   unknown.name = "Unknown";
+   metadata.devices.push_back(unknown);
+   return metadata;
+}
+
+} // anonymous namespace
+
+TEST_CASE("FileStamp of missing file", "[AdapterMetadataCache]")
+{
+   FileStamp stamp;
+   CHECK_FALSE(FileStamp::Get("NoSuchFile.xyz", stamp));
+}
+
+TEST_CASE("adapter metadata cache is invalidated by file changes", "[AdapterMetadataCache]")
+{
+   const std::string lib = "AdapterMetadataCacheTest.lib";
+   WriteFile(lib, "library");
+
+   AdapterMetadataCache cache;
+   const AdapterMetadata stored = MakeMetadata(lib);
+   cache.Store(stored);
+
+   AdapterMetadata found;
+   REQUIRE(cache.Lookup(lib, stored.stamp, found));
+   CHECK(found.devices.size() == 2);
+   CHECK_FALSE(cache.Lookup("other.lib", stored.stamp, found));
+
+   WriteFile(lib, "rebuilt library");
+   FileStamp newStamp;
+   REQUIRE(FileStamp::Get(lib, newStamp));
+   CHECK(newStamp != stored.stamp);
+   CHECK_FALSE(cache.Lookup(lib, newStamp, found));
+
+   std::remove(lib.c_str());
+}
+
+TEST_CASE("adapter metadata cache persists to file", "[AdapterMetadataCache]")
+{
+   const std::string lib = "AdapterMetadataCachePersistTest.lib";
+   const std::string cacheFile = "AdapterMetadataCacheTest.txt";
+   WriteFile(lib, "library");
+   std::remove(cacheFile.c_str());
+
+   const AdapterMetadata stored = MakeMetadata(lib);
+   {
+      AdapterMetadataCache cache;
+      cache.Store(stored); // Before setting the file
+      cache.SetCacheFile(cacheFile);
+      CHECK(cache.Save());
+   }
+
+   AdapterMetadataCache cache;
+   cache.SetCacheFile(cacheFile);
+   AdapterMetadata found;
+   REQUIRE(cache.Lookup(lib, stored.stamp, found));
+   CHECK(found.path == lib);
+   CHECK(found.moduleInterfaceVersion == 10);
+   CHECK(found.deviceInterfaceVersion == 75);
+   REQUIRE(found.devices.size() == 2);
+   CHECK(found.devices[0].name == "Cam\tera");
+   CHECK(found.devices[0].description == "Line 1\nLine 2 \\ with backslash");
+   CHECK(found.devices[0].hasDescription);
+   CHECK(found.devices[0].type == MM::CameraDevice);
+   CHECK(found.devices[1].name == "Unknown");
+   CHECK_FALSE(found.devices[1].hasDescription);
+   CHECK(found.devices[1].type == MM::UnknownType);
+
+   // A corrupt or foreign file is ignored
+   WriteFile(cacheFile, "MMAdapterMetadataCache\t1\t0\t0\nA\tx\n");
+   AdapterMetadataCache other;
+   other.SetCacheFile(cacheFile);
+   CHECK_FALSE(other.Lookup(lib, stored.stamp, found));
+
+   std::remove(lib.c_str());
+   std::remove(cacheFile.c_str());
+}
+
+TEST_CASE("adapter metadata cache is written once on destruction", "[AdapterMetadataCache]")
+{
+   const std::string lib1 = "AdapterMetadataCacheDeferredTest1.lib";
+   const std::string lib2 = "AdapterMetadataCacheDeferredTest2.lib";
+   const std::string cacheFile = "AdapterMetadataCacheDeferredTest.txt";
+   WriteFile(lib1, "library 1");
+   WriteFile(lib2, "library 2");
+   std::remove(cacheFile.c_str());
+
+   {
+      AdapterMetadataCache cache;
+      cache.SetCacheFile(cacheFile);
+      cache.Store(MakeMetadata(lib1));
+      cache.Store(MakeMetadata(lib2));
+      FileStamp stamp;
+      CHECK_FALSE(FileStamp::Get(cacheFile, stamp)); // Not written per entry
+   }
+
+   AdapterMetadataCache cache;
+   cache.SetCacheFile(cacheFile);
+   AdapterMetadata found;
+   CHECK(cache.Lookup(lib1, MakeMetadata(lib1).stamp, found));
+   CHECK(cache.Lookup(lib2, MakeMetadata(lib2).stamp, found));
+
+   std::remove(lib1.c_str());
+   std::remove(lib2.c_str());
+   std::remove(cacheFile.c_str());
+}
+
+} // namespace mm
@@ -0,0 +1,188 @@
+#include <catch2/catch_all.hpp>
+
+#include "Logging/BinaryLogFormat.h"
+#include "Logging/BinaryLogReader.h"
+#include "Logging/Logging.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace mm {
+namespace logging {
+
+namespace {
+
+std::string ReadFile(const std::string& filename)
+{
+   std::ifstream f(filename.c_str(), std::ios_base::binary);
+   std::ostringstream ss;
+   ss << f.rdbuf();
+   return ss.str();
+}
+
+std::string DecodeToText(const std::string& filename)
+{
+   std::ifstream f(filename.c_str(), std::ios_base::binary);
+   BinaryLogReader reader(f);
+   internal::MetadataFormatter formatter;
+   std::ostringstream ss;
+   BinaryLogEntry entry;
+   while (reader.ReadEntry(entry))
+      WriteBinaryLogEntryAsText(ss, entry, formatter);
+   return ss.str();
+}
+
+} // anonymous namespace
+
+TEST_CASE("varint and zigzag encoding round trip", "[BinaryLog]")
+{
+   using namespace internal;
+   for (std::int64_t v : { std::int64_t(0), std::int64_t(1), std::int64_t(-1),
+         std::int64_t(63), std::int64_t(-64), std::int64_t(1) << 40,
+         -(std::int64_t(1) << 62) })
+   {
+      CHECK(ZigzagDecode(ZigzagEncode(v)) == v);
+   }
+   CHECK(ZigzagEncode(-1) == 1);
+   CHECK(ZigzagEncode(1) == 2);
+
+   std::string buf;
+   AppendVarint(buf, 127);
+   CHECK(buf.size() == 1);
+   AppendVarint(buf, 128);
+   CHECK(buf.size() == 3);
+   AppendVarint(buf, ~std::uint64_t(0));
+   CHECK(buf.size() == 13);
+}
+
+TEST_CASE("binary log decodes to the text log format", "[BinaryLog]")
+{
+   const std::string textFile = "BinaryLogTest.txt";
+   const std::string binFile = "BinaryLogTest.mmlog";
+   {
+      std::shared_ptr<LoggingCore> c = std::make_shared<LoggingCore>();
+      c->AddSink(std::make_shared<FileLogSink>(textFile),
+            SinkModeSynchronous);
+      c->AddSink(std::make_shared<BinaryFileLogSink>(binFile),
+            SinkModeSynchronous);
+      Logger core = c->NewLogger("Core");
+      Logger dev = c->NewLogger("dev:Camera");
+
+      core(LogLevelInfo, "Core started");
+      dev(LogLevelDebug, "Two\nlines");
+      dev(LogLevelTrace, "");
+      dev(LogLevelError, "Ends with newlines\r\n\n");
+      core(LogLevelWarning, std::string(300, 'x').c_str()); // Continuations
+   }
+
+   const std::string text = ReadFile(textFile);
+   CHECK(!text.empty());
+   CHECK(DecodeToText(binFile) == text);
+   CHECK(ReadFile(binFile).size() < text.size());
+
+   std::ifstream f(binFile.c_str(), std::ios_base::binary);
+   BinaryLogReader reader(f);
+   BinaryLogEntry entry;
+   REQUIRE(reader.ReadEntry(entry));
+   CHECK(entry.label == "Core");
+   CHECK(entry.level == LogLevelInfo);
+   CHECK(entry.text == "Core started");
+   REQUIRE(reader.ReadEntry(entry));
+   CHECK(entry.label == "dev:Camera");
+   CHECK(entry.text == "Two\nlines");
+
+   std::remove(textFile.c_str());
+   std::remove(binFile.c_str());
+}
+
+TEST_CASE("binary log appends a decodable segment", "[BinaryLog]")
+{
+   const std::string binFile = "BinaryLogAppendTest.mmlog";
+   for (bool append : { false, true })
+   {
+      std::shared_ptr<LoggingCore> c = std::make_shared<LoggingCore>();
+      c->AddSink(std::make_shared<BinaryFileLogSink>(binFile, append),
+            SinkModeSynchronous);
+      Logger lgr = c->NewLogger(append ? "second" : "first");
+      lgr(LogLevelInfo, "entry");
+   }
+
+   std::ifstream f(binFile.c_str(), std::ios_base::binary);
+   BinaryLogReader reader(f);
+   BinaryLogEntry entry;
+   REQUIRE(reader.ReadEntry(entry));
+   CHECK(entry.label == "first");
+   REQUIRE(reader.ReadEntry(entry));
+   CHECK(entry.label == "second");
+   CHECK_FALSE(reader.ReadEntry(entry));
+   f.close();
+
+   std::remove(binFile.c_str());
+}
+
+TEST_CASE("binary log rotates by size", "[BinaryLog]")
+{
+   const std::string binFile = "BinaryLogRotateTest.mmlog";
+   const unsigned entryCount = 200;
+   {
+      std::shared_ptr<LoggingCore> c = std::make_shared<LoggingCore>();
+      c->AddSink(std::make_shared<BinaryFileLogSink>(binFile, false, 1000),
+            SinkModeSynchronous);
+      Logger lgr = c->NewLogger("rotating");
+      for (unsigned i = 0; i < entryCount; ++i)
+         lgr(LogLevelInfo, ("entry " + std::to_string(i)).c_str());
+   }
+
+   std::vector<std::string> files;
+   for (unsigned i = 1; ; ++i)
+   {
+      const std::string rotated = BinaryFileLogSink::RotatedFilename(binFile, i);
+      if (!std::ifstream(rotated.c_str()))
+         break;
+      files.push_back(rotated);
+   }
+   files.push_back(binFile);
+   CHECK(files.size() > 2);
+
+   // Each file decodes on its own, and together they have all entries
+   unsigned count = 0;
+   for (const std::string& file : files)
+   {
+      CHECK(ReadFile(file).size() < 1000 + 100);
+      std::ifstream f(file.c_str(), std::ios_base::binary);
+      BinaryLogReader reader(f);
+      BinaryLogEntry entry;
+      while (reader.ReadEntry(entry))
+      {
+         CHECK(entry.label == "rotating");
+         CHECK(entry.text == "entry " + std::to_string(count));
+         ++count;
+      }
+      f.close();
+      std::remove(file.c_str());
+   }
+   CHECK(count == entryCount);
+}
+
+TEST_CASE("binary log reader rejects corrupt data", "[BinaryLog]")
+{
+   std::istringstream notLog("not a binary log file");
+   CHECK_THROWS_AS(BinaryLogReader(notLog), BinaryLogFormatError);
+
+   std::string data;
+   internal::AppendBinaryLogHeader(data, 0);
+   data.push_back(static_cast<char>(internal::BinaryLogTagEntry));
+   data.push_back(0); // Undefined label
+   std::istringstream corrupt(data);
+   BinaryLogReader reader(corrupt);
+   BinaryLogEntry entry;
+   CHECK_THROWS_AS(reader.ReadEntry(entry), BinaryLogFormatError);
+}
+
+} // namespace logging
+} // namespace mm
@@ -0,0 +1,711 @@
+#include <catch2/catch_all.hpp>
+
+#include "BufferMemory.h"
+#include "CircularBuffer.h"
+#include "CoreCallback.h"
+#include "CoreFeatures.h"
+#include "ImageBatch.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+class LockFreeFeatureSetting
+{
+   bool saved_;
+public:
+   explicit LockFreeFeatureSetting(bool enable) :
+      saved_(mm::features::isFeatureEnabled("LockFreeCircularBuffer"))
+   {
+      mm::features::enableFeature("LockFreeCircularBuffer", enable);
+   }
+
+   ~LockFreeFeatureSetting()
+   {
+      mm::features::enableFeature("LockFreeCircularBuffer", saved_);
+   }
+};
+
+class VariableSizeFeatureSetting
+{
+   bool saved_;
+public:
+   explicit VariableSizeFeatureSetting(bool enable) :
+      saved_(mm::features::isFeatureEnabled("VariableSizeCircularBuffer"))
+   {
+      mm::features::enableFeature("VariableSizeCircularBuffer", enable);
+   }
+
+   ~VariableSizeFeatureSetting()
+   {
+      mm::features::enableFeature("VariableSizeCircularBuffer", saved_);
+   }
+};
+
+Metadata CameraMetadata()
+{
+   Metadata md;
+   md.PutImageTag(MM::g_Keyword_Metadata_CameraLabel, "Camera");
+   return md;
+}
+
+// Stamp the frame number into the first bytes of the image
+void StampFrame(std::vector<unsigned char>& pixels, long frame)
+{
+   std::memcpy(pixels.data(), &frame, sizeof(frame));
+}
+
+long ReadStamp(const unsigned char* pixels)
+{
+   long frame;
+   std::memcpy(&frame, pixels, sizeof(frame));
+   return frame;
+}
+
+// Insert 'count' frames from a second thread while popping them on the
+// calling thread; returns the number of frames received in order.
+long RunProducerConsumer(CircularBuffer& cb, unsigned width, unsigned height,
+   unsigned byteDepth, long count)
+{
+   std::thread producer([&] {
+      const Metadata md = CameraMetadata();
+      std::vector<unsigned char> pixels(width * height * byteDepth);
+      for (long i = 0; i < count; ++i)
+      {
+         StampFrame(pixels, i);
+         while (!cb.InsertImage(pixels.data(), width, height, byteDepth, &md))
+            std::this_thread::yield();
+      }
+   });
+
+   long received = 0;
+   while (received < count)
+   {
+      const mm::ImgBuffer* img = cb.GetNextImageBuffer(0);
+      if (!img)
+      {
+         std::this_thread::yield();
+         continue;
+      }
+      if (ReadStamp(img->GetPixels()) != received)
+         break;
+      ++received;
+   }
+   producer.join();
+   return received;
+}
+
+} // anonymous namespace
+
+TEST_CASE("circular buffer pops images in insertion order", "[CircularBuffer]")
+{
+   const bool lockFree = GENERATE(false, true);
+   LockFreeFeatureSetting feature(lockFree);
+
+   CircularBuffer cb(1);
+   REQUIRE(cb.Initialize(1, 64, 64, 2));
+   CHECK(cb.IsLockFree() == lockFree);
+   const unsigned long capacity = cb.GetSize();
+   REQUIRE(capacity == (1 << 20) / (64 * 64 * 2));
+
+   const Metadata md = CameraMetadata();
+   std::vector<unsigned char> pixels(64 * 64 * 2);
+   for (long i = 0; i < 10; ++i)
+   {
+      StampFrame(pixels, i);
+      REQUIRE(cb.InsertImage(pixels.data(), 64, 64, 2, &md));
+   }
+   CHECK(cb.GetRemainingImageCount() == 10);
+   CHECK(cb.GetFreeSize() == capacity - 10);
+
+   const mm::ImgBuffer* top = cb.GetTopImageBuffer(0);
+   REQUIRE(top != nullptr);
+   CHECK(ReadStamp(top->GetPixels()) == 9);
+   CHECK(ReadStamp(cb.GetNthFromTopImageBuffer(3)->GetPixels()) == 6);
+   CHECK(cb.GetNthFromTopImageBuffer(10) == nullptr);
+
+   for (long i = 0; i < 10; ++i)
+   {
+      const mm::ImgBuffer* img = cb.GetNextImageBuffer(0);
+      REQUIRE(img != nullptr);
+      CHECK(ReadStamp(img->GetPixels()) == i);
+      CHECK(img->GetMetadata().GetSingleTag(MM::g_Keyword_Metadata_ImageNumber).GetValue() ==
+         std::to_string(i));
+   }
+   CHECK(cb.GetNextImageBuffer(0) == nullptr);
+   CHECK(cb.GetRemainingImageCount() == 0);
+}
+
+TEST_CASE("circular buffer reports overflow when full", "[CircularBuffer]")
+{
+   const bool lockFree = GENERATE(false, true);
+   LockFreeFeatureSetting feature(lockFree);
+
+   CircularBuffer cb(1);
+   REQUIRE(cb.Initialize(1, 512, 512, 2));
+   REQUIRE(cb.GetSize() == 2);
+
+   const Metadata md = CameraMetadata();
+   std::vector<unsigned char> pixels(512 * 512 * 2);
+   CHECK(cb.InsertImage(pixels.data(), 512, 512, 2, &md));
+   CHECK(cb.InsertImage(pixels.data(), 512, 512, 2, &md));
+   CHECK_FALSE(cb.Overflow());
+   CHECK_FALSE(cb.InsertImage(pixels.data(), 512, 512, 2, &md));
+   CHECK(cb.Overflow());
+
+   CHECK_THROWS_AS(cb.InsertImage(pixels.data(), 256, 256, 2, &md), CMMError);
+
+   cb.Clear();
+   CHECK_FALSE(cb.Overflow());
+   CHECK(cb.GetRemainingImageCount() == 0);
+   CHECK(cb.InsertImage(pixels.data(), 512, 512, 2, &md));
+}
+
+TEST_CASE("circular buffer frames written in place", "[CircularBuffer]")
+{
+   const bool lockFree = GENERATE(false, true);
+   LockFreeFeatureSetting feature(lockFree);
+
+   CircularBuffer cb(1);
+   REQUIRE(cb.Initialize(1, 512, 512, 2));
+   REQUIRE(cb.GetSize() == 2);
+
+   const Metadata md = CameraMetadata();
+   const int camera = 0;
+   CHECK(cb.GetPendingWriteSlot(&camera) == nullptr);
+   CHECK_FALSE(cb.CommitWriteSlot(&camera, &md));
+   CHECK_THROWS_AS(cb.AcquireWriteSlot(&camera, 256, 256, 2, 1), CMMError);
+
+   unsigned char* slot = cb.AcquireWriteSlot(&camera, 512, 512, 2, 1);
+   REQUIRE(slot != nullptr);
+   CHECK(cb.AcquireWriteSlot(&camera, 512, 512, 2, 1) == slot);
+   CHECK(cb.GetPendingWriteSlot(&camera) == slot);
+   CHECK(cb.GetRemainingImageCount() == 0);
+
+   long frame = 42;
+   std::memcpy(slot, &frame, sizeof(frame));
+   REQUIRE(cb.CommitWriteSlot(&camera, &md));
+   CHECK(cb.GetPendingWriteSlot(&camera) == nullptr);
+   CHECK(cb.GetRemainingImageCount() == 1);
+
+   // An abandoned slot is handed out again
+   unsigned char* slot2 = cb.AcquireWriteSlot(&camera, 512, 512, 2, 1);
+   REQUIRE(slot2 != nullptr);
+   CHECK(slot2 != slot);
+   cb.AbandonWriteSlot(&camera);
+   CHECK(cb.GetRemainingImageCount() == 1);
+   CHECK(cb.AcquireWriteSlot(&camera, 512, 512, 2, 1) == slot2);
+   REQUIRE(cb.CommitWriteSlot(&camera, &md));
+
+   CHECK(cb.AcquireWriteSlot(&camera, 512, 512, 2, 1) == nullptr);
+   CHECK(cb.Overflow());
+
+   const mm::ImgBuffer* img = cb.GetNextImageBuffer(0);
+   REQUIRE(img != nullptr);
+   CHECK(img->GetPixels() == slot);
+   CHECK(ReadStamp(img->GetPixels()) == 42);
+   CHECK(img->GetMetadata().GetSingleTag(MM::g_Keyword_Metadata_ImageNumber).GetValue() == "0");
+   CHECK(img->GetMetadata().GetSingleTag(MM::g_Keyword_Metadata_Width).GetValue() == "512");
+}
+
+TEST_CASE("circular buffer write slots of two producers", "[CircularBuffer]")
+{
+   CircularBuffer cb(1);
+   REQUIRE(cb.Initialize(1, 256, 256, 2));
+   const std::size_t frameBytes = 256 * 256 * 2;
+   const long count = 200;
+
+   // Each producer stamps both ends of the frame, so that frames written
+   // into the same slot by both would be detected
+   auto produce = [&](const int* owner, long base) {
+      const Metadata md = CameraMetadata();
+      for (long i = 0; i < count; ++i)
+      {
+         unsigned char* slot;
+         while ((slot = cb.AcquireWriteSlot(owner, 256, 256, 2, 1)) == nullptr)
+            std::this_thread::yield();
+         const long stamp = base + i;
+         std::memcpy(slot, &stamp, sizeof(stamp));
+         std::this_thread::yield();
+         std::memcpy(slot + frameBytes - sizeof(stamp), &stamp, sizeof(stamp));
+         REQUIRE(cb.CommitWriteSlot(owner, &md));
+      }
+   };
+   const int camera1 = 0;
+   const int camera2 = 0;
+   std::thread producer1(produce, &camera1, 0);
+   std::thread producer2(produce, &camera2, 1000000);
+
+   long next[2] = { 0, 1000000 };
+   long received = 0;
+   bool consistent = true;
+   while (received < 2 * count)
+   {
+      const mm::ImgBuffer* img = cb.GetNextImageBuffer(0);
+      if (!img)
+      {
+         std::this_thread::yield();
+         continue;
+      }
+      const long stamp = ReadStamp(img->GetPixels());
+      const long endStamp = ReadStamp(img->GetPixels() + frameBytes - sizeof(long));
+      long& expected = next[stamp >= 1000000 ? 1 : 0];
+      if (stamp != endStamp || stamp != expected)
+         consistent = false;
+      ++expected;
+      ++received;
+   }
+   producer1.join();
+   producer2.join();
+   CHECK(consistent);
+   CHECK(next[0] == count);
+   CHECK(next[1] == 1000000 + count);
+}
+
+TEST_CASE("circular buffer write slot blocks other producers until released", "[CircularBuffer]")
+{
+   CircularBuffer cb(1);
+   REQUIRE(cb.Initialize(1, 256, 256, 2));
+   const Metadata md = CameraMetadata();
+   std::vector<unsigned char> pixels(256 * 256 * 2);
+   const int camera1 = 0;
+   const int camera2 = 0;
+
+   unsigned char* slot = cb.AcquireWriteSlot(&camera1, 256, 256, 2, 1);
+   REQUIRE(slot != nullptr);
+   CHECK(cb.GetPendingWriteSlot(&camera2) == nullptr);
+   CHECK_FALSE(cb.CommitWriteSlot(&camera2, &md));
+
+   std::atomic<bool> inserted(false);
+   std::thread other([&] {
+      StampFrame(pixels, 7);
+      cb.InsertImage(pixels.data(), 256, 256, 2, &md);
+      inserted = true;
+   });
+   std::this_thread::sleep_for(std::chrono::milliseconds(20));
+   CHECK_FALSE(inserted);
+
+   long frame = 6;
+   std::memcpy(slot, &frame, sizeof(frame));
+   REQUIRE(cb.CommitWriteSlot(&camera1, &md));
+   other.join();
+   CHECK(ReadStamp(cb.GetNextImageBuffer(0)->GetPixels()) == 6);
+   CHECK(ReadStamp(cb.GetNextImageBuffer(0)->GetPixels()) == 7);
+
+   // Clearing does not wait for the slot to be released, and cancels it
+   REQUIRE(cb.AcquireWriteSlot(&camera1, 256, 256, 2, 1) != nullptr);
+   cb.Clear();
+   CHECK(cb.GetPendingWriteSlot(&camera1) == nullptr);
+   CHECK_FALSE(cb.CommitWriteSlot(&camera1, &md));
+   CHECK(cb.InsertImage(pixels.data(), 256, 256, 2, &md));
+   CHECK(cb.GetRemainingImageCount() == 1);
+}
+
+TEST_CASE("circular buffer in contiguous memory", "[CircularBuffer]")
+{
+   const bool lockFree = GENERATE(false, true);
+   LockFreeFeatureSetting feature(lockFree);
+
+   CircularBuffer cb(2);
+   cb.AllocateContiguousMemory(true);
+   const mm::BufferMemory* memory = cb.GetContiguousMemory();
+   REQUIRE(memory != nullptr);
+   CHECK(memory->GetSize() >= 2 << 20);
+
+   REQUIRE(cb.Initialize(2, 256, 256, 2));
+   REQUIRE(cb.GetSize() == 8);
+   const std::size_t channelSize = 256 * 256 * 2;
+
+   const Metadata md = CameraMetadata();
+   std::vector<unsigned char> pixels(2 * channelSize);
+   CHECK(cb.GetFirstFillMicroseconds() == -1);
+   for (long i = 0; i < 8; ++i)
+   {
+      StampFrame(pixels, i);
+      REQUIRE(cb.InsertMultiChannel(pixels.data(), 2, 256, 256, 2, &md));
+   }
+   CHECK(cb.GetFirstFillMicroseconds() >= 0);
+
+   for (long i = 0; i < 8; ++i)
+   {
+      const mm::ImgBuffer* img0 = cb.GetNthFromTopImageBuffer(7 - i, 0);
+      const mm::ImgBuffer* img1 = cb.GetNthFromTopImageBuffer(7 - i, 1);
+      REQUIRE(img0 != nullptr);
+      REQUIRE(img1 != nullptr);
+      CHECK(img0->GetPixels() == memory->GetData() + 2 * i * channelSize);
+      CHECK(img1->GetPixels() == img0->GetPixels() + channelSize);
+      CHECK(ReadStamp(img0->GetPixels()) == i);
+   }
+
+   // Reinitializing for a different image size reuses the same memory
+   REQUIRE(cb.Initialize(1, 512, 512, 1));
+   CHECK(cb.GetContiguousMemory() == memory);
+   CHECK(cb.GetFirstFillMicroseconds() == -1);
+   std::vector<unsigned char> large(512 * 512);
+   StampFrame(large, 7);
+   REQUIRE(cb.InsertImage(large.data(), 512, 512, 1, &md));
+   const mm::ImgBuffer* img = cb.GetNextImageBuffer(0);
+   REQUIRE(img != nullptr);
+   CHECK(img->GetPixels() == memory->GetData());
+   CHECK(ReadStamp(img->GetPixels()) == 7);
+}
+
+TEST_CASE("variable-size circular buffer holds mixed image sizes", "[CircularBuffer]")
+{
+   const bool lockFree = GENERATE(false, true);
+   LockFreeFeatureSetting lockFreeFeature(lockFree);
+   VariableSizeFeatureSetting feature(true);
+
+   CircularBuffer cb(1);
+   REQUIRE(cb.Initialize(1, 512, 512, 2));
+   REQUIRE(cb.GetSize() == 2);
+   const mm::BufferMemory* memory = cb.GetContiguousMemory();
+   REQUIRE(memory != nullptr);
+
+   const Metadata md = CameraMetadata();
+   std::vector<unsigned char> large(512 * 512 * 2);
+   std::vector<unsigned char> small(128 * 128 * 1);
+   StampFrame(large, 0);
+   REQUIRE(cb.InsertImage(large.data(), 512, 512, 2, &md));
+   StampFrame(small, 1);
+   REQUIRE(cb.InsertImage(small.data(), 128, 128, 1, &md));
+   StampFrame(small, 2);
+   REQUIRE(cb.InsertImage(small.data(), 128, 128, 1, &md));
+
+   // The camera changes its image size; buffered images are kept
+   REQUIRE(cb.Initialize(1, 128, 128, 1));
+   CHECK(cb.GetRemainingImageCount() == 3);
+   CHECK(cb.GetSize() == (1 << 20) / (128 * 128));
+
+   const mm::ImgBuffer* img = cb.GetNextImageBuffer(0);
+   REQUIRE(img != nullptr);
+   CHECK(img->Width() == 512);
+   CHECK(img->Depth() == 2);
+   CHECK(img->GetPixels() == memory->GetData());
+   CHECK(ReadStamp(img->GetPixels()) == 0);
+   CHECK(img->GetMetadata().GetSingleTag(MM::g_Keyword_Metadata_Width).GetValue() == "512");
+   CHECK(cb.IsVariableSize());
+
+   for (long i = 1; i < 3; ++i)
+   {
+      img = cb.GetNextImageBuffer(0);
+      REQUIRE(img != nullptr);
+      CHECK(img->Width() == 128);
+      CHECK(img->Height() == 128);
+      CHECK(img->Depth() == 1);
+      CHECK(img->GetPixels() == memory->GetData() + 512 * 512 * 2 + (i - 1) * 128 * 128);
+      CHECK(ReadStamp(img->GetPixels()) == i);
+      CHECK(img->GetMetadata().GetSingleTag(MM::g_Keyword_Metadata_Height).GetValue() == "128");
+      CHECK(img->GetMetadata().GetSingleTag(MM::g_Keyword_PixelType).GetValue() == MM::g_Keyword_PixelType_GRAY8);
+   }
+   CHECK(cb.GetNextImageBuffer(0) == nullptr);
+}
+
+TEST_CASE("variable-size circular buffer overflows when memory is full", "[CircularBuffer]")
+{
+   const bool lockFree = GENERATE(false, true);
+   LockFreeFeatureSetting lockFreeFeature(lockFree);
+   VariableSizeFeatureSetting feature(true);
+
+   CircularBuffer cb(1);
+   REQUIRE(cb.Initialize(1, 512, 512, 2));
+   const std::size_t arenaSize = cb.GetContiguousMemory()->GetSize();
+   const unsigned width = 512;
+   const unsigned height = static_cast<unsigned>(arenaSize / 3 / width);
+
+   const Metadata md = CameraMetadata();
+   std::vector<unsigned char> pixels(width * height);
+   for (long i = 0; i < 3; ++i)
+   {
+      StampFrame(pixels, i);
+      REQUIRE(cb.InsertImage(pixels.data(), width, height, 1, &md));
+   }
+   CHECK_FALSE(cb.InsertImage(pixels.data(), width, height, 1, &md));
+   CHECK(cb.Overflow());
+
+   // Popping the oldest image frees room at the start of the memory
+   const mm::ImgBuffer* img = cb.GetNextImageBuffer(0);
+   REQUIRE(img != nullptr);
+   CHECK(ReadStamp(img->GetPixels()) == 0);
+   StampFrame(pixels, 3);
+   REQUIRE(cb.InsertImage(pixels.data(), width, height, 1, &md));
+   CHECK(cb.GetTopImageBuffer(0)->GetPixels() == cb.GetContiguousMemory()->GetData());
+
+   for (long i = 1; i < 4; ++i)
+   {
+      img = cb.GetNextImageBuffer(0);
+      REQUIRE(img != nullptr);
+      CHECK(ReadStamp(img->GetPixels()) == i);
+   }
+
+   // An image larger than the whole buffer can never be stored
+   std::vector<unsigned char> huge(arenaSize + 1);
+   CHECK_THROWS_AS(cb.InsertImage(huge.data(), static_cast<unsigned>(arenaSize + 1), 1, 1, &md), CMMError);
+}
+
+TEST_CASE("circular buffer with concurrent producer and consumer", "[CircularBuffer]")
+{
+   const bool lockFree = GENERATE(false, true);
+   LockFreeFeatureSetting feature(lockFree);
+
+   CircularBuffer cb(1);
+   REQUIRE(cb.Initialize(1, 64, 64, 1));
+
+   const long count = 20000;
+   CHECK(RunProducerConsumer(cb, 64, 64, 1, count) == count);
+}
+
+TEST_CASE("circular buffer producer/consumer contention", "[.][benchmark][CircularBuffer]")
+{
+   const bool lockFree = GENERATE(false, true);
+   LockFreeFeatureSetting feature(lockFree);
+
+   const unsigned width = 256;
+   const unsigned height = 256;
+   const long count = 2000;
+   CircularBuffer cb(64);
+   REQUIRE(cb.Initialize(1, width, height, 2));
+
+   BENCHMARK(std::string(lockFree ? "lock-free" : "locked") +
+      ", 2000 frames of 256x256x16-bit")
+   {
+      cb.Clear();
+      return RunProducerConsumer(cb, width, height, 2, count);
+   };
+}
+
+TEST_CASE("circular buffer pops images in batches", "[CircularBuffer]")
+{
+   const bool lockFree = GENERATE(false, true);
+   LockFreeFeatureSetting feature(lockFree);
+
+   CircularBuffer cb(1);
+   REQUIRE(cb.Initialize(1, 64, 64, 2));
+   const unsigned long capacity = cb.GetSize();
+
+   ImageBatch batch;
+   CHECK(cb.PopNextImages(10, 0, batch) == 0);
+   CHECK(batch.size() == 0);
+
+   const Metadata md = CameraMetadata();
+   std::vector<unsigned char> pixels(64 * 64 * 2);
+   for (long i = 0; i < 10; ++i)
+   {
+      StampFrame(pixels, i);
+      REQUIRE(cb.InsertImage(pixels.data(), 64, 64, 2, &md));
+   }
+
+   REQUIRE(cb.PopNextImages(4, 0, batch) == 4);
+   REQUIRE(batch.size() == 4);
+   CHECK(cb.GetRemainingImageCount() == 6);
+   CHECK(cb.GetFreeSize() == capacity - 6);
+   for (long i = 0; i < 4; ++i)
+   {
+      CHECK(batch.getImageWidth(i) == 64);
+      CHECK(batch.getImageHeight(i) == 64);
+      CHECK(batch.getBytesPerPixel(i) == 2);
+      CHECK(batch.getNumberOfComponents(i) == 1);
+      const unsigned char* image = static_cast<const unsigned char*>(batch.getImagePixels(i));
+      CHECK(ReadStamp(image) == i);
+      CHECK(image == static_cast<const unsigned char*>(batch.getImagePixels(0)) + i * 64 * 64 * 2);
+      CHECK(batch.getImageMetadata(i).GetSingleTag(MM::g_Keyword_Metadata_ImageNumber).GetValue() ==
+         std::to_string(i));
+   }
+   CHECK_THROWS_AS(batch.getImageWidth(4), CMMError);
+   CHECK_THROWS_AS(batch.getImagePixels(4), CMMError);
+   CHECK_THROWS_AS(batch.getImagePixels(-1), CMMError);
+
+   // The remaining images are returned in order; the batch is refilled
+   REQUIRE(cb.PopNextImages(100, 0, batch) == 6);
+   REQUIRE(batch.size() == 6);
+   CHECK(ReadStamp(static_cast<const unsigned char*>(batch.getImagePixels(0))) == 4);
+   CHECK(ReadStamp(static_cast<const unsigned char*>(batch.getImagePixels(5))) == 9);
+   CHECK(cb.GetRemainingImageCount() == 0);
+   CHECK(cb.GetNextImageBuffer(0) == nullptr);
+
+   // Popped slots are free for the camera again
+   for (unsigned long i = 0; i < capacity; ++i)
+      REQUIRE(cb.InsertImage(pixels.data(), 64, 64, 2, &md));
+   CHECK(cb.PopNextImages(capacity + 1, 0, batch) == capacity);
+}
+
+TEST_CASE("image batch of empty images has no pixels", "[CircularBuffer]")
+{
+   ImageBatch batch;
+   CHECK_THROWS_AS(batch.getImagePixels(0), CMMError);
+
+   const Metadata md = CameraMetadata();
+   batch.append(0, 0, 2, 1, md);
+   batch.append(64, 0, 2, 1, md);
+   REQUIRE(batch.size() == 2);
+   CHECK(batch.getImagePixels(0) == batch.getImagePixels(1));
+   CHECK(batch.getImageWidth(1) == 64);
+   CHECK_THROWS_AS(batch.getImagePixels(2), CMMError);
+}
+
+TEST_CASE("pinned images are not overwritten", "[CircularBuffer]")
+{
+   const bool lockFree = GENERATE(false, true);
+   LockFreeFeatureSetting feature(lockFree);
+
+   CircularBuffer cb(1);
+   REQUIRE(cb.Initialize(1, 512, 512, 2));
+   REQUIRE(cb.GetSize() == 2);
+
+   const Metadata md = CameraMetadata();
+   std::vector<unsigned char> pixels(512 * 512 * 2);
+   CHECK(cb.PinNthFromTopImageBuffer(0, 0) == nullptr);
+   CHECK(cb.PinNextImageBuffer(0) == nullptr);
+
+   StampFrame(pixels, 0);
+   REQUIRE(cb.InsertImage(pixels.data(), 512, 512, 2, &md));
+   const mm::ImgBuffer* popped = cb.PinNextImageBuffer(0);
+   REQUIRE(popped != nullptr);
+   StampFrame(pixels, 1);
+   REQUIRE(cb.InsertImage(pixels.data(), 512, 512, 2, &md));
+   const mm::ImgBuffer* last = cb.PinNthFromTopImageBuffer(0, 0);
+   REQUIRE(last != nullptr);
+   CHECK(cb.GetPinnedImageCount() == 2);
+   CHECK(cb.GetPinnedImageBytes(last->GetPixels()) == 512 * 512 * 2);
+   CHECK(cb.GetPinnedImageBytes(pixels.data()) == 0);
+
+   // The popped image's slot is free but pinned
+   CHECK(cb.GetNextImageBuffer(0) == last);
+   StampFrame(pixels, 2);
+   CHECK_FALSE(cb.InsertImage(pixels.data(), 512, 512, 2, &md));
+   CHECK(ReadStamp(popped->GetPixels()) == 0);
+   CHECK(ReadStamp(last->GetPixels()) == 1);
+
+   // Resizing would free the pinned memory
+   CHECK_FALSE(cb.Initialize(1, 256, 256, 2));
+
+   CHECK(cb.ReleasePinnedImage(popped->GetPixels()));
+   CHECK_FALSE(cb.ReleasePinnedImage(popped->GetPixels()));
+   cb.Clear();
+   REQUIRE(cb.InsertImage(pixels.data(), 512, 512, 2, &md));
+   CHECK(ReadStamp(popped->GetPixels()) == 2);
+   CHECK_FALSE(cb.InsertImage(pixels.data(), 512, 512, 2, &md));
+   CHECK(ReadStamp(last->GetPixels()) == 1);
+
+   // Pinned twice, released twice
+   CHECK(cb.PinNthFromTopImageBuffer(0, 0) == popped);
+   CHECK(cb.PinNthFromTopImageBuffer(0, 0) == popped);
+   CHECK(cb.ReleasePinnedImage(last->GetPixels()));
+   CHECK(cb.ReleasePinnedImage(popped->GetPixels()));
+   CHECK(cb.GetPinnedImageCount() == 1);
+   CHECK(cb.ReleasePinnedImage(popped->GetPixels()));
+   CHECK(cb.GetPinnedImageCount() == 0);
+   CHECK(cb.Initialize(1, 256, 256, 2));
+}
+
+TEST_CASE("variable-size circular buffer does not overwrite pinned images", "[CircularBuffer]")
+{
+   const bool lockFree = GENERATE(false, true);
+   LockFreeFeatureSetting lockFreeFeature(lockFree);
+   VariableSizeFeatureSetting feature(true);
+
+   CircularBuffer cb(1);
+   REQUIRE(cb.Initialize(1, 512, 512, 2));
+   const std::size_t arenaSize = cb.GetContiguousMemory()->GetSize();
+   const unsigned width = 512;
+   const unsigned height = static_cast<unsigned>(arenaSize / 3 / width);
+
+   const Metadata md = CameraMetadata();
+   std::vector<unsigned char> pixels(width * height);
+   StampFrame(pixels, 0);
+   REQUIRE(cb.InsertImage(pixels.data(), width, height, 1, &md));
+   const mm::ImgBuffer* pinned = cb.PinNextImageBuffer(0);
+   REQUIRE(pinned != nullptr);
+   for (long i = 1; i < 3; ++i)
+   {
+      StampFrame(pixels, i);
+      REQUIRE(cb.InsertImage(pixels.data(), width, height, 1, &md));
+      REQUIRE(cb.GetNextImageBuffer(0) != nullptr);
+   }
+
+   // Wrapping around to the start of the memory would overwrite frame 0
+   StampFrame(pixels, 3);
+   CHECK_FALSE(cb.InsertImage(pixels.data(), width, height, 1, &md));
+   CHECK(ReadStamp(pinned->GetPixels()) == 0);
+
+   REQUIRE(cb.ReleasePinnedImage(pinned->GetPixels()));
+   CHECK(cb.InsertImage(pixels.data(), width, height, 1, &md));
+   CHECK(ReadStamp(pinned->GetPixels()) == 3);
+}
+
+TEST_CASE("image metadata tags are added without serialization", "[CircularBuffer]")
+{
+   const MM::ImageMetadataTag tags[] = {
+      { MM::g_Keyword_Metadata_CameraLabel, nullptr, "Camera" },
+      { MM::g_Keyword_Binning, nullptr, "1" },
+      { "Temperature", "Camera", "-20" },
+      { MM::g_Keyword_Binning, nullptr, "2" },
+   };
+   Metadata md;
+   AddImageMetadataTags(md, tags, 4);
+   CHECK(md.GetKeys().size() == 3);
+   CHECK(md.GetSingleTag(MM::g_Keyword_Binning).GetValue() == "2");
+   CHECK(md.GetSingleTag("Camera-Temperature").GetValue() == "-20");
+   CHECK(md.GetSingleTag("Camera-Temperature").GetDevice() == "Camera");
+
+   Metadata empty;
+   AddImageMetadataTags(empty, nullptr, 0);
+   CHECK(empty.GetKeys().empty());
+
+   CircularBuffer cb(1);
+   REQUIRE(cb.Initialize(1, 16, 16, 1));
+   std::vector<unsigned char> pixels(16 * 16);
+   REQUIRE(cb.InsertImage(pixels.data(), 16, 16, 1, &md));
+   const mm::ImgBuffer* img = cb.GetNextImageBuffer(0);
+   REQUIRE(img != nullptr);
+   CHECK(img->GetMetadata().GetSingleTag(MM::g_Keyword_Binning).GetValue() == "2");
+   CHECK(img->GetMetadata().GetSingleTag("Camera-Temperature").GetValue() == "-20");
+   CHECK(img->GetMetadata().GetSingleTag(MM::g_Keyword_Metadata_TimeInCore).GetValue().size() == 26);
+}
+
+TEST_CASE("circular buffer per-frame metadata cost", "[.][benchmark][CircularBuffer]")
+{
+   // A small frame, so that the cost of handling the metadata dominates.
+   // The tags are those attached by DemoCamera.
+   CircularBuffer cb(1);
+   REQUIRE(cb.Initialize(1, 16, 16, 1));
+   std::vector<unsigned char> pixels(16 * 16);
+
+   const std::string label = "Camera";
+   BENCHMARK("serialized metadata text")
+   {
+      Metadata devMd;
+      devMd.put(MM::g_Keyword_Metadata_CameraLabel, label);
+      devMd.put(MM::g_Keyword_Elapsed_Time_ms, "1234.5");
+      devMd.put(MM::g_Keyword_Metadata_ROI_X, "0");
+      devMd.put(MM::g_Keyword_Metadata_ROI_Y, "0");
+      devMd.put(MM::g_Keyword_Binning, "1");
+      const std::string serialized = devMd.Serialize();
+
+      Metadata md;
+      md.Restore(serialized.c_str());
+      bool ok = cb.InsertImage(pixels.data(), 16, 16, 1, &md);
+      return ok && cb.GetNextImageBuffer(0) != nullptr;
+   };
+
+   BENCHMARK("metadata tag array")
+   {
+      const MM::ImageMetadataTag tags[] = {
+         { MM::g_Keyword_Metadata_CameraLabel, nullptr, label.c_str() },
+         { MM::g_Keyword_Elapsed_Time_ms, nullptr, "1234.5" },
+         { MM::g_Keyword_Metadata_ROI_X, nullptr, "0" },
+         { MM::g_Keyword_Metadata_ROI_Y, nullptr, "0" },
+         { MM::g_Keyword_Binning, nullptr, "1" },
+      };
+
+      Metadata md;
+      AddImageMetadataTags(md, tags, 5);
+      bool ok = cb.InsertImage(pixels.data(), 16, 16, 1, &md);
+      return ok && cb.GetNextImageBuffer(0) != nullptr;
+   };
+}
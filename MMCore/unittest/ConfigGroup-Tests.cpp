@@ -0,0 +1,82 @@
+#include <catch2/catch_all.hpp>
+
+#include "ConfigGroup.h"
+
+#include <string>
+#include <vector>
+
+using Groups = std::vector<std::string>;
+
+TEST_CASE("config groups are indexed by property", "[ConfigGroup]")
+{
+   ConfigGroupCollection groups;
+   CHECK(groups.GetGroupsIncludingProperty("Wheel", "State").empty());
+
+   // Presets with a single property are not indexed
+   groups.Define("Channel", "DAPI", "Wheel", "State", "0");
+   CHECK(groups.GetGroupsIncludingProperty("Wheel", "State").empty());
+   groups.Define("Channel", "DAPI", "Laser", "Power", "10");
+   CHECK(groups.GetGroupsIncludingProperty("Wheel", "State") == Groups{ "Channel" });
+   CHECK(groups.GetGroupsIncludingProperty("Laser", "Power") == Groups{ "Channel" });
+
+   groups.Define("Channel", "FITC", "Wheel", "State", "1");
+   groups.Define("Channel", "FITC", "Camera", "Gain", "2");
+   groups.Define("Objective", "10x", "Wheel", "State", "2");
+   groups.Define("Objective", "10x", "Turret", "State", "0");
+   CHECK(groups.GetGroupsIncludingProperty("Wheel", "State") == (Groups{ "Channel", "Objective" }));
+
+   // Still included in FITC
+   groups.Delete("Channel", "DAPI", "Wheel", "State");
+   CHECK(groups.GetGroupsIncludingProperty("Wheel", "State") == (Groups{ "Channel", "Objective" }));
+   // DAPI is down to 1 property
+   CHECK(groups.GetGroupsIncludingProperty("Laser", "Power").empty());
+
+   groups.Delete("Channel", "FITC");
+   CHECK(groups.GetGroupsIncludingProperty("Wheel", "State") == Groups{ "Objective" });
+   CHECK(groups.GetGroupsIncludingProperty("Camera", "Gain").empty());
+
+   groups.RenameGroup("Objective", "Lens");
+   CHECK(groups.GetGroupsIncludingProperty("Turret", "State") == Groups{ "Lens" });
+   groups.RenameConfig("Lens", "10x", "20x");
+   CHECK(groups.GetGroupsIncludingProperty("Turret", "State") == Groups{ "Lens" });
+
+   groups.Delete("Lens");
+   CHECK(groups.GetGroupsIncludingProperty("Turret", "State").empty());
+   CHECK(groups.GetGroupsIncludingProperty("Wheel", "State").empty());
+
+   groups.Define("Channel", "DAPI", "Wheel", "State", "0");
+   CHECK(groups.GetGroupsIncludingProperty("Laser", "Power") == Groups{ "Channel" });
+   groups.Clear();
+   CHECK(groups.GetGroupsIncludingProperty("Laser", "Power").empty());
+}
+
+TEST_CASE("replaced presets are removed from the property index", "[ConfigGroup]")
+{
+   ConfigGroupCollection groups;
+   groups.Define("Channel", "A", "Wheel", "State", "0");
+   groups.Define("Channel", "A", "Laser", "Power", "10");
+   groups.Define("Channel", "B", "Wheel", "State", "1");
+   groups.Define("Channel", "B", "Camera", "Gain", "2");
+   groups.RenameConfig("Channel", "A", "B");
+   CHECK(groups.GetGroupsIncludingProperty("Camera", "Gain").empty());
+   CHECK(groups.GetGroupsIncludingProperty("Laser", "Power") == Groups{ "Channel" });
+
+   groups.Define("Other", "X", "Camera", "Gain", "1");
+   groups.Define("Other", "X", "Camera", "Binning", "1");
+   groups.RenameGroup("Channel", "Other");
+   CHECK(groups.GetGroupsIncludingProperty("Camera", "Binning").empty());
+   CHECK(groups.GetGroupsIncludingProperty("Wheel", "State") == Groups{ "Other" });
+}
+
+TEST_CASE("pixel size configs are indexed by property", "[ConfigGroup]")
+{
+   PixelSizeConfigGroup pixelSizes;
+   CHECK_FALSE(pixelSizes.IsPropertyIncluded("Turret", "State"));
+   pixelSizes.DefinePixelSize("10x", "Turret", "State", "0", 0.65);
+   CHECK(pixelSizes.IsPropertyIncluded("Turret", "State"));
+   pixelSizes.DefinePixelSize("20x", "Turret", "State", "1", 0.325);
+   pixelSizes.Delete("10x");
+   CHECK(pixelSizes.IsPropertyIncluded("Turret", "State"));
+   pixelSizes.Delete("20x", "Turret", "State");
+   CHECK_FALSE(pixelSizes.IsPropertyIncluded("Turret", "State"));
+}
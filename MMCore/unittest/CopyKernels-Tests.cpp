@@ -0,0 +1,70 @@
+#include <catch2/catch_all.hpp>
+
+#include "CopyKernels.h"
+#include "TaskSet_CopyMemory.h"
+#include "ThreadPool.h"
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+TEST_CASE("streaming copy handles any size and alignment", "[CopyKernels]")
+{
+   INFO("kernel: " << mm::StreamingCopyKernelName());
+   const size_t srcOffset = GENERATE(0, 1, 31);
+   const size_t dstOffset = GENERATE(0, 3, 64);
+   for (size_t bytes : { size_t(0), size_t(1), size_t(63), size_t(64),
+         size_t(255), size_t(257), size_t(4099), size_t(1 << 20) })
+   {
+      std::vector<unsigned char> src(bytes + srcOffset);
+      for (size_t i = 0; i < src.size(); ++i)
+         src[i] = static_cast<unsigned char>(i * 13 + 5);
+      // Guard bytes after the destination must be left alone
+      std::vector<unsigned char> dst(bytes + dstOffset + 64, 0xcc);
+      mm::StreamingCopy(dst.data() + dstOffset, src.data() + srcOffset, bytes);
+      CHECK(std::memcmp(dst.data() + dstOffset, src.data() + srcOffset, bytes) == 0);
+      CHECK(dst[dstOffset + bytes] == 0xcc);
+      CHECK(dst[dstOffset + bytes + 63] == 0xcc);
+      if (dstOffset > 0)
+         CHECK(dst[dstOffset - 1] == 0xcc);
+   }
+}
+
+TEST_CASE("copy tuning is usable", "[CopyKernels]")
+{
+   auto pool = std::make_shared<ThreadPool>(2);
+   TaskSet_CopyMemory copier(pool);
+   const TaskSet_CopyMemory::Tuning tuning = TaskSet_CopyMemory::GetTuning();
+   CHECK(tuning.bytesPerTask > 0);
+   CHECK(tuning.maxTaskCount >= 1);
+   CHECK(tuning.streamingThreshold > 0);
+
+   // Large enough to be split and streamed with any tuning
+   std::vector<unsigned char> src((64 << 20) + 7);
+   for (size_t i = 0; i < src.size(); ++i)
+      src[i] = static_cast<unsigned char>(i / 4096);
+   std::vector<unsigned char> dst(src.size());
+   copier.MemCopy(dst.data(), src.data(), src.size());
+   CHECK(dst == src);
+}
+
+TEST_CASE("streaming copy throughput", "[.][benchmark][CopyKernels]")
+{
+   const size_t bytes = GENERATE(size_t(1 << 20), size_t(32 << 20));
+   std::vector<unsigned char> src(bytes, 1);
+   std::vector<unsigned char> dst(bytes);
+
+   BENCHMARK("memcpy " + std::to_string(bytes >> 20) + " MB")
+   {
+      std::memcpy(dst.data(), src.data(), bytes);
+      return dst[0];
+   };
+
+   BENCHMARK(std::string(mm::StreamingCopyKernelName()) + " " +
+         std::to_string(bytes >> 20) + " MB")
+   {
+      mm::StreamingCopy(dst.data(), src.data(), bytes);
+      return dst[0];
+   };
+}
@@ -0,0 +1,41 @@
+#include <catch2/catch_all.hpp>
+
+#include "IdleSignal.h"
+
+#include <chrono>
+#include <thread>
+
+using namespace std::chrono;
+
+TEST_CASE("idle signal wait times out without notification", "[IdleSignal]")
+{
+   mm::IdleSignal signal;
+   const unsigned long long count = signal.GetCount();
+   const auto start = steady_clock::now();
+   CHECK_FALSE(signal.WaitForChange(count, start + milliseconds(20)));
+   CHECK(steady_clock::now() - start >= milliseconds(20));
+   CHECK(signal.GetCount() == count);
+}
+
+TEST_CASE("idle signal notification before wait is not missed", "[IdleSignal]")
+{
+   mm::IdleSignal signal;
+   const unsigned long long count = signal.GetCount();
+   signal.Notify();
+   CHECK(signal.GetCount() == count + 1);
+   CHECK(signal.WaitForChange(count, steady_clock::now()));
+}
+
+TEST_CASE("idle signal wakes up waiter", "[IdleSignal]")
+{
+   mm::IdleSignal signal;
+   const unsigned long long count = signal.GetCount();
+   std::thread notifier([&] {
+      std::this_thread::sleep_for(milliseconds(10));
+      signal.Notify();
+   });
+   const auto start = steady_clock::now();
+   CHECK(signal.WaitForChange(count, start + seconds(10)));
+   CHECK(steady_clock::now() - start < seconds(10));
+   notifier.join();
+}
@@ -0,0 +1,395 @@
+#include <catch2/catch_all.hpp>
+
+#include "DeviceBase.h"
+#include "ImageProcessingPipeline.h"
+#include "MMCore.h"
+#include "MockDeviceAdapter.h"
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using mm::ImageProcessingPipeline;
+
+namespace {
+
+std::unique_ptr<ImageProcessingPipeline::Frame>
+MakeFrame(ImageProcessingPipeline& pipeline, unsigned char value)
+{
+   std::unique_ptr<ImageProcessingPipeline::Frame> frame =
+      pipeline.AcquireFrame();
+   frame->pixels.assign(4, value);
+   frame->width = 2;
+   frame->height = 2;
+   frame->byteDepth = 1;
+   frame->nComponents = 1;
+   return frame;
+}
+
+struct Published
+{
+   std::mutex mutex;
+   std::vector<unsigned char> values;
+
+   ImageProcessingPipeline::PublishFunction Function()
+   {
+      return [this](const ImageProcessingPipeline::Frame& f) {
+         std::lock_guard<std::mutex> lock(mutex);
+         values.push_back(f.pixels[0]);
+         return true;
+      };
+   }
+};
+
+class PipelineTestCamera : public CCameraBase<PipelineTestCamera>
+{
+public:
+   PipelineTestCamera() : pixels_(16 * 16, 0) {}
+
+   int Initialize() override { return DEVICE_OK; }
+   int Shutdown() override { return DEVICE_OK; }
+   void GetName(char* name) const override
+   { CDeviceUtils::CopyLimitedString(name, "Camera"); }
+
+   int SnapImage() override { return DEVICE_OK; }
+   const unsigned char* GetImageBuffer() override { return pixels_.data(); }
+   unsigned GetImageWidth() const override { return 16; }
+   unsigned GetImageHeight() const override { return 16; }
+   unsigned GetImageBytesPerPixel() const override { return 1; }
+   unsigned GetBitDepth() const override { return 8; }
+   long GetImageBufferSize() const override { return 16 * 16; }
+   int GetBinning() const override { return 1; }
+   int SetBinning(int) override { return DEVICE_OK; }
+   void SetExposure(double) override {}
+   double GetExposure() const override { return 0.0; }
+   int SetROI(unsigned, unsigned, unsigned, unsigned) override { return DEVICE_OK; }
+   int GetROI(unsigned& x, unsigned& y, unsigned& xSize, unsigned& ySize) override
+   {
+      x = y = 0;
+      xSize = ySize = 16;
+      return DEVICE_OK;
+   }
+   int ClearROI() override { return DEVICE_OK; }
+   int IsExposureSequenceable(bool& isSequenceable) const override
+   {
+      isSequenceable = false;
+      return DEVICE_OK;
+   }
+
+   // Inserts a frame from the calling thread, as a sequence would
+   int InsertTestImage()
+   { return GetCoreCallback()->InsertImage(this, pixels_.data(), 16, 16, 1, 1, ""); }
+
+private:
+   std::vector<unsigned char> pixels_;
+};
+
+// Slow, so that frames are still in the pipeline when the camera is done;
+// marks the frames it has processed, and counts concurrent calls
+class PipelineTestProcessor : public CImageProcessorBase<PipelineTestProcessor>
+{
+public:
+   explicit PipelineTestProcessor(bool tileSafe = false) :
+      tileSafe_(tileSafe), active_(0), maxActive_(0) {}
+
+   int Initialize() override
+   {
+      if (tileSafe_)
+         CreateStringProperty(MM::g_Keyword_TileSafe, "Yes", true);
+      return DEVICE_OK;
+   }
+   int Shutdown() override { return DEVICE_OK; }
+   void GetName(char* name) const override
+   { CDeviceUtils::CopyLimitedString(name, "Processor"); }
+   bool Busy() override { return false; }
+
+   int Process(unsigned char* buffer, unsigned, unsigned, unsigned) override
+   {
+      const int active = ++active_;
+      int maxActive = maxActive_;
+      while (active > maxActive && !maxActive_.compare_exchange_weak(maxActive, active))
+         ;
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      buffer[0] = 255;
+      --active_;
+      return DEVICE_OK;
+   }
+
+   int GetMaxConcurrentCalls() const { return maxActive_; }
+
+private:
+   const bool tileSafe_;
+   std::atomic<int> active_;
+   std::atomic<int> maxActive_;
+};
+
+class PipelineTestAdapter : public MockDeviceAdapter
+{
+public:
+   void InitializeModuleData(RegisterDeviceFunction registerDevice) override
+   {
+      registerDevice("Camera", MM::CameraDevice, "Camera");
+      registerDevice("Processor", MM::ImageProcessorDevice, "Slow image processor");
+      registerDevice("TileSafeProcessor", MM::ImageProcessorDevice,
+            "Slow image processor allowing concurrent calls");
+   }
+   MM::Device* CreateDevice(const char* name) override
+   {
+      if (std::string(name) == "Camera")
+         return camera = new PipelineTestCamera;
+      if (std::string(name) == "Processor")
+         return processors[name] = new PipelineTestProcessor;
+      if (std::string(name) == "TileSafeProcessor")
+         return processors[name] = new PipelineTestProcessor(true);
+      return nullptr;
+   }
+   void DeleteDevice(MM::Device* device) override { delete device; }
+
+   PipelineTestCamera* camera = nullptr;
+   std::map<std::string, PipelineTestProcessor*> processors;
+};
+
+void WaitForImages(CMMCore& core, long count)
+{
+   const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+   while ((core.isSequenceRunning() || core.getRemainingImageCount() < count) &&
+         std::chrono::steady_clock::now() < deadline)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+} // anonymous namespace
+
+TEST_CASE("pipeline publishes processed frames in submission order",
+      "[ImageProcessingPipeline]")
+{
+   Published published;
+   ImageProcessingPipeline pipeline(4, 64, published.Function());
+   CHECK(pipeline.GetThreadCount() == 4);
+
+   for (unsigned char i = 0; i < 40; ++i)
+   {
+      pipeline.Submit(MakeFrame(pipeline, i),
+            [](ImageProcessingPipeline::Frame& f) {
+               // Earlier frames take longer, so they finish out of order
+               std::this_thread::sleep_for(
+                  std::chrono::microseconds(100 * (10 - f.pixels[0] % 10)));
+               for (unsigned char& p : f.pixels)
+                  p = static_cast<unsigned char>(p + 100);
+            });
+   }
+   pipeline.Drain();
+   CHECK(pipeline.GetQueueDepth() == 0);
+
+   REQUIRE(published.values.size() == 40);
+   for (unsigned char i = 0; i < 40; ++i)
+      CHECK(published.values[i] == i + 100);
+}
+
+TEST_CASE("pipeline submission blocks at capacity", "[ImageProcessingPipeline]")
+{
+   Published published;
+   ImageProcessingPipeline pipeline(1, 2, published.Function());
+
+   std::atomic<bool> release(false);
+   auto blockUntilReleased = [&](ImageProcessingPipeline::Frame&) {
+      while (!release)
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   };
+   pipeline.Submit(MakeFrame(pipeline, 1), blockUntilReleased);
+   pipeline.Submit(MakeFrame(pipeline, 2), blockUntilReleased);
+   CHECK(pipeline.GetQueueDepth() == 2);
+
+   std::atomic<bool> submitted(false);
+   std::thread submitter([&] {
+      pipeline.Submit(MakeFrame(pipeline, 3), blockUntilReleased);
+      submitted = true;
+   });
+   std::this_thread::sleep_for(std::chrono::milliseconds(20));
+   CHECK_FALSE(submitted);
+
+   release = true;
+   submitter.join();
+   pipeline.Drain();
+   CHECK(published.values == std::vector<unsigned char>{1, 2, 3});
+}
+
+TEST_CASE("pipeline discards frames not yet processed", "[ImageProcessingPipeline]")
+{
+   Published published;
+   ImageProcessingPipeline pipeline(1, 16, published.Function());
+
+   std::atomic<bool> started(false);
+   std::atomic<bool> release(false);
+   pipeline.Submit(MakeFrame(pipeline, 1),
+         [&](ImageProcessingPipeline::Frame&) {
+            started = true;
+            while (!release)
+               std::this_thread::sleep_for(std::chrono::milliseconds(1));
+         });
+   while (!started)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   for (unsigned char i = 2; i < 6; ++i)
+      pipeline.Submit(MakeFrame(pipeline, i),
+            [](ImageProcessingPipeline::Frame&) {});
+
+   pipeline.DiscardPending();
+   release = true;
+   pipeline.Drain();
+   // The frame being processed is still published
+   CHECK(published.values == std::vector<unsigned char>{1});
+   CHECK(pipeline.GetQueueDepth() == 0);
+}
+
+TEST_CASE("pipeline reports failure to publish once", "[ImageProcessingPipeline]")
+{
+   ImageProcessingPipeline pipeline(2, 16,
+         [](const ImageProcessingPipeline::Frame& f) { return f.pixels[0] != 3; });
+
+   CHECK_FALSE(pipeline.TakeOverflow());
+   for (unsigned char i = 0; i < 6; ++i)
+      pipeline.Submit(MakeFrame(pipeline, i),
+            [](ImageProcessingPipeline::Frame&) {});
+   pipeline.Drain();
+   CHECK(pipeline.TakeOverflow());
+   CHECK_FALSE(pipeline.TakeOverflow());
+}
+
+TEST_CASE("pipeline publishes remaining frames when destroyed",
+      "[ImageProcessingPipeline]")
+{
+   Published published;
+   {
+      ImageProcessingPipeline pipeline(2, 16, published.Function());
+      for (unsigned char i = 0; i < 8; ++i)
+         pipeline.Submit(MakeFrame(pipeline, i),
+               [](ImageProcessingPipeline::Frame&) {
+                  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+               });
+   }
+   CHECK(published.values.size() == 8);
+}
+
+TEST_CASE("image processor pipeline survives resizing the circular buffer",
+      "[ImageProcessingPipeline]")
+{
+   PipelineTestAdapter adapter;
+   CMMCore core;
+   core.loadMockDeviceAdapter("PipelineTest", &adapter);
+   core.loadDevice("Camera", "PipelineTest", "Camera");
+   core.loadDevice("Processor", "PipelineTest", "Processor");
+   core.initializeAllDevices();
+   core.setCameraDevice("Camera");
+   core.setImageProcessorDevice("Processor");
+   core.setProperty("Core", MM::g_Keyword_CoreImageProcessorThreads, "2");
+
+   core.startSequenceAcquisition(20, 0.0, false);
+   while (core.isSequenceRunning())
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+   // Frames still being processed are published to the old buffer before it
+   // is deleted, and are discarded with it
+   core.setCircularBufferMemoryFootprint(8);
+   CHECK(core.getProperty("Core", MM::g_Keyword_CoreImageProcessorQueueDepth) == "0");
+   CHECK(core.getRemainingImageCount() == 0);
+
+   // Later frames go to the new buffer
+   core.startSequenceAcquisition(5, 0.0, false);
+   WaitForImages(core, 5);
+   REQUIRE(core.getRemainingImageCount() == 5);
+   for (int i = 0; i < 5; ++i)
+   {
+      const unsigned char* pixels =
+         static_cast<const unsigned char*>(core.popNextImage());
+      CHECK(pixels[0] == 255);
+   }
+}
+
+TEST_CASE("image processor pipeline runs only tile-safe processors concurrently",
+      "[ImageProcessingPipeline]")
+{
+   PipelineTestAdapter adapter;
+   CMMCore core;
+   core.loadMockDeviceAdapter("PipelineTest", &adapter);
+   core.loadDevice("Camera", "PipelineTest", "Camera");
+   core.loadDevice("Processor", "PipelineTest", "Processor");
+   core.loadDevice("TileSafeProcessor", "PipelineTest", "TileSafeProcessor");
+   core.initializeAllDevices();
+   core.setCameraDevice("Camera");
+   core.setProperty("Core", MM::g_Keyword_CoreImageProcessorThreads, "4");
+
+   const std::string processor = GENERATE("Processor", "TileSafeProcessor");
+   CAPTURE(processor);
+   core.setImageProcessorDevice(processor.c_str());
+   core.startSequenceAcquisition(8, 0.0, false);
+   WaitForImages(core, 8);
+   REQUIRE(core.getRemainingImageCount() == 8);
+   for (int i = 0; i < 8; ++i)
+   {
+      const unsigned char* pixels =
+         static_cast<const unsigned char*>(core.popNextImage());
+      CHECK(pixels[0] == 255);
+   }
+
+   const int maxConcurrentCalls =
+      adapter.processors[processor]->GetMaxConcurrentCalls();
+   if (processor == "Processor")
+      CHECK(maxConcurrentCalls == 1);
+   else
+      CHECK(maxConcurrentCalls > 1);
+}
+
+TEST_CASE("image processor pipeline is flushed before devices are unloaded",
+      "[ImageProcessingPipeline]")
+{
+   PipelineTestAdapter adapter;
+   CMMCore core;
+   core.loadMockDeviceAdapter("PipelineTest", &adapter);
+   core.loadDevice("Camera", "PipelineTest", "Camera");
+   core.loadDevice("Processor", "PipelineTest", "Processor");
+   core.initializeAllDevices();
+   core.setCameraDevice("Camera");
+   core.setImageProcessorDevice("Processor");
+   core.setProperty("Core", MM::g_Keyword_CoreImageProcessorThreads, "1");
+   core.initializeCircularBuffer();
+   for (int i = 0; i < 6; ++i)
+      REQUIRE(adapter.camera->InsertTestImage() == DEVICE_OK);
+
+   // The processor is still needed for the queued frames
+   core.unloadDevice("Processor");
+   CHECK(core.getProperty("Core", MM::g_Keyword_CoreImageProcessorQueueDepth) == "0");
+   REQUIRE(core.getRemainingImageCount() == 6);
+   for (int i = 0; i < 6; ++i)
+   {
+      const unsigned char* pixels =
+         static_cast<const unsigned char*>(core.popNextImage());
+      CHECK(pixels[0] == 255);
+   }
+}
+
+TEST_CASE("clearing the circular buffer drops frames in the pipeline",
+      "[ImageProcessingPipeline]")
+{
+   PipelineTestAdapter adapter;
+   CMMCore core;
+   core.loadMockDeviceAdapter("PipelineTest", &adapter);
+   core.loadDevice("Camera", "PipelineTest", "Camera");
+   core.loadDevice("Processor", "PipelineTest", "Processor");
+   core.initializeAllDevices();
+   core.setCameraDevice("Camera");
+   core.setImageProcessorDevice("Processor");
+   core.setProperty("Core", MM::g_Keyword_CoreImageProcessorThreads, "1");
+   core.initializeCircularBuffer();
+   for (int i = 0; i < 6; ++i)
+      REQUIRE(adapter.camera->InsertTestImage() == DEVICE_OK);
+
+   // The frame being processed is not inserted after the buffer is cleared
+   core.clearCircularBuffer();
+   CHECK(core.getProperty("Core", MM::g_Keyword_CoreImageProcessorQueueDepth) == "0");
+   std::this_thread::sleep_for(std::chrono::milliseconds(100));
+   CHECK(core.getRemainingImageCount() == 0);
+}
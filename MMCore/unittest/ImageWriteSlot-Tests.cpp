@@ -0,0 +1,204 @@
+#include <catch2/catch_all.hpp>
+
+#include "DeviceBase.h"
+#include "ImageMetadata.h"
+#include "MMCore.h"
+#include "MockDeviceAdapter.h"
+
+#include <algorithm>
+#include <string>
+
+namespace {
+
+const unsigned width = 512;
+const unsigned height = 512;
+
+// Inserts frames through the write slot callbacks, from the test thread
+class WriteSlotTestCamera : public CCameraBase<WriteSlotTestCamera>
+{
+public:
+   int Initialize() override
+   {
+      AddTag("Gain", "WriteSlotCamera", "2");
+      return DEVICE_OK;
+   }
+   int Shutdown() override { return DEVICE_OK; }
+   void GetName(char* name) const override
+   { CDeviceUtils::CopyLimitedString(name, "Camera"); }
+
+   int SnapImage() override { return DEVICE_OK; }
+   const unsigned char* GetImageBuffer() override { return 0; }
+   unsigned GetImageWidth() const override { return width; }
+   unsigned GetImageHeight() const override { return height; }
+   unsigned GetImageBytesPerPixel() const override { return 1; }
+   unsigned GetBitDepth() const override { return 8; }
+   long GetImageBufferSize() const override { return width * height; }
+   int GetBinning() const override { return 1; }
+   int SetBinning(int) override { return DEVICE_OK; }
+   void SetExposure(double) override {}
+   double GetExposure() const override { return 0.0; }
+   int SetROI(unsigned, unsigned, unsigned, unsigned) override { return DEVICE_OK; }
+   int GetROI(unsigned& x, unsigned& y, unsigned& xSize, unsigned& ySize) override
+   {
+      x = y = 0;
+      xSize = width;
+      ySize = height;
+      return DEVICE_OK;
+   }
+   int ClearROI() override { return DEVICE_OK; }
+   int IsExposureSequenceable(bool& isSequenceable) const override
+   {
+      isSequenceable = false;
+      return DEVICE_OK;
+   }
+
+   int Acquire(unsigned char** pixels)
+   {
+      return GetCoreCallback()->AcquireImageWriteSlot(this, width, height, 1, 1, pixels);
+   }
+   int Commit(const char* serializedMetadata)
+   {
+      return GetCoreCallback()->CommitImageWriteSlot(this, serializedMetadata);
+   }
+   void Abandon() { GetCoreCallback()->AbandonImageWriteSlot(this); }
+
+   // Acquires, fills and commits a slot
+   int InsertFrame(unsigned char value)
+   {
+      unsigned char* pixels = 0;
+      int ret = Acquire(&pixels);
+      if (ret != DEVICE_OK)
+         return ret;
+      std::fill(pixels, pixels + width * height, value);
+      return Commit(0);
+   }
+};
+
+class WriteSlotTestAdapter : public MockDeviceAdapter
+{
+public:
+   void InitializeModuleData(RegisterDeviceFunction registerDevice) override
+   {
+      registerDevice("Camera", MM::CameraDevice, "Camera");
+   }
+   MM::Device* CreateDevice(const char* name) override
+   {
+      if (std::string(name) == "Camera")
+         return camera = new WriteSlotTestCamera;
+      return nullptr;
+   }
+   void DeleteDevice(MM::Device* device) override { delete device; }
+
+   WriteSlotTestCamera* camera = nullptr;
+};
+
+} // anonymous namespace
+
+TEST_CASE("write slot frames are inserted with metadata", "[ImageWriteSlot]")
+{
+   WriteSlotTestAdapter adapter;
+   CMMCore core;
+   core.loadMockDeviceAdapter("WriteSlotTest", &adapter);
+   core.loadDevice("WriteSlotCamera", "WriteSlotTest", "Camera");
+   core.initializeAllDevices();
+   core.setCameraDevice("WriteSlotCamera");
+   core.initializeCircularBuffer();
+   WriteSlotTestCamera& camera = *adapter.camera;
+
+   unsigned char* pixels = 0;
+   REQUIRE(camera.Acquire(&pixels) == DEVICE_OK);
+   REQUIRE(pixels != 0);
+   // Until committed, the slot is not an image, and acquiring returns it again
+   CHECK(core.getRemainingImageCount() == 0);
+   unsigned char* again = 0;
+   CHECK(camera.Acquire(&again) == DEVICE_OK);
+   CHECK(again == pixels);
+
+   std::fill(pixels, pixels + width * height, 7);
+   Metadata frameMd;
+   frameMd.PutImageTag("Frame", "first");
+   REQUIRE(camera.Commit(frameMd.Serialize().c_str()) == DEVICE_OK);
+   CHECK(core.getRemainingImageCount() == 1);
+   // The slot is gone once committed
+   CHECK(camera.Commit(0) == DEVICE_INVALID_INPUT_PARAM);
+
+   REQUIRE(camera.InsertFrame(8) == DEVICE_OK);
+   CHECK(core.getRemainingImageCount() == 2);
+
+   for (unsigned char value : { 7, 8 })
+   {
+      Metadata md;
+      const unsigned char* image =
+         static_cast<const unsigned char*>(core.popNextImageMD(md));
+      CHECK(image[0] == value);
+      CHECK(image[width * height - 1] == value);
+      CHECK(md.GetSingleTag(MM::g_Keyword_Metadata_CameraLabel).GetValue() ==
+            "WriteSlotCamera");
+      CHECK(md.GetSingleTag("WriteSlotCamera-Gain").GetValue() == "2");
+      CHECK(md.GetSingleTag(MM::g_Keyword_Metadata_ImageNumber).GetValue() ==
+            std::to_string(value - 7));
+      CHECK(md.GetSingleTag(MM::g_Keyword_Metadata_Width).GetValue() ==
+            std::to_string(width));
+      CHECK(md.HasTag("Frame") == (value == 7));
+   }
+   CHECK(core.getRemainingImageCount() == 0);
+}
+
+TEST_CASE("abandoned write slots are not inserted", "[ImageWriteSlot]")
+{
+   WriteSlotTestAdapter adapter;
+   CMMCore core;
+   core.loadMockDeviceAdapter("WriteSlotTest", &adapter);
+   core.loadDevice("WriteSlotCamera", "WriteSlotTest", "Camera");
+   core.initializeAllDevices();
+   core.setCameraDevice("WriteSlotCamera");
+   core.initializeCircularBuffer();
+   WriteSlotTestCamera& camera = *adapter.camera;
+
+   unsigned char* pixels = 0;
+   REQUIRE(camera.Acquire(&pixels) == DEVICE_OK);
+   std::fill(pixels, pixels + width * height, 1);
+   camera.Abandon();
+   CHECK(camera.Commit(0) == DEVICE_INVALID_INPUT_PARAM);
+   CHECK(core.getRemainingImageCount() == 0);
+
+   // The next frame reuses the space, and numbering is unaffected
+   REQUIRE(camera.InsertFrame(2) == DEVICE_OK);
+   REQUIRE(core.getRemainingImageCount() == 1);
+   Metadata md;
+   const unsigned char* image =
+      static_cast<const unsigned char*>(core.popNextImageMD(md));
+   CHECK(image[0] == 2);
+   CHECK(md.GetSingleTag(MM::g_Keyword_Metadata_ImageNumber).GetValue() == "0");
+}
+
+TEST_CASE("write slots overflow when the buffer is full", "[ImageWriteSlot]")
+{
+   WriteSlotTestAdapter adapter;
+   CMMCore core;
+   core.loadMockDeviceAdapter("WriteSlotTest", &adapter);
+   core.loadDevice("WriteSlotCamera", "WriteSlotTest", "Camera");
+   core.initializeAllDevices();
+   core.setCameraDevice("WriteSlotCamera");
+   core.setCircularBufferMemoryFootprint(2);
+   WriteSlotTestCamera& camera = *adapter.camera;
+
+   const long capacity = core.getBufferTotalCapacity();
+   REQUIRE(capacity > 0);
+   REQUIRE(capacity < 100);
+   for (long i = 0; i < capacity; ++i)
+      REQUIRE(camera.InsertFrame(static_cast<unsigned char>(i)) == DEVICE_OK);
+   CHECK(core.getRemainingImageCount() == capacity);
+   CHECK_FALSE(core.isBufferOverflowed());
+
+   unsigned char* pixels = 0;
+   CHECK(camera.Acquire(&pixels) == DEVICE_BUFFER_OVERFLOW);
+   CHECK(pixels == 0);
+   CHECK(core.isBufferOverflowed());
+   CHECK(core.getRemainingImageCount() == capacity);
+
+   // Space is available again once the buffer is cleared
+   core.clearCircularBuffer();
+   CHECK(camera.InsertFrame(1) == DEVICE_OK);
+   CHECK(core.getRemainingImageCount() == 1);
+}
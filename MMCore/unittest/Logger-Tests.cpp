@@ -1,8 +1,13 @@
 #include <catch2/catch_all.hpp>
 
+#include "Logging/GenericEntryRing.h"
 #include "Logging/Logging.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <functional>
+#include <map>
 #include <memory>
 #include <string>
 #include <thread>
@@ -119,5 +124,156 @@ TEST_CASE("async logger on thread", "[Logger]")
       threads[i]->join();
 }
 
+
+namespace {
+
+// Reassembles the entries it receives
+class CapturingLogSink : public LogSink
+{
+public:
+   std::vector<std::pair<std::string, std::string>> entries; // label, text
+
+   void Consume(const PacketArrayType& packets) override
+   {
+      for (auto it = packets.Begin(); it != packets.End(); ++it)
+      {
+         switch (it->GetPacketState())
+         {
+            case internal::PacketStateEntryFirstLine:
+               entries.emplace_back(it->GetMetadataConstRef().
+                     GetLoggerData().GetComponentLabel(), it->GetText());
+               break;
+            case internal::PacketStateNewLine:
+               entries.back().second += '\n';
+               entries.back().second += it->GetText();
+               break;
+            case internal::PacketStateLineContinuation:
+               entries.back().second += it->GetText();
+               break;
+         }
+      }
+   }
+};
+
+} // anonymous namespace
+
+
+TEST_CASE("entry ring reassembles long entries", "[Logger]")
+{
+   internal::GenericEntryRing<Metadata> ring(8);
+   std::vector<internal::GenericRawEntry<Metadata>> entries;
+   std::string text;
+   StampData stamp;
+   stamp.Stamp();
+   const Metadata md("ring", LogLevelInfo, stamp);
+
+   ring.Push(md, "", [] {});
+   ring.Push(md, "short", [] {});
+   const std::string longText(3 * internal::GenericEntryRing<Metadata>::SlotTextLen, 'x');
+   ring.Push(md, longText.c_str(), [] {});
+   CHECK_FALSE(ring.IsEmpty());
+   ring.Drain(entries, text);
+   CHECK(ring.IsEmpty());
+   REQUIRE(entries.size() == 3);
+   CHECK(std::string(text.c_str() + entries[0].textOffset).empty());
+   CHECK(std::string(text.c_str() + entries[1].textOffset) == "short");
+   CHECK(std::string(text.c_str() + entries[2].textOffset) == longText);
+   CHECK(std::string(entries[2].metadata.GetLoggerData().GetComponentLabel()) == "ring");
+
+   // Longer than the ring: the producer waits for the consumer
+   entries.clear();
+   text.clear();
+   const std::string veryLongText(10 * longText.size(), 'y');
+   ring.Push(md, veryLongText.c_str(), [&] { ring.Drain(entries, text); });
+   ring.Drain(entries, text);
+   REQUIRE(entries.size() == 1);
+   CHECK(std::string(text.c_str() + entries[0].textOffset) == veryLongText);
+}
+
+
+TEST_CASE("async logger delivers all entries in per-thread order", "[Logger]")
+{
+   auto sink = std::make_shared<CapturingLogSink>();
+   {
+      std::shared_ptr<LoggingCore> c = std::make_shared<LoggingCore>();
+      c->AddSink(sink, SinkModeAsynchronous);
+
+      std::vector<std::thread> threads;
+      for (unsigned t = 0; t < 4; ++t)
+      {
+         threads.emplace_back([c, t]
+         {
+            Logger lgr = c->NewLogger("thread" + std::to_string(t));
+            for (unsigned i = 0; i < 2000; ++i)
+               LOG_DEBUG(lgr) << i;
+            LOG_DEBUG(lgr) << std::string(5000, 'z') << "\nend";
+         });
+      }
+      for (auto& th : threads)
+         th.join();
+   } // Destroying the core flushes the sinks
+
+   REQUIRE(sink->entries.size() == 4 * 2001);
+   std::map<std::string, unsigned> next;
+   for (const auto& e : sink->entries)
+   {
+      unsigned& n = next[e.first];
+      if (n < 2000)
+         CHECK(e.second == std::to_string(n));
+      else
+         CHECK(e.second == std::string(5000, 'z') + "\nend");
+      ++n;
+   }
+   CHECK(next.size() == 4);
+}
+
+
+TEST_CASE("async logger throughput with file sink", "[.][benchmark][Logger]")
+{
+   const std::string filename = "LoggerBenchmark.log";
+   std::shared_ptr<LoggingCore> c = std::make_shared<LoggingCore>();
+   c->AddSink(std::make_shared<FileLogSink>(filename), SinkModeAsynchronous);
+   Logger lgr = c->NewLogger("bench");
+
+   BENCHMARK("log 1 short entry (caller-side latency)")
+   {
+      lgr(LogLevelDebug, "SerialPort: sent 12 bytes: <MOVE X=1234.5>");
+   };
+
+   BENCHMARK("log 1 entry via LOG_DEBUG")
+   {
+      LOG_DEBUG(lgr) << "Position " << 1234.5 << " um";
+   };
+
+   // Entries per second from several threads, including writing to file
+   for (unsigned threadCount : { 1u, 4u })
+   {
+      const unsigned perThread = 200000;
+      const auto start = std::chrono::steady_clock::now();
+      std::vector<std::thread> threads;
+      for (unsigned t = 0; t < threadCount; ++t)
+      {
+         threads.emplace_back([&]
+         {
+            for (unsigned i = 0; i < perThread; ++i)
+               lgr(LogLevelDebug, "SerialPort: received 8 bytes: <OK>");
+         });
+      }
+      for (auto& th : threads)
+         th.join();
+      const std::chrono::duration<double> logged =
+         std::chrono::steady_clock::now() - start;
+      // Restarting the receive loop waits for the file sink to catch up
+      c->RemoveSink(nullptr, SinkModeAsynchronous);
+      const std::chrono::duration<double> written =
+         std::chrono::steady_clock::now() - start;
+      WARN(threadCount << " threads: " <<
+            threadCount * perThread / logged.count() << " entries/s logged, " <<
+            threadCount * perThread / written.count() << " entries/s written");
+   }
+   c.reset();
+   std::remove(filename.c_str());
+}
+
 } // namespace logging
 } // namespace mm
\ No newline at end of file
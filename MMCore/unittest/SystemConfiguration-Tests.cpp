@@ -0,0 +1,172 @@
+#include <catch2/catch_all.hpp>
+
+#include "DeviceBase.h"
+#include "MMCore.h"
+#include "MockDeviceAdapter.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+namespace {
+
+void WriteFile(const std::string& filename, const std::string& contents)
+{
+   std::ofstream f(filename.c_str(), std::ios_base::binary);
+   f << contents;
+}
+
+class PreInitDevice : public CGenericBase<PreInitDevice>
+{
+public:
+   PreInitDevice()
+   {
+      CreateStringProperty("Mode", "A", false, nullptr, true);
+      AddAllowedValue("Mode", "A");
+      AddAllowedValue("Mode", "B");
+   }
+
+   int Initialize() override { return DEVICE_OK; }
+   int Shutdown() override { return DEVICE_OK; }
+   void GetName(char* name) const override
+   { CDeviceUtils::CopyLimitedString(name, "PreInitDevice"); }
+   bool Busy() override { return false; }
+};
+
+class PreInitAdapter : public MockDeviceAdapter
+{
+public:
+   void InitializeModuleData(RegisterDeviceFunction registerDevice) override
+   { registerDevice("PreInitDevice", MM::GenericDevice, "Device with a pre-init property"); }
+   MM::Device* CreateDevice(const char* name) override
+   { return std::string(name) == "PreInitDevice" ? new PreInitDevice : nullptr; }
+   void DeleteDevice(MM::Device* device) override { delete device; }
+};
+
+} // anonymous namespace
+
+TEST_CASE("load system configuration with Core commands", "[SystemConfiguration]")
+{
+   const std::string filename = "SystemConfigurationTest.cfg";
+   WriteFile(filename,
+         "# Generated by test\r\n"
+         "Property,Core,Initialize,0\r\n"
+         "\r\n"
+         "Property,Core,Initialize,1\r\n"
+         "ConfigGroup,Timing,Fast,Core,TimeoutMs,1000\r\n"
+         "ConfigGroup,Timing,Slow,Core,TimeoutMs,9000\r\n"
+         "ConfigGroup,System,Startup,Core,TimeoutMs,1000\n"
+         "Property,Core,SystemStateSlowPropertyMs,20");
+
+   for (bool parallel : { false, true })
+   {
+      CMMCore::enableFeature("ParallelConfigLoading", parallel);
+      CMMCore core;
+      core.loadSystemConfiguration(filename.c_str());
+      CHECK(core.getAvailableConfigs("Timing").size() == 2);
+      CHECK(core.getProperty("Core", "TimeoutMs") == "1000");
+      CHECK(core.getCurrentConfig("Timing") == "Fast");
+      CHECK(core.getProperty("Core", "SystemStateSlowPropertyMs") == "20");
+   }
+   CMMCore::enableFeature("ParallelConfigLoading", false);
+
+   std::remove(filename.c_str());
+}
+
+TEST_CASE("load system configuration reports the failing line", "[SystemConfiguration]")
+{
+   const std::string filename = "SystemConfigurationErrorTest.cfg";
+   WriteFile(filename,
+         "Property,Core,Initialize,0\n"
+         "# comment\n"
+         "Property,NoSuchDevice,Prop,1\n"
+         "Property,Core,Initialize,1\n");
+
+   for (bool parallel : { false, true })
+   {
+      CMMCore::enableFeature("ParallelConfigLoading", parallel);
+      CMMCore core;
+      try
+      {
+         core.loadSystemConfiguration(filename.c_str());
+         FAIL("No error thrown");
+      }
+      catch (const CMMError& e)
+      {
+         CHECK(e.getCode() == MMERR_InvalidConfigurationFile);
+         CHECK(e.getMsg().find("Line 3: Property,NoSuchDevice,Prop,1") == 0);
+      }
+   }
+   CMMCore::enableFeature("ParallelConfigLoading", false);
+
+   std::remove(filename.c_str());
+}
+
+TEST_CASE("load system configuration with devices of several adapters", "[SystemConfiguration]")
+{
+   const std::string filename = "SystemConfigurationDevicesTest.cfg";
+   WriteFile(filename,
+         "Property,Core,Initialize,0\n"
+         "Device,A1,AdapterA,PreInitDevice\n"
+         "Device,A2,AdapterA,PreInitDevice\n"
+         "Device,B1,AdapterB,PreInitDevice\n"
+         "Property,A1,Mode,B\n"
+         "Property,A2,Mode,A\n"
+         "Property,B1,Mode,B\n"
+         "Property,Core,Initialize,1\n");
+
+   for (bool parallel : { false, true })
+   {
+      CMMCore::enableFeature("ParallelConfigLoading", parallel);
+      PreInitAdapter adapterA, adapterB;
+      CMMCore core;
+      core.loadMockDeviceAdapter("AdapterA", &adapterA);
+      core.loadMockDeviceAdapter("AdapterB", &adapterB);
+      core.loadSystemConfiguration(filename.c_str());
+      CHECK(core.getProperty("A1", "Mode") == "B");
+      CHECK(core.getProperty("A2", "Mode") == "A");
+      CHECK(core.getProperty("B1", "Mode") == "B");
+      for (const char* label : { "A1", "A2", "B1" })
+         CHECK(core.getDeviceInitializationState(label) == InitializedSuccessfully);
+      CHECK(core.getDeviceLibrary("B1") == "AdapterB");
+   }
+   CMMCore::enableFeature("ParallelConfigLoading", false);
+
+   std::remove(filename.c_str());
+}
+
+TEST_CASE("load system configuration reports the failing pre-init property", "[SystemConfiguration]")
+{
+   const std::string filename = "SystemConfigurationDevicesErrorTest.cfg";
+   WriteFile(filename,
+         "Property,Core,Initialize,0\n"
+         "Device,A1,AdapterA,PreInitDevice\n"
+         "Device,A2,AdapterA,PreInitDevice\n"
+         "Device,B1,AdapterB,PreInitDevice\n"
+         "Property,A1,Mode,B\n"
+         "Property,A2,Mode,A\n"
+         "Property,B1,Mode,C\n"
+         "Property,Core,Initialize,1\n");
+
+   for (bool parallel : { false, true })
+   {
+      CMMCore::enableFeature("ParallelConfigLoading", parallel);
+      PreInitAdapter adapterA, adapterB;
+      CMMCore core;
+      core.loadMockDeviceAdapter("AdapterA", &adapterA);
+      core.loadMockDeviceAdapter("AdapterB", &adapterB);
+      try
+      {
+         core.loadSystemConfiguration(filename.c_str());
+         FAIL("No error thrown");
+      }
+      catch (const CMMError& e)
+      {
+         CHECK(e.getCode() == MMERR_InvalidConfigurationFile);
+         CHECK(e.getMsg().find("Line 7: Property,B1,Mode,C") == 0);
+      }
+   }
+   CMMCore::enableFeature("ParallelConfigLoading", false);
+
+   std::remove(filename.c_str());
+}
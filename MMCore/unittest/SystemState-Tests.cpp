@@ -0,0 +1,48 @@
+#include <catch2/catch_all.hpp>
+
+#include "MMCore.h"
+
+TEST_CASE("system state slow property Core property", "[SystemState]")
+{
+   CMMCore core;
+   CHECK(core.getProperty("Core", "SystemStateSlowPropertyMs") == "0");
+
+   core.setProperty("Core", "SystemStateSlowPropertyMs", "50");
+   CHECK(core.getProperty("Core", "SystemStateSlowPropertyMs") == "50");
+   CHECK_THROWS_AS(core.setProperty("Core", "SystemStateSlowPropertyMs", "-1"), CMMError);
+   CHECK(core.getProperty("Core", "SystemStateSlowPropertyMs") == "50");
+
+   core.updateSystemStateCache();
+   Configuration cached = core.getSystemStateCache();
+   CHECK(cached.isPropertyIncluded("Core", "SystemStateSlowPropertyMs"));
+   CHECK(cached.getSetting("Core", "SystemStateSlowPropertyMs").getPropertyValue() == "50");
+}
+
+TEST_CASE("system state with and without parallel reading", "[SystemState]")
+{
+   CMMCore core;
+   const Configuration serial = core.getSystemState();
+
+   CMMCore::enableFeature("ParallelSystemState", true);
+   const Configuration parallel = core.getSystemState();
+   core.updateSystemStateCache();
+   CMMCore::enableFeature("ParallelSystemState", false);
+
+   CHECK(parallel.getVerbose() == serial.getVerbose());
+   CHECK(core.getSystemStateCache().getVerbose() == serial.getVerbose());
+}
+
+TEST_CASE("setConfig with per-adapter application", "[SystemState]")
+{
+   CMMCore core;
+   core.defineConfig("Timing", "Fast", "Core", "TimeoutMs", "1000");
+   core.defineConfig("Timing", "Fast", "Core", "SystemStateSlowPropertyMs", "20");
+
+   CMMCore::enableFeature("ParallelSetConfig", true);
+   core.setConfig("Timing", "Fast");
+   CMMCore::enableFeature("ParallelSetConfig", false);
+
+   CHECK(core.getProperty("Core", "TimeoutMs") == "1000");
+   CHECK(core.getProperty("Core", "SystemStateSlowPropertyMs") == "20");
+   CHECK(core.getCurrentConfig("Timing") == "Fast");
+}
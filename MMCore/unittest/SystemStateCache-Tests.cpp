@@ -0,0 +1,105 @@
+#include <catch2/catch_all.hpp>
+
+#include "MMCore.h"
+#include "SystemStateCache.h"
+
+using mm::SystemStateCache;
+
+TEST_CASE("state cache versions only change with values", "[SystemStateCache]")
+{
+   SystemStateCache cache;
+   CHECK(cache.GetVersion() == 0);
+
+   cache.Set(PropertySetting("Camera", "Exposure", "10"));
+   cache.Set(PropertySetting("Stage", "Position", "0"));
+   CHECK(cache.GetVersion() == 2);
+   cache.Set(PropertySetting("Camera", "Exposure", "10"));
+   CHECK(cache.GetVersion() == 2);
+   cache.Set(PropertySetting("Camera", "Exposure", "10", true));
+   CHECK(cache.GetVersion() == 3);
+
+   PropertySetting s;
+   REQUIRE(cache.Find("Camera", "Exposure", s));
+   CHECK(s.getPropertyValue() == "10");
+   CHECK(s.getReadOnly());
+   CHECK_FALSE(cache.Find("Camera", "Gain", s));
+}
+
+TEST_CASE("state cache snapshots are shared until changed", "[SystemStateCache]")
+{
+   SystemStateCache cache;
+   cache.Set(PropertySetting("Camera", "Exposure", "10"));
+
+   auto first = cache.GetSnapshot();
+   CHECK(cache.GetSnapshot() == first);
+
+   cache.Set(PropertySetting("Camera", "Exposure", "20"));
+   auto second = cache.GetSnapshot();
+   CHECK(second != first);
+   CHECK(first->getSetting("Camera", "Exposure").getPropertyValue() == "10");
+   CHECK(second->getSetting("Camera", "Exposure").getPropertyValue() == "20");
+}
+
+TEST_CASE("state cache changes since a version", "[SystemStateCache]")
+{
+   SystemStateCache cache;
+   cache.Set(PropertySetting("Camera", "Exposure", "10"));
+   cache.Set(PropertySetting("Stage", "Position", "0"));
+   const long long v = cache.GetVersion();
+
+   CHECK(cache.GetChangesSince(v).size() == 0);
+   CHECK(cache.GetChangesSince(0).size() == 2);
+
+   cache.Set(PropertySetting("Camera", "Exposure", "20"));
+   cache.Set(PropertySetting("Camera", "Exposure", "30"));
+   cache.Set(PropertySetting("Shutter", "State", "1"));
+   Configuration changes = cache.GetChangesSince(v);
+   CHECK(changes.size() == 2);
+   CHECK(changes.getSetting("Camera", "Exposure").getPropertyValue() == "30");
+   CHECK(changes.isPropertyIncluded("Shutter", "State"));
+   CHECK_FALSE(changes.isPropertyIncluded("Stage", "Position"));
+}
+
+TEST_CASE("state cache replacement", "[SystemStateCache]")
+{
+   SystemStateCache cache;
+   cache.Set(PropertySetting("Camera", "Exposure", "10"));
+   cache.Set(PropertySetting("Stage", "Position", "0"));
+   const long long v = cache.GetVersion();
+
+   Configuration same;
+   same.addSetting(PropertySetting("Camera", "Exposure", "10"));
+   same.addSetting(PropertySetting("Stage", "Position", "5"));
+   cache.Replace(same);
+   CHECK(cache.GetRemovalVersion() == 0);
+   Configuration changes = cache.GetChangesSince(v);
+   REQUIRE(changes.size() == 1);
+   CHECK(changes.getSetting(0).getPropertyValue() == "5");
+
+   Configuration fewer;
+   fewer.addSetting(PropertySetting("Camera", "Exposure", "10"));
+   cache.Replace(fewer);
+   CHECK(cache.GetRemovalVersion() == cache.GetVersion());
+   CHECK(cache.GetChangesSince(v).size() == 1);
+   CHECK(cache.GetChangesSince(cache.GetVersion()).size() == 0);
+   CHECK(cache.GetSnapshot()->size() == 1);
+
+   cache.Set(PropertySetting("Stage", "Position", "7"));
+   CHECK(cache.GetChangesSince(cache.GetRemovalVersion()).size() == 1);
+}
+
+TEST_CASE("Core state cache versions", "[SystemStateCache]")
+{
+   CMMCore core;
+   core.updateSystemStateCache();
+   const long long v = core.getSystemStateCacheVersion();
+   CHECK(v > 0);
+   CHECK(core.getSystemStateCacheChanges(v).size() == 0);
+   CHECK(core.getSystemStateCacheChanges(0).size() == core.getSystemStateCache().size());
+
+   core.setProperty("Core", "TimeoutMs", "1234");
+   Configuration changes = core.getSystemStateCacheChanges(v);
+   REQUIRE(changes.size() == 1);
+   CHECK(changes.getSetting("Core", "TimeoutMs").getPropertyValue() == "1234");
+   CHECK(core.getPropertyFromCache("Core", "TimeoutMs") == "1234");
+}
@@ -0,0 +1,123 @@
+#include <catch2/catch_all.hpp>
+
+#include "MMCore.h"
+#include "Semaphore.h"
+#include "Task.h"
+#include "TaskSet_CopyMemory.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+class CountingTask : public Task
+{
+   std::atomic<long>& counter_;
+public:
+   CountingTask(std::shared_ptr<Semaphore> semaphore, std::atomic<long>& counter) :
+      Task(semaphore, 0, 1),
+      counter_(counter)
+   {}
+
+   void Execute() override { ++counter_; }
+};
+
+} // anonymous namespace
+
+TEST_CASE("thread pool runs all tasks", "[ThreadPool]")
+{
+   const size_t threadCount = GENERATE(1, 2, 7);
+   ThreadPool pool(threadCount);
+   CHECK(pool.GetSize() == threadCount);
+
+   auto semaphore = std::make_shared<Semaphore>();
+   std::atomic<long> counter(0);
+   std::vector<std::unique_ptr<CountingTask>> tasks;
+   std::vector<Task*> taskPtrs;
+   for (int i = 0; i < 100; ++i)
+   {
+      tasks.emplace_back(new CountingTask(semaphore, counter));
+      taskPtrs.push_back(tasks.back().get());
+   }
+
+   for (int round = 0; round < 50; ++round)
+   {
+      pool.Execute(taskPtrs);
+      pool.Execute(taskPtrs[0]);
+      semaphore->Wait(taskPtrs.size() + 1);
+   }
+   CHECK(counter == 50 * 101);
+}
+
+TEST_CASE("thread pool accepts tasks from several threads", "[ThreadPool]")
+{
+   ThreadPool pool(3);
+   std::atomic<long> counter(0);
+
+   std::vector<std::thread> submitters;
+   for (int t = 0; t < 4; ++t)
+   {
+      submitters.emplace_back([&] {
+         auto semaphore = std::make_shared<Semaphore>();
+         CountingTask task(semaphore, counter);
+         for (int i = 0; i < 1000; ++i)
+         {
+            pool.Execute(&task);
+            semaphore->Wait();
+         }
+      });
+   }
+   for (auto& submitter : submitters)
+      submitter.join();
+   CHECK(counter == 4000);
+}
+
+TEST_CASE("parallel copy on pinned thread pool", "[ThreadPool]")
+{
+   auto pool = std::make_shared<ThreadPool>(4, true);
+   REQUIRE(pool->GetSize() == 4);
+   TaskSet_CopyMemory copier(pool);
+
+   for (size_t bytes : { size_t(1), size_t(999999), size_t(4000001), size_t(16 << 20) })
+   {
+      std::vector<unsigned char> src(bytes);
+      for (size_t i = 0; i < bytes; ++i)
+         src[i] = static_cast<unsigned char>(i * 7);
+      std::vector<unsigned char> dst(bytes);
+      copier.MemCopy(dst.data(), src.data(), bytes);
+      CHECK(dst == src);
+   }
+}
+
+TEST_CASE("thread pool Core properties", "[ThreadPool]")
+{
+   CMMCore core;
+   CHECK(core.getProperty("Core", "ThreadPoolSize") == "0");
+   CHECK(core.getProperty("Core", "ThreadPoolPinning") == "0");
+
+   core.setProperty("Core", "ThreadPoolSize", "2");
+   CHECK(core.getProperty("Core", "ThreadPoolSize") == "2");
+   core.setProperty("Core", "ThreadPoolPinning", "1");
+   CHECK(core.getProperty("Core", "ThreadPoolPinning") == "1");
+
+   CHECK_THROWS_AS(core.setProperty("Core", "ThreadPoolSize", "-1"), CMMError);
+   CHECK(core.getProperty("Core", "ThreadPoolSize") == "2");
+   CHECK_THROWS_AS(core.setProperty("Core", "ThreadPoolPinning", "2"), CMMError);
+}
+
+TEST_CASE("thread pool copy throughput", "[.][benchmark][ThreadPool]")
+{
+   auto pool = std::make_shared<ThreadPool>();
+   TaskSet_CopyMemory copier(pool);
+   std::vector<unsigned char> src(8 << 20, 1);
+   std::vector<unsigned char> dst(8 << 20);
+
+   BENCHMARK("8 MB frame copy")
+   {
+      copier.MemCopy(dst.data(), src.data(), src.size());
+      return dst[0];
+   };
+}
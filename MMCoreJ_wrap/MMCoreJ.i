@@ -559,6 +559,176 @@
    }
 }
 
+// Java typemap
+// map the pixels of an image in an ImageBatch to a Java array, in the same
+// way as the void* typemap above, but using the geometry of that image
+// (arg2 is the image index) instead of the current camera settings
+
+%typemap(out) void* getImagePixels
+{
+   long lSize = (arg1)->getImageWidth(arg2) * (arg1)->getImageHeight(arg2);
+   unsigned bytesPerPixel = (arg1)->getBytesPerPixel(arg2);
+   unsigned numComponents = (arg1)->getNumberOfComponents(arg2);
+
+   jarray data = 0;
+   if (bytesPerPixel == 1)
+   {
+      data = JCALL1(NewByteArray, jenv, lSize);
+      if (data)
+         JCALL4(SetByteArrayRegion, jenv, (jbyteArray)data, 0, lSize, (jbyte*)result);
+   }
+   else if (bytesPerPixel == 2)
+   {
+      data = JCALL1(NewShortArray, jenv, lSize);
+      if (data)
+         JCALL4(SetShortArrayRegion, jenv, (jshortArray)data, 0, lSize, (jshort*)result);
+   }
+   else if (bytesPerPixel == 4 && numComponents == 1)
+   {
+      data = JCALL1(NewFloatArray, jenv, lSize);
+      if (data)
+         JCALL4(SetFloatArrayRegion, jenv, (jfloatArray)data, 0, lSize, (jfloat*)result);
+   }
+   else if (bytesPerPixel == 4)
+   {
+      data = JCALL1(NewByteArray, jenv, lSize * 4);
+      if (data)
+         JCALL4(SetByteArrayRegion, jenv, (jbyteArray)data, 0, lSize * 4, (jbyte*)result);
+   }
+   else if (bytesPerPixel == 8)
+   {
+      data = JCALL1(NewShortArray, jenv, lSize * 4);
+      if (data)
+         JCALL4(SetShortArrayRegion, jenv, (jshortArray)data, 0, lSize * 4, (jshort*)result);
+   }
+   else
+   {
+      // don't know how to map
+      $result = 0;
+      return $result;
+   }
+
+   if (data == 0)
+   {
+      jclass excep = jenv->FindClass("java/lang/OutOfMemoryError");
+      if (excep)
+         jenv->ThrowNew(excep, "The system ran out of memory!");
+   }
+   $result = data;
+}
+
+// Java typemap
+// getLastImage(), popNextImage() and their MD variants are wrapped through
+// the variants returning the image in the circular buffer (see the %rename
+// below), whose pixels are mapped to a Java array in the same way, using the
+// geometry of that image, which can differ from the current camera settings
+// in variable-size mode
+
+%typemap(jni) const mm::ImgBuffer*        "jobject"
+%typemap(jtype) const mm::ImgBuffer*      "Object"
+%typemap(jstype) const mm::ImgBuffer*     "Object"
+%typemap(javaout) const mm::ImgBuffer* {
+   return $jnicall;
+}
+%typemap(out) const mm::ImgBuffer*
+{
+   unsigned width, height, bytesPerPixel, numComponents;
+   (arg1)->getBufferedImageGeometry(result, width, height, bytesPerPixel, numComponents);
+   long lSize = (long)width * height;
+   const unsigned char* pixels = result->GetPixels();
+
+   jarray data = 0;
+   if (bytesPerPixel == 1)
+   {
+      data = JCALL1(NewByteArray, jenv, lSize);
+      if (data)
+         JCALL4(SetByteArrayRegion, jenv, (jbyteArray)data, 0, lSize, (const jbyte*)pixels);
+   }
+   else if (bytesPerPixel == 2)
+   {
+      data = JCALL1(NewShortArray, jenv, lSize);
+      if (data)
+         JCALL4(SetShortArrayRegion, jenv, (jshortArray)data, 0, lSize, (const jshort*)pixels);
+   }
+   else if (bytesPerPixel == 4 && numComponents == 1)
+   {
+      data = JCALL1(NewFloatArray, jenv, lSize);
+      if (data)
+         JCALL4(SetFloatArrayRegion, jenv, (jfloatArray)data, 0, lSize, (const jfloat*)pixels);
+   }
+   else if (bytesPerPixel == 4)
+   {
+      data = JCALL1(NewByteArray, jenv, lSize * 4);
+      if (data)
+         JCALL4(SetByteArrayRegion, jenv, (jbyteArray)data, 0, lSize * 4, (const jbyte*)pixels);
+   }
+   else if (bytesPerPixel == 8)
+   {
+      data = JCALL1(NewShortArray, jenv, lSize * 4);
+      if (data)
+         JCALL4(SetShortArrayRegion, jenv, (jshortArray)data, 0, lSize * 4, (const jshort*)pixels);
+   }
+   else
+   {
+      // don't know how to map
+      $result = 0;
+      return $result;
+   }
+
+   if (data == 0)
+   {
+      jclass excep = jenv->FindClass("java/lang/OutOfMemoryError");
+      if (excep)
+         jenv->ThrowNew(excep, "The system ran out of memory!");
+   }
+   $result = data;
+}
+
+// Java typemap
+// return pinned images as direct ByteBuffers over the circular buffer memory
+// (no copy), in native byte order; the size is that of the pinned image.
+// Pass the ByteBuffer back to releaseImage() when done with it.
+
+%typemap(jni) void* getLastImagePinned, void* getLastImagePinnedMD,
+      void* popNextImagePinned, void* popNextImagePinnedMD "jobject"
+%typemap(jtype) void* getLastImagePinned, void* getLastImagePinnedMD,
+      void* popNextImagePinned, void* popNextImagePinnedMD "java.nio.ByteBuffer"
+%typemap(jstype) void* getLastImagePinned, void* getLastImagePinnedMD,
+      void* popNextImagePinned, void* popNextImagePinnedMD "java.nio.ByteBuffer"
+%typemap(javaout) void* getLastImagePinned, void* getLastImagePinnedMD,
+      void* popNextImagePinned, void* popNextImagePinnedMD {
+   java.nio.ByteBuffer buffer = $jnicall;
+   return buffer == null ? null : buffer.order(java.nio.ByteOrder.nativeOrder());
+}
+%typemap(out) void* getLastImagePinned, void* getLastImagePinnedMD,
+      void* popNextImagePinned, void* popNextImagePinnedMD
+{
+   // Neither call can fail for an image that was just pinned
+   jlong bytes = 0;
+   try { bytes = (jlong)(arg1)->getPinnedImageBufferSize(result); } catch (...) {}
+   $result = JCALL2(NewDirectByteBuffer, jenv, result, bytes);
+   if ($result == 0)
+   {
+      // Java has no reference to the image, so nobody else can release it
+      try { (arg1)->releaseImage(result); } catch (...) {}
+      if (!jenv->ExceptionCheck())
+      {
+         jclass excep = jenv->FindClass("java/lang/UnsupportedOperationException");
+         if (excep)
+            jenv->ThrowNew(excep, "Direct buffers are not supported by this JVM");
+      }
+   }
+}
+
+%typemap(jni) void* pinnedPixels "jobject"
+%typemap(jtype) void* pinnedPixels "java.nio.ByteBuffer"
+%typemap(jstype) void* pinnedPixels "java.nio.ByteBuffer"
+%typemap(javain) void* pinnedPixels "$javainput"
+%typemap(in) void* pinnedPixels
+{
+   $1 = $input ? JCALL1(GetDirectBufferAddress, jenv, $input) : 0;
+}
+
 
 %typemap(jni) imgRGB32 "jintArray"
 %typemap(jtype) imgRGB32      "int[]"
@@ -632,6 +802,21 @@
 %ignore MetadataKeyError;
 %ignore MetadataIndexError;
 
+// Wrapped through the variants returning the image (see the typemaps above)
+%ignore CMMCore::getLastImage;
+%ignore CMMCore::popNextImage;
+%ignore CMMCore::getLastImageMD;
+%ignore CMMCore::popNextImageMD;
+%ignore CMMCore::getNBeforeLastImageMD;
+%rename(getLastImage) CMMCore::getLastImageBuffer;
+%rename(popNextImage) CMMCore::popNextImageBuffer;
+%rename(getLastImageMD) CMMCore::getLastImageBufferMD;
+%rename(popNextImageMD) CMMCore::popNextImageBufferMD;
+%rename(getNBeforeLastImageMD) CMMCore::getNBeforeLastImageBufferMD;
+%ignore CMMCore::getBufferedImageGeometry;
+// For testing from C++ only
+%ignore CMMCore::loadMockDeviceAdapter;
+
 
 %typemap(javaimports) CMMCore %{
    import mmcorej.org.json.JSONObject;
@@ -806,6 +991,55 @@
       return popNextTaggedImage(0);
    }
 
+   /*
+    * Pops up to maxCount images from the circular buffer at once. Returns an
+    * empty list if the buffer is empty.
+    */
+   public List<TaggedImage> popNextTaggedImages(int cameraChannelIndex, int maxCount) throws java.lang.Exception {
+      ImageBatch batch = new ImageBatch();
+      popNextImages(cameraChannelIndex, maxCount, batch);
+      List<TaggedImage> images = new ArrayList<TaggedImage>((int) batch.size());
+      for (int i = 0; i < batch.size(); ++i) {
+         images.add(createTaggedImage(batch.getImagePixels(i), batch.getImageMetadata(i), cameraChannelIndex));
+      }
+      batch.delete();
+      return images;
+   }
+
+   public List<TaggedImage> popNextTaggedImages(int maxCount) throws java.lang.Exception {
+      return popNextTaggedImages(0, maxCount);
+   }
+
+   /*
+    * Like getLastTaggedImage(), but the pixels (image.pix) are a direct
+    * ByteBuffer over the circular buffer memory instead of a copy. The image
+    * is not overwritten until the buffer is passed to releaseImage(), which
+    * must be done promptly (see getLastImagePinned()).
+    */
+   public TaggedImage getLastTaggedImagePinned(int cameraChannelIndex) throws java.lang.Exception {
+      Metadata md = new Metadata();
+      java.nio.ByteBuffer pixels = getLastImagePinnedMD(cameraChannelIndex, md);
+      return createTaggedImage(pixels, md, cameraChannelIndex);
+   }
+
+   public TaggedImage getLastTaggedImagePinned() throws java.lang.Exception {
+      return getLastTaggedImagePinned(0);
+   }
+
+   /*
+    * Like popNextTaggedImage(), but the pixels (image.pix) are a direct
+    * ByteBuffer that must be passed to releaseImage() when no longer used.
+    */
+   public TaggedImage popNextTaggedImagePinned(int cameraChannelIndex) throws java.lang.Exception {
+      Metadata md = new Metadata();
+      java.nio.ByteBuffer pixels = popNextImagePinnedMD(cameraChannelIndex, md);
+      return createTaggedImage(pixels, md, cameraChannelIndex);
+   }
+
+   public TaggedImage popNextTaggedImagePinned() throws java.lang.Exception {
+      return popNextTaggedImagePinned(0);
+   }
+
    // convenience functions follow
    
    /*
@@ -918,6 +1152,8 @@
 %{
 #include "../MMDevice/MMDeviceConstants.h"
 #include "../MMCore/Configuration.h"
+#include "../MMCore/FrameBuffer.h"
+#include "../MMCore/ImageBatch.h"
 #include "../MMDevice/ImageMetadata.h"
 #include "../MMCore/MMEventCallback.h"
 #include "../MMCore/MMCore.h"
@@ -1236,6 +1472,7 @@ namespace std {
 
 %include "../MMDevice/MMDeviceConstants.h"
 %include "../MMCore/Configuration.h"
+%include "../MMCore/ImageBatch.h"
 %include "../MMCore/MMCore.h"
 %include "../MMDevice/ImageMetadata.h"
 %include "../MMCore/MMEventCallback.h"
@@ -0,0 +1,153 @@
+///////////////////////////////////////////////////////////////////////////////
+// MODULE:        BandWorkers.cpp
+// SYSTEM:        ImageBase subsystem
+//
+// DESCRIPTION:   Persistent threads that process an image in bands of rows.
+//
+// LICENSE:       This file is free for use, modification and distribution and
+//                is distributed under terms specified in the BSD license
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "BandWorkers.h"
+
+#include <algorithm>
+#include <system_error>
+
+namespace MM {
+
+BandWorkers::BandWorkers() :
+   threadCount_(1),
+   stop_(false),
+   generation_(0),
+   busyWorkers_(0),
+   fn_(0),
+   height_(0),
+   bandRows_(0),
+   bandCount_(0),
+   nextBand_(0)
+{
+}
+
+BandWorkers::~BandWorkers()
+{
+   std::lock_guard<std::mutex> runLock(runMutex_);
+   StopThreads();
+}
+
+unsigned BandWorkers::Resize(unsigned threadCount)
+{
+   std::lock_guard<std::mutex> runLock(runMutex_);
+
+   StopThreads();
+   threadCount = (std::max)(threadCount, 1u);
+   while (threads_.size() + 1 < threadCount)
+   {
+      try
+      {
+         threads_.emplace_back(&BandWorkers::WorkerLoop, this, generation_);
+      }
+      catch (const std::system_error&)
+      {
+         // Out of threads; make do with those we have
+         break;
+      }
+   }
+   threadCount_ = static_cast<unsigned>(threads_.size() + 1);
+   return threadCount_;
+}
+
+unsigned BandWorkers::GetThreadCount() const
+{
+   return threadCount_;
+}
+
+void BandWorkers::Run(unsigned height, unsigned bandRows,
+      const BandFunction& fn)
+{
+   std::lock_guard<std::mutex> runLock(runMutex_);
+
+   if (height == 0)
+      return;
+   bandRows = (std::max)(1u, (std::min)(bandRows, height));
+   const unsigned bandCount = (height - 1) / bandRows + 1;
+   if (threads_.empty() || bandCount < 2)
+   {
+      for (unsigned rowBegin = 0; rowBegin < height; rowBegin += bandRows)
+         fn(rowBegin, (std::min)(rowBegin + bandRows, height));
+      return;
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      fn_ = &fn;
+      height_ = height;
+      bandRows_ = bandRows;
+      bandCount_ = bandCount;
+      nextBand_ = 0;
+      busyWorkers_ = static_cast<unsigned>(threads_.size());
+      ++generation_;
+   }
+   workCond_.notify_all();
+
+   RunBands();
+
+   // Workers still read the job after the last band is taken, so wait for
+   // all of them before it goes out of scope
+   std::unique_lock<std::mutex> lock(mutex_);
+   doneCond_.wait(lock, [this] { return busyWorkers_ == 0; });
+   fn_ = 0;
+}
+
+void BandWorkers::WorkerLoop(unsigned long long generation)
+{
+   std::unique_lock<std::mutex> lock(mutex_);
+   for (;;)
+   {
+      workCond_.wait(lock, [&] { return stop_ || generation_ != generation; });
+      if (stop_)
+         return;
+      generation = generation_;
+
+      lock.unlock();
+      RunBands();
+      lock.lock();
+
+      if (--busyWorkers_ == 0)
+         doneCond_.notify_one();
+   }
+}
+
+void BandWorkers::RunBands()
+{
+   for (;;)
+   {
+      const unsigned band = nextBand_++;
+      if (band >= bandCount_)
+         return;
+      const unsigned rowBegin = band * bandRows_;
+      (*fn_)(rowBegin, (std::min)(rowBegin + bandRows_, height_));
+   }
+}
+
+// Must be called with runMutex_ held
+void BandWorkers::StopThreads()
+{
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+   }
+   workCond_.notify_all();
+   for (std::thread& thread : threads_)
+      thread.join();
+   threads_.clear();
+   stop_ = false;
+   threadCount_ = 1;
+}
+
+} // namespace MM
@@ -0,0 +1,131 @@
+///////////////////////////////////////////////////////////////////////////////
+// MODULE:        BandWorkers.h
+// SYSTEM:        ImageBase subsystem
+//
+// DESCRIPTION:   Processing images in bands of rows on several threads.
+//
+// LICENSE:       This file is free for use, modification and distribution and
+//                is distributed under terms specified in the BSD license
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace MM {
+
+/**
+ * Splits rows [0, height) into up to threadCount bands of at least
+ * minRowsPerBand rows and calls fn(rowBegin, rowEnd) for each, on new
+ * threads and the calling thread, returning when all are done. For one-off
+ * work; use BandWorkers to process a stream of frames.
+ */
+template <typename F>
+void ForEachRowBand(unsigned height, unsigned threadCount,
+      unsigned minRowsPerBand, F fn)
+{
+   const unsigned bandCount = (std::min)(threadCount,
+         height / (std::max)(minRowsPerBand, 1u));
+   if (bandCount < 2)
+   {
+      fn(0u, height);
+      return;
+   }
+
+   std::vector<std::thread> threads;
+   for (unsigned band = 1; band < bandCount; ++band)
+   {
+      const unsigned rowBegin = static_cast<unsigned>(
+            static_cast<unsigned long long>(height) * band / bandCount);
+      const unsigned rowEnd = static_cast<unsigned>(
+            static_cast<unsigned long long>(height) * (band + 1) / bandCount);
+      try
+      {
+         threads.emplace_back(fn, rowBegin, rowEnd);
+      }
+      catch (const std::system_error&)
+      {
+         // Out of threads; do the band here instead
+         fn(rowBegin, rowEnd);
+      }
+   }
+   fn(0u, height / bandCount);
+   for (std::thread& thread : threads)
+      thread.join();
+}
+
+/**
+ * A set of threads, kept between calls, that run a function on consecutive
+ * bands of image rows.
+ *
+ * The threads are started by Resize() and wait for work between calls to
+ * Run(), so that processing each frame does not pay for starting threads.
+ * Run() and Resize() may be called from any thread; calls are serialized.
+ */
+class BandWorkers
+{
+public:
+   // Processes rows [rowBegin, rowEnd); must not throw
+   typedef std::function<void(unsigned rowBegin, unsigned rowEnd)> BandFunction;
+
+   BandWorkers();
+   ~BandWorkers();
+
+   BandWorkers(const BandWorkers&) = delete;
+   BandWorkers& operator=(const BandWorkers&) = delete;
+
+   /**
+    * Sets the number of threads used by Run(), including the calling
+    * thread. If the system cannot start that many threads, fewer are used.
+    * Returns the number actually used (at least 1).
+    */
+   unsigned Resize(unsigned threadCount);
+
+   // The number of threads used by Run(), including the calling thread
+   unsigned GetThreadCount() const;
+
+   /**
+    * Calls fn on each band of bandRows rows (the last band may be shorter)
+    * of an image of height rows, and returns when all bands are done.
+    * The calling thread processes bands, too.
+    */
+   void Run(unsigned height, unsigned bandRows, const BandFunction& fn);
+
+private:
+   void WorkerLoop(unsigned long long generation);
+   void RunBands();
+   void StopThreads();
+
+   std::mutex runMutex_; // Held for the whole of Run() or Resize()
+   std::mutex mutex_;
+   std::condition_variable workCond_;
+   std::condition_variable doneCond_;
+   std::vector<std::thread> threads_;
+   std::atomic<unsigned> threadCount_;
+   bool stop_;
+   unsigned long long generation_; // Incremented for each Run()
+   unsigned busyWorkers_;
+
+   // The current job; written while holding mutex_ before the generation
+   // is incremented
+   const BandFunction* fn_;
+   unsigned height_;
+   unsigned bandRows_;
+   unsigned bandCount_;
+   std::atomic<unsigned> nextBand_;
+};
+
+} // namespace MM
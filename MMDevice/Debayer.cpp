@@ -24,8 +24,13 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "Debayer.h"
+#include "BandWorkers.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstdlib>
+#include <thread>
+#include <type_traits>
 
 ///////////////////////////////////////////////////////////////////////////////
 // Debayer class implementation
@@ -47,6 +52,8 @@ Debayer::Debayer()
    // default settings
    orderIndex = 0; // RGRG ordering
    algoIndex = 0;  // replication - faster
+   threadCount = (std::max)(1u, std::thread::hardware_concurrency());
+   SetRGBScales(1.0, 1.0, 1.0);
 }
 
 Debayer::~Debayer()
@@ -86,30 +93,338 @@ int Debayer::Process(ImgBuffer& out, const unsigned char* in, int width, int hei
 int Debayer::Process(ImgBuffer& out, const unsigned short* in, int width, int height, int bitDepth)
 { return ProcessT(out, in, width, height, bitDepth); }
 
+int Debayer::Process(unsigned char* out, const unsigned char* in, int width, int height, int bitDepth)
+{ return ProcessT(out, in, width, height, bitDepth); }
+
+int Debayer::Process(unsigned char* out, const unsigned short* in, int width, int height, int bitDepth)
+{ return ProcessT(out, in, width, height, bitDepth); }
+
+void Debayer::SetRGBScales(double rScale, double gScale, double bScale)
+{
+   const double s[3] = { rScale, gScale, bScale };
+   for (int i = 0; i < 3; ++i)
+      scales[i] = s[i] > 0.0 ? static_cast<int>(s[i] * 256.0 + 0.5) : 0;
+}
+
 template <typename T>
 int Debayer::ProcessT(ImgBuffer& out, const T* in, int width, int height, int bitDepth)
 {
-   assert(sizeof(int) == 4);
    out.Resize(width, height, 4);
-   int* outBuf = reinterpret_cast<int*>(out.GetPixelsRW());
-   return Convert(in, outBuf, width, height, bitDepth, orderIndex, algoIndex);
+   return ProcessT(out.GetPixelsRW(), in, width, height, bitDepth);
+}
+
+namespace {
+
+// Row and column parity of the samples decoded as red, by order index; blue
+// is at the opposite parities, green at the other two positions
+const int redPhase[4][2] = { {0, 0}, {1, 1}, {1, 0}, {0, 1} };
+
+// Columns of padding on either side of cached rows
+const int pad = 2;
+
+// Mirrors an out-of-range index about the edge pixel, which keeps the Bayer
+// phase (-1 -> 1, n -> n - 2)
+int Reflect(int i, int n)
+{
+   if (n == 1)
+      return 0;
+   while (i < 0 || i >= n)
+   {
+      if (i < 0)
+         i = -i;
+      if (i >= n)
+         i = 2 * (n - 1) - i;
+   }
+   return i;
+}
+
+/**
+ * Decodes a band of rows. Input rows (and, for the edge-aware algorithm,
+ * interpolated green rows) are kept in small caches of padded rows, so
+ * that the inner loops need no bounds checks and can be vectorized.
+ */
+template <typename T>
+class BandDecoder
+{
+public:
+   // lut holds the 8-bit output for each input value, for red, green and
+   // blue in turn
+   BandDecoder(const T* in, unsigned char* out, int width, int height,
+         int bitDepth, int order, const unsigned char* lut) :
+      in_(in), out_(out), width_(width), height_(height),
+      maxValue_((1 << bitDepth) - 1),
+      redY_(redPhase[order][0]), redX_(redPhase[order][1]),
+      redLut_(lut), greenLut_(lut + maxValue_ + 1), blueLut_(lut + 2 * (maxValue_ + 1)),
+      rawRows_(rawSlots * (width + 2 * pad)),
+      greenRows_(greenSlots * (width + 2 * pad))
+   {
+      for (int i = 0; i < rawSlots; ++i)
+         rawTags_[i] = noRow;
+      for (int i = 0; i < greenSlots; ++i)
+         greenTags_[i] = noRow;
+   }
+
+   void Decode(int algorithm, int rowBegin, int rowEnd)
+   {
+      for (int y = rowBegin; y < rowEnd; ++y)
+      {
+         if (algorithm == 0)
+            ReplicateRow(y);
+         else if (algorithm == 1)
+            BilinearRow(y);
+         else
+            EdgeAwareRow(y);
+      }
+   }
+
+private:
+   static const int rawSlots = 8;
+   static const int greenSlots = 4;
+   static const int noRow = -1000000;
+
+   static int Slot(int y, int slots) { return ((y % slots) + slots) % slots; }
+
+   // Parity of the red (in red rows) or blue (in blue rows) columns
+   int ColorX(int y) const { return IsRedRow(y) ? redX_ : 1 - redX_; }
+   bool IsRedRow(int y) const { return (y & 1) == redY_; }
+
+   const int* RawRow(int y)
+   {
+      const int slot = Slot(y, rawSlots);
+      int* row = &rawRows_[slot * (width_ + 2 * pad)] + pad;
+      if (rawTags_[slot] != y)
+      {
+         const T* src = in_ + static_cast<size_t>(Reflect(y, height_)) * width_;
+         // Samples above bitDepth (from a camera sending more bits than it
+         // reports) would index past the lookup tables
+         for (int x = 0; x < width_; ++x)
+            row[x] = Clamp(src[x]);
+         PadRow(row);
+         rawTags_[slot] = y;
+      }
+      return row;
+   }
+
+   void PadRow(int* row) const
+   {
+      for (int i = 1; i <= pad; ++i)
+      {
+         row[-i] = row[Reflect(-i, width_)];
+         row[width_ - 1 + i] = row[Reflect(width_ - 1 + i, width_)];
+      }
+   }
+
+   // Calls f(x, colorSite, redRow) for each pixel of row y, where colorSite
+   // and redRow are std::true_type or std::false_type. Pixels are visited in
+   // pairs, so the loop body needs no per-pixel branches.
+   template <typename F>
+   void ForEachPixel(int y, F f) const
+   {
+      if (IsRedRow(y))
+         ForEachPixel(ColorX(y), std::true_type(), f);
+      else
+         ForEachPixel(ColorX(y), std::false_type(), f);
+   }
+
+   template <typename RedRow, typename F>
+   void ForEachPixel(int colorX, RedRow redRow, F f) const
+   {
+      int x = 0;
+      if (colorX == 1)
+      {
+         f(0, std::false_type(), redRow);
+         x = 1;
+      }
+      for (; x + 1 < width_; x += 2)
+      {
+         f(x, std::true_type(), redRow);
+         f(x + 1, std::false_type(), redRow);
+      }
+      if (x < width_)
+         f(x, std::true_type(), redRow);
+   }
+
+   void Store(unsigned char* o, int x, int r, int g, int b) const
+   {
+      o[4 * x] = blueLut_[b];
+      o[4 * x + 1] = greenLut_[g];
+      o[4 * x + 2] = redLut_[r];
+      o[4 * x + 3] = 0;
+   }
+
+   int Clamp(int v) const { return v < 0 ? 0 : (v > maxValue_ ? maxValue_ : v); }
+
+   unsigned char* OutRow(int y) const { return out_ + static_cast<size_t>(y) * width_ * 4; }
+
+   // Each sample is copied to the pixels to its right and below (to its
+   // left and above at the first row and column, by the reflected padding)
+   void ReplicateRow(int y)
+   {
+      const int* c = RawRow(y);
+      const int* o = RawRow(y - 1);
+      unsigned char* out = OutRow(y);
+      ForEachPixel(y, [&](int x, auto colorSite, auto redRow)
+      {
+         const int own = colorSite ? c[x] : c[x - 1];
+         const int g = colorSite ? c[x - 1] : c[x];
+         const int other = colorSite ? o[x - 1] : o[x];
+         Store(out, x, redRow ? own : other, g, redRow ? other : own);
+      });
+   }
+
+   void BilinearRow(int y)
+   {
+      const int* n = RawRow(y - 1);
+      const int* c = RawRow(y);
+      const int* s = RawRow(y + 1);
+      unsigned char* out = OutRow(y);
+      ForEachPixel(y, [&](int x, auto colorSite, auto redRow)
+      {
+         int own, g, other;
+         if (colorSite)
+         {
+            own = c[x];
+            g = (c[x - 1] + c[x + 1] + n[x] + s[x] + 2) >> 2;
+            other = (n[x - 1] + n[x + 1] + s[x - 1] + s[x + 1] + 2) >> 2;
+         }
+         else
+         {
+            own = (c[x - 1] + c[x + 1] + 1) >> 1;
+            g = c[x];
+            other = (n[x] + s[x] + 1) >> 1;
+         }
+         Store(out, x, redRow ? own : other, g, redRow ? other : own);
+      });
+   }
+
+   // Green at red and blue sites is interpolated along the direction with
+   // the smaller gradient, with a second-derivative correction from the
+   // center color (Hamilton-Adams)
+   const int* GreenRow(int y)
+   {
+      const int slot = Slot(y, greenSlots);
+      int* row = &greenRows_[slot * (width_ + 2 * pad)] + pad;
+      if (greenTags_[slot] == y)
+         return row;
+
+      const int* n2 = RawRow(y - 2);
+      const int* n = RawRow(y - 1);
+      const int* c = RawRow(y);
+      const int* s = RawRow(y + 1);
+      const int* s2 = RawRow(y + 2);
+      ForEachPixel(y, [&](int x, auto colorSite, auto)
+      {
+         if (!colorSite)
+         {
+            row[x] = c[x];
+            return;
+         }
+         const int lapH = 2 * c[x] - c[x - 2] - c[x + 2];
+         const int lapV = 2 * c[x] - n2[x] - s2[x];
+         const int dH = std::abs(c[x - 1] - c[x + 1]) + std::abs(lapH);
+         const int dV = std::abs(n[x] - s[x]) + std::abs(lapV);
+         const int gH = 2 * (c[x - 1] + c[x + 1]) + lapH; // 4x
+         const int gV = 2 * (n[x] + s[x]) + lapV; // 4x
+         const int g8 = dH < dV ? 2 * gH : (dV < dH ? 2 * gV : gH + gV);
+         row[x] = Clamp((g8 + 4) >> 3);
+      });
+      PadRow(row);
+      greenTags_[slot] = y;
+      return row;
+   }
+
+   // Red and blue are interpolated from the color differences (color minus
+   // green) of the neighboring samples
+   void EdgeAwareRow(int y)
+   {
+      const int* gn = GreenRow(y - 1);
+      const int* gc = GreenRow(y);
+      const int* gs = GreenRow(y + 1);
+      const int* n = RawRow(y - 1);
+      const int* c = RawRow(y);
+      const int* s = RawRow(y + 1);
+      unsigned char* out = OutRow(y);
+      ForEachPixel(y, [&](int x, auto colorSite, auto redRow)
+      {
+         const int g = gc[x];
+         int own, other;
+         if (colorSite)
+         {
+            own = c[x];
+            other = Clamp(g + ((n[x - 1] - gn[x - 1]) + (n[x + 1] - gn[x + 1]) +
+               (s[x - 1] - gs[x - 1]) + (s[x + 1] - gs[x + 1])) / 4);
+         }
+         else
+         {
+            own = Clamp(g + ((c[x - 1] - gc[x - 1]) + (c[x + 1] - gc[x + 1])) / 2);
+            other = Clamp(g + ((n[x] - gn[x]) + (s[x] - gs[x])) / 2);
+         }
+         Store(out, x, redRow ? own : other, g, redRow ? other : own);
+      });
+   }
+
+   const T* in_;
+   unsigned char* out_;
+   const int width_;
+   const int height_;
+   const int maxValue_;
+   const int redY_;
+   const int redX_;
+   const unsigned char* redLut_;
+   const unsigned char* greenLut_;
+   const unsigned char* blueLut_;
+   std::vector<int> rawRows_;
+   int rawTags_[rawSlots];
+   std::vector<int> greenRows_;
+   int greenTags_[greenSlots];
+};
+
+} // anonymous namespace
+
+template <typename T>
+int Debayer::ProcessT(unsigned char* out, const T* in, int width, int height, int bitDepth)
+{
+   if (width <= 0 || height <= 0 || bitDepth < 1 || bitDepth > static_cast<int>(8 * sizeof(T)))
+      return DEVICE_INVALID_INPUT_PARAM;
+   if (orderIndex < 0 || orderIndex > 3)
+      return DEVICE_NOT_SUPPORTED;
+   if (algoIndex == 2)
+      return Convert(in, reinterpret_cast<int*>(out), width, height, bitDepth, orderIndex, algoIndex);
+   if (algoIndex != 0 && algoIndex != 1 && algoIndex != 3)
+      return DEVICE_NOT_SUPPORTED;
+
+   // Samples are reduced to 8 bits by dropping low bits, then scaled
+   const int shift = bitDepth > 8 ? bitDepth - 8 : 0;
+   const int levels = 1 << bitDepth;
+   std::vector<unsigned char> lut(3 * levels);
+   for (int c = 0; c < 3; ++c)
+   {
+      for (int v = 0; v < levels; ++v)
+      {
+         const int scaled = ((v >> shift) * scales[c]) >> 8;
+         lut[c * levels + v] = static_cast<unsigned char>((std::min)(scaled, 255));
+      }
+   }
+   const unsigned char* lutData = &lut[0];
+
+   // Starting a thread costs more than decoding a few rows
+   const unsigned minRowsPerThread = 32;
+   MM::ForEachRowBand(static_cast<unsigned>(height), threadCount, minRowsPerThread,
+         [=](unsigned rowBegin, unsigned rowEnd)
+         {
+            BandDecoder<T>(in, out, width, height, bitDepth, orderIndex, lutData).Decode(algoIndex, rowBegin, rowEnd);
+         });
+   return DEVICE_OK;
 }
 
 template<typename T>
 int Debayer::Convert(const T* input, int* output, int width, int height, int bitDepth, int rowOrder, int algorithm)
-{				
-	if (algorithm == 0)
-      ReplicateDecode(input, output, width, height, bitDepth, rowOrder);
-	else if (algorithm == 1)
-      return DEVICE_NOT_SUPPORTED;
-	else if (algorithm == 2)
+{
+   if (algorithm == 2)
       SmoothDecode(input, output, width, height, bitDepth, rowOrder);
-	else if (algorithm == 3)
-      return DEVICE_NOT_SUPPORTED;
    else
       return DEVICE_NOT_SUPPORTED;
 
-
    return DEVICE_OK;
 }
 
@@ -135,155 +450,6 @@ unsigned short Debayer::GetPixel(const unsigned char* v, int x, int y, int width
       return v[y*width + x];
 }
 
-// Replication algorithm
-template <typename T>
-void Debayer::ReplicateDecode(const T* input, int* output, int width, int height, int bitDepth, int rowOrder)
-{
-   unsigned numPixels(width*height);
-   if (r.size() != numPixels)
-   {
-      r.resize(numPixels);
-      g.resize(numPixels);
-      b.resize(numPixels);
-   }
-
-   int bitShift = bitDepth - 8;
-	
-	if (rowOrder == 0 || rowOrder == 1) {
-		for (int y=0; y<height; y+=2) {
-			for (int x=0; x<width; x+=2) {
-				unsigned short one = GetPixel(input, x, y, width, height);
-				SetPixel(b, one, x, y, width, height);
-				SetPixel(b, one, x+1, y, width, height);
-				SetPixel(b, one, x, y+1, width, height); 
-				SetPixel(b, one, x+1, y+1, width, height);
-			}
-		}
-		
-		for (int y=1; y<height; y+=2) {
-			for (int x=1; x<width; x+=2) {
-            unsigned short one = GetPixel(input, x, y, width, height);
-				SetPixel(r, one, x, y, width, height);
-				SetPixel(r, one, x+1, y, width, height);
-				SetPixel(r, one, x, y+1, width, height); 
-				SetPixel(r, one, x+1, y+1, width, height);
-			}
-		}
-		
-		for (int y=0; y<height; y+=2) {
-			for (int x=1; x<width; x+=2) {
-				unsigned short one = GetPixel(input, x, y, width, height);
-            SetPixel(g, one, x, y, width, height);
-            SetPixel(g, one, x+1, y, width, height);
-			}
-		}	
-			
-		for (int y=1; y<height; y+=2) {
-			for (int x=0; x<width; x+=2) {
-            unsigned short one = GetPixel(input, x, y, width, height);
-            SetPixel(g, one, x, y, width, height);
-            SetPixel(g, one, x+1, y, width, height);
-			}
-		}	
-		
-		if (rowOrder == 0) {
-         for (int i=0; i<height*width; i++)
-         {
-            output[i] = 0;
-            unsigned char* bytePix = (unsigned char*)(output+i);
-            *bytePix = (unsigned char)(r[i] >> bitShift);
-            *(bytePix+1) = (unsigned char)(g[i] >> bitShift);
-            *(bytePix+2) = (unsigned char)(b[i] >> bitShift);
-
-			   //rgb.addSlice("red",b);	
-			   //rgb.addSlice("green",g);
-			   //rgb.addSlice("blue",r);
-         }
-		}
-		else if (rowOrder == 1) {
-         for (int i=0; i<height*width; i++)
-         {
-            output[i] = 0;
-            unsigned char* bytePix = (unsigned char*)(output+i);
-            *bytePix = (unsigned char)(b[i] >> bitShift);
-            *(bytePix+1) = (unsigned char)(g[i] >> bitShift);
-            *(bytePix+2) = (unsigned char)(r[i] >> bitShift);
-
-			   //rgb.addSlice("red",r);	
-			   //rgb.addSlice("green",g);
-			   //rgb.addSlice("blue",b);			
-		   }
-      }
-	}
-
-	else if (rowOrder == 2 || rowOrder == 3) {
-		for (int y=1; y<height; y+=2) {
-			for (int x=0; x<width; x+=2) {
-				unsigned short one = GetPixel(input, x, y, width, height);
-				SetPixel(b, one, x, y, width, height);
-				SetPixel(b, one, x+1, y, width, height);
-				SetPixel(b, one, x, y+1, width, height); 
-				SetPixel(b, one, x+1, y+1, width, height);
-			}
-		}
-		
-		for (int y=0; y<height; y+=2) {
-			for (int x=1; x<width; x+=2) {
-            unsigned short one = GetPixel(input, x, y, width, height);
-				SetPixel(r, one, x, y, width, height);
-				SetPixel(r, one, x+1, y, width, height);
-				SetPixel(r, one, x, y+1, width, height); 
-				SetPixel(r, one, x+1, y+1, width, height);
-			}
-		}
-		
-		for (int y=0; y<height; y+=2) {
-			for (int x=0; x<width; x+=2) {
-				unsigned short one = GetPixel(input, x, y, width, height);
-            SetPixel(g, one, x, y, width, height);
-            SetPixel(g, one, x+1, y, width, height);
-			}
-		}	
-			
-		for (int y=1; y<height; y+=2) {
-			for (int x=1; x<width; x+=2) {
-            unsigned short one = GetPixel(input, x, y, width, height);
-            SetPixel(g, one, x, y, width, height);
-            SetPixel(g, one, x+1, y, width, height);
-			}
-		}	
-		
-		if (rowOrder == 2) {
-         for (int i=0; i<height*width; i++)
-         {
-            output[i] = 0;
-            unsigned char* bytePix = (unsigned char*)(output+i);
-            *bytePix = (unsigned char)(r[i] >> bitShift);
-            *(bytePix+1) = (unsigned char)(g[i] >> bitShift);
-            *(bytePix+2) = (unsigned char)(b[i] >> bitShift);
-
-            //rgb.addSlice("red",b);	
-			   //rgb.addSlice("green",g);
-			   //rgb.addSlice("blue",r);
-         }
-		}
-		else if (rowOrder == 3) {
-         for (int i=0; i<height*width; i++)
-         {
-            output[i] = 0;
-            unsigned char* bytePix = (unsigned char*)(output+i);
-            *bytePix = (unsigned char)(b[i] >> bitShift);
-            *(bytePix+1) = (unsigned char)(g[i] >> bitShift);
-            *(bytePix+2) = (unsigned char)(r[i] >> bitShift);
-
-            //rgb.addSlice("red",r);	
-			   //rgb.addSlice("green",g);
-			   //rgb.addSlice("blue",b);
-         }
-		}
-	}
-}
-
 // Smooth Hue algorithm
 template <typename T>
 void Debayer::SmoothDecode(const T* input, int* output, int width, int height, int bitDepth, int rowOrder)
@@ -32,6 +32,13 @@
 /**
  * Utility class to build color image from the Bayer grayscale image
  * Based on the Debayer_Image plugin for ImageJ, by Jennifer West, University of Manitoba
+ *
+ * Replication, Bilinear and Adaptive-Smooth-Hue (edge-aware: green is
+ * interpolated along the smoother direction, red and blue from color
+ * differences) write RGB32 directly, row by row, with the rows split into
+ * bands decoded on several threads. Smooth-Hue uses full-image scratch
+ * buffers. Device adapters should use this class rather than keep their
+ * own copies.
  */
 class Debayer
 {
@@ -43,17 +50,27 @@ public:
    int Process(ImgBuffer& out, const unsigned char* in, int width, int height, int bitDepth);
    int Process(ImgBuffer& out, const unsigned short* in, int width, int height, int bitDepth);
 
+   // Decode into a caller-provided RGB32 buffer of width * height * 4 bytes
+   int Process(unsigned char* out, const unsigned char* in, int width, int height, int bitDepth);
+   int Process(unsigned char* out, const unsigned short* in, int width, int height, int bitDepth);
+
    const std::vector<std::string> GetOrders() const {return orders;}
    const std::vector<std::string> GetAlgorithms() const {return algorithms;}
 
    void SetOrderIndex(int idx) {orderIndex = idx;}
    void SetAlgorithmIndex(int idx) {algoIndex = idx;}
 
+   // White balance factors applied to the 8-bit output (default 1.0; not
+   // applied by Smooth-Hue)
+   void SetRGBScales(double rScale, double gScale, double bScale);
+   // Maximum number of threads (default: the number of processors)
+   void SetThreadCount(unsigned count) {threadCount = count > 0 ? count : 1;}
+
 private:
    template <typename T>
    int ProcessT(ImgBuffer& out, const T* in, int width, int height, int bitDepth);
-   template<typename T>
-   void ReplicateDecode(const T* input, int* out, int width, int height, int bitDepth, int rowOrder);
+   template <typename T>
+   int ProcessT(unsigned char* out, const T* in, int width, int height, int bitDepth);
    template <typename T>
    void SmoothDecode(const T* input, int* output, int width, int height, int bitDepth, int rowOrder);
    template<typename T>
@@ -71,4 +88,6 @@ private:
 
    int orderIndex;
    int algoIndex;
+   unsigned threadCount;
+   int scales[3]; // Red, green, blue in units of 1/256
 };
@@ -33,6 +33,11 @@
 #include <math.h>
 #include <assert.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
 #include <string>
 #include <vector>
 #include <iomanip>
@@ -1100,6 +1105,16 @@ protected:
       return DEVICE_NO_CALLBACK_REGISTERED;
    }
 
+   /*
+    * Signals that the device has stopped (or started) being busy
+   */
+   int OnBusyChanged(bool busy)
+   {
+      if (callback_)
+         return callback_->OnBusyChanged(this, busy);
+      return DEVICE_NO_CALLBACK_REGISTERED;
+   }
+
    /*
     */
    int OnExposureChanged(double exposure)
@@ -1279,6 +1294,89 @@ class CGenericBase : public CDeviceBase<MM::Generic, U>
 {
 };
 
+/**
+* Frame timing statistics of a sequence acquisition.
+* Frames are added by the sequence thread; the statistics can be read from
+* any thread.
+*/
+class CSequenceTimingStats
+{
+public:
+   typedef std::chrono::steady_clock::time_point TimePoint;
+
+   CSequenceTimingStats() { Reset(); }
+
+   void Reset()
+   {
+      MMThreadGuard g(lock_);
+      frames_ = 0;
+      meanIntervalMs_ = 0.0;
+      sumSqDevMs2_ = 0.0;
+      maxLatenessMs_ = 0.0;
+   }
+
+   /**
+   * Records the start of a frame that was due at deadline (pass start as the
+   * deadline if frames are not paced).
+   */
+   void AddFrame(TimePoint start, TimePoint deadline)
+   {
+      MMThreadGuard g(lock_);
+      const double lateness =
+         std::chrono::duration<double, std::milli>(start - deadline).count();
+      if (lateness > maxLatenessMs_)
+         maxLatenessMs_ = lateness;
+      if (frames_++ > 0)
+      {
+         // Welford's running mean and variance of the frame intervals
+         const double interval =
+            std::chrono::duration<double, std::milli>(start - lastStart_).count();
+         const long n = frames_ - 1;
+         const double delta = interval - meanIntervalMs_;
+         meanIntervalMs_ += delta / n;
+         sumSqDevMs2_ += delta * (interval - meanIntervalMs_);
+      }
+      lastStart_ = start;
+   }
+
+   long GetFrameCount() const
+   {
+      MMThreadGuard g(lock_);
+      return frames_;
+   }
+
+   double GetMeanIntervalMs() const
+   {
+      MMThreadGuard g(lock_);
+      return meanIntervalMs_;
+   }
+
+   double GetIntervalStdDevMs() const
+   {
+      MMThreadGuard g(lock_);
+      if (frames_ < 3)
+         return 0.0;
+      return sqrt(sumSqDevMs2_ / (frames_ - 2));
+   }
+
+   /**
+   * The longest delay of a frame start past its deadline.
+   */
+   double GetMaxLatenessMs() const
+   {
+      MMThreadGuard g(lock_);
+      return maxLatenessMs_;
+   }
+
+private:
+   mutable MMThreadLock lock_;
+   long frames_;
+   TimePoint lastStart_;
+   double meanIntervalMs_;
+   double sumSqDevMs2_;
+   double maxLatenessMs_;
+};
+
 /**
 * Base class for creating camera device adapters.
 * This class has a functional constructor - must be invoked
@@ -1315,6 +1413,14 @@ public:
       CreateProperty(MM::g_Keyword_Transpose_Correction, "0", MM::Integer, false);
       SetAllowedValues(MM::g_Keyword_Transpose_Correction, allowedValues);
 
+      // frame timing of the last (or current) sequence acquisition
+      this->CreatePropertyWithHandler(MM::g_Keyword_SequenceIntervalMean_ms,
+         "0", MM::Float, true, &CCameraBase::OnSequenceIntervalMean);
+      this->CreatePropertyWithHandler(MM::g_Keyword_SequenceIntervalStdDev_ms,
+         "0", MM::Float, true, &CCameraBase::OnSequenceIntervalStdDev);
+      this->CreatePropertyWithHandler(MM::g_Keyword_SequenceMaxLateness_ms,
+         "0", MM::Float, true, &CCameraBase::OnSequenceMaxLateness);
+
       thd_ = new BaseSequenceThread(this);
    }
 
@@ -1541,18 +1647,17 @@ protected:
    {
       char label[MM::MaxStrLength];
       this->GetLabel(label);
-      Metadata md;
-      md.put(MM::g_Keyword_Metadata_CameraLabel, label);
+      const MM::ImageMetadataTag tags[] = {
+         { MM::g_Keyword_Metadata_CameraLabel, 0, label },
+      };
       int ret = GetCoreCallback()->InsertImage(this, GetImageBuffer(), GetImageWidth(),
-         GetImageHeight(), GetImageBytesPerPixel(),
-         md.Serialize().c_str());
+         GetImageHeight(), GetImageBytesPerPixel(), 1, tags, 1);
       if (!stopWhenCBOverflows_ && ret == DEVICE_BUFFER_OVERFLOW)
       {
          // do not stop on overflow - just reset the buffer
          GetCoreCallback()->ClearImageBuffer(this);
          return GetCoreCallback()->InsertImage(this, GetImageBuffer(), GetImageWidth(),
-            GetImageHeight(), GetImageBytesPerPixel(),
-            md.Serialize().c_str());
+            GetImageHeight(), GetImageBytesPerPixel(), 1, tags, 1);
       } else
          return ret;
    }
@@ -1560,6 +1665,28 @@ protected:
    virtual double GetIntervalMs() {return thd_->GetIntervalMs();}
    virtual long GetImageCounter() {return thd_->GetImageCounter();}
    virtual long GetNumberOfImages() {return thd_->GetNumberOfImages();}
+   const CSequenceTimingStats& GetSequenceTimingStats() const {return thd_->GetTimingStats();}
+
+   int OnSequenceIntervalMean(MM::PropertyBase* pProp, MM::ActionType eAct)
+   {
+      if (eAct == MM::BeforeGet)
+         pProp->Set(thd_->GetTimingStats().GetMeanIntervalMs());
+      return DEVICE_OK;
+   }
+
+   int OnSequenceIntervalStdDev(MM::PropertyBase* pProp, MM::ActionType eAct)
+   {
+      if (eAct == MM::BeforeGet)
+         pProp->Set(thd_->GetTimingStats().GetIntervalStdDevMs());
+      return DEVICE_OK;
+   }
+
+   int OnSequenceMaxLateness(MM::PropertyBase* pProp, MM::ActionType eAct)
+   {
+      if (eAct == MM::BeforeGet)
+         pProp->Set(thd_->GetTimingStats().GetMaxLatenessMs());
+      return DEVICE_OK;
+   }
 
    // called from the thread function before exit
    virtual void OnThreadExiting()
@@ -1599,6 +1726,9 @@ protected:
    ////////////////////////////////////////////////////////////////////////////
 
    // Nested class for live streaming
+   // Frames are started every intervalMs_ (if positive), on a fixed schedule
+   // so that the interval does not drift. A frame that is late by more than
+   // a whole interval moves the schedule instead of causing a burst.
    ////////////////////////////////////////////////////////////////////////////
    class BaseSequenceThread : public MMDeviceThreadBase
    {
@@ -1620,17 +1750,20 @@ protected:
       ~BaseSequenceThread() {}
 
       void Stop() {
-         MMThreadGuard g(this->stopLock_);
-         stop_=true;
+         {
+            // Taking the lock ensures that a waiting svc() sees stop_
+            std::lock_guard<std::mutex> g(wakeMutex_);
+            stop_=true;
+         }
+         wakeCond_.notify_all();
       }
 
       void Start(long numImages, double intervalMs)
       {
-         MMThreadGuard g1(this->stopLock_);
-         MMThreadGuard g2(this->suspendLock_);
          numImages_=numImages;
          intervalMs_=intervalMs;
          imageCounter_=0;
+         timingStats_.Reset();
          stop_ = false;
          suspend_=false;
          activate();
@@ -1639,20 +1772,20 @@ protected:
          lastFrameTime_ = MM::MMTime{};
       }
       bool IsStopped(){
-         MMThreadGuard g(this->stopLock_);
          return stop_;
       }
       void Suspend() {
-         MMThreadGuard g(this->suspendLock_);
          suspend_ = true;
       }
       bool IsSuspended() {
-         MMThreadGuard g(this->suspendLock_);
          return suspend_;
       }
       void Resume() {
-         MMThreadGuard g(this->suspendLock_);
-         suspend_ = false;
+         {
+            std::lock_guard<std::mutex> g(wakeMutex_);
+            suspend_ = false;
+         }
+         wakeCond_.notify_all();
       }
       double GetIntervalMs(){return intervalMs_;}
       void SetLength(long images) {numImages_ = images;}
@@ -1667,14 +1800,46 @@ protected:
 
       void UpdateActualDuration() {actualDuration_ = camera_->GetCurrentMMTime() - startTime_;}
 
+      const CSequenceTimingStats& GetTimingStats() const {return timingStats_;}
+
    private:
+      // Returns false if stopped while waiting
+      bool WaitUntil(std::chrono::steady_clock::time_point deadline)
+      {
+         std::unique_lock<std::mutex> g(wakeMutex_);
+         wakeCond_.wait_until(g, deadline,
+               [this] { return stop_.load(); });
+         // While suspended, wait without a deadline
+         wakeCond_.wait(g, [this] { return stop_.load() || !suspend_.load(); });
+         return !stop_;
+      }
+
       virtual int svc()
       {
+         typedef std::chrono::steady_clock Clock;
          int ret=DEVICE_ERR;
          try
          {
+            const Clock::duration interval =
+               std::chrono::duration_cast<Clock::duration>(
+                     std::chrono::duration<double, std::milli>(intervalMs_));
+            const bool paced = interval > Clock::duration::zero();
+            Clock::time_point deadline = Clock::now();
             do
             {
+               if (paced || suspend_)
+               {
+                  if (!WaitUntil(deadline))
+                     break;
+               }
+               const Clock::time_point frameStart = Clock::now();
+               timingStats_.AddFrame(frameStart, paced ? deadline : frameStart);
+               if (paced)
+               {
+                  deadline += interval;
+                  if (deadline < frameStart) // more than an interval behind
+                     deadline = frameStart + interval;
+               }
                ret=camera_->ThreadRun();
             } while (DEVICE_OK == ret && !IsStopped() && imageCounter_++ < numImages_-1);
             if (IsStopped())
@@ -1692,14 +1857,16 @@ protected:
       double intervalMs_;
       long numImages_;
       long imageCounter_;
-      bool stop_;
-      bool suspend_;
+      std::atomic<bool> stop_;
+      std::atomic<bool> suspend_;
       CCameraBase* camera_;
       MM::MMTime startTime_;
       MM::MMTime actualDuration_;
       MM::MMTime lastFrameTime_;
-      MMThreadLock stopLock_;
-      MMThreadLock suspendLock_;
+      CSequenceTimingStats timingStats_;
+      // For waking up svc() from a wait for the next frame
+      std::mutex wakeMutex_;
+      std::condition_variable wakeCond_;
    };
    //////////////////////////////////////////////////////////////////////////
 
@@ -1,500 +1,823 @@
-///////////////////////////////////////////////////////////////////////////////
-// FILE:          ImageMetadata.h
-// PROJECT:       Micro-Manager
-// SUBSYSTEM:     MMCore
-//-----------------------------------------------------------------------------
-// DESCRIPTION:   Metadata associated with the acquired image
-//
-// AUTHOR:        Nenad Amodaj, nenad@amodaj.com, 06/07/2007
-// COPYRIGHT:     University of California, San Francisco, 2007
-//                100X Imaging Inc, 2008
-//
-// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
-//                License text is included with the source distribution.
-//
-//                This file is distributed in the hope that it will be useful,
-//                but WITHOUT ANY WARRANTY; without even the implied warranty
-//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
-//
-//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
-//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
-//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
-
-#pragma once
-
-#include "MMDeviceConstants.h"
-
-#include <string>
-#include <vector>
-#include <map>
-#include <sstream>
-#include <stdio.h>
-#include <stdlib.h>
-
-#ifdef SWIG
-#define MMDEVICE_LEGACY_THROW(ex) throw (ex)
-#else
-#define MMDEVICE_LEGACY_THROW(ex)
-#endif
-
-///////////////////////////////////////////////////////////////////////////////
-// MetadataError
-// -------------
-// Micro-Manager metadata error class, used to create exception objects
-// 
-class MetadataError
-{
-public:
-   MetadataError(const char* msg) :
-      message_(msg) {}
-
-   virtual ~MetadataError() {}
-
-   virtual std::string getMsg()
-   {
-      return message_;
-   }
-
-private:
-   std::string message_;
-};
-
-class MetadataKeyError : public MetadataError
-{
-public:
-   MetadataKeyError() :
-      MetadataError("Undefined metadata key") {}
-   ~MetadataKeyError() {}
-};
-
-class MetadataIndexError : public MetadataError
-{
-public:
-   MetadataIndexError() :
-      MetadataError("Metadata array index out of bounds") {}
-   ~MetadataIndexError() {}
-};
-
-
-class MetadataSingleTag;
-class MetadataArrayTag;
-
-/**
- * Image information tags - metadata.
- */
-class MetadataTag
-{
-public:
-   MetadataTag() : name_("undefined"), deviceLabel_("undefined"), readOnly_(false) {}
-   MetadataTag(const char* name, const char* device, bool readOnly) :
-      name_(name), deviceLabel_(device), readOnly_(readOnly) {}
-   virtual ~MetadataTag() {}
-
-   const std::string& GetDevice() const {return deviceLabel_;}
-   const std::string& GetName() const {return name_;}
-   const std::string GetQualifiedName() const
-   {
-      std::string str;
-      if (deviceLabel_.compare("_") != 0)
-      {
-         str.append(deviceLabel_).append("-");
-      }
-      str.append(name_);
-      return str;
-   }
-   bool IsReadOnly() const  {return readOnly_;}
-
-   void SetDevice(const char* device) {deviceLabel_ = device;}
-   void SetName(const char* name) {name_ = name;}
-   void SetReadOnly(bool ro) {readOnly_ = ro;}
-
-   /**
-    * Equivalent of dynamic_cast<MetadataSingleTag*>(this), but does not use
-    * RTTI. This makes it safe against multiple definitions when using 
-    * dynamic libraries on Linux (original cause: JVM uses 
-    * dlopen with RTLD_LOCAL when loading libraries.
-    */
-   virtual const MetadataSingleTag* ToSingleTag() const { return 0; }
-   /**
-    * Equivalent of dynamic_cast<MetadataArrayTag*>(this), but does not use
-    * RTTI. @see ToSingleTag
-    */
-   virtual const MetadataArrayTag*  ToArrayTag()  const { return 0; }
-
-   //inline  MetadataSingleTag* ToSingleTag() {
-   //   const MetadataTag *p = this;
-   //   return const_cast<MetadataSingleTag*>(p->ToSingleTag());
-   //  }
-   //inline  MetadataArrayTag* ToArrayTag() {
-   //   const MetadataTag *p = this;
-   //   return const_cast<MetadataArrayTag*>(p->ToArrayTag());
-   //}
-
-   virtual MetadataTag* Clone() = 0;
-   virtual std::string Serialize() = 0;
-   virtual bool Restore(const char* stream) = 0;
-   virtual bool Restore(std::istringstream& is) = 0;
-
-   static std::string ReadLine(std::istringstream& is)
-   {
-      std::string ret;
-      std::getline(is, ret);
-      return ret;
-   }
-
-private:
-   std::string name_;
-   std::string deviceLabel_;
-   bool readOnly_;
-};
-
-class MetadataSingleTag : public MetadataTag
-{
-public:
-   MetadataSingleTag() {}
-   MetadataSingleTag(const char* name, const char* device, bool readOnly) :
-      MetadataTag(name, device, readOnly) {}
-   ~MetadataSingleTag() {}
-
-   const std::string& GetValue() const {return value_;}
-   void SetValue(const char* val) {value_ = val;}
-
-   virtual const MetadataSingleTag* ToSingleTag() const { return this; }
-
-   MetadataTag* Clone()
-   {
-      return new MetadataSingleTag(*this);
-   }
-
-   std::string Serialize()
-   {
-      std::string str;
-
-      str.append(GetName()).append("\n");
-      str.append(GetDevice()).append("\n");
-      str.append(IsReadOnly() ? "1" : "0").append("\n");
-
-      str.append(value_).append("\n");
-
-      return str;
-   }
-
-   bool Restore(const char* stream)
-   {
-      std::istringstream is(stream);
-      return Restore(is);
-   }
-
-   bool Restore(std::istringstream& is)
-   {
-      SetName(ReadLine(is).c_str());
-      SetDevice(ReadLine(is).c_str());
-      SetReadOnly(atoi(ReadLine(is).c_str()) != 0);
-
-      value_ = ReadLine(is);
-
-      return true;
-   }
-
-private:
-   std::string value_;
-};
-
-class MetadataArrayTag : public MetadataTag
-{
-public:
-   MetadataArrayTag() {}
-   MetadataArrayTag(const char* name, const char* device, bool readOnly) :
-      MetadataTag(name, device, readOnly) {}
-   ~MetadataArrayTag() {}
-
-   virtual const MetadataArrayTag* ToArrayTag() const { return this; }
-
-   void AddValue(const char* val) {values_.push_back(val);}
-   void SetValue(const char* val, size_t idx)
-   {
-      if (values_.size() < idx+1)
-         values_.resize(idx+1);
-      values_[idx] = val;
-   }
-
-   const std::string& GetValue(size_t idx) const {
-      if (idx >= values_.size())
-         throw MetadataIndexError();
-      return values_[idx];
-   }
-
-   size_t GetSize() const {return values_.size();}
-
-   MetadataTag* Clone()
-   {
-      return new MetadataArrayTag(*this);
-   }
-
-   std::string Serialize()
-   {
-      std::string str;
-
-      str.append(GetName()).append("\n");
-      str.append(GetDevice()).append("\n");
-      str.append(IsReadOnly() ? "1" : "0").append("\n");
-
-      std::stringstream os;
-      os << values_.size();
-      str.append(os.str()).append("\n");
-
-      for (size_t i = 0; i < values_.size(); i++)
-         str.append(values_[i]).append("\n");
-
-      return str;
-   }
-
-   bool Restore(const char* stream)
-   {
-      std::istringstream is(stream);
-      return Restore(is);
-   }
-
-   bool Restore(std::istringstream& is)
-   {
-      SetName(ReadLine(is).c_str());
-      SetDevice(ReadLine(is).c_str());
-      SetReadOnly(atoi(ReadLine(is).c_str()) != 0);
-
-      size_t size = atol(ReadLine(is).c_str());
-
-      values_.resize(size);
-
-      for (size_t i = 0; i < size; i++)
-         values_[i] = ReadLine(is);
-
-      return true;
-   }
-
-private:
-   std::vector<std::string> values_;
-};
-
-/**
- * Container for all metadata associated with a single image.
- */
-class Metadata
-{
-public:
-
-   Metadata() {} // empty constructor
-
-   ~Metadata() // destructor
-   {
-      Clear();
-   }
-
-   Metadata(const Metadata& original) // copy constructor
-   {
-      for (TagConstIter it = original.tags_.begin(); it != original.tags_.end(); it++)
-      {
-         SetTag(*it->second);
-      }
-   }
-
-   void Clear()
-   {
-      for (TagConstIter it=tags_.begin(); it != tags_.end(); it++)
-         delete it->second;
-      tags_.clear();
-   }
-
-   std::vector<std::string> GetKeys() const
-   {
-      std::vector<std::string> keyList;
-      for (TagConstIter it = tags_.begin(), end = tags_.end(); it != end; ++it)
-         keyList.push_back(it->first);
-      return keyList;
-   }
-
-   bool HasTag(const char* key)
-   {
-      TagConstIter it = tags_.find(key);
-      if (it != tags_.end())
-         return true;
-      else
-         return false;
-   }
-
-   MetadataSingleTag GetSingleTag(const char* key) const MMDEVICE_LEGACY_THROW(MetadataKeyError)
-   {
-      MetadataTag* tag = FindTag(key);
-      const MetadataSingleTag* stag = tag->ToSingleTag();
-      return *stag;
-   }
-
-   MetadataArrayTag GetArrayTag(const char* key) const MMDEVICE_LEGACY_THROW(MetadataKeyError)
-   {
-      MetadataTag* tag = FindTag(key);
-      const MetadataArrayTag* atag = tag->ToArrayTag();
-      return *atag;
-   }
-
-   void SetTag(MetadataTag& tag)
-   {
-      MetadataTag* newTag = tag.Clone();
-      const std::string key(tag.GetQualifiedName());
-      RemoveTag(key.c_str());
-      tags_[key] = newTag;
-   }
-
-   void RemoveTag(const char* key)
-   {
-      TagIter it = tags_.find(key);
-      if (it != tags_.end())
-      {
-         delete it->second;
-         tags_.erase(it); // Non-const iterator needed in pre-C++11 code
-      }
-   }
-
-   /*
-    * Convenience method to add a MetadataSingleTag
-    */
-   template <class anytype>
-   void PutTag(std::string key, std::string deviceLabel, anytype value)
-   {
-      std::stringstream os;
-      os << value;
-      MetadataSingleTag* newTag = new MetadataSingleTag(key.c_str(), deviceLabel.c_str(), true);
-      newTag->SetValue(os.str().c_str());
-      tags_[newTag->GetQualifiedName()] = newTag;
-   }
-
-   /*
-    * Add a tag not associated with any device.
-    */
-   template <class anytype>
-   void PutImageTag(std::string key, anytype value)
-   {
-      PutTag(key, "_", value);
-   }
-
-   /*
-    * Deprecated name. Equivalent to PutImageTag.
-    */
-   template <class anytype>
-   void put(std::string key, anytype value)
-   {
-      PutImageTag(key, value);
-   }
-
-#ifndef SWIG
-   Metadata& operator=(const Metadata& rhs)
-   {
-      Clear();
-      
-      for (TagConstIter it=rhs.tags_.begin(); it != rhs.tags_.end(); it++)
-      {
-         SetTag(*it->second);
-      }
-
-      return *this;
-   }
-#endif
-
-   void Merge(const Metadata& newTags)
-   {     
-      for (TagConstIter it=newTags.tags_.begin(); it != newTags.tags_.end(); it++)
-      {
-         SetTag(*it->second);
-      }
-   }
-
-   std::string Serialize() const
-   {
-      std::string str;
-
-      std::ostringstream os;
-      os << tags_.size();
-      str.append(os.str()).append("\n");
-
-      for (TagConstIter it = tags_.begin(); it != tags_.end(); it++)
-      {
-         const std::string id((it->second->ToArrayTag()) ? "a" : "s");
-         str.append(id).append("\n");
-
-         str.append(it->second->Serialize());
-      }
-
-      return str;
-   }
-
-   // TODO: Can this be removed?
-   std::string readLine(std::istringstream &iss)
-   {
-      return MetadataTag::ReadLine(iss);
-   }
-
-   bool Restore(const char* stream)
-   {
-      Clear();
-      if (stream == nullptr)
-      {
-         return true;
-      }
-
-      std::istringstream is(stream);
-
-      const size_t sz = atol(readLine(is).c_str());
-
-      for (size_t i=0; i<sz; i++)
-      {
-         const std::string id(readLine(is));
-
-         MetadataTag* newTag;
-         if (id.compare("s") == 0)
-         {
-            newTag = new MetadataSingleTag();
-         }
-         else if (id.compare("a") == 0)
-         {
-            newTag = new MetadataArrayTag();
-         }
-         else
-         {
-            return false;
-         }
-
-         newTag->Restore(is);
-         tags_[newTag->GetQualifiedName()] = newTag;
-      }
-      return true;
-   }
-
-   std::string Dump()
-   {
-      std::ostringstream os;
-
-      os << tags_.size();
-      for (TagConstIter it = tags_.begin(); it != tags_.end(); it++)
-      {
-         std::string id("s");
-         if (it->second->ToArrayTag())
-            id = "a";
-         std::string ser = it->second->Serialize();
-         os << id << " : " << ser << '\n';
-      }
-
-      return os.str();
-   }
-
-private:
-   MetadataTag* FindTag(const char* key) const
-   {
-      TagConstIter it = tags_.find(key);
-      if (it != tags_.end())
-         return it->second;
-      else
-         throw MetadataKeyError();
-   }
-
-   std::map<std::string, MetadataTag*> tags_;
-   typedef std::map<std::string, MetadataTag*>::iterator TagIter;
-   typedef std::map<std::string, MetadataTag*>::const_iterator TagConstIter;
-};
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ImageMetadata.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Metadata associated with the acquired image
+//
+// AUTHOR:        Nenad Amodaj, nenad@amodaj.com, 06/07/2007
+// COPYRIGHT:     University of California, San Francisco, 2007
+//                100X Imaging Inc, 2008
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "MMDeviceConstants.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef SWIG
+#define MMDEVICE_LEGACY_THROW(ex) throw (ex)
+#else
+#define MMDEVICE_LEGACY_THROW(ex)
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// MetadataError
+// -------------
+// Micro-Manager metadata error class, used to create exception objects
+// 
+class MetadataError
+{
+public:
+   MetadataError(const char* msg) :
+      message_(msg) {}
+
+   virtual ~MetadataError() {}
+
+   virtual std::string getMsg()
+   {
+      return message_;
+   }
+
+private:
+   std::string message_;
+};
+
+class MetadataKeyError : public MetadataError
+{
+public:
+   MetadataKeyError() :
+      MetadataError("Undefined metadata key") {}
+   ~MetadataKeyError() {}
+};
+
+class MetadataIndexError : public MetadataError
+{
+public:
+   MetadataIndexError() :
+      MetadataError("Metadata array index out of bounds") {}
+   ~MetadataIndexError() {}
+};
+
+
+class MetadataSingleTag;
+class MetadataArrayTag;
+
+/**
+ * Image information tags - metadata.
+ */
+class MetadataTag
+{
+public:
+   MetadataTag() : name_("undefined"), deviceLabel_("undefined"), readOnly_(false) {}
+   MetadataTag(const char* name, const char* device, bool readOnly) :
+      name_(name), deviceLabel_(device), readOnly_(readOnly) {}
+   virtual ~MetadataTag() {}
+
+   const std::string& GetDevice() const {return deviceLabel_;}
+   const std::string& GetName() const {return name_;}
+   const std::string GetQualifiedName() const
+   {
+      std::string str;
+      if (deviceLabel_.compare("_") != 0)
+      {
+         str.append(deviceLabel_).append("-");
+      }
+      str.append(name_);
+      return str;
+   }
+   bool IsReadOnly() const  {return readOnly_;}
+
+   void SetDevice(const char* device) {deviceLabel_ = device;}
+   void SetName(const char* name) {name_ = name;}
+   void SetReadOnly(bool ro) {readOnly_ = ro;}
+
+   /**
+    * Equivalent of dynamic_cast<MetadataSingleTag*>(this), but does not use
+    * RTTI. This makes it safe against multiple definitions when using 
+    * dynamic libraries on Linux (original cause: JVM uses 
+    * dlopen with RTLD_LOCAL when loading libraries.
+    */
+   virtual const MetadataSingleTag* ToSingleTag() const { return 0; }
+   /**
+    * Equivalent of dynamic_cast<MetadataArrayTag*>(this), but does not use
+    * RTTI. @see ToSingleTag
+    */
+   virtual const MetadataArrayTag*  ToArrayTag()  const { return 0; }
+
+   //inline  MetadataSingleTag* ToSingleTag() {
+   //   const MetadataTag *p = this;
+   //   return const_cast<MetadataSingleTag*>(p->ToSingleTag());
+   //  }
+   //inline  MetadataArrayTag* ToArrayTag() {
+   //   const MetadataTag *p = this;
+   //   return const_cast<MetadataArrayTag*>(p->ToArrayTag());
+   //}
+
+   virtual MetadataTag* Clone() = 0;
+   virtual std::string Serialize() = 0;
+   virtual bool Restore(const char* stream) = 0;
+   virtual bool Restore(std::istringstream& is) = 0;
+
+   static std::string ReadLine(std::istringstream& is)
+   {
+      std::string ret;
+      std::getline(is, ret);
+      return ret;
+   }
+
+private:
+   std::string name_;
+   std::string deviceLabel_;
+   bool readOnly_;
+};
+
+class MetadataSingleTag : public MetadataTag
+{
+public:
+   MetadataSingleTag() {}
+   MetadataSingleTag(const char* name, const char* device, bool readOnly) :
+      MetadataTag(name, device, readOnly) {}
+   ~MetadataSingleTag() {}
+
+   const std::string& GetValue() const {return value_;}
+   void SetValue(const char* val) {value_ = val;}
+
+   virtual const MetadataSingleTag* ToSingleTag() const { return this; }
+
+   MetadataTag* Clone()
+   {
+      return new MetadataSingleTag(*this);
+   }
+
+   std::string Serialize()
+   {
+      std::string str;
+
+      str.append(GetName()).append("\n");
+      str.append(GetDevice()).append("\n");
+      str.append(IsReadOnly() ? "1" : "0").append("\n");
+
+      str.append(value_).append("\n");
+
+      return str;
+   }
+
+   bool Restore(const char* stream)
+   {
+      std::istringstream is(stream);
+      return Restore(is);
+   }
+
+   bool Restore(std::istringstream& is)
+   {
+      SetName(ReadLine(is).c_str());
+      SetDevice(ReadLine(is).c_str());
+      SetReadOnly(atoi(ReadLine(is).c_str()) != 0);
+
+      value_ = ReadLine(is);
+
+      return true;
+   }
+
+private:
+   std::string value_;
+};
+
+class MetadataArrayTag : public MetadataTag
+{
+public:
+   MetadataArrayTag() {}
+   MetadataArrayTag(const char* name, const char* device, bool readOnly) :
+      MetadataTag(name, device, readOnly) {}
+   ~MetadataArrayTag() {}
+
+   virtual const MetadataArrayTag* ToArrayTag() const { return this; }
+
+   void AddValue(const char* val) {values_.push_back(val);}
+   void SetValue(const char* val, size_t idx)
+   {
+      if (values_.size() < idx+1)
+         values_.resize(idx+1);
+      values_[idx] = val;
+   }
+
+   const std::string& GetValue(size_t idx) const {
+      if (idx >= values_.size())
+         throw MetadataIndexError();
+      return values_[idx];
+   }
+
+   size_t GetSize() const {return values_.size();}
+
+   MetadataTag* Clone()
+   {
+      return new MetadataArrayTag(*this);
+   }
+
+   std::string Serialize()
+   {
+      std::string str;
+
+      str.append(GetName()).append("\n");
+      str.append(GetDevice()).append("\n");
+      str.append(IsReadOnly() ? "1" : "0").append("\n");
+
+      std::stringstream os;
+      os << values_.size();
+      str.append(os.str()).append("\n");
+
+      for (size_t i = 0; i < values_.size(); i++)
+         str.append(values_[i]).append("\n");
+
+      return str;
+   }
+
+   bool Restore(const char* stream)
+   {
+      std::istringstream is(stream);
+      return Restore(is);
+   }
+
+   bool Restore(std::istringstream& is)
+   {
+      SetName(ReadLine(is).c_str());
+      SetDevice(ReadLine(is).c_str());
+      SetReadOnly(atoi(ReadLine(is).c_str()) != 0);
+
+      size_t size = atol(ReadLine(is).c_str());
+
+      values_.resize(size);
+
+      for (size_t i = 0; i < size; i++)
+         values_[i] = ReadLine(is);
+
+      return true;
+   }
+
+private:
+   std::vector<std::string> values_;
+};
+
+/**
+ * Container for all metadata associated with a single image.
+ *
+ * The tags are stored in one block, sorted by qualified name, with all names
+ * and values in a single character buffer (each device label is stored only
+ * once per block). Copies share the block, which is only duplicated when a
+ * shared copy is modified; copying metadata therefore does not allocate.
+ */
+class Metadata
+{
+public:
+
+   Metadata() : block_(0) {} // empty constructor
+
+   ~Metadata() // destructor
+   {
+      Release();
+   }
+
+   Metadata(const Metadata& original) : // copy constructor
+      block_(original.block_)
+   {
+      if (block_)
+         ++block_->refCount;
+   }
+
+   void Clear()
+   {
+      Release();
+   }
+
+   std::vector<std::string> GetKeys() const
+   {
+      std::vector<std::string> keyList;
+      if (block_)
+      {
+         keyList.reserve(block_->entries.size());
+         for (std::size_t i = 0; i < block_->entries.size(); ++i)
+            keyList.push_back(block_->Key(block_->entries[i]));
+      }
+      return keyList;
+   }
+
+   bool HasTag(const char* key) const
+   {
+      return Find(key) != 0;
+   }
+
+   MetadataSingleTag GetSingleTag(const char* key) const MMDEVICE_LEGACY_THROW(MetadataKeyError)
+   {
+      const Entry& entry = FindTag(key);
+      if (entry.isArray)
+         throw MetadataKeyError();
+      MetadataSingleTag tag(block_->Name(entry).c_str(), block_->Device(entry),
+            entry.readOnly);
+      tag.SetValue(block_->Value(entry, 0));
+      return tag;
+   }
+
+   MetadataArrayTag GetArrayTag(const char* key) const MMDEVICE_LEGACY_THROW(MetadataKeyError)
+   {
+      const Entry& entry = FindTag(key);
+      if (!entry.isArray)
+         throw MetadataKeyError();
+      MetadataArrayTag tag(block_->Name(entry).c_str(), block_->Device(entry),
+            entry.readOnly);
+      for (std::uint32_t i = 0; i < entry.numValues; ++i)
+         tag.AddValue(block_->Value(entry, i));
+      return tag;
+   }
+
+   void SetTag(MetadataTag& tag)
+   {
+      const std::string& name = tag.GetName();
+      const std::string& device = tag.GetDevice();
+      if (const MetadataSingleTag* stag = tag.ToSingleTag())
+      {
+         const std::string& value = stag->GetValue();
+         const StringRef ref = { value.c_str(), value.size() };
+         AddTag(name.c_str(), name.size(), device.c_str(), device.size(),
+               tag.IsReadOnly(), false, &ref, 1);
+      }
+      else if (const MetadataArrayTag* atag = tag.ToArrayTag())
+      {
+         std::vector<StringRef> refs(atag->GetSize());
+         for (std::size_t i = 0; i < refs.size(); ++i)
+         {
+            refs[i].str = atag->GetValue(i).c_str();
+            refs[i].len = atag->GetValue(i).size();
+         }
+         AddTag(name.c_str(), name.size(), device.c_str(), device.size(),
+               tag.IsReadOnly(), true, refs.empty() ? 0 : &refs[0], refs.size());
+      }
+   }
+
+   void RemoveTag(const char* key)
+   {
+      if (!Find(key))
+         return;
+      Block* block = MakeMutable();
+      std::vector<Entry>::iterator it = block->LowerBound(key);
+      block->Discard(*it);
+      block->entries.erase(it);
+   }
+
+   /*
+    * Convenience method to add a MetadataSingleTag
+    */
+   template <class anytype>
+   void PutTag(std::string key, std::string deviceLabel, anytype value)
+   {
+      std::stringstream os;
+      os << value;
+      const std::string str = os.str();
+      const StringRef ref = { str.c_str(), str.size() };
+      AddTag(key.c_str(), key.size(), deviceLabel.c_str(), deviceLabel.size(),
+            true, false, &ref, 1);
+   }
+
+   /*
+    * Add a tag not associated with any device.
+    */
+   template <class anytype>
+   void PutImageTag(std::string key, anytype value)
+   {
+      PutTag(key, "_", value);
+   }
+
+   /*
+    * Deprecated name. Equivalent to PutImageTag.
+    */
+   template <class anytype>
+   void put(std::string key, anytype value)
+   {
+      PutImageTag(key, value);
+   }
+
+#ifndef SWIG
+   Metadata& operator=(const Metadata& rhs)
+   {
+      if (rhs.block_)
+         ++rhs.block_->refCount;
+      Release();
+      block_ = rhs.block_;
+      return *this;
+   }
+#endif
+
+   void Merge(const Metadata& newTags)
+   {     
+      if (!newTags.block_ || newTags.block_ == block_)
+         return;
+      if (!block_ || block_->entries.empty())
+      {
+         *this = newTags;
+         return;
+      }
+
+      // Hold a reference, in case our block is modified in place
+      const Metadata source(newTags);
+      AddTags(*source.block_);
+   }
+
+   std::string Serialize() const
+   {
+      std::string str;
+      if (!block_)
+         return "0\n";
+
+      str.reserve(16 + block_->chars.size() + 8 * block_->entries.size());
+      str.append(std::to_string(block_->entries.size())).append("\n");
+
+      for (std::size_t i = 0; i < block_->entries.size(); ++i)
+      {
+         const Entry& entry = block_->entries[i];
+         str.append(entry.isArray ? "a" : "s").append("\n");
+         SerializeEntry(str, entry);
+      }
+
+      return str;
+   }
+
+   // TODO: Can this be removed?
+   std::string readLine(std::istringstream &iss)
+   {
+      return MetadataTag::ReadLine(iss);
+   }
+
+   bool Restore(const char* stream)
+   {
+      Clear();
+      if (stream == nullptr)
+      {
+         return true;
+      }
+
+      const char* p = stream;
+      StringRef line = ReadLine(p);
+      const std::size_t sz = static_cast<std::size_t>(ParseLong(line));
+
+      std::vector<StringRef> refs;
+      for (size_t i=0; i<sz; i++)
+      {
+         line = ReadLine(p);
+         bool isArray;
+         if (line.len == 1 && line.str[0] == 's')
+         {
+            isArray = false;
+         }
+         else if (line.len == 1 && line.str[0] == 'a')
+         {
+            isArray = true;
+         }
+         else
+         {
+            return false;
+         }
+
+         const StringRef name = ReadLine(p);
+         const StringRef device = ReadLine(p);
+         const bool readOnly = ParseLong(ReadLine(p)) != 0;
+         std::size_t numValues = 1;
+         if (isArray)
+            numValues = static_cast<std::size_t>(ParseLong(ReadLine(p)));
+
+         refs.resize(numValues);
+         for (std::size_t j = 0; j < numValues; ++j)
+            refs[j] = ReadLine(p);
+
+         AddTag(name.str, name.len, device.str, device.len, readOnly, isArray,
+               refs.empty() ? 0 : &refs[0], numValues);
+      }
+      return true;
+   }
+
+   std::string Dump()
+   {
+      std::ostringstream os;
+
+      os << (block_ ? block_->entries.size() : 0);
+      if (block_)
+      {
+         for (std::size_t i = 0; i < block_->entries.size(); ++i)
+         {
+            const Entry& entry = block_->entries[i];
+            std::string ser;
+            SerializeEntry(ser, entry);
+            os << (entry.isArray ? "a" : "s") << " : " << ser << '\n';
+         }
+      }
+
+      return os.str();
+   }
+
+#ifndef SWIG
+private:
+   struct StringRef
+   {
+      const char* str;
+      std::size_t len;
+   };
+
+   // Offset and length of a null-terminated string in Block::chars
+   struct CharRange
+   {
+      std::uint32_t offset;
+      std::uint32_t len;
+   };
+
+   struct Entry
+   {
+      std::uint32_t key; // Qualified name, "device-name" or "name"
+      std::uint32_t keyLen;
+      std::uint32_t nameLen; // The name is the tail of the qualified name
+      std::uint32_t device;
+      std::uint32_t deviceLen;
+      std::uint32_t firstValue; // Index into Block::values
+      std::uint32_t numValues;
+      bool isArray;
+      bool readOnly;
+   };
+
+   // A Metadata object may be copied between modules (MMCore and device
+   // adapters) that do not share a heap, so a block is only freed or grown
+   // by code of the module that allocated it
+   struct Block
+   {
+      Block() : refCount(1), unusedChars(0), destroy(&Destroy) {}
+      Block(const Block& other) :
+         refCount(1),
+         chars(other.chars),
+         entries(other.entries),
+         values(other.values),
+         unusedChars(other.unusedChars),
+         destroy(&Destroy)
+      {}
+
+      std::atomic<int> refCount;
+      std::vector<char> chars;
+      std::vector<Entry> entries; // Sorted by qualified name
+      std::vector<CharRange> values;
+      std::size_t unusedChars; // Left behind by replaced or removed tags
+      void (*destroy)(Block*); // Destroy() of the allocating module
+
+      // Each module has its own copy of this function
+      static void Destroy(Block* block) { delete block; }
+      bool IsLocal() const { return destroy == &Destroy; }
+
+      const char* Key(const Entry& entry) const { return &chars[entry.key]; }
+      const char* Device(const Entry& entry) const { return &chars[entry.device]; }
+      std::string Name(const Entry& entry) const
+      {
+         return std::string(Key(entry) + (entry.keyLen - entry.nameLen), entry.nameLen);
+      }
+      const char* Value(const Entry& entry, std::uint32_t i) const
+      {
+         return &chars[values[entry.firstValue + i].offset];
+      }
+
+      std::vector<Entry>::iterator LowerBound(const char* key)
+      {
+         return std::lower_bound(entries.begin(), entries.end(), key,
+               KeyLess(&chars[0]));
+      }
+
+      std::vector<Entry>::const_iterator LowerBound(const char* key) const
+      {
+         return std::lower_bound(entries.begin(), entries.end(), key,
+               KeyLess(chars.empty() ? 0 : &chars[0]));
+      }
+
+      std::uint32_t Append(const char* str, std::size_t len)
+      {
+         const std::uint32_t offset = static_cast<std::uint32_t>(chars.size());
+         chars.insert(chars.end(), str, str + len);
+         chars.push_back('\0');
+         return offset;
+      }
+
+      // Return the offset of an existing copy of the device label, if any
+      std::uint32_t InternDevice(const char* device, std::size_t len)
+      {
+         for (std::size_t i = 0; i < entries.size(); ++i)
+         {
+            const Entry& entry = entries[i];
+            if (entry.deviceLen == len &&
+                  std::memcmp(&chars[entry.device], device, len) == 0)
+               return entry.device;
+         }
+         return Append(device, len);
+      }
+
+      // Account for the characters of an entry that is about to be dropped
+      // (device labels are shared, so are not counted)
+      void Discard(const Entry& entry)
+      {
+         unusedChars += entry.keyLen + 1;
+         for (std::uint32_t i = 0; i < entry.numValues; ++i)
+            unusedChars += values[entry.firstValue + i].len + 1;
+      }
+   };
+
+   struct KeyLess
+   {
+      explicit KeyLess(const char* chars) : chars_(chars) {}
+      bool operator()(const Entry& entry, const char* key) const
+      {
+         return std::strcmp(chars_ + entry.key, key) < 0;
+      }
+      const char* chars_;
+   };
+
+   static StringRef ReadLine(const char*& p)
+   {
+      StringRef line = { p, 0 };
+      const char* newline = std::strchr(p, '\n');
+      if (newline)
+      {
+         line.len = newline - p;
+         p = newline + 1;
+      }
+      else
+      {
+         line.len = std::strlen(p);
+         p += line.len;
+      }
+      return line;
+   }
+
+   // Same result as atol() on the line
+   static long ParseLong(const StringRef& line)
+   {
+      std::size_t i = 0;
+      while (i < line.len && std::isspace(static_cast<unsigned char>(line.str[i])))
+         ++i;
+      bool negative = false;
+      if (i < line.len && (line.str[i] == '-' || line.str[i] == '+'))
+         negative = (line.str[i++] == '-');
+      long value = 0;
+      for (; i < line.len && line.str[i] >= '0' && line.str[i] <= '9'; ++i)
+         value = value * 10 + (line.str[i] - '0');
+      return negative ? -value : value;
+   }
+
+   void Release()
+   {
+      if (block_ && --block_->refCount == 0)
+         block_->destroy(block_);
+      block_ = 0;
+   }
+
+   // Return a block that is not shared with other Metadata objects and was
+   // allocated by this module
+   Block* MakeMutable()
+   {
+      if (!block_)
+      {
+         block_ = new Block();
+      }
+      else if (block_->refCount.load() > 1 || !block_->IsLocal())
+      {
+         Block* copy = new Block(*block_);
+         Release();
+         block_ = copy;
+      }
+      return block_;
+   }
+
+   const Entry* Find(const char* key) const
+   {
+      if (!block_)
+         return 0;
+      std::vector<Entry>::const_iterator it = block_->LowerBound(key);
+      if (it != block_->entries.end() && std::strcmp(block_->Key(*it), key) == 0)
+         return &*it;
+      return 0;
+   }
+
+   const Entry& FindTag(const char* key) const
+   {
+      const Entry* entry = Find(key);
+      if (!entry)
+         throw MetadataKeyError();
+      return *entry;
+   }
+
+   void AddTag(const char* name, std::size_t nameLen,
+         const char* device, std::size_t deviceLen, bool readOnly, bool isArray,
+         const StringRef* values, std::size_t numValues)
+   {
+      Block* block = MakeMutable();
+      if (block->unusedChars > 4096 && block->unusedChars > block->chars.size() / 2)
+      {
+         Compact();
+         block = block_;
+      }
+
+      Entry entry;
+      entry.device = block->InternDevice(device, deviceLen);
+      entry.deviceLen = static_cast<std::uint32_t>(deviceLen);
+      entry.nameLen = static_cast<std::uint32_t>(nameLen);
+      if (deviceLen == 1 && device[0] == '_')
+      {
+         entry.key = block->Append(name, nameLen);
+         entry.keyLen = entry.nameLen;
+      }
+      else
+      {
+         entry.key = block->Append(device, deviceLen);
+         block->chars.back() = '-';
+         block->chars.insert(block->chars.end(), name, name + nameLen);
+         block->chars.push_back('\0');
+         entry.keyLen = static_cast<std::uint32_t>(deviceLen + 1 + nameLen);
+      }
+      entry.firstValue = static_cast<std::uint32_t>(block->values.size());
+      entry.numValues = static_cast<std::uint32_t>(numValues);
+      entry.isArray = isArray;
+      entry.readOnly = readOnly;
+      for (std::size_t i = 0; i < numValues; ++i)
+      {
+         CharRange value;
+         value.offset = block->Append(values[i].str, values[i].len);
+         value.len = static_cast<std::uint32_t>(values[i].len);
+         block->values.push_back(value);
+      }
+
+      std::vector<Entry>::iterator it = block->LowerBound(&block->chars[entry.key]);
+      if (it != block->entries.end() &&
+            std::strcmp(block->Key(*it), block->Key(entry)) == 0)
+      {
+         block->Discard(*it);
+         *it = entry;
+      }
+      else
+      {
+         block->entries.insert(it, entry);
+      }
+   }
+
+   void AddTags(const Block& src)
+   {
+      std::vector<StringRef> refs;
+      for (std::size_t i = 0; i < src.entries.size(); ++i)
+      {
+         const Entry& entry = src.entries[i];
+         refs.resize(entry.numValues);
+         for (std::uint32_t j = 0; j < entry.numValues; ++j)
+         {
+            refs[j].str = src.Value(entry, j);
+            refs[j].len = src.values[entry.firstValue + j].len;
+         }
+         const char* name = src.Key(entry) + (entry.keyLen - entry.nameLen);
+         AddTag(name, entry.nameLen, src.Device(entry), entry.deviceLen,
+               entry.readOnly, entry.isArray, refs.empty() ? 0 : &refs[0],
+               entry.numValues);
+      }
+   }
+
+   // Rebuild the block without the characters of replaced or removed tags
+   void Compact()
+   {
+      const Metadata old(*this);
+      Release();
+      block_ = new Block();
+      AddTags(*old.block_);
+   }
+
+   void SerializeEntry(std::string& str, const Entry& entry) const
+   {
+      str.append(block_->Key(entry) + (entry.keyLen - entry.nameLen), entry.nameLen).append("\n");
+      str.append(block_->Device(entry), entry.deviceLen).append("\n");
+      str.append(entry.readOnly ? "1" : "0").append("\n");
+      if (entry.isArray)
+         str.append(std::to_string(entry.numValues)).append("\n");
+      for (std::uint32_t i = 0; i < entry.numValues; ++i)
+         str.append(block_->Value(entry, i), block_->values[entry.firstValue + i].len).append("\n");
+   }
+
+   Block* block_;
+#endif
+};
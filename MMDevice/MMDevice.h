@@ -28,7 +28,7 @@
 // Header version
 // If any of the class definitions changes, the interface version
 // must be incremented
-#define DEVICE_INTERFACE_VERSION 73
+#define DEVICE_INTERFACE_VERSION 77
 ///////////////////////////////////////////////////////////////////////////////
 
 // N.B.
@@ -205,6 +205,19 @@ namespace MM {
    };
 
 
+   /**
+    * A single image metadata tag, passed to MM::Core::InsertImage() without
+    * serializing the whole metadata to text. The strings are only read
+    * during the call and may point to storage owned by the device.
+    */
+   struct ImageMetadataTag
+   {
+      const char* key;
+      const char* deviceLabel; // null for tags not tied to a device ("_")
+      const char* value;
+   };
+
+
    /**
     * Generic device interface.
     */
@@ -1576,6 +1589,18 @@ namespace MM {
        * Magnifiers can use this to signal changes in magnification
        */
       virtual int OnMagnifierChanged(const Device* caller) = 0;
+      /**
+       * Devices that know when they stop being busy (e.g. a stage that has
+       * finished moving) can call this with busy == false at that moment, so
+       * that the Core can stop waiting immediately instead of polling
+       * Busy(). Calling it with busy == true is optional.
+       *
+       * Once a device has called this, the Core relies on the notification
+       * (polling Busy() only rarely), so it must be called every time the
+       * device stops being busy. Busy() must already return false when it
+       * is called. It may be called from any thread.
+       */
+      virtual int OnBusyChanged(const Device* caller, bool busy) = 0;
 
       // Deprecated: Return value overflows in ~72 minutes on Windows.
       // Prefer std::chrono::steady_clock for time delta measurements.
@@ -1615,6 +1640,16 @@ namespace MM {
        */
       virtual int InsertImage(const Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const char* serializedMetadata, const bool doProcess = true) = 0;
 
+      /**
+       * Same as the overload taking serializedMetadata, but with the
+       * metadata given as an array of numTags single-valued tags. This
+       * avoids formatting and parsing the metadata text for every frame.
+       *
+       * tags may be null if numTags is 0. Tags with the same key (and
+       * device label) replace earlier ones.
+       */
+      virtual int InsertImage(const Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const ImageMetadataTag* tags, unsigned numTags, const bool doProcess = true) = 0;
+
       /// \deprecated Use the other overloads instead.
       MM_DEPRECATED(virtual int InsertImage(const Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const Metadata* md = 0, const bool doProcess = true)) = 0;
       // TODO Upon removing the above deprecated overload, add a default
@@ -1628,6 +1663,43 @@ namespace MM {
        */
       virtual int InsertImage(const Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const char* serializedMetadata, const bool doProcess = true) = 0;
 
+      /**
+       * Zero-copy alternative to InsertImage(): obtain writable memory in the
+       * Core's sequence buffer for the next frame, so that the camera can
+       * write (e.g., DMA or decode) the frame directly into it.
+       *
+       * width, height, byteDepth, nComponents: as for InsertImage()
+       *
+       * On success, *pixels points to width * height * byteDepth bytes that
+       * the camera may write until it calls CommitImageWriteSlot() (to
+       * insert the frame) or AbandonImageWriteSlot() (to give the slot back).
+       * The slot belongs to the calling device; calling this function again
+       * before then returns the same slot. Only one slot is reserved at a
+       * time, so other cameras' insertions wait until it is given back.
+       * Inserting an image with InsertImage() gives back the caller's slot,
+       * and clearing or re-initializing the buffer cancels it (the commit
+       * then fails).
+       *
+       * Returns DEVICE_BUFFER_OVERFLOW if the buffer is full (handle as for
+       * InsertImage(), except that there is no doProcess argument to clear)
+       * and DEVICE_INCOMPATIBLE_IMAGE if the image format does not match the
+       * buffer.
+       */
+      virtual int AcquireImageWriteSlot(const Device* caller, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, unsigned char** pixels) = 0;
+      /**
+       * Insert the frame written into the slot obtained from
+       * AcquireImageWriteSlot(). The image processor, if any, is applied to
+       * the slot in place.
+       *
+       * serializedMetadata: as for InsertImage(); may be null
+       */
+      virtual int CommitImageWriteSlot(const Device* caller, const char* serializedMetadata) = 0;
+      /**
+       * Give back the slot obtained from AcquireImageWriteSlot() without
+       * inserting a frame (e.g., when the camera failed to fill it).
+       */
+      virtual void AbandonImageWriteSlot(const Device* caller) = 0;
+
       virtual void ClearImageBuffer(const Device* caller) = 0;
       virtual bool InitializeImageBuffer(unsigned channels, unsigned slices, unsigned int w, unsigned int h, unsigned int pixDepth) = 0;
 
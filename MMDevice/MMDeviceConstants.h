@@ -147,6 +147,15 @@ namespace MM {
    const char* const g_Keyword_CorePressurePump = "PressurePump";
    const char* const g_Keyword_CoreVolumetricPump = "VolumetricPump";
    const char* const g_Keyword_CoreTimeoutMs    = "TimeoutMs";
+   const char* const g_Keyword_CoreThreadPoolSize = "ThreadPoolSize";
+   const char* const g_Keyword_CoreThreadPoolPinning = "ThreadPoolPinning";
+   const char* const g_Keyword_CoreSystemStateSlowPropertyMs = "SystemStateSlowPropertyMs";
+   const char* const g_Keyword_CoreImageProcessorThreads = "ImageProcessorThreads";
+   const char* const g_Keyword_CoreImageProcessorQueueCapacity = "ImageProcessorQueueCapacity";
+   const char* const g_Keyword_CoreImageProcessorQueueDepth = "ImageProcessorQueueDepth";
+   const char* const g_Keyword_CoreImageProcessorWaitLatencyMs = "ImageProcessorWaitLatencyMs";
+   const char* const g_Keyword_CoreImageProcessorProcessLatencyMs = "ImageProcessorProcessLatencyMs";
+   const char* const g_Keyword_CoreImageProcessorPublishLatencyMs = "ImageProcessorPublishLatencyMs";
    const char* const g_Keyword_Channel          = "Channel";
    const char* const g_Keyword_Version          = "Version";
    const char* const g_Keyword_ColorMode        = "ColorMode";
@@ -154,6 +163,13 @@ namespace MM {
    const char* const g_Keyword_Transpose_MirrorX = "TransposeMirrorX";
    const char* const g_Keyword_Transpose_MirrorY = "TransposeMirrorY";
    const char* const g_Keyword_Transpose_Correction = "TransposeCorrection";
+   // Image processors: "Yes" if each output row depends only on the same
+   // input row, and Process() may run concurrently (on bands of rows, or on
+   // whole frames in the Core's image processor pipeline)
+   const char* const g_Keyword_TileSafe         = "TileSafe";
+   const char* const g_Keyword_SequenceIntervalMean_ms = "SequenceIntervalMean-ms";
+   const char* const g_Keyword_SequenceIntervalStdDev_ms = "SequenceIntervalStdDev-ms";
+   const char* const g_Keyword_SequenceMaxLateness_ms = "SequenceMaxLateness-ms";
    const char* const g_Keyword_Closed_Position = "ClosedPosition";
    const char* const g_Keyword_HubID = "HubID";
 
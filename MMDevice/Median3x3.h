@@ -0,0 +1,111 @@
+///////////////////////////////////////////////////////////////////////////////
+// MODULE:        Median3x3.h
+// SYSTEM:        ImageBase subsystem
+//
+// DESCRIPTION:   3x3 median filter for grayscale images.
+//
+// LICENSE:       This file is free for use, modification and distribution and
+//                is distributed under terms specified in the BSD license
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "BandWorkers.h"
+
+#include <algorithm>
+#include <cstddef>
+
+namespace MM {
+
+namespace detail {
+
+template <typename PixelType>
+inline PixelType Median3(PixelType a, PixelType b, PixelType c)
+{
+   return (std::max)((std::min)(a, b), (std::min)((std::max)(a, b), c));
+}
+
+} // namespace detail
+
+/**
+ * Applies a 3x3 median filter to rows [rowBegin, rowEnd) of src, writing to
+ * the same rows of dst. Pixels beyond the image edges are taken to be
+ * copies of the nearest edge pixel.
+ *
+ * Each column of 3 pixels is sorted once per output row; the median of a
+ * 3x3 window is then the median of (the largest column minimum, the median
+ * column median, the smallest column maximum). The loops are branchless, so
+ * that the compiler can vectorize them.
+ */
+template <typename PixelType>
+void Median3x3Rows(const PixelType* src, PixelType* dst, unsigned width,
+      unsigned height, unsigned rowBegin, unsigned rowEnd)
+{
+   if (width == 0)
+      return;
+
+   // Sorted columns; index x + 1 holds column x, and the edge columns are
+   // duplicated at 0 and width + 1
+   std::vector<PixelType> columns(3 * (width + 2));
+   PixelType* lo = &columns[0];
+   PixelType* mid = lo + width + 2;
+   PixelType* hi = mid + width + 2;
+
+   for (unsigned y = rowBegin; y < rowEnd; ++y)
+   {
+      const PixelType* above = src + static_cast<std::size_t>(y > 0 ? y - 1 : 0) * width;
+      const PixelType* row = src + static_cast<std::size_t>(y) * width;
+      const PixelType* below = src + static_cast<std::size_t>(y + 1 < height ? y + 1 : y) * width;
+
+      for (unsigned x = 0; x < width; ++x)
+      {
+         const PixelType a = (std::min)(above[x], row[x]);
+         const PixelType b = (std::max)(above[x], row[x]);
+         const PixelType c = below[x];
+         lo[x + 1] = (std::min)(a, c);
+         mid[x + 1] = (std::max)(a, (std::min)(b, c));
+         hi[x + 1] = (std::max)(b, c);
+      }
+      lo[0] = lo[1];
+      mid[0] = mid[1];
+      hi[0] = hi[1];
+      lo[width + 1] = lo[width];
+      mid[width + 1] = mid[width];
+      hi[width + 1] = hi[width];
+
+      PixelType* out = dst + static_cast<std::size_t>(y) * width;
+      for (unsigned x = 0; x < width; ++x)
+      {
+         const PixelType maxLo = (std::max)((std::max)(lo[x], lo[x + 1]), lo[x + 2]);
+         const PixelType minHi = (std::min)((std::min)(hi[x], hi[x + 1]), hi[x + 2]);
+         const PixelType medMid = detail::Median3(mid[x], mid[x + 1], mid[x + 2]);
+         out[x] = detail::Median3(maxLo, medMid, minHi);
+      }
+   }
+}
+
+/**
+ * Applies a 3x3 median filter to src, writing to dst (which must not
+ * overlap src). The rows are split into bands filtered on up to threadCount
+ * threads.
+ */
+template <typename PixelType>
+void Median3x3(const PixelType* src, PixelType* dst, unsigned width,
+      unsigned height, unsigned threadCount = 1)
+{
+   // Below this, starting a thread costs more than it saves
+   const unsigned minRowsPerThread = 32;
+   ForEachRowBand(height, threadCount, minRowsPerThread,
+         [=](unsigned rowBegin, unsigned rowEnd)
+         {
+            Median3x3Rows(src, dst, width, height, rowBegin, rowEnd);
+         });
+}
+
+} // namespace MM
@@ -0,0 +1,130 @@
+#include <catch2/catch_all.hpp>
+
+#include "BandWorkers.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+// Like DemoCamera's ImageFlipX: mirrors each row of the given rows
+void FlipX(uint16_t* pixels, unsigned width, unsigned rows)
+{
+   for (unsigned y = 0; y < rows; ++y)
+      std::reverse(pixels + y * width, pixels + (y + 1) * width);
+}
+
+void Invert(uint16_t* pixels, unsigned width, unsigned rows)
+{
+   for (unsigned i = 0; i < width * rows; ++i)
+      pixels[i] = static_cast<uint16_t>(~pixels[i]);
+}
+
+std::vector<uint16_t> MakeImage(unsigned width, unsigned height)
+{
+   std::vector<uint16_t> image(width * height);
+   for (unsigned i = 0; i < image.size(); ++i)
+      image[i] = static_cast<uint16_t>(i * 2654435761u >> 7);
+   return image;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Tiled FlipX chain matches full-frame output", "[BandWorkers]")
+{
+   const unsigned width = 13;
+   const unsigned threadCount = GENERATE(1u, 2u, 3u, 5u);
+   MM::BandWorkers workers;
+   workers.Resize(threadCount);
+
+   for (unsigned height : { 1u, 2u, 7u, 31u, 97u })
+   {
+      for (unsigned bandRows : { 0u, 1u, 2u, 3u, 5u, 8u, 13u, 1000u })
+      {
+         CAPTURE(threadCount, height, bandRows);
+         std::vector<uint16_t> expected = MakeImage(width, height);
+         FlipX(expected.data(), width, height);
+         Invert(expected.data(), width, height);
+         FlipX(expected.data(), width, height);
+
+         std::vector<uint16_t> image = MakeImage(width, height);
+         workers.Run(height, bandRows, [&](unsigned rowBegin, unsigned rowEnd)
+         {
+            uint16_t* band = image.data() + rowBegin * width;
+            FlipX(band, width, rowEnd - rowBegin);
+            Invert(band, width, rowEnd - rowBegin);
+            FlipX(band, width, rowEnd - rowBegin);
+         });
+         CHECK(image == expected);
+      }
+   }
+}
+
+TEST_CASE("BandWorkers process each row once across resizes", "[BandWorkers]")
+{
+   MM::BandWorkers workers;
+   CHECK(workers.GetThreadCount() == 1);
+
+   const unsigned height = 101;
+   for (unsigned threadCount : { 4u, 1u, 3u, 0u, 2u })
+   {
+      CAPTURE(threadCount);
+      const unsigned actual = workers.Resize(threadCount);
+      CHECK(actual == (std::max)(threadCount, 1u));
+      CHECK(workers.GetThreadCount() == actual);
+
+      for (int frame = 0; frame < 50; ++frame)
+      {
+         // Catch assertions are not thread-safe, so check after Run()
+         std::vector<std::atomic<int>> visits(height);
+         for (std::atomic<int>& v : visits)
+            v = 0;
+         std::atomic<bool> emptyBand(false);
+         workers.Run(height, 7, [&](unsigned rowBegin, unsigned rowEnd)
+         {
+            if (rowEnd <= rowBegin)
+               emptyBand = true;
+            for (unsigned y = rowBegin; y < rowEnd; ++y)
+               ++visits[y];
+         });
+         REQUIRE_FALSE(emptyBand);
+         for (unsigned y = 0; y < height; ++y)
+            REQUIRE(visits[y] == 1);
+      }
+   }
+
+   bool called = false;
+   workers.Run(0, 7, [&](unsigned, unsigned) { called = true; });
+   CHECK_FALSE(called);
+}
+
+TEST_CASE("ForEachRowBand covers each row once in large enough bands", "[BandWorkers]")
+{
+   for (unsigned height : { 0u, 1u, 31u, 64u, 65u, 1000u })
+   {
+      for (unsigned threadCount : { 0u, 1u, 2u, 3u, 7u })
+      {
+         CAPTURE(height, threadCount);
+         std::vector<std::atomic<int>> visits(height);
+         for (std::atomic<int>& v : visits)
+            v = 0;
+         std::atomic<unsigned> bands(0);
+         std::atomic<bool> smallBand(false);
+         MM::ForEachRowBand(height, threadCount, 32,
+               [&](unsigned rowBegin, unsigned rowEnd)
+               {
+                  ++bands;
+                  if (rowEnd - rowBegin < 32 && rowEnd - rowBegin < height)
+                     smallBand = true;
+                  for (unsigned y = rowBegin; y < rowEnd; ++y)
+                     ++visits[y];
+               });
+         CHECK_FALSE(smallBand);
+         CHECK(bands <= (std::max)(threadCount, 1u));
+         for (unsigned y = 0; y < height; ++y)
+            REQUIRE(visits[y] == 1);
+      }
+   }
+}
@@ -0,0 +1,260 @@
+#include <catch2/catch_all.hpp>
+
+#include "Debayer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+
+// Row and column parity of the red samples, by order index
+const int redPhase[4][2] = { {0, 0}, {1, 1}, {1, 0}, {0, 1} };
+
+enum Channel { Red, Green, Blue };
+
+Channel ChannelAt(int order, int x, int y)
+{
+   const bool redRow = (y & 1) == redPhase[order][0];
+   const bool redCol = (x & 1) == redPhase[order][1];
+   if (redRow && redCol)
+      return Red;
+   if (!redRow && !redCol)
+      return Blue;
+   return Green;
+}
+
+// Samples a function of (channel, x, y) on the mosaic of the given order
+template <typename T, typename F>
+std::vector<T> Mosaic(int order, int width, int height, F f)
+{
+   std::vector<T> mosaic(static_cast<std::size_t>(width) * height);
+   for (int y = 0; y < height; ++y)
+      for (int x = 0; x < width; ++x)
+         mosaic[y * width + x] = static_cast<T>(f(ChannelAt(order, x, y), x, y));
+   return mosaic;
+}
+
+template <typename T>
+std::vector<unsigned char> Decode(const std::vector<T>& in, int width, int height,
+      int bitDepth, int order, int algorithm, unsigned threads = 1)
+{
+   Debayer debayer;
+   debayer.SetOrderIndex(order);
+   debayer.SetAlgorithmIndex(algorithm);
+   debayer.SetThreadCount(threads);
+   std::vector<unsigned char> out(static_cast<std::size_t>(width) * height * 4, 0xcd);
+   REQUIRE(debayer.Process(out.data(), in.data(), width, height, bitDepth) == DEVICE_OK);
+   return out;
+}
+
+// Output is BGRA
+int Get(const std::vector<unsigned char>& out, int width, int x, int y, Channel c)
+{
+   return out[(y * width + x) * 4 + 2 - c];
+}
+
+} // anonymous namespace
+
+TEST_CASE("debayer reproduces a uniform color for every order and algorithm", "[Debayer]")
+{
+   const int width = 13;
+   const int height = 9;
+   const int algorithms[] = { 0, 1, 3 };
+   for (int order = 0; order < 4; ++order)
+   {
+      for (int algorithm : algorithms)
+      {
+         const std::vector<std::uint8_t> in = Mosaic<std::uint8_t>(order, width, height,
+               [](Channel c, int, int) { return c == Red ? 200 : (c == Green ? 120 : 40); });
+         const std::vector<unsigned char> out = Decode(in, width, height, 8, order, algorithm);
+         for (int y = 0; y < height; ++y)
+         {
+            for (int x = 0; x < width; ++x)
+            {
+               CHECK(Get(out, width, x, y, Red) == 200);
+               CHECK(Get(out, width, x, y, Green) == 120);
+               CHECK(Get(out, width, x, y, Blue) == 40);
+               CHECK(out[(y * width + x) * 4 + 3] == 0);
+            }
+         }
+      }
+   }
+}
+
+TEST_CASE("debayer replication copies the nearest sample up and to the left", "[Debayer]")
+{
+   const int width = 10;
+   const int height = 8;
+   std::mt19937 rng(42);
+   std::vector<std::uint8_t> in(width * height);
+   for (std::uint8_t& p : in)
+      p = static_cast<std::uint8_t>(rng());
+
+   for (int order = 0; order < 4; ++order)
+   {
+      const std::vector<unsigned char> out = Decode(in, width, height, 8, order, 0);
+      for (int y = 0; y < height; ++y)
+      {
+         for (int x = 0; x < width; ++x)
+         {
+            // The sample used is the first of that color in the 2x2 block
+            // at and above-left of the pixel (below-right at the edges),
+            // preferring the current row
+            const int xs[] = { x, x > 0 ? x - 1 : x + 1 };
+            const int ys[] = { y, y > 0 ? y - 1 : y + 1 };
+            for (Channel c : { Red, Green, Blue })
+            {
+               int expected = -1;
+               for (int yy : ys)
+                  for (int xx : xs)
+                     if (expected < 0 && ChannelAt(order, xx, yy) == c)
+                        expected = in[yy * width + xx];
+               CHECK(Get(out, width, x, y, c) == expected);
+            }
+         }
+      }
+   }
+}
+
+TEST_CASE("debayer bilinear is exact on linear gradients", "[Debayer]")
+{
+   const int width = 16;
+   const int height = 12;
+   for (int order = 0; order < 4; ++order)
+   {
+      const std::vector<std::uint16_t> in = Mosaic<std::uint16_t>(order, width, height,
+            [](Channel c, int x, int y) { return 100 + 20 * c + 6 * x + 4 * y; });
+      const std::vector<unsigned char> out = Decode(in, width, height, 10, order, 1);
+      for (int y = 1; y < height - 1; ++y)
+         for (int x = 1; x < width - 1; ++x)
+            for (Channel c : { Red, Green, Blue })
+               CHECK(Get(out, width, x, y, c) == (100 + 20 * c + 6 * x + 4 * y) >> 2);
+   }
+}
+
+TEST_CASE("debayer edge-aware keeps a vertical edge sharp", "[Debayer]")
+{
+   const int width = 16;
+   const int height = 10;
+   for (int order = 0; order < 4; ++order)
+   {
+      const std::vector<std::uint8_t> in = Mosaic<std::uint8_t>(order, width, height,
+            [](Channel, int x, int) { return x < 8 ? 20 : 220; });
+      const std::vector<unsigned char> edgeAware = Decode(in, width, height, 8, order, 3);
+      const std::vector<unsigned char> bilinear = Decode(in, width, height, 8, order, 1);
+      for (int y = 0; y < height; ++y)
+      {
+         // Green is interpolated along the edge, so it is not blurred
+         for (int x = 0; x < width; ++x)
+            CHECK(Get(edgeAware, width, x, y, Green) == (x < 8 ? 20 : 220));
+      }
+      int edgeAwareError = 0;
+      int bilinearError = 0;
+      for (int y = 0; y < height; ++y)
+      {
+         for (int x = 0; x < width; ++x)
+         {
+            for (Channel c : { Red, Green, Blue })
+            {
+               const int expected = x < 8 ? 20 : 220;
+               edgeAwareError += std::abs(Get(edgeAware, width, x, y, c) - expected);
+               bilinearError += std::abs(Get(bilinear, width, x, y, c) - expected);
+            }
+         }
+      }
+      CHECK(edgeAwareError < bilinearError);
+   }
+}
+
+TEST_CASE("debayer scales high bit depths and applies color scales", "[Debayer]")
+{
+   const int width = 8;
+   const int height = 8;
+   const std::vector<std::uint16_t> in = Mosaic<std::uint16_t>(0, width, height,
+         [](Channel c, int, int) { return c == Red ? 4095 : (c == Green ? 2048 : 1024); });
+
+   Debayer debayer;
+   debayer.SetAlgorithmIndex(1);
+   std::vector<unsigned char> out(width * height * 4);
+   REQUIRE(debayer.Process(out.data(), in.data(), width, height, 12) == DEVICE_OK);
+   CHECK(Get(out, width, 3, 3, Red) == 255);
+   CHECK(Get(out, width, 3, 3, Green) == 128);
+   CHECK(Get(out, width, 3, 3, Blue) == 64);
+
+   debayer.SetRGBScales(0.5, 1.5, 4.0);
+   REQUIRE(debayer.Process(out.data(), in.data(), width, height, 12) == DEVICE_OK);
+   CHECK(Get(out, width, 3, 3, Red) == 127);
+   CHECK(Get(out, width, 3, 3, Green) == 192);
+   CHECK(Get(out, width, 3, 3, Blue) == 255);
+
+   CHECK(debayer.Process(out.data(), in.data(), width, height, 17) == DEVICE_INVALID_INPUT_PARAM);
+}
+
+TEST_CASE("debayer saturates samples above the bit depth", "[Debayer]")
+{
+   const int width = 31;
+   const int height = 17;
+   std::mt19937 rng(11);
+   std::vector<std::uint16_t> in(width * height);
+   std::vector<std::uint16_t> clamped(in.size());
+   std::vector<std::uint8_t> in8(in.size());
+   std::vector<std::uint8_t> clamped8(in.size());
+   for (std::size_t i = 0; i < in.size(); ++i)
+   {
+      in[i] = static_cast<std::uint16_t>(rng());
+      clamped[i] = (std::min)(in[i], std::uint16_t(1023));
+      in8[i] = static_cast<std::uint8_t>(in[i]);
+      clamped8[i] = (std::min)(in8[i], std::uint8_t(63));
+   }
+
+   const int algorithms[] = { 0, 1, 3 };
+   for (int algorithm : algorithms)
+   {
+      CAPTURE(algorithm);
+      CHECK(Decode(in, width, height, 10, 1, algorithm) ==
+            Decode(clamped, width, height, 10, 1, algorithm));
+      CHECK(Decode(in8, width, height, 6, 1, algorithm) ==
+            Decode(clamped8, width, height, 6, 1, algorithm));
+   }
+}
+
+TEST_CASE("debayer gives the same result on any number of threads", "[Debayer]")
+{
+   const int width = 97;
+   const int height = 203;
+   std::mt19937 rng(7);
+   std::vector<std::uint16_t> in(width * height);
+   for (std::uint16_t& p : in)
+      p = static_cast<std::uint16_t>(rng() & 0x3fff);
+
+   const int algorithms[] = { 0, 1, 3 };
+   for (int algorithm : algorithms)
+   {
+      const std::vector<unsigned char> single = Decode(in, width, height, 14, 2, algorithm, 1);
+      for (unsigned threads = 2; threads <= 5; ++threads)
+         CHECK(Decode(in, width, height, 14, 2, algorithm, threads) == single);
+   }
+}
+
+TEST_CASE("debayer into an image buffer matches the raw buffer overload", "[Debayer]")
+{
+   const int width = 20;
+   const int height = 6;
+   std::mt19937 rng(3);
+   std::vector<std::uint8_t> in(width * height);
+   for (std::uint8_t& p : in)
+      p = static_cast<std::uint8_t>(rng());
+
+   Debayer debayer;
+   debayer.SetAlgorithmIndex(3);
+   ImgBuffer buffer;
+   REQUIRE(debayer.Process(buffer, in.data(), width, height, 8) == DEVICE_OK);
+   CHECK(buffer.Width() == width);
+   CHECK(buffer.Height() == height);
+   CHECK(buffer.Depth() == 4);
+   const std::vector<unsigned char> out = Decode(in, width, height, 8, 0, 3);
+   CHECK(std::vector<unsigned char>(buffer.GetPixels(), buffer.GetPixels() + out.size()) == out);
+}
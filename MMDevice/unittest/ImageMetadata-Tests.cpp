@@ -0,0 +1,156 @@
+#include <catch2/catch_all.hpp>
+
+#include "ImageMetadata.h"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+Metadata DeviceMetadata(int numProperties)
+{
+   Metadata md;
+   for (int i = 0; i < numProperties; ++i)
+   {
+      const std::string device = "Device" + std::to_string(i % 10);
+      md.PutTag("Property" + std::to_string(i), device, i);
+   }
+   return md;
+}
+
+} // anonymous namespace
+
+TEST_CASE("Metadata serialization format", "[Metadata]")
+{
+   Metadata md;
+   md.PutImageTag("Width", 512);
+   md.PutTag("Exposure", "Camera", "10.0000");
+   MetadataArrayTag atag("Positions", "Stage", false);
+   atag.AddValue("1.5");
+   atag.AddValue("2.5");
+   md.SetTag(atag);
+
+   const std::string expected =
+      "3\n"
+      "s\nExposure\nCamera\n1\n10.0000\n"
+      "a\nPositions\nStage\n0\n2\n1.5\n2.5\n"
+      "s\nWidth\n_\n1\n512\n";
+   CHECK(md.Serialize() == expected);
+
+   Metadata restored;
+   REQUIRE(restored.Restore(expected.c_str()));
+   CHECK(restored.Serialize() == expected);
+   CHECK(restored.GetKeys() ==
+      std::vector<std::string>{ "Camera-Exposure", "Stage-Positions", "Width" });
+
+   CHECK_FALSE(restored.Restore("1\nx\n"));
+   CHECK(restored.Restore(nullptr));
+   CHECK(restored.GetKeys().empty());
+}
+
+TEST_CASE("Metadata tag access", "[Metadata]")
+{
+   Metadata md;
+   md.PutTag("Exposure", "Camera", 10);
+   MetadataSingleTag binning("Binning", "_", false);
+   binning.SetValue("2");
+   md.SetTag(binning);
+
+   CHECK(md.HasTag("Camera-Exposure"));
+   CHECK_FALSE(md.HasTag("Exposure"));
+
+   MetadataSingleTag tag = md.GetSingleTag("Camera-Exposure");
+   CHECK(tag.GetName() == "Exposure");
+   CHECK(tag.GetDevice() == "Camera");
+   CHECK(tag.IsReadOnly());
+   CHECK(tag.GetValue() == "10");
+   CHECK_FALSE(md.GetSingleTag("Binning").IsReadOnly());
+   CHECK_THROWS_AS(md.GetSingleTag("Camera-Gain"), MetadataKeyError);
+
+   // Replacing a tag
+   md.PutTag("Exposure", "Camera", 20);
+   CHECK(md.GetSingleTag("Camera-Exposure").GetValue() == "20");
+   CHECK(md.GetKeys().size() == 2);
+
+   md.RemoveTag("Binning");
+   CHECK_FALSE(md.HasTag("Binning"));
+   md.RemoveTag("Binning");
+   CHECK(md.GetKeys().size() == 1);
+
+   MetadataArrayTag atag("Positions", "Stage", true);
+   atag.AddValue("1");
+   atag.AddValue("2");
+   md.SetTag(atag);
+   MetadataArrayTag got = md.GetArrayTag("Stage-Positions");
+   CHECK(got.GetSize() == 2);
+   CHECK(got.GetValue(1) == "2");
+   CHECK_THROWS_AS(got.GetValue(2), MetadataIndexError);
+}
+
+TEST_CASE("Metadata copies are independent", "[Metadata]")
+{
+   Metadata original = DeviceMetadata(100);
+   Metadata copy(original);
+   Metadata assigned;
+   assigned.PutImageTag("Stale", 1);
+   assigned = original;
+   CHECK(copy.Serialize() == original.Serialize());
+   CHECK(assigned.Serialize() == original.Serialize());
+   CHECK_FALSE(assigned.HasTag("Stale"));
+
+   copy.PutTag("Property3", "Device3", "changed");
+   assigned.RemoveTag("Device5-Property5");
+   CHECK(original.GetSingleTag("Device3-Property3").GetValue() == "3");
+   CHECK(copy.GetSingleTag("Device3-Property3").GetValue() == "changed");
+   CHECK(original.HasTag("Device5-Property5"));
+   CHECK_FALSE(assigned.HasTag("Device5-Property5"));
+   CHECK(copy.HasTag("Device5-Property5"));
+
+   original.Clear();
+   CHECK(original.GetKeys().empty());
+   CHECK(copy.GetKeys().size() == 100);
+
+   Metadata merged;
+   merged.PutImageTag("Width", 16);
+   merged.PutTag("Property0", "Device0", "old");
+   merged.Merge(copy);
+   CHECK(merged.GetKeys().size() == 101);
+   CHECK(merged.GetSingleTag("Device0-Property0").GetValue() == "0");
+   CHECK(merged.GetSingleTag("Width").GetValue() == "16");
+}
+
+TEST_CASE("Metadata survives many replacements", "[Metadata]")
+{
+   Metadata md = DeviceMetadata(20);
+   for (int i = 0; i < 10000; ++i)
+      md.PutTag("Property7", "Device7", i);
+   CHECK(md.GetSingleTag("Device7-Property7").GetValue() == "9999");
+   CHECK(md.GetKeys().size() == 20);
+   CHECK(md.GetSingleTag("Device9-Property19").GetValue() == "19");
+}
+
+TEST_CASE("Metadata copy cost", "[.][benchmark][Metadata]")
+{
+   const Metadata md = DeviceMetadata(100);
+
+   BENCHMARK("copy 100 tags")
+   {
+      Metadata copy(md);
+      return copy.HasTag("Device0-Property0");
+   };
+
+   BENCHMARK("copy 100 tags and add one")
+   {
+      Metadata copy(md);
+      copy.PutImageTag("ImageNumber", "1");
+      return copy.HasTag("ImageNumber");
+   };
+
+   BENCHMARK("restore 100 tags")
+   {
+      const std::string serialized = md.Serialize();
+      Metadata copy;
+      copy.Restore(serialized.c_str());
+      return copy.HasTag("Device0-Property0");
+   };
+}
@@ -0,0 +1,101 @@
+#include <catch2/catch_all.hpp>
+
+#include "Median3x3.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace {
+
+// The original DemoCamera MedianFilter algorithm: clamp the window
+// coordinates, sort the 9 values and take the middle one
+template <typename PixelType>
+std::vector<PixelType> ReferenceMedian(const std::vector<PixelType>& src,
+      unsigned width, unsigned height)
+{
+   std::vector<PixelType> dst(src.size());
+   for (int i = 0; i < static_cast<int>(width); ++i)
+   {
+      for (int j = 0; j < static_cast<int>(height); ++j)
+      {
+         std::vector<PixelType> window;
+         for (int dy = -1; dy <= 1; ++dy)
+         {
+            for (int dx = -1; dx <= 1; ++dx)
+            {
+               const int x = (std::min)((std::max)(i + dx, 0), static_cast<int>(width) - 1);
+               const int y = (std::min)((std::max)(j + dy, 0), static_cast<int>(height) - 1);
+               window.push_back(src[x + width * y]);
+            }
+         }
+         std::sort(window.begin(), window.end());
+         dst[i + width * j] = window[4];
+      }
+   }
+   return dst;
+}
+
+template <typename PixelType>
+std::vector<PixelType> RandomImage(unsigned width, unsigned height,
+      unsigned maxValue, unsigned seed)
+{
+   std::mt19937 rng(seed);
+   std::uniform_int_distribution<unsigned> dist(0, maxValue);
+   std::vector<PixelType> image(static_cast<std::size_t>(width) * height);
+   for (PixelType& p : image)
+      p = static_cast<PixelType>(dist(rng));
+   return image;
+}
+
+template <typename PixelType>
+void CheckAgainstReference(unsigned width, unsigned height, unsigned maxValue,
+      unsigned threadCount)
+{
+   const std::vector<PixelType> src =
+      RandomImage<PixelType>(width, height, maxValue, width * 1000 + height);
+   std::vector<PixelType> dst(src.size());
+   MM::Median3x3(src.data(), dst.data(), width, height, threadCount);
+   CHECK(dst == ReferenceMedian(src, width, height));
+}
+
+} // namespace
+
+TEST_CASE("median 3x3 matches reference on small and odd sizes", "[Median3x3]")
+{
+   const unsigned sizes[][2] = {
+      {1, 1}, {1, 7}, {7, 1}, {2, 2}, {3, 3}, {5, 4}, {17, 13}, {64, 3},
+   };
+   for (const auto& size : sizes)
+   {
+      CheckAgainstReference<std::uint8_t>(size[0], size[1], 255, 1);
+      CheckAgainstReference<std::uint16_t>(size[0], size[1], 65535, 1);
+      CheckAgainstReference<std::uint32_t>(size[0], size[1], 4000000000u, 1);
+   }
+}
+
+TEST_CASE("median 3x3 matches reference with many equal values", "[Median3x3]")
+{
+   CheckAgainstReference<std::uint8_t>(37, 29, 2, 1);
+   CheckAgainstReference<std::uint16_t>(37, 29, 3, 1);
+}
+
+TEST_CASE("median 3x3 matches reference when split into row bands", "[Median3x3]")
+{
+   for (unsigned threads = 1; threads <= 5; ++threads)
+   {
+      CheckAgainstReference<std::uint16_t>(101, 200, 4095, threads);
+      CheckAgainstReference<std::uint8_t>(64, 97, 255, threads);
+   }
+}
+
+TEST_CASE("median 3x3 removes an isolated hot pixel", "[Median3x3]")
+{
+   std::vector<std::uint16_t> src(8 * 8, 100);
+   src[3 * 8 + 4] = 65535;
+   std::vector<std::uint16_t> dst(src.size());
+   MM::Median3x3(src.data(), dst.data(), 8, 8);
+   CHECK(std::all_of(dst.begin(), dst.end(),
+         [](std::uint16_t p) { return p == 100; }));
+}
@@ -0,0 +1,64 @@
+#include <catch2/catch_all.hpp>
+
+#include "DeviceBase.h"
+
+#include <chrono>
+#include <cmath>
+
+using namespace std::chrono;
+
+namespace {
+
+bool Near(double value, double expected)
+{
+   return std::abs(value - expected) < 1e-6;
+}
+
+} // namespace
+
+TEST_CASE("sequence timing stats start empty", "[SequenceTimingStats]")
+{
+   CSequenceTimingStats stats;
+   CHECK(stats.GetFrameCount() == 0);
+   CHECK(stats.GetMeanIntervalMs() == 0.0);
+   CHECK(stats.GetIntervalStdDevMs() == 0.0);
+   CHECK(stats.GetMaxLatenessMs() == 0.0);
+}
+
+TEST_CASE("sequence timing stats of regular frames", "[SequenceTimingStats]")
+{
+   CSequenceTimingStats stats;
+   const steady_clock::time_point t0 = steady_clock::now();
+   for (int i = 0; i < 10; ++i)
+   {
+      const steady_clock::time_point t = t0 + milliseconds(10 * i);
+      stats.AddFrame(t, t);
+   }
+   CHECK(stats.GetFrameCount() == 10);
+   CHECK(Near(stats.GetMeanIntervalMs(), 10.0));
+   CHECK(Near(stats.GetIntervalStdDevMs(), 0.0));
+   CHECK(stats.GetMaxLatenessMs() == 0.0);
+}
+
+TEST_CASE("sequence timing stats of jittery frames", "[SequenceTimingStats]")
+{
+   CSequenceTimingStats stats;
+   const steady_clock::time_point t0 = steady_clock::now();
+   // Intervals 8, 12, 8, 12 ms; frames 1 and 3 start 2 ms early
+   const int offsetsMs[] = { 0, 8, 20, 28, 40 };
+   const int deadlinesMs[] = { 0, 10, 20, 30, 40 };
+   for (int i = 0; i < 5; ++i)
+      stats.AddFrame(t0 + milliseconds(offsetsMs[i]),
+            t0 + milliseconds(deadlinesMs[i]));
+   CHECK(Near(stats.GetMeanIntervalMs(), 10.0));
+   // Sample standard deviation of { 8, 12, 8, 12 }
+   CHECK(Near(stats.GetIntervalStdDevMs(), std::sqrt(16.0 / 3.0)));
+   CHECK(Near(stats.GetMaxLatenessMs(), 0.0));
+
+   stats.AddFrame(t0 + milliseconds(53), t0 + milliseconds(50));
+   CHECK(Near(stats.GetMaxLatenessMs(), 3.0));
+
+   stats.Reset();
+   CHECK(stats.GetFrameCount() == 0);
+   CHECK(stats.GetMaxLatenessMs() == 0.0);
+}